@@ -1807,7 +1807,7 @@ See Info node `(elisp) Integer Basics'."
          process-running-child-p process-sentinel process-thread
          process-tty-name process-type
          ;; search.c
-         match-beginning match-end regexp-quote
+         match-beginning match-end regexp-quote regexp-source
          ;; sqlite.c
          sqlite-columns sqlite-more-p sqlite-version
          ;; syntax.c
@@ -1858,7 +1858,8 @@ See Info node `(elisp) Integer Basics'."
          ;; alloc.c
          bool-vector cons list make-marker purecopy record vector
          ;; buffer.c
-         buffer-list buffer-live-p current-buffer overlay-lists overlayp
+         buffer-list buffer-live-p buffer-snapshot-p current-buffer
+         overlay-lists overlayp
          ;; casetab.c
          case-table-p current-case-table standard-case-table
          ;; category.c
@@ -1911,6 +1912,8 @@ See Info node `(elisp) Integer Basics'."
          minibuffer-prompt minibuffer-prompt-end
          ;; process.c
          process-list processp signal-names waiting-for-user-input-p
+         ;; search.c
+         regexpp string-matcher-p
          ;; sqlite.c
          sqlite-available-p sqlitep
          ;; syntax.c
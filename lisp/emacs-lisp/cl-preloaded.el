@@ -398,6 +398,9 @@ regardless if `funcall' would accept to call them."
   (plist    symbol-plist))
 
 (cl--define-built-in-type obarray atom)
+(cl--define-built-in-type regexp atom)
+(cl--define-built-in-type string-matcher atom)
+(cl--define-built-in-type buffer-snapshot atom)
 (cl--define-built-in-type native-comp-unit atom)
 
 (cl--define-built-in-type sequence t "Abstract supertype of sequences.")
@@ -3450,6 +3450,7 @@ goes wrong and syntax highlighting in the shell gets messed up."
                               plist
                             ;; Replace FACE text properties with
                             ;; FONT-LOCK-FACE so input is fontified.
+                            (setq plist (copy-sequence plist))
                             (plist-put plist 'face nil)
                             (plist-put plist 'font-lock-face face)))))
             (set-text-properties
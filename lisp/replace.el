@@ -1245,18 +1245,11 @@ a previously found match."
 	(setq rstart (point)
 	      rend (point-max)))
       (goto-char rstart))
-    (let ((count 0)
-	  (case-fold-search
-	   (if (and case-fold-search search-upper-case)
-	       (isearch-no-upper-case-p regexp t)
-	     case-fold-search)))
-      (while (and (< (point) rend)
-		  (re-search-forward regexp rend t))
-        ;; Ensure forward progress on zero-length matches like "^$".
-        (when (and (= (match-beginning 0) (match-end 0))
-                   (not (eobp)))
-          (forward-char 1))
-	(setq count (1+ count)))
+    (let* ((case-fold-search
+	    (if (and case-fold-search search-upper-case)
+	        (isearch-no-upper-case-p regexp t)
+	      case-fold-search))
+	   (count (re-count-matches regexp (point) rend)))
       (when interactive (message (ngettext "%d occurrence"
 					   "%d occurrences"
 					   count)
@@ -1802,6 +1802,17 @@ included in the count."
                  (1- (line-number-at-pos))
                (line-number-at-pos)))))))
 
+(define-minor-mode buffer-line-index-mode
+  "Toggle an index of the lines of the current buffer.
+In a large buffer, the index makes counting lines and moving by many
+lines, as `count-lines', `line-number-at-pos', `goto-line' and
+`display-line-numbers-mode' do, take time that grows only with the
+logarithm of the buffer size instead of the distance covered.
+Keeping the index up to date makes editing a little slower."
+  :group 'editing-basics
+  :version "30.1")
+(put 'buffer-line-index-mode 'permanent-local t)
+
 (defcustom what-cursor-show-names nil
   "Whether to show character names in `what-cursor-position'."
   :type 'boolean
@@ -10589,10 +10600,8 @@ after it has been set up properly in other respects."
 	(lvars (buffer-local-variables))
 	(process (get-buffer-process (current-buffer)))
 	(new (generate-new-buffer (or newname (buffer-name)))))
-    (save-restriction
-      (widen)
-      (with-current-buffer new
-	(insert-buffer-substring buf)))
+    (with-current-buffer new
+      (internal--clone-buffer-text buf))
     (with-current-buffer new
       (narrow-to-region ptmin ptmax)
       (goto-char pt)
@@ -3464,6 +3464,15 @@ cleanup_vector (struct Lisp_Vector *vector)
 	hash_table_allocated_bytes -= bytes;
       }
       break;
+    case PVEC_REGEXP:
+      free_compiled_regexp (PSEUDOVEC_STRUCT (vector, Lisp_Regexp));
+      break;
+    case PVEC_STRING_MATCHER:
+      free_string_matcher (PSEUDOVEC_STRUCT (vector, Lisp_String_Matcher));
+      break;
+    case PVEC_BUFFER_SNAPSHOT:
+      free_buffer_snapshot (PSEUDOVEC_STRUCT (vector, Lisp_Buffer_Snapshot));
+      break;
     /* Keep the switch exhaustive.  */
     case PVEC_NORMAL_VECTOR:
     case PVEC_FREE:
@@ -4040,7 +4049,8 @@ DEFUN ("make-marker", Fmake_marker, Smake_marker, 0, 0, 0,
   p->buffer = 0;
   p->bytepos = 0;
   p->charpos = 0;
-  p->next = NULL;
+  p->next = p->prev = NULL;
+  p->parent = p->left = p->right = NULL;
   p->insertion_type = 0;
   p->need_adjustment = 0;
   return make_lisp_ptr (p, Lisp_Vectorlike);
@@ -4060,13 +4070,12 @@ build_marker (struct buffer *buf, ptrdiff_t charpos, ptrdiff_t bytepos)
 
   struct Lisp_Marker *m = ALLOCATE_PLAIN_PSEUDOVECTOR (struct Lisp_Marker,
 						       PVEC_MARKER);
-  m->buffer = buf;
-  m->charpos = charpos;
-  m->bytepos = bytepos;
+  m->buffer = NULL;
   m->insertion_type = 0;
   m->need_adjustment = 0;
-  m->next = BUF_MARKERS (buf);
-  BUF_MARKERS (buf) = m;
+  m->next = m->prev = NULL;
+  m->parent = m->left = m->right = NULL;
+  attach_marker (m, buf, charpos, bytepos);
   return make_lisp_ptr (m, Lisp_Vectorlike);
 }
 
@@ -6497,12 +6506,25 @@ watch_gc_cons_percentage (Lisp_Object symbol, Lisp_Object newval,
   return Qnil;
 }
 
+/* Make the next maybe_gc call maybe_garbage_collect, without changing
+   the number of bytes counted as allocated since the last GC.  */
+void
+request_maybe_gc (void)
+{
+  if (!garbage_collection_inhibited && consing_until_gc >= 0)
+    {
+      gc_threshold -= consing_until_gc + 1;
+      consing_until_gc = -1;
+    }
+}
+
 /* It may be time to collect garbage.  Recalculate consing_until_gc,
    since it might depend on current usage, and do the garbage
    collection if the recalculation says so.  */
 void
 maybe_garbage_collect (void)
 {
+  truncate_grown_undo_lists ();
   if (bump_consing_until_gc (gc_cons_threshold, Vgc_cons_percentage) < 0)
     garbage_collect ();
 }
@@ -6605,6 +6627,7 @@ garbage_collect (void)
   mark_threads ();
   mark_charset ();
   mark_composite ();
+  mark_regexp_cache ();
   mark_profiler ();
 #ifdef HAVE_PGTK
   mark_pgtkterm ();
@@ -7830,20 +7853,18 @@ sweep_symbols (void)
 }
 
 /* Remove BUFFER's markers that are due to be swept.  This is needed since
-   we treat BUF_MARKERS and markers's `next' field as weak pointers.  */
+   we treat BUF_MARKERS and the links between markers as weak pointers.  */
 static void
 unchain_dead_markers (struct buffer *buffer)
 {
-  struct Lisp_Marker *this, **prev = &BUF_MARKERS (buffer);
+  struct Lisp_Marker *this, *next;
 
-  while ((this = *prev))
-    if (vectorlike_marked_p (&this->header))
-      prev = &this->next;
-    else
-      {
-        this->buffer = NULL;
-        *prev = this->next;
-      }
+  for (this = BUF_MARKERS (buffer); this; this = next)
+    {
+      next = this->next;
+      if (!vectorlike_marked_p (&this->header))
+	unchain_marker (this);
+    }
 }
 
 NO_INLINE /* For better stack traces */
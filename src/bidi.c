@@ -1123,6 +1123,10 @@ bidi_initialize (void)
   staticpro (&paragraph_start_re);
   paragraph_separate_re = build_string ("^[ \t\f]*$");
   staticpro (&paragraph_separate_re);
+  /* These are matched by bidi_find_paragraph_start for every
+     paragraph that redisplay examines.  */
+  pin_regexp (paragraph_start_re);
+  pin_regexp (paragraph_separate_re);
 
   bidi_cache_sp = 0;
   bidi_cache_total_alloc = 0;
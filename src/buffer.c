@@ -636,6 +636,10 @@ even if it is dead.  The return value is never nil.  */)
   *(BUF_GPT_ADDR (b)) = *(BUF_Z_ADDR (b)) = 0; /* Put an anchor '\0'.  */
   b->text->inhibit_shrinking = false;
   b->text->redisplay = false;
+  b->text->charpos_index = NULL;
+  b->text->share = NULL;
+  b->text->undo_growth = 0;
+  b->text->changed_blocks_modiff = 0;
 
   b->newline_cache = 0;
   b->width_run_cache = 0;
@@ -662,6 +666,7 @@ even if it is dead.  The return value is never nil.  */)
 
   bset_mark (b, Fmake_marker ());
   BUF_MARKERS (b) = NULL;
+  b->text->marker_tree = NULL;
 
   /* Put this in the alist of all live buffers.  */
   XSETBUFFER (buffer, b);
@@ -691,14 +696,33 @@ copy_overlays (struct buffer *from, struct buffer *to)
   eassert (to && ! to->overlays);
   struct itree_node *node;
 
+  if (itree_empty_p (from->overlays))
+    return;
+
+  /* Make all the copies first, and then insert them into the new
+     tree at once, which takes linear time as they are in order.  */
+  ptrdiff_t n = itree_size (from->overlays), i = 0;
+  USE_SAFE_ALLOCA;
+  Lisp_Object *copies;
+  struct itree_node **nodes;
+  SAFE_ALLOCA_LISP (copies, n);
+  SAFE_NALLOCA (nodes, 1, n);
   ITREE_FOREACH (node, from->overlays, PTRDIFF_MIN, PTRDIFF_MAX, ASCENDING)
     {
       Lisp_Object ov = node->data;
       Lisp_Object copy = build_overlay (node->front_advance,
                                         node->rear_advance,
                                         Fcopy_sequence (OVERLAY_PLIST (ov)));
-      add_buffer_overlay (to, XOVERLAY (copy), node->begin, node->end);
+      copies[i] = copy;
+      nodes[i] = XOVERLAY (copy)->interval;
+      nodes[i]->begin = node->begin;
+      nodes[i]->end = node->end;
+      XOVERLAY (copy)->buffer = to;
+      i++;
     }
+  to->overlays = itree_create ();
+  itree_insert_many (to->overlays, nodes, n);
+  SAFE_FREE ();
 }
 
 bool
@@ -732,7 +756,7 @@ clone_per_buffer_values (struct buffer *from, struct buffer *to)
 	{
 	  struct Lisp_Marker *m = XMARKER (obj);
 
-	  obj = build_marker (to, m->charpos, m->bytepos);
+	  obj = build_marker (to, marker_charpos (m), marker_bytepos (m));
 	  XMARKER (obj)->insertion_type = m->insertion_type;
 	}
 
@@ -2069,16 +2093,12 @@ cleaning up all windows currently displaying the buffer to be killed. */)
       /* Unchain all markers that belong to this indirect buffer.
 	 Don't unchain the markers that belong to the base buffer
 	 or its other indirect buffers.  */
-      struct Lisp_Marker **mp = &BUF_MARKERS (b);
-      while ((m = *mp))
+      struct Lisp_Marker *next;
+      for (m = BUF_MARKERS (b); m; m = next)
 	{
+	  next = m->next;
 	  if (m->buffer == b)
-	    {
-	      m->buffer = NULL;
-	      *mp = m->next;
-	    }
-	  else
-	    mp = &m->next;
+	    unchain_marker (m);
 	}
       /* Intervals should be owned by the base buffer (Bug#16502).  */
       i = buffer_intervals (b);
@@ -2093,11 +2113,12 @@ cleaning up all windows currently displaying the buffer to be killed. */)
     {
       /* Unchain all markers of this buffer and its indirect buffers.
 	 and leave them pointing nowhere.  */
+      flatten_marker_tree (b);
       for (m = BUF_MARKERS (b); m; )
 	{
 	  struct Lisp_Marker *next = m->next;
 	  m->buffer = 0;
-	  m->next = NULL;
+	  m->next = m->prev = NULL;
 	  m = next;
 	}
       BUF_MARKERS (b) = NULL;
@@ -2731,6 +2752,7 @@ current buffer is cleared.  */)
     error ("Changing multibyteness in a narrowed buffer");
 
   invalidate_buffer_caches (current_buffer, BEGV, ZV);
+  unshare_buffer_text (current_buffer);
 
   if (NILP (flag))
     {
@@ -2751,8 +2773,10 @@ current buffer is cleared.  */)
       TEMP_SET_PT_BOTH (PT_BYTE, PT_BYTE);
 
 
+      flatten_marker_tree (current_buffer);
       for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
 	tail->charpos = tail->bytepos;
+      rebuild_marker_tree (current_buffer);
 
       /* Convert multibyte form of 8-bit characters to unibyte.  */
       pos = BEG;
@@ -2902,6 +2926,7 @@ current buffer is cleared.  */)
 	TEMP_SET_PT_BOTH (position, byte);
       }
 
+      flatten_marker_tree (current_buffer);
       tail = markers = BUF_MARKERS (current_buffer);
 
       /* This prevents BYTE_TO_CHAR (that is, buf_bytepos_to_charpos) from
@@ -2921,6 +2946,7 @@ current buffer is cleared.  */)
 	emacs_abort ();
 
       BUF_MARKERS (current_buffer) = markers;
+      rebuild_marker_tree (current_buffer);
 
       /* Do this last, so it can calculate the new correspondences
 	 between chars and bytes.  */
@@ -3623,6 +3649,98 @@ for the rear of the overlay advance when text is inserted there
 
   return ov;
 }
+
+DEFUN ("make-overlays", Fmake_overlays, Smake_overlays, 1, 5, 0,
+       doc: /* Create overlays for each range in RANGES and return them.
+RANGES is a vector whose elements have the form (BEG . END), where
+BEG and END are integers or markers.  The value is a vector of the
+new overlays, in the same order.  Creating many overlays this way is
+much faster than calling `make-overlay' for each of them.
+
+If omitted, BUFFER defaults to the current buffer.  FRONT-ADVANCE and
+REAR-ADVANCE are as for `make-overlay', and apply to all the overlays.
+Each overlay starts with a copy of the property list PROPERTIES.  If
+PROPERTIES has a non-nil `evaporate' property, the overlays of empty
+ranges are deleted at once, like `overlay-put' does.  */)
+  (Lisp_Object ranges, Lisp_Object buffer, Lisp_Object front_advance,
+   Lisp_Object rear_advance, Lisp_Object properties)
+{
+  struct buffer *b;
+
+  if (NILP (buffer))
+    XSETBUFFER (buffer, current_buffer);
+  else
+    CHECK_BUFFER (buffer);
+
+  b = XBUFFER (buffer);
+  if (! BUFFER_LIVE_P (b))
+    error ("Attempt to create overlay in a dead buffer");
+
+  CHECK_VECTOR (ranges);
+  CHECK_LIST (properties);
+  ptrdiff_t n = ASIZE (ranges);
+
+  /* Check all the ranges before creating any overlay.  */
+  USE_SAFE_ALLOCA;
+  ptrdiff_t *bounds;
+  struct itree_node **nodes;
+  SAFE_NALLOCA (bounds, 2, n);
+  SAFE_NALLOCA (nodes, 1, n);
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      Lisp_Object range = AREF (ranges, i);
+      CHECK_CONS (range);
+      Lisp_Object beg = XCAR (range), end = XCDR (range);
+
+      if (MARKERP (beg) && !BASE_EQ (Fmarker_buffer (beg), buffer))
+	signal_error ("Marker points into wrong buffer", beg);
+      if (MARKERP (end) && !BASE_EQ (Fmarker_buffer (end), buffer))
+	signal_error ("Marker points into wrong buffer", end);
+
+      CHECK_FIXNUM_COERCE_MARKER (beg);
+      CHECK_FIXNUM_COERCE_MARKER (end);
+
+      ptrdiff_t obeg = min (XFIXNUM (beg), XFIXNUM (end));
+      ptrdiff_t oend = max (XFIXNUM (beg), XFIXNUM (end));
+      bounds[2 * i] = clip_to_bounds (BUF_BEG (b), obeg, BUF_Z (b));
+      bounds[2 * i + 1] = clip_to_bounds (bounds[2 * i], oend, BUF_Z (b));
+    }
+
+  bool evaporate = ! NILP (plist_get (properties, Qevaporate));
+  Lisp_Object result = make_nil_vector (n);
+  ptrdiff_t nnodes = 0, lo = PTRDIFF_MAX, hi = PTRDIFF_MIN;
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      Lisp_Object ov = build_overlay (! NILP (front_advance),
+				      ! NILP (rear_advance),
+				      Fcopy_sequence (properties));
+      ASET (result, i, ov);
+      if (evaporate && bounds[2 * i] == bounds[2 * i + 1])
+	continue;
+
+      /* The nodes are not in the tree yet, so setting their
+	 positions directly is safe.  */
+      struct itree_node *node = XOVERLAY (ov)->interval;
+      node->begin = bounds[2 * i];
+      node->end = bounds[2 * i + 1];
+      nodes[nnodes++] = node;
+      XOVERLAY (ov)->buffer = b;
+      lo = min (lo, node->begin);
+      hi = max (hi, node->end);
+    }
+
+  if (nnodes > 0)
+    {
+      if (! b->overlays)
+	b->overlays = itree_create ();
+      itree_insert_many (b->overlays, nodes, nnodes);
+      if (! NILP (properties))
+	modify_overlay (b, lo, hi);
+    }
+
+  SAFE_FREE ();
+  return result;
+}
 
 /* Mark a section of BUF as needing redisplay because of overlays changes.  */
 
@@ -3914,6 +4032,62 @@ The resulting list of overlays is in an arbitrary unpredictable order.  */)
   return result;
 }
 
+DEFUN ("overlays-count-in", Foverlays_count_in, Soverlays_count_in, 2, 2, 0,
+       doc: /* Return the number of overlays that overlap the region BEG ... END.
+This counts the overlays that `overlays-in' would return, without
+making a list of them.  */)
+  (Lisp_Object beg, Lisp_Object end)
+{
+  CHECK_FIXNUM_COERCE_MARKER (beg);
+  CHECK_FIXNUM_COERCE_MARKER (end);
+
+  if (!buffer_has_overlays ())
+    return make_fixnum (0);
+
+  /* With no room for them, overlays_in just counts the overlays.  */
+  ptrdiff_t len = 0;
+  Lisp_Object *overlay_vec = NULL;
+  return make_fixnum (overlays_in (XFIXNUM (beg), XFIXNUM (end), false,
+				   &overlay_vec, &len, true, false, NULL));
+}
+
+DEFUN ("overlays-map-in", Foverlays_map_in, Soverlays_map_in, 3, 3, 0,
+       doc: /* Call FUNCTION on each overlay that overlaps the region BEG ... END.
+These are the overlays that `overlays-in' would return, and FUNCTION
+is called with each of them in turn, in increasing order of their
+start positions, without making a list of them.  FUNCTION may modify
+the overlays of the buffer; overlays it deletes before their turn are
+skipped.  Return nil.  */)
+  (Lisp_Object function, Lisp_Object beg, Lisp_Object end)
+{
+  CHECK_FIXNUM_COERCE_MARKER (beg);
+  CHECK_FIXNUM_COERCE_MARKER (end);
+
+  if (!buffer_has_overlays ())
+    return Qnil;
+
+  /* FUNCTION may change the overlay tree, which must not happen while
+     iterating over it, so first collect the overlays in a vector that
+     GC knows about.  */
+  struct buffer *b = current_buffer;
+  ptrdiff_t len = 0;
+  Lisp_Object *overlay_vec = NULL;
+  ptrdiff_t noverlays = overlays_in (XFIXNUM (beg), XFIXNUM (end), false,
+				     &overlay_vec, &len, true, false, NULL);
+  USE_SAFE_ALLOCA;
+  SAFE_ALLOCA_LISP (overlay_vec, noverlays);
+  len = noverlays;
+  overlays_in (XFIXNUM (beg), XFIXNUM (end), false, &overlay_vec, &len,
+	       true, false, NULL);
+
+  for (ptrdiff_t i = 0; i < noverlays; i++)
+    if (XOVERLAY (overlay_vec[i])->buffer == b)
+      call1 (function, overlay_vec[i]);
+
+  SAFE_FREE ();
+  return Qnil;
+}
+
 DEFUN ("next-overlay-change", Fnext_overlay_change, Snext_overlay_change,
        1, 1, 0,
        doc: /* Return the next position after POS where an overlay starts or ends.
@@ -4570,6 +4744,68 @@ alloc_buffer_text (struct buffer *b, ptrdiff_t nbytes)
   unblock_input ();
 }
 
+/* The sharing record of the memory that holds the text of a buffer,
+   when clones of the buffer or snapshots of its text use the memory
+   too; see share_buffer_text and `buffer-snapshot'.  */
+
+struct text_share
+{
+  /* The number of buffers and snapshots that use the memory.  */
+  ptrdiff_t refcount;
+
+  /* The number of buffers among them.  When there are several, they
+     have no gap, and each copies the text before changing it.  */
+  ptrdiff_t nbuffers;
+
+  /* The snapshots that read some of their text from the memory while
+     a buffer can still change it, linked by their NEXT fields.  */
+  struct Lisp_Buffer_Snapshot *snapshots;
+};
+
+/* Return the sharing record of buffer B's text, making one if B's
+   text has none.  */
+
+static struct text_share *
+buffer_text_share (struct buffer *b)
+{
+  if (!b->text->share)
+    {
+      struct text_share *share = xmalloc (sizeof *share);
+      share->refcount = share->nbuffers = 1;
+      share->snapshots = NULL;
+      b->text->share = share;
+    }
+  return b->text->share;
+}
+
+/* Drop buffer B's reference to its shared text.  Return true if B
+   held the last reference, so that the memory is now B's alone.  */
+
+static bool
+release_text_share (struct buffer *b)
+{
+  struct text_share *share = b->text->share;
+  b->text->share = NULL;
+
+  /* Once no buffer can change the memory, the snapshots that still
+     read it need not copy anything more.  */
+  if (--share->nbuffers == 0)
+    {
+      struct Lisp_Buffer_Snapshot *s, *next;
+      for (s = share->snapshots; s; s = next)
+	{
+	  next = s->next;
+	  s->prev = s->next = NULL;
+	}
+      share->snapshots = NULL;
+    }
+
+  if (--share->refcount > 0)
+    return false;
+  xfree (share);
+  return true;
+}
+
 /* Enlarge buffer B's text buffer by DELTA bytes.  DELTA < 0 means
    shrink it.  */
 
@@ -4583,7 +4819,10 @@ enlarge_buffer_text (struct buffer *b, ptrdiff_t delta)
     BUF_Z_BYTE (b) - BUF_BEG_BYTE (b) + BUF_GAP_SIZE (b) + 1;
   ptrdiff_t new_nbytes = old_nbytes + delta;
 
-  if (pdumper_object_p (old_beg))
+  /* Text in the dump or shared with other buffers cannot be
+     reallocated; copy it to newly allocated memory instead.  */
+  struct text_share *share = b->text->share;
+  if (pdumper_object_p (old_beg) || (share && share->refcount > 1))
     b->text->beg = NULL;
   else
     old_beg = NULL;
@@ -4608,6 +4847,9 @@ enlarge_buffer_text (struct buffer *b, ptrdiff_t delta)
   if (old_beg)
     memcpy (p, old_beg, min (old_nbytes, new_nbytes));
 
+  if (share)
+    release_text_share (b);
+
   BUF_BEG_ADDR (b) = p;
   unblock_input ();
 }
@@ -4618,9 +4860,15 @@ enlarge_buffer_text (struct buffer *b, ptrdiff_t delta)
 static void
 free_buffer_text (struct buffer *b)
 {
+  clear_charpos_cache (b);
   block_input ();
 
-  if (!pdumper_object_p (b->text->beg))
+  if (b->text->share)
+    {
+      if (release_text_share (b))
+	xfree (b->text->beg);
+    }
+  else if (!pdumper_object_p (b->text->beg))
     {
 #if defined USE_MMAP_FOR_BUFFERS
       mmap_free ((void **) &b->text->beg);
@@ -4635,8 +4883,512 @@ free_buffer_text (struct buffer *b)
   unblock_input ();
 }
 
+/* Buffers smaller than this are copied rather than shared, since
+   copying them costs less than the gap that sharing takes away.  */
+enum { SHARE_BUFFER_TEXT_MIN = 1024 * 1024 };
+
+/* Make the text of buffer FROM shareable with another buffer, and
+   return its sharing record with that buffer counted.  FROM's gap is
+   removed, so that every change to its text first enlarges the gap,
+   which copies the text, or calls unshare_buffer_bytes.  Return NULL,
+   doing nothing, if FROM's text is small or cannot be shared.  */
+
+static struct text_share *
+pin_buffer_text (struct buffer *from)
+{
+#if defined USE_MMAP_FOR_BUFFERS || defined REL_ALLOC
+  return NULL;
+#else
+  ptrdiff_t nbytes = BUF_Z_BYTE (from) - BUF_BEG_BYTE (from);
+
+  if (nbytes < SHARE_BUFFER_TEXT_MIN
+      || pdumper_object_p (BUF_BEG_ADDR (from)))
+    return NULL;
+
+  if (BUF_GAP_SIZE (from) > 0)
+    {
+      struct buffer *oldb = current_buffer;
+      Lisp_Object tem = Vinhibit_quit;
+
+      /* Move the gap to the end of FROM without quitting, and give
+	 its memory back.  */
+      current_buffer = from;
+      Vinhibit_quit = Qt;
+      move_gap_both (Z, Z_BYTE);
+      Vinhibit_quit = tem;
+      current_buffer = oldb;
+      enlarge_buffer_text (from, - BUF_GAP_SIZE (from));
+      BUF_GAP_SIZE (from) = 0;
+      *(BUF_Z_ADDR (from)) = 0;	/* Put an anchor.  */
+    }
+
+  struct text_share *share = buffer_text_share (from);
+  share->nbuffers++;
+  share->refcount++;
+  return share;
+#endif
+}
+
+/* Replace the text of buffer B, which must be empty, with the text of
+   buffer FROM, sharing the memory that holds it until either buffer
+   changes; see pin_buffer_text.  The shared bytes are left at the
+   start of B's gap, to be taken into the text by the caller.  Return
+   false, doing nothing, if FROM's text is small or cannot be
+   shared.  */
+
+bool
+share_buffer_text (struct buffer *b, struct buffer *from)
+{
+  ptrdiff_t nbytes = BUF_Z_BYTE (from) - BUF_BEG_BYTE (from);
+
+  eassert (BUF_Z (b) == BUF_BEG (b) && b->text != from->text);
+  struct text_share *share = pin_buffer_text (from);
+  if (!share)
+    return false;
+
+  free_buffer_text (b);
+  b->text->share = share;
+  b->text->beg = BUF_BEG_ADDR (from);
+  BUF_GPT (b) = BUF_BEG (b);
+  BUF_GPT_BYTE (b) = BUF_BEG_BYTE (b);
+  BUF_GAP_SIZE (b) = nbytes;
+  return true;
+}
+
+
+/* Buffer snapshots.
+
+   A snapshot of a small buffer holds a copy of its text.  A snapshot
+   of a larger one reads its text from the memory of the buffer, gap
+   and all, as long as the buffer does not change the bytes it reads.
+   The buffer's text and the snapshot then share a text_share record,
+   which lists the snapshot.  Before the buffer moves or overwrites
+   some bytes of its memory, unshare_buffer_bytes gives each listed
+   snapshot a copy of the chunks of its text at those bytes.  Since the
+   gap never holds text of a snapshot, writing into the gap needs no
+   such care, and a snapshot costs little more than the chunks around
+   the places where the buffer changes.  When the buffer stops using
+   the memory, because it enlarged it or was killed, the memory is left
+   to the snapshots.  */
+
+/* The number of characters between the entries of the index of a
+   snapshot's byte positions.  */
+enum { BUFFER_SNAPSHOT_INDEX_STEP = 1024 };
+
+/* The size of the chunks of text that a snapshot copies.  */
+enum { BUFFER_SNAPSHOT_CHUNK = 16 * 1024 };
+
+/* Snapshots of smaller buffers copy their text.  */
+enum { BUFFER_SNAPSHOT_SHARE_MIN = 4 * BUFFER_SNAPSHOT_CHUNK };
+
+/* Return the number of chunks of the text of snapshot S.  */
+
+static ptrdiff_t
+snapshot_nchunks (struct Lisp_Buffer_Snapshot *s)
+{
+  return (s->nbytes + BUFFER_SNAPSHOT_CHUNK - 1) / BUFFER_SNAPSHOT_CHUNK;
+}
+
+/* Return the address of the byte at offset POS in the text of snapshot
+   S, and store in *N the number of bytes of the text that follow in
+   memory from there, that one included.  */
+
+static unsigned char *
+snapshot_address (struct Lisp_Buffer_Snapshot *s, ptrdiff_t pos,
+		  ptrdiff_t *n)
+{
+  ptrdiff_t end = s->nbytes;
+
+  if (s->chunks)
+    {
+      ptrdiff_t k = pos / BUFFER_SNAPSHOT_CHUNK;
+      end = min (end, (k + 1) * BUFFER_SNAPSHOT_CHUNK);
+      if (s->chunks[k])
+	{
+	  *n = end - pos;
+	  return s->chunks[k] + pos % BUFFER_SNAPSHOT_CHUNK;
+	}
+    }
+
+  if (pos < s->part1)
+    {
+      *n = min (end, s->part1) - pos;
+      return s->base + pos;
+    }
+  *n = end - pos;
+  return s->base + s->gap + pos;
+}
+
+/* Copy the bytes of the text of snapshot S from offset FROM to offset
+   TO into DST.  */
+
+static void
+copy_snapshot_bytes (struct Lisp_Buffer_Snapshot *s,
+		     ptrdiff_t from, ptrdiff_t to, unsigned char *dst)
+{
+  while (from < to)
+    {
+      ptrdiff_t n;
+      unsigned char *p = snapshot_address (s, from, &n);
+      n = min (n, to - from);
+      memcpy (dst, p, n);
+      dst += n;
+      from += n;
+    }
+}
+
+/* Stop snapshot S from reading the memory of a buffer's text, which it
+   no longer needs.  */
+
+static void
+release_snapshot_share (struct Lisp_Buffer_Snapshot *s)
+{
+  struct text_share *share = s->share;
+
+  if (s->prev)
+    s->prev->next = s->next;
+  else if (share->snapshots == s)
+    share->snapshots = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+  s->prev = s->next = NULL;
+
+  /* The buffer has stopped using the memory if this was the last
+     reference.  */
+  if (--share->refcount == 0)
+    {
+      xfree (share);
+      xfree (s->base);
+    }
+  s->share = NULL;
+  s->base = NULL;
+}
+
+/* Give snapshot S a copy of the chunks of its text that are between
+   offsets FROM and TO of the memory of the buffer's text.  */
+
+static void
+copy_snapshot_chunks (struct Lisp_Buffer_Snapshot *s,
+		      ptrdiff_t from, ptrdiff_t to)
+{
+  /* The text at those offsets, in the two parts of the text.  */
+  ptrdiff_t range[2][2] = {
+    { max (from, 0), min (to, s->part1) },
+    { max (from - s->gap, s->part1), min (to - s->gap, s->nbytes) }
+  };
+
+  for (int i = 0; i < 2 && s->share; i++)
+    for (ptrdiff_t k = range[i][0] / BUFFER_SNAPSHOT_CHUNK;
+	 k * BUFFER_SNAPSHOT_CHUNK < range[i][1]; k++)
+      if (!s->chunks[k])
+	{
+	  ptrdiff_t beg = k * BUFFER_SNAPSHOT_CHUNK;
+	  ptrdiff_t end = min (beg + BUFFER_SNAPSHOT_CHUNK, s->nbytes);
+	  unsigned char *chunk = xmalloc (end - beg);
+	  copy_snapshot_bytes (s, beg, end, chunk);
+	  s->chunks[k] = chunk;
+	  if (++s->ncopied == snapshot_nchunks (s))
+	    {
+	      release_snapshot_share (s);
+	      break;
+	    }
+	}
+}
+
+/* Prepare for buffer B to write over the bytes of its text memory
+   from offset FROM to offset TO; see unshare_buffer_bytes.  */
+
+void
+unshare_buffer_bytes_1 (struct buffer *b, ptrdiff_t from, ptrdiff_t to)
+{
+  struct text_share *share = b->text->share;
+
+  /* Other buffers read all of the memory; copy it.  */
+  if (share->nbuffers > 1)
+    {
+      enlarge_buffer_text (b, 0);
+      return;
+    }
+
+  struct Lisp_Buffer_Snapshot *s, *next;
+  for (s = share->snapshots; s; s = next)
+    {
+      next = s->next;
+      copy_snapshot_chunks (s, from, to);
+    }
+
+  /* Don't look again if B is the only user left.  */
+  if (share->refcount == 1)
+    {
+      xfree (share);
+      b->text->share = NULL;
+    }
+}
+
+/* Free the memory of snapshot S, which GC found unused.  */
+
+void
+free_buffer_snapshot (struct Lisp_Buffer_Snapshot *s)
+{
+  if (s->share)
+    release_snapshot_share (s);
+  else
+    xfree (s->base);
+  if (s->chunks)
+    {
+      ptrdiff_t nchunks = snapshot_nchunks (s);
+      for (ptrdiff_t k = 0; k < nchunks; k++)
+	xfree (s->chunks[k]);
+      xfree (s->chunks);
+    }
+  xfree (s->index);
+}
+
+/* Return a vector of the text properties of buffer B, in the form of
+   the `properties' field of a snapshot.  */
+
+static Lisp_Object
+snapshot_properties (struct buffer *b)
+{
+  INTERVAL tree = buffer_intervals (b);
+  ptrdiff_t n = 0;
+
+  if (!tree)
+    return make_nil_vector (0);
+
+  INTERVAL first = find_interval (tree, BUF_BEG (b));
+  for (INTERVAL i = first; i; i = next_interval (i))
+    if (!NILP (i->plist))
+      n++;
+
+  Lisp_Object props = make_nil_vector (3 * n);
+  n = 0;
+  for (INTERVAL i = first; i; i = next_interval (i))
+    if (!NILP (i->plist))
+      {
+	/* Interval plists are never modified in place, so the
+	   snapshot can share them.  */
+	ASET (props, n++, make_fixnum (i->position));
+	ASET (props, n++, make_fixnum (i->position + LENGTH (i)));
+	ASET (props, n++, i->plist);
+      }
+  return props;
+}
+
+/* Return the offset of the byte after the NCHARS characters that start
+   at byte offset POS in the text of snapshot S.  */
+
+static ptrdiff_t
+snapshot_skip_chars (struct Lisp_Buffer_Snapshot *s, ptrdiff_t pos,
+		     ptrdiff_t nchars)
+{
+  unsigned char *p = NULL;
+  ptrdiff_t start = 0, end = 0;
+
+  for (; nchars > 0; nchars--)
+    {
+      if (pos >= end)
+	{
+	  ptrdiff_t n;
+	  p = snapshot_address (s, pos, &n);
+	  start = pos;
+	  end = pos + n;
+	}
+      pos += BYTES_BY_CHAR_HEAD (p[pos - start]);
+    }
+  return pos;
+}
+
+/* Return the byte offset of the character at offset CHARPOS in the
+   text of snapshot S.  */
+
+static ptrdiff_t
+snapshot_char_to_byte (struct Lisp_Buffer_Snapshot *s, ptrdiff_t charpos)
+{
+  if (s->nchars == s->nbytes)
+    return charpos;
+
+  if (!s->index)
+    {
+      ptrdiff_t n = s->nchars / BUFFER_SNAPSHOT_INDEX_STEP + 1;
+      ptrdiff_t *index = xnmalloc (n, sizeof *index);
+      ptrdiff_t pos = 0;
+      for (ptrdiff_t k = 0; k < n; k++)
+	{
+	  index[k] = pos;
+	  if (k + 1 < n)
+	    pos = snapshot_skip_chars (s, pos, BUFFER_SNAPSHOT_INDEX_STEP);
+	}
+      s->index = index;
+    }
+
+  return snapshot_skip_chars (s, s->index[charpos
+					  / BUFFER_SNAPSHOT_INDEX_STEP],
+			      charpos % BUFFER_SNAPSHOT_INDEX_STEP);
+}
+
+/* Return the text of SNAPSHOT from START to END, with its text
+   properties if PROPS.  */
+
+static Lisp_Object
+snapshot_substring (Lisp_Object snapshot, Lisp_Object start,
+		    Lisp_Object end, bool props)
+{
+  CHECK_BUFFER_SNAPSHOT (snapshot);
+  struct Lisp_Buffer_Snapshot *s = XBUFFER_SNAPSHOT (snapshot);
+  CHECK_FIXNUM (start);
+  CHECK_FIXNUM (end);
+
+  EMACS_INT b = min (XFIXNUM (start), XFIXNUM (end));
+  EMACS_INT e = max (XFIXNUM (start), XFIXNUM (end));
+  if (! (1 <= b && e <= s->nchars + 1))
+    args_out_of_range (start, end);
+
+  ptrdiff_t from = snapshot_char_to_byte (s, b - 1);
+  ptrdiff_t to = snapshot_char_to_byte (s, e - 1);
+  Lisp_Object string = (s->multibyte
+			? make_uninit_multibyte_string (e - b, to - from)
+			: make_uninit_string (to - from));
+  copy_snapshot_bytes (s, from, to, SDATA (string));
+
+  if (props && VECTORP (s->properties))
+    {
+      /* Find the first run that ends after B.  */
+      ptrdiff_t lo = 0, hi = ASIZE (s->properties) / 3;
+      while (lo < hi)
+	{
+	  ptrdiff_t mid = lo + (hi - lo) / 2;
+	  if (XFIXNUM (AREF (s->properties, 3 * mid + 1)) <= b)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      for (ptrdiff_t k = 3 * lo; k < ASIZE (s->properties); k += 3)
+	{
+	  EMACS_INT rs = XFIXNUM (AREF (s->properties, k));
+	  EMACS_INT re = XFIXNUM (AREF (s->properties, k + 1));
+	  if (rs >= e)
+	    break;
+	  Fset_text_properties (make_fixnum (max (rs, b) - b),
+				make_fixnum (min (re, e) - b),
+				AREF (s->properties, k + 2), string);
+	}
+    }
+
+  return string;
+}
+
+DEFUN ("buffer-snapshot", Fbuffer_snapshot, Sbuffer_snapshot, 0, 2, 0,
+       doc: /* Return a snapshot of the text of BUFFER as it is now.
+BUFFER defaults to the current buffer.  The snapshot holds the whole
+text of the buffer, regardless of any narrowing, and never changes
+afterwards, whatever happens to the buffer.  If PROPERTIES is non-nil,
+it also holds the text properties of the buffer.  Use
+`buffer-snapshot-substring' to get text out of a snapshot.
+
+A snapshot of a large buffer does not copy its text when it is made.
+Instead, when the buffer is about to change some of that text, the
+snapshot copies the blocks of 16 KB around the change, so that each
+change costs time proportional to its size, and the memory of the
+snapshot grows with the amount of text changed since it was taken.  */)
+  (Lisp_Object buffer, Lisp_Object properties)
+{
+  struct buffer *b = decode_buffer (buffer);
+  XSETBUFFER (buffer, b);
+  if (! BUFFER_LIVE_P (b))
+    error ("Attempt to take a snapshot of a dead buffer");
+
+  Lisp_Object props = NILP (properties) ? Qnil : snapshot_properties (b);
+  struct Lisp_Buffer_Snapshot *s
+    = ALLOCATE_ZEROED_PSEUDOVECTOR (struct Lisp_Buffer_Snapshot, properties,
+				    PVEC_BUFFER_SNAPSHOT);
+  Lisp_Object snapshot;
+  XSETPSEUDOVECTOR (snapshot, s, PVEC_BUFFER_SNAPSHOT);
+  s->buffer = buffer;
+  s->properties = props;
+  s->nchars = BUF_Z (b) - BUF_BEG (b);
+  s->nbytes = BUF_Z_BYTE (b) - BUF_BEG_BYTE (b);
+  s->multibyte = ! NILP (BVAR (b, enable_multibyte_characters));
+  s->part1 = BUF_GPT_BYTE (b) - BUF_BEG_BYTE (b);
+  s->gap = BUF_GAP_SIZE (b);
+
+  /* Memory that the allocator may move or unmap, or that is in the
+     dump, is copied.  */
+#if !defined USE_MMAP_FOR_BUFFERS && !defined REL_ALLOC
+  if (s->nbytes >= BUFFER_SNAPSHOT_SHARE_MIN
+      && !pdumper_object_p (BUF_BEG_ADDR (b)))
+    {
+      struct text_share *share = buffer_text_share (b);
+      share->refcount++;
+      s->share = share;
+      s->base = BUF_BEG_ADDR (b);
+      s->chunks = xzalloc (snapshot_nchunks (s) * sizeof *s->chunks);
+      s->next = share->snapshots;
+      if (s->next)
+	s->next->prev = s;
+      share->snapshots = s;
+      return snapshot;
+    }
+#endif
+
+  unsigned char *text = xmalloc (s->nbytes);
+  memcpy (text, BUF_BEG_ADDR (b), s->part1);
+  memcpy (text + s->part1, BUF_GAP_END_ADDR (b), s->nbytes - s->part1);
+  s->base = text;
+  s->part1 = s->nbytes;
+  s->gap = 0;
+  return snapshot;
+}
+
+DEFUN ("buffer-snapshot-p", Fbuffer_snapshot_p, Sbuffer_snapshot_p, 1, 1, 0,
+       doc: /* Return t if OBJECT is a buffer snapshot.  */)
+  (Lisp_Object object)
+{
+  return BUFFER_SNAPSHOT_P (object) ? Qt : Qnil;
+}
+
+DEFUN ("buffer-snapshot-buffer", Fbuffer_snapshot_buffer,
+       Sbuffer_snapshot_buffer, 1, 1, 0,
+       doc: /* Return the buffer that SNAPSHOT was taken of.
+The buffer may have been killed since.  */)
+  (Lisp_Object snapshot)
+{
+  CHECK_BUFFER_SNAPSHOT (snapshot);
+  return XBUFFER_SNAPSHOT (snapshot)->buffer;
+}
+
+DEFUN ("buffer-snapshot-size", Fbuffer_snapshot_size, Sbuffer_snapshot_size,
+       1, 1, 0,
+       doc: /* Return the number of characters in SNAPSHOT.  */)
+  (Lisp_Object snapshot)
+{
+  CHECK_BUFFER_SNAPSHOT (snapshot);
+  return make_fixnum (XBUFFER_SNAPSHOT (snapshot)->nchars);
+}
+
+DEFUN ("buffer-snapshot-substring", Fbuffer_snapshot_substring,
+       Sbuffer_snapshot_substring, 3, 3, 0,
+       doc: /* Return the text of SNAPSHOT between START and END, as a string.
+START and END are the positions the text had in the buffer when the
+snapshot was taken, disregarding narrowing: they must be integers
+between 1 and one more than the size of the snapshot.  The string has
+the text properties of the text if the snapshot holds them.  */)
+  (Lisp_Object snapshot, Lisp_Object start, Lisp_Object end)
+{
+  return snapshot_substring (snapshot, start, end, true);
+}
+
+DEFUN ("buffer-snapshot-substring-no-properties",
+       Fbuffer_snapshot_substring_no_properties,
+       Sbuffer_snapshot_substring_no_properties, 3, 3, 0,
+       doc: /* Return the text of SNAPSHOT between START and END, without properties.
+See `buffer-snapshot-substring' for the meaning of START and END.  */)
+  (Lisp_Object snapshot, Lisp_Object start, Lisp_Object end)
+{
+  return snapshot_substring (snapshot, start, end, false);
+}
+
 
-
 /***********************************************************************
 			    Initialization
  ***********************************************************************/
@@ -5074,6 +5826,7 @@ syms_of_buffer (void)
 
   DEFSYM (Qpermanent_local_hook, "permanent-local-hook");
   DEFSYM (Qoverlayp, "overlayp");
+  DEFSYM (Qbuffer_snapshot_p, "buffer-snapshot-p");
   DEFSYM (Qevaporate, "evaporate");
   DEFSYM (Qmodification_hooks, "modification-hooks");
   DEFSYM (Qinsert_in_front_hooks, "insert-in-front-hooks");
@@ -6084,6 +6837,7 @@ There is no reason to change that value except for debugging purposes.  */);
 
   defsubr (&Soverlayp);
   defsubr (&Smake_overlay);
+  defsubr (&Smake_overlays);
   defsubr (&Sdelete_overlay);
   defsubr (&Sdelete_all_overlays);
   defsubr (&Smove_overlay);
@@ -6093,6 +6847,14 @@ There is no reason to change that value except for debugging purposes.  */);
   defsubr (&Soverlay_properties);
   defsubr (&Soverlays_at);
   defsubr (&Soverlays_in);
+  defsubr (&Soverlays_count_in);
+  defsubr (&Soverlays_map_in);
+  defsubr (&Sbuffer_snapshot);
+  defsubr (&Sbuffer_snapshot_p);
+  defsubr (&Sbuffer_snapshot_buffer);
+  defsubr (&Sbuffer_snapshot_size);
+  defsubr (&Sbuffer_snapshot_substring);
+  defsubr (&Sbuffer_snapshot_substring_no_properties);
   defsubr (&Snext_overlay_change);
   defsubr (&Sprevious_overlay_change);
   defsubr (&Soverlay_recenter);
@@ -165,6 +165,9 @@ extern void temp_set_point_both (struct buffer *,
 				 ptrdiff_t, ptrdiff_t);
 extern void set_point_from_marker (Lisp_Object);
 extern void enlarge_buffer_text (struct buffer *, ptrdiff_t);
+extern bool share_buffer_text (struct buffer *, struct buffer *);
+extern void unshare_buffer_bytes_1 (struct buffer *, ptrdiff_t, ptrdiff_t);
+extern void free_buffer_snapshot (struct Lisp_Buffer_Snapshot *);
 
 INLINE void
 SET_PT (ptrdiff_t position)
@@ -275,11 +278,29 @@ struct buffer_text
        This is actually a single marker ---
        successive elements in its marker `chain'
        are the other markers referring to this buffer.
-       This is a singly linked unordered list, which means that it's
-       very cheap to add a marker to the list and it's also very cheap
-       to move a marker within a buffer.  */
+       This is a doubly linked unordered list, which means that it's
+       very cheap to add a marker to the list or remove it.  */
     struct Lisp_Marker *markers;
 
+    /* The root of the tree of the same markers, ordered by position;
+       see marker.c.  */
+    struct Lisp_Marker *marker_tree;
+
+    /* The index of the correspondence between character and byte
+       positions, or NULL; see marker.c.  */
+    struct charpos_index *charpos_index;
+
+    /* If non-NULL, BEG is shared with the text of other buffers, which
+       all point to the same reference count; see share_buffer_text.  */
+    struct text_share *share;
+
+    /* Approximate number of bytes of undo information recorded since
+       the undo list was last truncated; see undo.c.  */
+    intmax_t undo_growth;
+
+    /* BUF_CHARS_MODIFF as of the last call of `buffer-changed-blocks'.  */
+    modiff_count changed_blocks_modiff;
+
     /* Usually false.  Temporarily true in decode_coding_gap to
        prevent Fgarbage_collect from shrinking the gap and losing
        not-yet-decoded bytes.  */
@@ -962,6 +983,43 @@ BUF_GAP_END_ADDR (struct buffer *buf)
   return buf->text->beg + buf->text->gpt_byte + buf->text->gap_size - BEG_BYTE;
 }
 
+/* Prepare for BUF to move or overwrite the bytes of its text memory
+   from offset FROM to offset TO from BUF_BEG_ADDR (BUF), gap included.
+   If other buffers share the memory, give BUF a copy of its own; if
+   snapshots read these bytes, make them copy the bytes first.  This
+   must be done before bytes of BUF are changed or moved in place;
+   enlarging the gap does it too.  */
+
+INLINE void
+unshare_buffer_bytes (struct buffer *buf, ptrdiff_t from, ptrdiff_t to)
+{
+  if (buf->text->share)
+    unshare_buffer_bytes_1 (buf, from, to);
+}
+
+/* Likewise for the text of BUF between byte positions FROM and TO.  */
+
+INLINE void
+unshare_buffer_range (struct buffer *buf, ptrdiff_t from, ptrdiff_t to)
+{
+  if (buf->text->share)
+    {
+      ptrdiff_t beg = BUF_BEG_BYTE (buf), gpt = BUF_GPT_BYTE (buf);
+      ptrdiff_t gap = BUF_GAP_SIZE (buf);
+      unshare_buffer_bytes_1 (buf, from - beg + (from > gpt ? gap : 0),
+			      to - beg + (to > gpt ? gap : 0));
+    }
+}
+
+/* Likewise for all of the text of BUF.  */
+
+INLINE void
+unshare_buffer_text (struct buffer *buf)
+{
+  unshare_buffer_bytes (buf, 0, (BUF_Z_BYTE (buf) - BUF_BEG_BYTE (buf)
+				 + BUF_GAP_SIZE (buf)));
+}
+
 /* Compute how many characters at the top and bottom of BUF are
    unchanged when the range START..END is modified.  This computation
    must be done each time BUF is modified.  */
@@ -44,6 +44,12 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
    was once used.  */
 static Lisp_Object Vccl_program_table;
 
+/* Hash table mapping the compiled code (vector) of registered CCL
+   programs, once they are used, to their byte maps, or to t if they
+   have none.  Keys are weak, so that the maps of redefined programs
+   are freed.  See CCL_BYTE_MAP_STRIDE for the layout of byte maps.  */
+static Lisp_Object Vccl_byte_maps;
+
 /* Return a hash table of id number ID.  */
 #define GET_HASH_TABLE(id) \
   XHASH_TABLE (XCDR (AREF (Vtranslation_hash_table_vector, id)))
@@ -871,6 +877,65 @@ GET_TRANSLATION_TABLE (int id)
   return XCDR (AREF (Vtranslation_table_vector, id));
 }
 
+/* A byte map of a CCL program is a vector which has, for each byte B
+   from 0 to 255, CCL_BYTE_MAP_STRIDE elements describing what the
+   program does when it reads B: the number N of characters it
+   writes, CCL_BYTE_MAP_MAX_OUTPUT elements whose first N are those
+   characters, and the state it is left in, waiting for the next byte:
+   its instruction counter, a bit mask of the registers that may be
+   read before being set from there on, and the values of its 8
+   registers, those not in the mask being 0.  */
+enum { CCL_BYTE_MAP_MAX_OUTPUT = 4,
+       CCL_BYTE_MAP_IC = 1 + CCL_BYTE_MAP_MAX_OUTPUT,
+       CCL_BYTE_MAP_LIVE = CCL_BYTE_MAP_IC + 1,
+       CCL_BYTE_MAP_REG = CCL_BYTE_MAP_LIVE + 1,
+       CCL_BYTE_MAP_STRIDE = CCL_BYTE_MAP_REG + 8 };
+
+/* Return the entry for byte B in byte map MAP.  */
+static Lisp_Object *
+ccl_byte_map_entry (Lisp_Object *map, int b)
+{
+  return map + b * CCL_BYTE_MAP_STRIDE;
+}
+
+/* Return true if IC and the registers REG of a CCL program are the
+   state described by byte map entry ENTRY.  */
+static bool
+ccl_byte_map_state_match (Lisp_Object *entry, int ic, int *reg)
+{
+  if (ic != XFIXNUM (entry[CCL_BYTE_MAP_IC]))
+    return false;
+  int live = XFIXNUM (entry[CCL_BYTE_MAP_LIVE]);
+  for (int r = 0; r < 8; r++)
+    if (live & (1 << r) && reg[r] != XFIXNUM (entry[CCL_BYTE_MAP_REG + r]))
+      return false;
+  return true;
+}
+
+/* Return true if CCL is in a state where its byte map applies: at
+   the start of the program, or in a state that a byte leaves it
+   in.  */
+static bool
+ccl_byte_map_state_p (struct ccl_program *ccl)
+{
+  if (ccl->stack_idx != 0)
+    return false;
+  if (ccl->ic == CCL_HEADER_MAIN)
+    {
+      int r;
+      for (r = 0; r < 8; r++)
+	if (ccl->reg[r] != 0)
+	  break;
+      if (r == 8)
+	return true;
+    }
+  for (int b = 0; b < 256; b++)
+    if (ccl_byte_map_state_match (ccl_byte_map_entry (ccl->map, b),
+				  ccl->ic, ccl->reg))
+      return true;
+  return false;
+}
+
 void
 ccl_driver (struct ccl_program *ccl, int *source, int *destination, int src_size, int dst_size, Lisp_Object charset_list)
 {
@@ -895,6 +960,31 @@ ccl_driver (struct ccl_program *ccl, int *source, int *destination, int src_size
   /* Set mapping stack pointer. */
   mapping_stack_pointer = mapping_stack;
 
+  /* Convert as many bytes as the byte map of the program allows,
+     then let the code below go on from the state the map leaves.  */
+  if (ccl->map && src && dst && ccl_byte_map_state_p (ccl))
+    {
+      Lisp_Object *entry = NULL;
+
+      while (src < src_end && 0 <= *src && *src < 256)
+	{
+	  Lisp_Object *this = ccl_byte_map_entry (ccl->map, *src);
+	  int n = XFIXNUM (this[0]);
+	  if (dst_end - dst < n)
+	    break;
+	  for (int k = 1; k <= n; k++)
+	    *dst++ = XFIXNUM (this[k]);
+	  src++;
+	  entry = this;
+	}
+      if (entry)
+	{
+	  for (int r = 0; r < 8; r++)
+	    reg[r] = XFIXNUM (entry[CCL_BYTE_MAP_REG + r]);
+	  ic = XFIXNUM (entry[CCL_BYTE_MAP_IC]);
+	}
+    }
+
 #ifdef CCL_DEBUG
   ccl_backtrace_idx = 0;
 #endif
@@ -1069,6 +1159,8 @@ ccl_driver (struct ccl_program *ccl, int *source, int *destination, int src_size
 	    Lisp_Object slot;
 	    int prog_id;
 
+	    ccl->used_tables = true;
+
 	    /* If FFF is nonzero, the CCL program ID is in the
                following code.  */
 	    if (rrr)
@@ -1328,6 +1420,7 @@ ccl_driver (struct ccl_program *ccl, int *source, int *destination, int src_size
 	  break;
 
 	case CCL_Extension:
+	  ccl->used_tables = true;
 	  switch (EXCMD)
 	    {
 	    case CCL_ReadMultibyteChar2:
@@ -1987,6 +2080,385 @@ ccl_get_compiled_code (Lisp_Object ccl_prog, ptrdiff_t *idx)
   return AREF (slot, 1);
 }
 
+/* Bit masks of CCL registers, used to find out which registers of a
+   CCL program may be read before being set from a given instruction
+   on.  Those that may not be are irrelevant to what the program will
+   do.  */
+#define CCL_REG_BIT(r) (1 << (r))
+#define CCL_ALL_REGS 0xFF
+
+/* Return true if the word at IC of the compiled code PROG of SIZE
+   words is an integer, and store it in *WORD.  */
+static bool
+ccl_word (Lisp_Object *prog, int size, int ic, EMACS_INT *word)
+{
+  if (! (0 <= ic && ic < size && FIXNUMP (prog[ic])))
+    return false;
+  *word = XFIXNUM (prog[ic]);
+  return true;
+}
+
+/* Return the mask of the registers of the CCL program whose compiled
+   code PROG has SIZE words and whose end-of-file code is at EOF_IC,
+   that may be read before being set when the instruction at IC is
+   executed, LIVE giving what is known so far of those masks for every
+   instruction counter.  This must never miss a register; when in
+   doubt, e.g. for instructions that call other programs, it returns
+   CCL_ALL_REGS.  */
+
+static int
+ccl_live_registers (Lisp_Object *prog, int size, int eof_ic, int ic,
+		    unsigned char *live)
+{
+#define LIVE(x) (0 <= (x) && (x) < size ? live[x] : CCL_ALL_REGS)
+  /* What may be read after reading a byte into register R, when X
+     may be read after that if the byte was available.  At the end of
+     input, R is set to -1 and the end-of-file code is run.  */
+#define AFTER_READ(r, x) (((x) | LIVE (eof_ic)) & ~CCL_REG_BIT (r))
+  /* Registers set, besides the destination, by operation OP.  */
+#define OP_SETS_R7(op) \
+  ((op) == CCL_RSH8 || (op) == CCL_DIVMOD \
+   || (op) == CCL_DECODE_SJIS || (op) == CCL_ENCODE_SJIS)
+
+  EMACS_INT code, word, op;
+  if (! (ccl_word (prog, size, ic, &code)
+	 && CCL_CODE_MIN <= code && code <= CCL_CODE_MAX))
+    return CCL_ALL_REGS;
+
+  int field1 = code >> 8, field2 = (code & 0xFF) >> 5;
+  int opcode = code & 0x1F, ic0 = ic + 1, set, used;
+
+  /* Whenever an instruction waits for input or output room, it is
+     executed again from where it stopped, which is either IC itself
+     or, for the reading part of instructions that write and then
+     read, the word before the one following the instruction.  */
+  switch (opcode)
+    {
+    case CCL_SetRegister:
+      return CCL_REG_BIT (RRR) | (LIVE (ic0) & ~CCL_REG_BIT (rrr));
+
+    case CCL_SetShortConst:
+      return LIVE (ic0) & ~CCL_REG_BIT (rrr);
+
+    case CCL_SetConst:
+      return LIVE (ic0 + 1) & ~CCL_REG_BIT (rrr);
+
+    case CCL_SetArray:
+      return CCL_REG_BIT (RRR) | LIVE (ic0 + (field1 >> 3));
+
+    case CCL_Jump:
+    case CCL_WriteConstJump:
+      return LIVE (ic0 + ADDR);
+
+    case CCL_JumpCond:
+      return CCL_REG_BIT (rrr) | LIVE (ic0) | LIVE (ic0 + ADDR);
+
+    case CCL_WriteRegisterJump:
+      return CCL_REG_BIT (rrr) | LIVE (ic0 + ADDR);
+
+    case CCL_WriteRegisterReadJump:
+      return (CCL_REG_BIT (rrr) | LIVE (ic0)
+	      | AFTER_READ (rrr, LIVE (ic0 + ADDR)));
+
+    case CCL_WriteConstReadJump:
+      return LIVE (ic0) | AFTER_READ (rrr, LIVE (ic0 + ADDR));
+
+    case CCL_WriteStringJump:
+      return LIVE (ic0) | LIVE (ic0 + ADDR);
+
+    case CCL_WriteArrayReadJump:
+      if (! (ccl_word (prog, size, ic0, &word) && 0 <= word
+	     && word < size))
+	return CCL_ALL_REGS;
+      return (CCL_REG_BIT (rrr) | LIVE (ic0 + word + 1)
+	      | AFTER_READ (rrr, LIVE (ic0 + ADDR)));
+
+    case CCL_ReadJump:
+      return AFTER_READ (rrr, LIVE (ic0 + ADDR));
+
+    case CCL_ReadBranch:
+    case CCL_Branch:
+      if (! (0 <= field1 && ic0 + field1 < size))
+	return CCL_ALL_REGS;
+      used = 0;
+      for (int k = 0; k <= field1; k++)
+	{
+	  if (! ccl_word (prog, size, ic0 + k, &word))
+	    return CCL_ALL_REGS;
+	  used |= LIVE (ic0 + word);
+	}
+      used |= CCL_REG_BIT (rrr);
+      return (opcode == CCL_Branch ? used : AFTER_READ (rrr, used));
+
+    case CCL_ReadRegister:
+    case CCL_WriteRegister:
+      /* Each word of the sequence reads or writes a register.  */
+      {
+	int last = ic;
+	while (field1)
+	  {
+	    if (! (ccl_word (prog, size, ++last, &code)
+		   && CCL_CODE_MIN <= code && code <= CCL_CODE_MAX))
+	      return CCL_ALL_REGS;
+	    field1 = code >> 8;
+	  }
+	used = LIVE (last + 1);
+	for (int k = last; k >= ic; k--)
+	  {
+	    rrr = (XFIXNUM (prog[k]) & 0xFF) >> 5;
+	    used = (opcode == CCL_ReadRegister ? AFTER_READ (rrr, used)
+		    : CCL_REG_BIT (rrr) | used);
+	    if (k > ic)
+	      used |= LIVE (k);
+	  }
+	return used;
+      }
+
+    case CCL_WriteExprConst:
+      op = field1 >> 6;
+      return (CCL_REG_BIT (RRR) | (op == CCL_DIVMOD ? CCL_REG_BIT (7) : 0)
+	      | (LIVE (ic0 + 1) & ~CCL_REG_BIT (7)));
+
+    case CCL_WriteExprRegister:
+      op = field1 >> 6;
+      return (CCL_REG_BIT (RRR) | CCL_REG_BIT (Rrr)
+	      | (op == CCL_DIVMOD ? CCL_REG_BIT (7) : 0)
+	      | (LIVE (ic0) & ~CCL_REG_BIT (7)));
+
+    case CCL_WriteConstString:
+      return LIVE (rrr ? ic0 + (field1 + 2) / 3 : ic0);
+
+    case CCL_WriteArray:
+      return CCL_REG_BIT (rrr) | LIVE (ic0 + field1);
+
+    case CCL_End:
+      return 0;
+
+    case CCL_ExprSelfConst:
+    case CCL_ExprSelfReg:
+      op = field1 >> 6;
+      set = CCL_REG_BIT (rrr) | (OP_SETS_R7 (op) ? CCL_REG_BIT (7) : 0);
+      if (opcode == CCL_ExprSelfConst)
+	return CCL_REG_BIT (rrr) | (LIVE (ic0 + 1) & ~set);
+      return CCL_REG_BIT (rrr) | CCL_REG_BIT (RRR) | (LIVE (ic0) & ~set);
+
+    case CCL_SetExprConst:
+    case CCL_SetExprReg:
+      op = field1 >> 6;
+      set = CCL_REG_BIT (rrr) | (OP_SETS_R7 (op) ? CCL_REG_BIT (7) : 0);
+      used = CCL_REG_BIT (RRR) | (op == CCL_DIVMOD ? CCL_REG_BIT (rrr) : 0);
+      if (opcode == CCL_SetExprConst)
+	return used | (LIVE (ic0 + 1) & ~set);
+      return used | CCL_REG_BIT (Rrr) | (LIVE (ic0) & ~set);
+
+    case CCL_ReadJumpCondExprConst:
+    case CCL_JumpCondExprConst:
+    case CCL_ReadJumpCondExprReg:
+    case CCL_JumpCondExprReg:
+      if (! ccl_word (prog, size, ic0, &op))
+	return CCL_ALL_REGS;
+      used = op == CCL_DIVMOD ? CCL_REG_BIT (7) : 0;
+      if (opcode == CCL_ReadJumpCondExprReg
+	  || opcode == CCL_JumpCondExprReg)
+	{
+	  if (! (ccl_word (prog, size, ic0 + 1, &word)
+		 && 0 <= word && word < 8))
+	    return CCL_ALL_REGS;
+	  used |= CCL_REG_BIT (word);
+	}
+      used |= (CCL_REG_BIT (rrr)
+	       | ((LIVE (ic0 + 2) | LIVE (ic0 + ADDR)) & ~CCL_REG_BIT (7)));
+      if (opcode == CCL_ReadJumpCondExprConst
+	  || opcode == CCL_ReadJumpCondExprReg)
+	return AFTER_READ (rrr, used);
+      return used;
+
+    default:
+      /* CCL_Call and CCL_Extension, which may look at any register,
+	 and invalid codes.  */
+      return CCL_ALL_REGS;
+    }
+#undef LIVE
+#undef AFTER_READ
+#undef OP_SETS_R7
+}
+
+/* Return a newly allocated array giving, for every instruction
+   counter of the compiled code CODE of a CCL program, the mask of the
+   registers that may be read before being set from there on.  */
+
+static unsigned char *
+ccl_live_registers_map (Lisp_Object code)
+{
+  Lisp_Object *prog = XVECTOR (code)->contents;
+  int size = ASIZE (code), eof_ic = XFIXNUM (prog[CCL_HEADER_EOF]);
+  unsigned char *live = xzalloc (size);
+  bool changed;
+
+  /* The masks only grow, so this terminates.  */
+  do
+    {
+      changed = false;
+      for (int ic = size - 1; ic >= 0; ic--)
+	{
+	  int mask = live[ic] | ccl_live_registers (prog, size, eof_ic, ic,
+						     live);
+	  if (mask != live[ic])
+	    {
+	      live[ic] = mask;
+	      changed = true;
+	    }
+	}
+    }
+  while (changed);
+  return live;
+}
+
+/* Run the compiled code CODE of a CCL program from instruction
+   counter *IC and registers REG on the input byte B, as if more input
+   were to follow.  Store what it writes in OUT, and the state it ends
+   in in *IC and REG, and return how many characters it wrote.  The
+   registers that LIVE, as returned by ccl_live_registers_map, says
+   are not read anymore are set to 0.  Return -1 if the program does
+   more than consuming B and waiting for the next byte, or if it looks
+   up tables, and -2 if it was quit.  */
+
+static int
+ccl_run_byte (Lisp_Object code, unsigned char *live, int *ic, int reg[8],
+	      int b, int out[CCL_BYTE_MAP_MAX_OUTPUT])
+{
+  struct ccl_program ccl = {
+    .idx = -1,
+    .size = ASIZE (code),
+    .prog = XVECTOR (code)->contents,
+    .ic = *ic,
+    .eof_ic = XFIXNUM (AREF (code, CCL_HEADER_EOF)),
+    .buf_magnification = XFIXNUM (AREF (code, CCL_HEADER_BUF_MAG)),
+    .quit_silently = true,
+  };
+
+  memcpy (ccl.reg, reg, sizeof ccl.reg);
+  ccl_driver (&ccl, &b, out, 1, CCL_BYTE_MAP_MAX_OUTPUT, Qnil);
+  if (ccl.status == CCL_STAT_QUIT)
+    return -2;
+  if (ccl.status != CCL_STAT_SUSPEND_BY_SRC || ccl.consumed != 1
+      || ccl.stack_idx != 0 || ccl.used_tables)
+    return -1;
+  *ic = ccl.ic;
+  for (int r = 0; r < 8; r++)
+    reg[r] = live[ccl.ic] & CCL_REG_BIT (r) ? ccl.reg[r] : 0;
+  return ccl.produced;
+}
+
+/* Return a byte map for the compiled code CODE of a CCL program, if
+   what the program writes for an input byte and the state it is left
+   in depend on that byte alone, and not on the bytes before it nor on
+   tables that may change later.  Registers that may not be read
+   before being set again are not part of that state.  This is
+   checked by running the program on every byte, from the start and
+   from every state a byte leaves it in.  Return t if the program has
+   no byte map, or nil if that could not be decided because the user
+   quit.  */
+
+static Lisp_Object
+ccl_make_byte_map (Lisp_Object code)
+{
+  if (XFIXNUM (AREF (code, CCL_HEADER_BUF_MAG)) == 0)
+    return Qt;
+
+  Lisp_Object map = make_nil_vector (256 * CCL_BYTE_MAP_STRIDE);
+  Lisp_Object *contents = XVECTOR (map)->contents;
+  unsigned char *live = ccl_live_registers_map (code);
+  int ics[256], regs[256][8];
+
+  for (int b = 0; b < 256; b++)
+    {
+      int out[CCL_BYTE_MAP_MAX_OUTPUT];
+      ics[b] = CCL_HEADER_MAIN;
+      memset (regs[b], 0, sizeof regs[b]);
+      int n = ccl_run_byte (code, live, &ics[b], regs[b], b, out);
+      if (n < 0)
+	{
+	  xfree (live);
+	  return n == -2 ? Qnil : Qt;
+	}
+
+      Lisp_Object *entry = ccl_byte_map_entry (contents, b);
+      entry[0] = make_fixnum (n);
+      for (int k = 0; k < n; k++)
+	entry[1 + k] = make_fixnum (out[k]);
+      entry[CCL_BYTE_MAP_IC] = make_fixnum (ics[b]);
+      entry[CCL_BYTE_MAP_LIVE] = make_fixnum (live[ics[b]]);
+      for (int r = 0; r < 8; r++)
+	entry[CCL_BYTE_MAP_REG + r] = make_fixnum (regs[b][r]);
+    }
+
+  for (int from = 0; from < 256; from++)
+    {
+      int prev;
+      for (prev = 0; prev < from; prev++)
+	if (ics[prev] == ics[from]
+	    && memcmp (regs[prev], regs[from], sizeof regs[from]) == 0)
+	  break;
+      if (prev < from)
+	/* This state was already checked.  */
+	continue;
+
+      for (int b = 0; b < 256; b++)
+	{
+	  int ic = ics[from], reg[8], out[CCL_BYTE_MAP_MAX_OUTPUT];
+	  memcpy (reg, regs[from], sizeof reg);
+	  int n = ccl_run_byte (code, live, &ic, reg, b, out);
+	  bool same = (n == XFIXNUM (contents[b * CCL_BYTE_MAP_STRIDE])
+		       && ic == ics[b]
+		       && memcmp (reg, regs[b], sizeof reg) == 0);
+	  for (int k = 0; same && k < n; k++)
+	    same = out[k] == XFIXNUM (ccl_byte_map_entry (contents, b)[1 + k]);
+	  if (!same)
+	    {
+	      xfree (live);
+	      return n == -2 ? Qnil : Qt;
+	    }
+	}
+    }
+  xfree (live);
+  return map;
+}
+
+/* Return a pointer into the byte map of the compiled code CODE of a
+   registered CCL program, making it if needed, or NULL if it has
+   none.  */
+
+static Lisp_Object *
+ccl_byte_map (Lisp_Object code)
+{
+  if (NILP (Vccl_byte_maps))
+    Vccl_byte_maps = make_hash_table (&hashtest_eq, DEFAULT_HASH_SIZE,
+				      Weak_Key, false);
+  Lisp_Object map = Fgethash (code, Vccl_byte_maps, Qnil);
+  if (NILP (map))
+    {
+      map = ccl_make_byte_map (code);
+      if (!NILP (map))
+	Fputhash (code, map, Vccl_byte_maps);
+    }
+  return VECTORP (map) ? XVECTOR (map)->contents : NULL;
+}
+
+/* Let CCL, set up by setup_ccl_program for converting text, use the
+   byte map of its program if it has one.  Programs run by
+   ccl-execute and ccl-execute-on-string don't use it, as the values
+   they leave in registers that are not used anymore are visible to
+   the caller.  */
+
+void
+setup_ccl_byte_map (struct ccl_program *ccl)
+{
+  ccl->map = (ccl->idx >= 0
+	      ? ccl_byte_map (AREF (AREF (Vccl_program_table, ccl->idx), 1))
+	      : NULL);
+}
+
 /* Setup fields of the structure pointed by CCL appropriately for the
    execution of CCL program CCL_PROG.  CCL_PROG is the name (symbol)
    of the CCL program or the already compiled code (vector).
@@ -2008,6 +2480,7 @@ setup_ccl_program (struct ccl_program *ccl, Lisp_Object ccl_prog)
       ccl->prog = vp->contents;
       ccl->eof_ic = XFIXNUM (vp->contents[CCL_HEADER_EOF]);
       ccl->buf_magnification = XFIXNUM (vp->contents[CCL_HEADER_BUF_MAG]);
+      ccl->map = NULL;
       if (ccl->idx >= 0)
 	{
 	  Lisp_Object slot;
@@ -2363,6 +2836,9 @@ syms_of_ccl (void)
   staticpro (&Vccl_program_table);
   Vccl_program_table = make_nil_vector (32);
 
+  staticpro (&Vccl_byte_maps);
+  Vccl_byte_maps = Qnil;
+
   DEFSYM (Qccl, "ccl");
   DEFSYM (Qcclp, "cclp");
 
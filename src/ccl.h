@@ -43,6 +43,8 @@ struct ccl_program {
 				   name.  */
   int size;			/* Size of the compiled code.  */
   Lisp_Object *prog;		/* Pointer into the compiled code.  */
+  Lisp_Object *map;		/* Pointer into the byte map of the
+				   program, or NULL if it has none.  */
   int ic;			/* Instruction Counter (index for PROG).  */
   int eof_ic;			/* Instruction Counter for end-of-file
 				   processing code.  */
@@ -61,6 +63,10 @@ struct ccl_program {
   bool_bf quit_silently : 1;	/* If true, don't append "CCL:
 				   Quitted" to the generated text when
 				   CCL program is quitted. */
+  bool_bf used_tables : 1;	/* Set to true when an instruction that
+				   looks up charsets, translation
+				   tables, code conversion maps or
+				   other CCL programs is executed.  */
 };
 
 /* This data type is used for the spec field of the structure
@@ -75,6 +81,7 @@ struct ccl_spec {
 /* Setup fields of the structure pointed by CCL appropriately for the
    execution of ccl program CCL_PROG (symbol or vector).  */
 extern bool setup_ccl_program (struct ccl_program *, Lisp_Object);
+extern void setup_ccl_byte_map (struct ccl_program *);
 
 extern void ccl_driver (struct ccl_program *, int *, int *, int, int,
                         Lisp_Object);
@@ -289,6 +289,8 @@ encode_coding_XXX (struct coding_system *coding)
 #include <wchar.h>
 #endif /* HAVE_WCHAR_H */
 
+#include <nproc.h>
+
 #include "lisp.h"
 #include "character.h"
 #include "buffer.h"
@@ -298,6 +300,7 @@ encode_coding_XXX (struct coding_system *coding)
 #include "coding.h"
 #include "termhooks.h"
 #include "pdumper.h"
+#include "systhread.h"
 
 Lisp_Object Vcoding_system_hash_table;
 
@@ -1125,6 +1128,76 @@ alloc_destination (struct coding_system *coding, ptrdiff_t nbytes,
 #define UTF_8_BOM_2 0xBB
 #define UTF_8_BOM_3 0xBF
 
+/* Return the number of ASCII bytes at the head of the NBYTES bytes at
+   SRC.  The bytes are examined a word at a time, and the unrolled
+   loop below is simple enough for compilers to vectorize, so long
+   runs of ASCII text are skipped much faster than byte by byte.  */
+
+static ptrdiff_t
+ascii_prefix_length (const unsigned char *src, ptrdiff_t nbytes)
+{
+  enum { WORD_BYTES = sizeof (size_t) };
+  size_t const high_bits = (size_t) -1 / 0xFF * 0x80;
+  const unsigned char *p = src, *end = src + nbytes;
+
+  while (end - p >= 4 * WORD_BYTES)
+    {
+      size_t w0, w1, w2, w3;
+
+      memcpy (&w0, p, WORD_BYTES);
+      memcpy (&w1, p + WORD_BYTES, WORD_BYTES);
+      memcpy (&w2, p + 2 * WORD_BYTES, WORD_BYTES);
+      memcpy (&w3, p + 3 * WORD_BYTES, WORD_BYTES);
+      if ((w0 | w1 | w2 | w3) & high_bits)
+	break;
+      p += 4 * WORD_BYTES;
+    }
+  while (end - p >= WORD_BYTES)
+    {
+      size_t w;
+
+      memcpy (&w, p, WORD_BYTES);
+      if (w & high_bits)
+	break;
+      p += WORD_BYTES;
+    }
+  while (p < end && UTF_8_1_OCTET_P (*p))
+    p++;
+  return p - src;
+}
+
+/* Return the "logical or" of EOL_SEEN_LF, EOL_SEEN_CR, and
+   EOL_SEEN_CRLF for the EOLs in the NBYTES bytes of ASCII-compatible
+   text at SRC.  A CR at the end is taken as EOL_SEEN_CR.  Only CRs
+   are looked at one by one; the text between them is searched for LF
+   by memchr, and not at all once an LF has been seen.  */
+
+static int
+scan_eol (const unsigned char *src, ptrdiff_t nbytes)
+{
+  const unsigned char *end = src + nbytes, *cr;
+  int eol_seen = EOL_SEEN_NONE;
+
+  while ((cr = memchr (src, '\r', end - src)))
+    {
+      if (! (eol_seen & EOL_SEEN_LF) && memchr (src, '\n', cr - src))
+	eol_seen |= EOL_SEEN_LF;
+      if (cr + 1 < end && cr[1] == '\n')
+	{
+	  eol_seen |= EOL_SEEN_CRLF;
+	  src = cr + 2;
+	}
+      else
+	{
+	  eol_seen |= EOL_SEEN_CR;
+	  src = cr + 1;
+	}
+    }
+  if (! (eol_seen & EOL_SEEN_LF) && memchr (src, '\n', end - src))
+    eol_seen |= EOL_SEEN_LF;
+  return eol_seen;
+}
+
 /* Unlike the other detect_coding_XXX, this function counts the number
    of characters and checks the EOL format.  */
 
@@ -1137,6 +1210,9 @@ detect_coding_utf_8 (struct coding_system *coding,
   bool multibytep = coding->src_multibyte;
   ptrdiff_t consumed_chars = 0;
   bool bom_found = 0;
+  /* Whether all the characters seen are valid Unicode, without
+     overlong sequences or surrogates.  */
+  bool unicode = true;
   ptrdiff_t nchars = coding->head_ascii;
 
   detect_info->checked |= CATEGORY_MASK_UTF_8;
@@ -1158,6 +1234,12 @@ detect_coding_utf_8 (struct coding_system *coding,
     {
       int c, c1, c2, c3, c4;
 
+      if (! multibytep)
+	{
+	  ptrdiff_t n = ascii_prefix_length (src, src_end - src);
+	  src += n;
+	  nchars += n;
+	}
       src_base = src;
       ONE_MORE_BYTE (c);
       if (c < 0 || UTF_8_1_OCTET_P (c))
@@ -1178,6 +1260,7 @@ detect_coding_utf_8 (struct coding_system *coding,
 	break;
       if (UTF_8_2_OCTET_LEADING_P (c))
 	{
+	  unicode &= c >= 0xC2;
 	  nchars++;
 	  continue;
 	}
@@ -1186,6 +1269,8 @@ detect_coding_utf_8 (struct coding_system *coding,
 	break;
       if (UTF_8_3_OCTET_LEADING_P (c))
 	{
+	  c = ((c & 0xF) << 12) | ((c1 & 0x3F) << 6) | (c2 & 0x3F);
+	  unicode &= c >= 0x800 && ! (c >= 0xd800 && c < 0xe000);
 	  nchars++;
 	  continue;
 	}
@@ -1194,6 +1279,9 @@ detect_coding_utf_8 (struct coding_system *coding,
 	break;
       if (UTF_8_4_OCTET_LEADING_P (c))
 	{
+	  c = (((c & 0x7) << 18) | ((c1 & 0x3F) << 12)
+	       | ((c2 & 0x3F) << 6) | (c3 & 0x3F));
+	  unicode &= c >= 0x10000 && c < 0x110000;
 	  nchars++;
 	  continue;
 	}
@@ -1205,6 +1293,7 @@ detect_coding_utf_8 (struct coding_system *coding,
 	     to be reviewed.  */
 	  && c < MAX_MULTIBYTE_LEADING_CODE)
 	{
+	  unicode = false;
 	  nchars++;
 	  continue;
 	}
@@ -1233,7 +1322,8 @@ detect_coding_utf_8 (struct coding_system *coding,
 	detect_info->found |= CATEGORY_MASK_UTF_8_AUTO | CATEGORY_MASK_UTF_8_NOSIG;
     }
   coding->detected_utf8_bytes = src_base - coding->source;
-  coding->detected_utf8_chars = nchars;
+  /* Decoding can skip the conversion only of valid Unicode.  */
+  coding->detected_utf8_chars = unicode ? nchars : -1;
   return 1;
 }
 
@@ -1298,39 +1388,66 @@ decode_coding_utf_8 (struct coding_system *coding)
 	  break;
 	}
 
-      /* In the simple case, rapidly handle ordinary characters */
-      if (multibytep && ! eol_dos
-	  && charbuf < charbuf_end - 6 && src < src_end - 6)
+      /* In the simple case, rapidly handle ordinary characters: runs
+	 of ASCII bytes and, in a unibyte source, well-formed multibyte
+	 sequences.  Anything else, including the end of the source,
+	 is left to the general code below.  */
+      if (! eol_dos && charbuf < charbuf_end - 6 && src < src_end - 6)
 	{
 	  while (charbuf < charbuf_end - 6 && src < src_end - 6)
 	    {
 	      c1 = *src;
-	      if (c1 & 0x80)
-		break;
-	      src++;
-	      consumed_chars++;
-	      *charbuf++ = c1;
-
-	      c1 = *src;
-	      if (c1 & 0x80)
+	      if (UTF_8_1_OCTET_P (c1))
+		{
+		  ptrdiff_t room = min (src_end - src, charbuf_end - charbuf);
+		  ptrdiff_t n = ascii_prefix_length (src, room - 6);
+		  for (ptrdiff_t i = 0; i < n; i++)
+		    charbuf[i] = src[i];
+		  src += n;
+		  charbuf += n;
+		  consumed_chars += n;
+		  continue;
+		}
+	      if (multibytep)
 		break;
-	      src++;
-	      consumed_chars++;
-	      *charbuf++ = c1;
-
-	      c1 = *src;
-	      if (c1 & 0x80)
+	      c2 = src[1];
+	      if (! UTF_8_EXTRA_OCTET_P (c2))
 		break;
-	      src++;
-	      consumed_chars++;
-	      *charbuf++ = c1;
-
-	      c1 = *src;
-	      if (c1 & 0x80)
-		break;
-	      src++;
+	      if (UTF_8_2_OCTET_LEADING_P (c1))
+		{
+		  c = ((c1 & 0x1F) << 6) | (c2 & 0x3F);
+		  if (c < 0x80)
+		    break;
+		  src += 2;
+		}
+	      else
+		{
+		  c3 = src[2];
+		  if (! UTF_8_EXTRA_OCTET_P (c3))
+		    break;
+		  if (UTF_8_3_OCTET_LEADING_P (c1))
+		    {
+		      c = (((c1 & 0xF) << 12)
+			   | ((c2 & 0x3F) << 6) | (c3 & 0x3F));
+		      if (c < 0x800 || (c >= 0xd800 && c < 0xe000))
+			break;
+		      src += 3;
+		    }
+		  else
+		    {
+		      c4 = src[3];
+		      if (! (UTF_8_4_OCTET_LEADING_P (c1)
+			     && UTF_8_EXTRA_OCTET_P (c4)))
+			break;
+		      c = (((c1 & 0x7) << 18) | ((c2 & 0x3F) << 12)
+			   | ((c3 & 0x3F) << 6) | (c4 & 0x3F));
+		      if (c < 0x10000)
+			break;
+		      src += 4;
+		    }
+		}
+	      *charbuf++ = c;
 	      consumed_chars++;
-	      *charbuf++ = c1;
 	    }
 	  /* If we handled at least one character, restart the main loop.  */
 	  if (src != src_base)
@@ -6177,49 +6294,16 @@ check_ascii (struct coding_system *coding)
       || SYMBOLP (eol_type))
     {
       /* We don't have to check EOL format.  */
-      while (src < end && !( *src & 0x80))
-	{
-	  if (*src++ == '\n')
-	    eol_seen |= EOL_SEEN_LF;
-	}
+      ptrdiff_t n = ascii_prefix_length (src, end - src);
+      if (memchr (src, '\n', n))
+	eol_seen |= EOL_SEEN_LF;
+      src += n;
     }
   else
     {
-      end--;		    /* We look ahead one byte for "CR LF".  */
-      while (src < end)
-	{
-	  int c = *src;
-
-	  if (c & 0x80)
-	    break;
-	  src++;
-	  if (c == '\r')
-	    {
-	      if (*src == '\n')
-		{
-		  eol_seen |= EOL_SEEN_CRLF;
-		  src++;
-		}
-	      else
-		eol_seen |= EOL_SEEN_CR;
-	    }
-	  else if (c == '\n')
-	    eol_seen |= EOL_SEEN_LF;
-	}
-      if (src == end)
-	{
-	  int c = *src;
-
-	  /* All bytes but the last one C are ASCII.  */
-	  if (! (c & 0x80))
-	    {
-	      if (c == '\r')
-		eol_seen |= EOL_SEEN_CR;
-	      else if (c  == '\n')
-		eol_seen |= EOL_SEEN_LF;
-	      src++;
-	    }
-	}
+      ptrdiff_t n = ascii_prefix_length (src, end - src);
+      eol_seen |= scan_eol (src, n);
+      src += n;
     }
   coding->head_ascii = src - coding->source;
   coding->eol_seen = eol_seen;
@@ -6227,63 +6311,65 @@ check_ascii (struct coding_system *coding)
 }
 
 
-/* Return the number of characters at the source if all the bytes are
-   valid UTF-8 (of Unicode range).  Otherwise, return -1.  By side
-   effects, update coding->eol_seen.  The value of coding->eol_seen is
-   "logical or" of EOL_SEEN_LF, EOL_SEEN_CR, and EOL_SEEN_CRLF, but
-   the value is reliable only when all the source bytes are valid
-   UTF-8.  */
+/* Return the number of characters in the NBYTES bytes at SRC if they
+   are all valid UTF-8 (of Unicode range).  Otherwise, return -1.  By
+   side effects, "logical or" EOL_SEEN_LF, EOL_SEEN_CR, and
+   EOL_SEEN_CRLF into *EOL_SEEN for the EOLs found in the text.  This
+   does not access any Lisp data, so it can run in a thread other than
+   the main one.  */
 
 static ptrdiff_t
-check_utf_8 (struct coding_system *coding)
+scan_utf_8_chunk (const unsigned char *src, ptrdiff_t nbytes, int *eol_seen)
 {
-  const unsigned char *src, *end;
-  int eol_seen;
-  ptrdiff_t nchars = coding->head_ascii;
+  const unsigned char *end = src + nbytes;
+  ptrdiff_t nchars = 0;
+  int seen = EOL_SEEN_NONE;
 
-  if (coding->head_ascii < 0)
-    check_ascii (coding);
-  else
-    coding_set_source (coding);
-  src = coding->source + coding->head_ascii;
-  /* We look ahead one byte for CR LF.  */
-  end = coding->source + coding->src_bytes - 1;
-  eol_seen = coding->eol_seen;
   while (src < end)
     {
       int c = *src;
 
-      if (UTF_8_1_OCTET_P (*src))
+      if (UTF_8_1_OCTET_P (c))
 	{
+	  /* Count a run of ASCII text without a CR at once.  */
+	  ptrdiff_t n = ascii_prefix_length (src, end - src);
+	  if (n > 1 && ! memchr (src, '\r', n))
+	    {
+	      if (! (seen & EOL_SEEN_LF) && memchr (src, '\n', n))
+		seen |= EOL_SEEN_LF;
+	      src += n;
+	      nchars += n;
+	      continue;
+	    }
 	  src++;
 	  if (c < 0x20)
 	    {
 	      if (c == '\r')
 		{
-		  if (*src == '\n')
+		  if (src < end && *src == '\n')
 		    {
-		      eol_seen |= EOL_SEEN_CRLF;
+		      seen |= EOL_SEEN_CRLF;
 		      src++;
 		      nchars++;
 		    }
 		  else
-		    eol_seen |= EOL_SEEN_CR;
+		    seen |= EOL_SEEN_CR;
 		}
 	      else if (c == '\n')
-		eol_seen |= EOL_SEEN_LF;
+		seen |= EOL_SEEN_LF;
 	    }
 	}
       else if (UTF_8_2_OCTET_LEADING_P (c))
 	{
 	  if (c < 0xC2		/* overlong sequence */
-	      || src + 1 >= end
+	      || end - src < 2
 	      || ! UTF_8_EXTRA_OCTET_P (src[1]))
 	    return -1;
 	  src += 2;
 	}
       else if (UTF_8_3_OCTET_LEADING_P (c))
 	{
-	  if (src + 2 >= end
+	  if (end - src < 3
 	      || ! (UTF_8_EXTRA_OCTET_P (src[1])
 		    && UTF_8_EXTRA_OCTET_P (src[2])))
 	    return -1;
@@ -6296,7 +6382,7 @@ check_utf_8 (struct coding_system *coding)
 	}
       else if (UTF_8_4_OCTET_LEADING_P (c))
 	{
-	  if (src + 3 >= end
+	  if (end - src < 4
 	      || ! (UTF_8_EXTRA_OCTET_P (src[1])
 		    && UTF_8_EXTRA_OCTET_P (src[2])
 		    && UTF_8_EXTRA_OCTET_P (src[3])))
@@ -6313,18 +6399,150 @@ check_utf_8 (struct coding_system *coding)
       nchars++;
     }
 
-  if (src == end)
+  *eol_seen |= seen;
+  return nchars;
+}
+
+#ifdef THREADS_ENABLED
+
+/* The maximum number of threads that scan_utf_8 uses.  */
+enum { SCAN_UTF_8_MAX_THREADS = 64 };
+
+/* State shared by the threads of one call to scan_utf_8.  */
+struct scan_utf_8_batch
+{
+  sys_mutex_t mutex;
+  sys_cond_t done;
+  int pending;
+};
+
+/* A chunk of text scanned by one thread.  */
+struct scan_utf_8_job
+{
+  const unsigned char *src;
+  ptrdiff_t nbytes;
+  ptrdiff_t nchars;
+  int eol_seen;
+  struct scan_utf_8_batch *batch;
+};
+
+static void *
+scan_utf_8_thread (void *arg)
+{
+  struct scan_utf_8_job *job = arg;
+  struct scan_utf_8_batch *batch = job->batch;
+
+  job->nchars = scan_utf_8_chunk (job->src, job->nbytes, &job->eol_seen);
+  sys_mutex_lock (&batch->mutex);
+  if (--batch->pending == 0)
+    sys_cond_signal (&batch->done);
+  sys_mutex_unlock (&batch->mutex);
+  return NULL;
+}
+
+#endif	/* THREADS_ENABLED */
+
+/* Like scan_utf_8_chunk, but if the text is larger than twice
+   coding_parallel_chunk_size, split it into chunks at character
+   boundaries, and scan them in parallel.  */
+
+static ptrdiff_t
+scan_utf_8 (const unsigned char *src, ptrdiff_t nbytes, int *eol_seen)
+{
+#ifdef THREADS_ENABLED
+  if (coding_parallel_chunk_size > 0
+      && nbytes / 2 >= coding_parallel_chunk_size)
     {
-      if (! UTF_8_1_OCTET_P (*src))
-	return -1;
-      nchars++;
-      if (*src == '\r')
-	eol_seen |= EOL_SEEN_CR;
-      else if (*src  == '\n')
-	eol_seen |= EOL_SEEN_LF;
+      const unsigned char *end = src + nbytes;
+      EMACS_INT nthreads
+	= (FIXNATP (Vcoding_parallel_threads)
+	   ? XFIXNAT (Vcoding_parallel_threads)
+	   : num_processors (NPROC_CURRENT_OVERRIDABLE));
+      ptrdiff_t nchunks = min (nbytes / coding_parallel_chunk_size,
+			       min (nthreads, SCAN_UTF_8_MAX_THREADS));
+      struct scan_utf_8_job jobs[SCAN_UTF_8_MAX_THREADS];
+      struct scan_utf_8_batch batch;
+      const unsigned char *from = src;
+      ptrdiff_t nchars = 0;
+
+      if (nchunks < 2)
+	return scan_utf_8_chunk (src, nbytes, eol_seen);
+
+      for (ptrdiff_t i = 0; i < nchunks; i++)
+	{
+	  const unsigned char *to = end;
+
+	  if (i < nchunks - 1)
+	    {
+	      /* Don't split a multibyte sequence or a CR LF pair.  An
+		 invalid sequence makes one of the chunks fail anyway.  */
+	      to = max (from, src + nbytes / nchunks * (i + 1));
+	      for (int j = 0; j < 3 && to < end && UTF_8_EXTRA_OCTET_P (*to);
+		   j++)
+		to++;
+	      if (from < to && to < end && to[-1] == '\r' && *to == '\n')
+		to++;
+	    }
+	  jobs[i].src = from;
+	  jobs[i].nbytes = to - from;
+	  jobs[i].eol_seen = EOL_SEEN_NONE;
+	  jobs[i].batch = &batch;
+	  from = to;
+	}
+
+      sys_mutex_init (&batch.mutex);
+      sys_cond_init (&batch.done);
+      batch.pending = nchunks - 1;
+      for (ptrdiff_t i = 1; i < nchunks; i++)
+	{
+	  sys_thread_t thread;
+
+	  if (! sys_thread_create (&thread, scan_utf_8_thread, &jobs[i]))
+	    scan_utf_8_thread (&jobs[i]);
+	}
+      jobs[0].nchars = scan_utf_8_chunk (jobs[0].src, jobs[0].nbytes,
+					 &jobs[0].eol_seen);
+      sys_mutex_lock (&batch.mutex);
+      while (batch.pending > 0)
+	sys_cond_wait (&batch.done, &batch.mutex);
+      sys_mutex_unlock (&batch.mutex);
+      sys_cond_destroy (&batch.done);
+
+      for (ptrdiff_t i = 0; i < nchunks; i++)
+	{
+	  if (jobs[i].nchars < 0)
+	    return -1;
+	  nchars += jobs[i].nchars;
+	  *eol_seen |= jobs[i].eol_seen;
+	}
+      return nchars;
     }
+#endif
+  return scan_utf_8_chunk (src, nbytes, eol_seen);
+}
+
+/* Return the number of characters at the source if all the bytes are
+   valid UTF-8 (of Unicode range).  Otherwise, return -1.  By side
+   effects, update coding->eol_seen.  The value of coding->eol_seen is
+   "logical or" of EOL_SEEN_LF, EOL_SEEN_CR, and EOL_SEEN_CRLF, but
+   the value is reliable only when all the source bytes are valid
+   UTF-8.  */
+
+static ptrdiff_t
+check_utf_8 (struct coding_system *coding)
+{
+  ptrdiff_t nchars;
+  int eol_seen;
+
+  if (coding->head_ascii < 0)
+    check_ascii (coding);
+  else
+    coding_set_source (coding);
+  eol_seen = coding->eol_seen;
+  nchars = scan_utf_8 (coding->source + coding->head_ascii,
+		       coding->src_bytes - coding->head_ascii, &eol_seen);
   coding->eol_seen = eol_seen;
-  return nchars;
+  return nchars < 0 ? -1 : coding->head_ascii + nchars;
 }
 
 
@@ -6448,37 +6666,47 @@ detect_eol (const unsigned char *source, ptrdiff_t src_bytes,
   else
     while (src < src_end)
       {
-	c = *src++;
-	if (c == '\n' || c == '\r')
-	  {
-	    int this_eol;
+	/* Find the next CR or LF by memchr rather than byte by
+	   byte.  */
+	const unsigned char *lf = memchr (src, '\n', src_end - src);
+	const unsigned char *cr = memchr (src, '\r',
+					  (lf ? lf : src_end) - src);
+	int this_eol;
 
-	    if (c == '\n')
-	      this_eol = EOL_SEEN_LF;
-	    else if (src >= src_end || *src != '\n')
+	if (cr)
+	  {
+	    src = cr + 1;
+	    if (src >= src_end || *src != '\n')
 	      this_eol = EOL_SEEN_CR;
 	    else
 	      this_eol = EOL_SEEN_CRLF, src++;
+	  }
+	else if (lf)
+	  {
+	    src = lf + 1;
+	    this_eol = EOL_SEEN_LF;
+	  }
+	else
+	  break;
 
-	    if (eol_seen == EOL_SEEN_NONE)
-	      /* This is the first end-of-line.  */
-	      eol_seen = this_eol;
-	    else if (eol_seen != this_eol)
+	if (eol_seen == EOL_SEEN_NONE)
+	  /* This is the first end-of-line.  */
+	  eol_seen = this_eol;
+	else if (eol_seen != this_eol)
+	  {
+	    /* The found type is different from what found before.
+	       Allow for stray ^M characters in DOS EOL files.  */
+	    if ((eol_seen == EOL_SEEN_CR && this_eol == EOL_SEEN_CRLF)
+		|| (eol_seen == EOL_SEEN_CRLF && this_eol == EOL_SEEN_CR))
+	      eol_seen = EOL_SEEN_CRLF;
+	    else
 	      {
-		/* The found type is different from what found before.
-		   Allow for stray ^M characters in DOS EOL files.  */
-		if ((eol_seen == EOL_SEEN_CR && this_eol == EOL_SEEN_CRLF)
-		    || (eol_seen == EOL_SEEN_CRLF && this_eol == EOL_SEEN_CR))
-		  eol_seen = EOL_SEEN_CRLF;
-		else
-		  {
-		    eol_seen = EOL_SEEN_LF;
-		    break;
-		  }
+		eol_seen = EOL_SEEN_LF;
+		break;
 	      }
-	    if (++total == MAX_EOL_CHECK_COUNT)
-	      break;
 	  }
+	if (++total == MAX_EOL_CHECK_COUNT)
+	  break;
       }
   return eol_seen;
 }
@@ -6511,6 +6739,153 @@ adjust_coding_eol_type (struct coding_system *coding, int eol_seen)
   return eol_type;
 }
 
+/* Number of windows of text that a detection sample is made of.  */
+enum { DETECTION_SAMPLE_WINDOWS = 4 };
+
+/* If SRC_BYTES bytes at SRC are more than `coding-detection-max-bytes',
+   store in *SAMPLE a newly allocated copy of windows of that text
+   taken at its head, its tail and evenly in between, and return the
+   length of the copy.  Each window but the first starts after a
+   newline, and each but the last ends after a newline, if they have
+   one, so that lines and escape sequences are rarely cut; otherwise,
+   they start and end at character boundaries.  Otherwise, return
+   -1.  */
+
+static ptrdiff_t
+coding_detection_sample (const unsigned char *src, ptrdiff_t src_bytes,
+			 unsigned char **sample)
+{
+  if (! FIXNATP (Vcoding_detection_max_bytes))
+    return -1;
+  EMACS_INT max_bytes = XFIXNAT (Vcoding_detection_max_bytes);
+  ptrdiff_t window = max_bytes / DETECTION_SAMPLE_WINDOWS;
+  if (window == 0 || src_bytes <= max_bytes)
+    return -1;
+
+  unsigned char *p = *sample = xmalloc (window * DETECTION_SAMPLE_WINDOWS);
+  for (int i = 0; i < DETECTION_SAMPLE_WINDOWS; i++)
+    {
+      const unsigned char *end
+	= (i < DETECTION_SAMPLE_WINDOWS - 1
+	   ? (src + window
+	      + i * ((src_bytes - window) / (DETECTION_SAMPLE_WINDOWS - 1)))
+	   : src + src_bytes);
+      const unsigned char *beg = end - window;
+      if (i > 0)
+	{
+	  const unsigned char *nl = memchr (beg, '\n', end - beg);
+	  if (nl)
+	    beg = nl + 1;
+	  else
+	    for (int j = 0; j < MAX_MULTIBYTE_LENGTH - 1; j++)
+	      if (beg < end && (*beg & 0xC0) == 0x80)
+		beg++;
+	}
+      if (i < DETECTION_SAMPLE_WINDOWS - 1)
+	{
+	  const unsigned char *nl = end;
+	  while (nl > beg && nl[-1] != '\n')
+	    nl--;
+	  if (nl > beg)
+	    end = nl;
+	  else
+	    for (int j = 0; j < MAX_MULTIBYTE_LENGTH - 1; j++)
+	      if (end > beg && (*end & 0xC0) == 0x80)
+		end--;
+	}
+      memcpy (p, beg, end - beg);
+      p += end - beg;
+    }
+  return p - *sample;
+}
+
+static void detect_coding (struct coding_system *);
+
+/* Detect the encoding of the text specified in CODING from a sample
+   of it, as `detect_coding' does.  Return true if the sample was
+   enough to decide the encoding; then, CODING is updated as
+   `detect_coding' would, except that what it records about the text
+   itself, such as the ASCII characters at its head and the EOLs seen
+   in it, is reset so that it is computed again from the whole text.
+   Return false if CODING is left as it was.  */
+
+static bool
+detect_coding_sampled (struct coding_system *coding)
+{
+  unsigned char *sample;
+  coding_set_source (coding);
+  ptrdiff_t nbytes = coding_detection_sample (coding->source,
+					      coding->src_bytes, &sample);
+  if (nbytes < 0)
+    return false;
+
+  Lisp_Object src_object = coding->src_object;
+  const unsigned char *source = coding->source;
+  ptrdiff_t src_chars = coding->src_chars, src_bytes = coding->src_bytes;
+  int id = coding->id;
+
+  coding->src_object = Qnil;
+  coding->source = sample;
+  coding->src_bytes = nbytes;
+  coding->src_chars = (coding->src_multibyte
+		       ? multibyte_chars_in_text (sample, nbytes) : nbytes);
+  detect_coding (coding);
+  xfree (sample);
+
+  coding->src_object = src_object;
+  coding->source = source;
+  coding->src_chars = src_chars;
+  coding->src_bytes = src_bytes;
+  coding->head_ascii = -1;
+  coding->detected_utf8_bytes = coding->detected_utf8_chars = -1;
+  coding->eol_seen = EOL_SEEN_NONE;
+
+  if (EQ (CODING_ATTR_TYPE (CODING_ID_ATTRS (coding->id)), Qundecided))
+    {
+      /* The sample was all ASCII, so the whole text must be seen.  */
+      if (coding->id != id)
+	setup_coding_system (CODING_ID_NAME (id), coding);
+      return false;
+    }
+  return true;
+}
+
+/* Hash table mapping the identities of files, as made by
+   insert-file-contents, to the coding systems detected when reading
+   them, or nil if no file was read since the coding system priorities
+   last changed.  */
+static Lisp_Object Vcoding_detection_cache;
+
+/* Maximum number of entries in Vcoding_detection_cache.  */
+enum { CODING_DETECTION_CACHE_MAX = 256 };
+
+/* Return the coding system detected when the file identified by KEY
+   was read, or nil if none was recorded.  */
+
+Lisp_Object
+cached_detected_coding (Lisp_Object key)
+{
+  if (NILP (Vcoding_detection_cache))
+    return Qnil;
+  struct Lisp_Hash_Table *h = XHASH_TABLE (Vcoding_detection_cache);
+  ptrdiff_t i = hash_lookup (h, key);
+  return i < 0 ? Qnil : HASH_VALUE (h, i);
+}
+
+/* Record that CODING_SYSTEM was detected when reading the file
+   identified by KEY.  */
+
+void
+cache_detected_coding (Lisp_Object key, Lisp_Object coding_system)
+{
+  if (NILP (Vcoding_detection_cache)
+      || (XHASH_TABLE (Vcoding_detection_cache)->count
+	  >= CODING_DETECTION_CACHE_MAX))
+    Vcoding_detection_cache
+      = make_hash_table (&hashtest_equal, DEFAULT_HASH_SIZE, Weak_None, false);
+  Fputhash (key, coding_system, Vcoding_detection_cache);
+}
+
 /* Detect how a text specified in CODING is encoded.  If a coding
    system is detected, update fields of CODING by the detected coding
    system.  */
@@ -6523,6 +6898,10 @@ detect_coding (struct coding_system *coding)
   Lisp_Object found = Qnil;
   Lisp_Object eol_type = CODING_ID_EOL_TYPE (coding->id);
 
+  if (EQ (CODING_ATTR_TYPE (CODING_ID_ATTRS (coding->id)), Qundecided)
+      && detect_coding_sampled (coding))
+    return;
+
   coding->consumed = coding->consumed_char = 0;
   coding->produced = coding->produced_char = 0;
   coding_set_source (coding);
@@ -6791,23 +7170,8 @@ decode_eol (struct coding_system *coding)
 
   if (VECTORP (eol_type))
     {
-      int eol_seen = EOL_SEEN_NONE;
+      int eol_seen = scan_eol (pbeg, pend - pbeg);
 
-      for (p = pbeg; p < pend; p++)
-	{
-	  if (*p == '\n')
-	    eol_seen |= EOL_SEEN_LF;
-	  else if (*p == '\r')
-	    {
-	      if (p + 1 < pend && *(p + 1) == '\n')
-		{
-		  eol_seen |= EOL_SEEN_CRLF;
-		  p++;
-		}
-	      else
-		eol_seen |= EOL_SEEN_CR;
-	    }
-	}
       /* Handle DOS-style EOLs in a file with stray ^M characters.  */
       if ((eol_seen & EOL_SEEN_CRLF) != 0
 	  && (eol_seen & EOL_SEEN_CR) != 0
@@ -6824,40 +7188,49 @@ decode_eol (struct coding_system *coding)
 
   if (EQ (eol_type, Qmac))
     {
-      for (p = pbeg; p < pend; p++)
-	if (*p == '\r')
-	  *p = '\n';
+      for (p = pbeg; (p = memchr (p, '\r', pend - p)); p++)
+	*p = '\n';
     }
   else if (EQ (eol_type, Qdos))
     {
       ptrdiff_t n = 0;
       ptrdiff_t pos = coding->dst_pos;
       ptrdiff_t pos_byte = coding->dst_pos_byte;
-      ptrdiff_t pos_end = pos_byte + coding->produced - 1;
+      unsigned char *src, *dst;
 
       /* This assertion is here instead of code, now deleted, that
 	 handled the NILP case, which no longer happens with the
 	 current codebase.  */
       eassert (!NILP (coding->dst_object));
 
-      while (pos_byte < pos_end)
-	{
-	  int incr;
-
-	  p = BYTE_POS_ADDR (pos_byte);
-	  if (coding->dst_multibyte)
-	    incr = BYTES_BY_CHAR_HEAD (*p);
-	  else
-	    incr = 1;
-
-	  if (*p == '\r' && p[1] == '\n')
-	    {
-	      del_range_2 (pos, pos_byte, pos + 1, pos_byte + 1, 0);
-	      n++;
-	      pos_end--;
-	    }
-	  pos++;
-	  pos_byte += incr;
+      /* Move the text between the CRs of CR LF pairs over them as
+	 blocks, and then delete as many characters at the end at
+	 once.  No marker can be inside text just decoded, but the
+	 char/byte position index has already recorded it, so it is
+	 told that the text before the tail was replaced.  As before,
+	 a CR at the very end is kept, since what follows is not
+	 known.  */
+      for (src = dst = p = pbeg;
+	   pend - p > 1 && (p = memchr (p, '\r', pend - 1 - p)); p++)
+	if (p[1] == '\n')
+	  {
+	    memmove (dst, src, p - src);
+	    dst += p - src;
+	    src = p + 1;
+	    n++;
+	  }
+      if (n > 0)
+	{
+	  memmove (dst, src, pend - src);
+	  del_range_2 (pos + coding->produced_char - n,
+		       pos_byte + coding->produced - n,
+		       pos + coding->produced_char,
+		       pos_byte + coding->produced, 0);
+	  adjust_charpos_index (pos, pos_byte,
+				coding->produced_char - n,
+				coding->produced - n,
+				coding->produced_char - n,
+				coding->produced - n);
 	}
       coding->produced -= n;
       coding->produced_char -= n;
@@ -7401,7 +7774,8 @@ decode_coding (struct coding_system *coding)
   if (coding->decoder == decode_coding_ccl)
     {
       coding->spec.ccl = &cclspec;
-      setup_ccl_program (&cclspec.ccl, CODING_CCL_DECODER (coding));
+      if (setup_ccl_program (&cclspec.ccl, CODING_CCL_DECODER (coding)))
+	setup_ccl_byte_map (&cclspec.ccl);
     }
   do
     {
@@ -7798,7 +8172,8 @@ encode_coding (struct coding_system *coding)
   if (coding->encoder == encode_coding_ccl)
     {
       coding->spec.ccl = &cclspec;
-      setup_ccl_program (&cclspec.ccl, CODING_CCL_ENCODER (coding));
+      if (setup_ccl_program (&cclspec.ccl, CODING_CCL_ENCODER (coding)))
+	setup_ccl_byte_map (&cclspec.ccl);
     }
   do {
     coding_set_source (coding);
@@ -7908,6 +8283,75 @@ coding_restore_undo_list (Lisp_Object arg)
   bset_undo_list (buf, undo_list);
 }
 
+/* Return the number of characters in the source text of CODING if
+   decoding it would not change it.  That is the case when CODING is
+   a UTF-8 coding system without BOM, translation table or post-read
+   conversion, the source is unibyte text that is valid UTF-8, and its
+   EOLs need no conversion.  Otherwise, return -1.  If the EOL type of
+   CODING is still undecided and the text contains LFs, set CODING to
+   its Unix variant as decode_eol would.  */
+
+static ptrdiff_t
+check_utf_8_passthrough (struct coding_system *coding)
+{
+  Lisp_Object attrs = CODING_ID_ATTRS (coding->id);
+  Lisp_Object eol_type = CODING_ID_EOL_TYPE (coding->id);
+  ptrdiff_t nchars;
+
+  if (disable_ascii_optimization
+      || coding->src_multibyte
+      || ! coding->dst_multibyte
+      || ! EQ (CODING_ATTR_TYPE (attrs), Qutf_8)
+      || CODING_UTF_8_BOM (coding) != utf_without_bom
+      || ! NILP (CODING_ATTR_POST_READ (attrs))
+      || ! NILP (get_translation_table (attrs, 0, NULL)))
+    return -1;
+
+  coding->head_ascii = -1;
+  coding->eol_seen = EOL_SEEN_NONE;
+  nchars = check_utf_8 (coding);
+  if (nchars < 0)
+    return -1;
+  if (inhibit_eol_conversion || EQ (eol_type, Qunix))
+    return nchars;
+  if (! VECTORP (eol_type)
+      || ((coding->eol_seen & (EOL_SEEN_CR | EOL_SEEN_CRLF))
+	  && ! (coding->eol_seen & EOL_SEEN_LF)))
+    return -1;
+  if (coding->eol_seen != EOL_SEEN_NONE)
+    adjust_coding_eol_type (coding, EOL_SEEN_LF);
+  return nchars;
+}
+
+/* Return true if encoding the NBYTES bytes of multibyte text at SRC by
+   CODING would not change them.  That is the case when CODING is a
+   UTF-8 coding system without BOM, translation table, pre-write
+   conversion or selective display, the text is valid UTF-8, that is,
+   has no raw bytes or characters beyond Unicode, and its EOLs need no
+   conversion.  */
+
+bool
+encode_coding_passthrough_p (struct coding_system *coding,
+			     const unsigned char *src, ptrdiff_t nbytes)
+{
+  Lisp_Object attrs = CODING_ID_ATTRS (coding->id);
+  Lisp_Object eol_type = CODING_ID_EOL_TYPE (coding->id);
+  int eol_seen = EOL_SEEN_NONE;
+
+  if (disable_ascii_optimization
+      || ! EQ (CODING_ATTR_TYPE (attrs), Qutf_8)
+      || CODING_UTF_8_BOM (coding) != utf_without_bom
+      || coding->mode & CODING_MODE_SELECTIVE_DISPLAY
+      || ! NILP (CODING_ATTR_PRE_WRITE (attrs))
+      || ! NILP (get_translation_table (attrs, 1, NULL))
+      || scan_utf_8 (src, nbytes, &eol_seen) < 0)
+    return false;
+  return (inhibit_eol_conversion
+	  || ! SYMBOLP (eol_type)
+	  || EQ (eol_type, Qunix)
+	  || ! (eol_seen & EOL_SEEN_LF));
+}
+
 /* Decode the *last* BYTES of the gap and insert them at point.  */
 void
 decode_coding_gap (struct coding_system *coding, ptrdiff_t bytes)
@@ -7946,15 +8390,19 @@ decode_coding_gap (struct coding_system *coding, ptrdiff_t bytes)
 	chars = check_ascii (coding);
       if (chars != bytes)
 	{
-	  /* There exists a non-ASCII byte.  */
+	  /* There exists a non-ASCII byte.  If the text is in UTF-8,
+	     either by detection or because the coding system said so,
+	     check that it is valid and adopt it as is.  */
 	  if (EQ (CODING_ATTR_TYPE (attrs), Qutf_8)
-	      && coding->detected_utf8_bytes == coding->src_bytes)
+	      && (coding->detected_utf8_bytes < 0
+		  || coding->detected_utf8_bytes == coding->src_bytes))
 	    {
 	      if (coding->detected_utf8_chars >= 0)
 		chars = coding->detected_utf8_chars;
 	      else
 		chars = check_utf_8 (coding);
-	      if (CODING_UTF_8_BOM (coding) != utf_without_bom
+	      if (chars > 0
+		  && CODING_UTF_8_BOM (coding) != utf_without_bom
 		  && coding->head_ascii == 0
 		  && coding->source[0] == UTF_8_BOM_1
 		  && coding->source[1] == UTF_8_BOM_2
@@ -7983,14 +8431,13 @@ decode_coding_gap (struct coding_system *coding, ptrdiff_t bytes)
 	      unsigned char *src_end = GAP_END_ADDR;
 	      unsigned char *src = src_end - coding->src_bytes;
 
-	      while (src < src_end)
-		{
-		  if (*src++ == '\r')
-		    src[-1] = '\n';
-		}
+	      while ((src = memchr (src, '\r', src_end - src)))
+		*src++ = '\n';
 	    }
 	  else if (EQ (eol_type, Qdos))
 	    {
+	      /* Working backwards, move each line, without the CR
+		 before its LF if any, as a block.  */
 	      unsigned char *src = GAP_END_ADDR;
 	      unsigned char *src_beg = src - coding->src_bytes;
 	      unsigned char *dst = src;
@@ -7998,8 +8445,14 @@ decode_coding_gap (struct coding_system *coding, ptrdiff_t bytes)
 
 	      while (src_beg < src)
 		{
-		  *--dst = *--src;
-		  if (*src == '\n' && src > src_beg && src[-1] == '\r')
+		  unsigned char *lf = memrchr (src_beg, '\n', src - src_beg);
+		  unsigned char *line = lf ? lf : src_beg;
+
+		  dst -= src - line;
+		  if (dst != line)
+		    memmove (dst, line, src - line);
+		  src = line;
+		  if (lf && lf > src_beg && lf[-1] == '\r')
 		    src--;
 		}
 	      diff = dst - src;
@@ -8116,7 +8569,7 @@ decode_coding_object (struct coding_system *coding,
 	  for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
 	    {
 	      tail->need_adjustment
-		= tail->charpos == (tail->insertion_type ? from : to);
+		= marker_charpos (tail) == (tail->insertion_type ? from : to);
 	      need_marker_adjustment |= tail->need_adjustment;
 	    }
 	  saved_pt = PT, saved_pt_byte = PT_BYTE;
@@ -8138,6 +8591,31 @@ decode_coding_object (struct coding_system *coding,
     detect_coding (coding);
   attrs = CODING_ID_ATTRS (coding->id);
 
+  if (EQ (dst_object, Qt))
+    {
+      /* Valid UTF-8 that needs no conversion is used as is.  */
+      ptrdiff_t nchars;
+
+      coding->dst_multibyte = !CODING_FOR_UNIBYTE (coding);
+      coding_set_source (coding);
+      nchars = check_utf_8_passthrough (coding);
+      if (nchars >= 0)
+	{
+	  coding_set_source (coding);
+	  coding->dst_object
+	    = make_specified_string ((const char *) coding->source,
+				     nchars, bytes, true);
+	  coding->consumed = coding->produced = bytes;
+	  coding->consumed_char = coding->src_chars;
+	  coding->produced_char = nchars;
+	  coding->carryover_bytes = 0;
+	  record_conversion_result (coding, CODING_RESULT_SUCCESS);
+	  Vdeactivate_mark = old_deactivate_mark;
+	  unbind_to (count, Qnil);
+	  return;
+	}
+    }
+
   if (EQ (dst_object, Qt)
       || (! NILP (CODING_ATTR_POST_READ (attrs))
 	  && NILP (dst_object)))
@@ -8250,17 +8728,14 @@ decode_coding_object (struct coding_system *coding,
 	      {
 		tail->need_adjustment = 0;
 		if (tail->insertion_type)
-		  {
-		    tail->bytepos = from_byte;
-		    tail->charpos = from;
-		  }
+		  move_marker (tail, from, from_byte);
 		else
-		  {
-		    tail->bytepos = from_byte + coding->produced;
-		    tail->charpos
-		      = (NILP (BVAR (current_buffer, enable_multibyte_characters))
-			 ? tail->bytepos : from + coding->produced_char);
-		  }
+		  move_marker (tail,
+			       (NILP (BVAR (current_buffer,
+					    enable_multibyte_characters))
+				? from_byte + coding->produced
+				: from + coding->produced_char),
+			       from_byte + coding->produced);
 	      }
 	}
     }
@@ -8338,7 +8813,7 @@ encode_coding_object (struct coding_system *coding,
       for (tail = BUF_MARKERS (XBUFFER (src_object)); tail; tail = tail->next)
 	{
 	  tail->need_adjustment
-	    = tail->charpos == (tail->insertion_type ? from : to);
+	    = marker_charpos (tail) == (tail->insertion_type ? from : to);
 	  need_marker_adjustment |= tail->need_adjustment;
 	}
     }
@@ -8350,7 +8825,7 @@ encode_coding_object (struct coding_system *coding,
       if (STRINGP (src_object))
 	insert_from_string (src_object, from, from_byte, chars, bytes, 0);
       else if (BUFFERP (src_object))
-	insert_from_buffer (XBUFFER (src_object), from, chars, 0);
+	insert_from_buffer (XBUFFER (src_object), from, chars, 0, false);
       else
 	insert_1_both ((char *) coding->source + from, chars, bytes, 0, 0, 0);
 
@@ -8505,17 +8980,14 @@ encode_coding_object (struct coding_system *coding,
 	      {
 		tail->need_adjustment = 0;
 		if (tail->insertion_type)
-		  {
-		    tail->bytepos = from_byte;
-		    tail->charpos = from;
-		  }
+		  move_marker (tail, from, from_byte);
 		else
-		  {
-		    tail->bytepos = from_byte + coding->produced;
-		    tail->charpos
-		      = (NILP (BVAR (current_buffer, enable_multibyte_characters))
-			 ? tail->bytepos : from + coding->produced_char);
-		  }
+		  move_marker (tail,
+			       (NILP (BVAR (current_buffer,
+					    enable_multibyte_characters))
+				? from_byte + coding->produced
+				: from + coding->produced_char),
+			       from_byte + coding->produced);
 	      }
 	}
     }
@@ -8723,6 +9195,31 @@ detect_coding_system (const unsigned char *src,
 
   /* At first, detect text-format if necessary.  */
   base_category = XFIXNUM (CODING_ATTR_CATEGORY (attrs));
+  if (base_category == coding_category_undecided)
+    {
+      /* If the text is large, try with a sample of it first.  */
+      unsigned char *sample;
+      ptrdiff_t nbytes = coding_detection_sample (src, src_bytes, &sample);
+      if (nbytes >= 0)
+	{
+	  val = detect_coding_system (sample,
+				      (multibytep
+				       ? multibyte_chars_in_text (sample,
+								  nbytes)
+				       : nbytes),
+				      nbytes, highest, multibytep,
+				      CODING_ID_NAME (coding.id));
+	  xfree (sample);
+	  Lisp_Object first = highest ? val : CAR_SAFE (val);
+	  if (! NILP (first)
+	      && ! EQ (CODING_ATTR_TYPE (CODING_ID_ATTRS
+					 (CODING_SYSTEM_ID (first))),
+		       Qundecided))
+	    return val;
+	  val = Qnil;
+	}
+    }
+
   if (base_category == coding_category_undecided)
     {
       enum coding_category category UNINIT;
@@ -10931,6 +11428,9 @@ usage: (set-coding-system-priority &rest coding-systems)  */)
 
   memcpy (coding_priorities, priorities, sizeof priorities);
 
+  /* Files may be detected differently now.  */
+  Vcoding_detection_cache = Qnil;
+
   /* Update `coding-category-list'.  */
   Vcoding_category_list = Qnil;
   for (i = coding_category_max; i-- > 0; )
@@ -11502,7 +12002,11 @@ usage: (define-coding-system-internal ...)  */)
 
   int id = coding_categories[category].id;
   if (id < 0 || EQ (name, CODING_ID_NAME (id)))
+    {
       setup_coding_system (name, &coding_categories[category]);
+      /* Files may be detected differently now.  */
+      Vcoding_detection_cache = Qnil;
+    }
 
   return Qnil;
 
@@ -11760,6 +12264,9 @@ syms_of_coding (void)
   staticpro (&Vcode_conversion_reused_workbuf);
   Vcode_conversion_reused_workbuf = Qnil;
 
+  staticpro (&Vcoding_detection_cache);
+  Vcoding_detection_cache = Qnil;
+
   staticpro (&Vcode_conversion_workbuf_name);
   Vcode_conversion_workbuf_name = build_pure_c_string (" *code-conversion-work*");
 
@@ -12229,6 +12736,49 @@ decode text as usual.  */);
 Internal use only.  Remove after the experimental optimizer becomes stable.  */);
   disable_ascii_optimization = 0;
 
+  DEFVAR_INT ("coding-parallel-chunk-size", coding_parallel_chunk_size,
+	      doc: /* Size in bytes of the chunks of text checked in parallel.
+When Emacs reads or writes UTF-8 text at least twice this size, it
+checks whether the text can be used as is in chunks of this size, one
+per thread, using at most `coding-parallel-threads' threads.  If zero
+or negative, or if Emacs was built without thread support, the text is
+always checked by the main thread alone.  */);
+  coding_parallel_chunk_size = 4 * 1024 * 1024;
+
+  DEFVAR_LISP ("coding-parallel-threads", Vcoding_parallel_threads,
+	       doc: /* Maximum number of threads checking text in parallel.
+If nil, use as many threads as there are processors, or as the
+environment variable OMP_NUM_THREADS says.  Otherwise, this should be
+a natural number; a value less than 2 means not to use threads.
+See `coding-parallel-chunk-size'.  */);
+  Vcoding_parallel_threads = Qnil;
+
+  DEFVAR_LISP ("coding-detection-max-bytes", Vcoding_detection_max_bytes,
+	       doc: /* Maximum number of bytes examined to detect a coding system.
+If non-nil, this should be a natural number.  Then, when the coding
+system of a text larger than this is detected, for instance when
+visiting a file or calling `detect-coding-region', only this many
+bytes of it are examined: some at its head, some at its tail and the
+rest evenly in between.  If they are all ASCII, the whole text is
+examined as usual.
+
+If nil, the whole text is always examined.  Bounding the detection
+makes visiting large files faster, at the risk of choosing a coding
+system that does not suit parts of the text that were not examined.  */);
+  Vcoding_detection_max_bytes = Qnil;
+
+  DEFVAR_BOOL ("coding-detection-use-cache", coding_detection_use_cache,
+	       doc: /* Non-nil means remember the coding systems detected for files.
+Then, when `insert-file-contents' detects the coding system of a whole
+file, it records the result, and reuses it instead of detecting again
+when it reads the file while its device, inode, size and modification
+time are the same, and so are the coding system priorities and the
+variables that affect detection, such as `inhibit-null-byte-detection'.
+
+A file changed without a change of its modification time or size may
+then be decoded with a coding system that does not suit it.  */);
+  coding_detection_use_cache = false;
+
   DEFVAR_LISP ("translation-table-for-input", Vtranslation_table_for_input,
 	       doc: /* Char table for translating self-inserting characters.
 This is applied to the result of input methods, not their input.
@@ -698,6 +698,8 @@ extern bool raw_text_coding_system_p (struct coding_system *);
 extern Lisp_Object coding_inherit_eol_type (Lisp_Object, Lisp_Object);
 extern Lisp_Object complement_process_encoding_system (Lisp_Object);
 extern Lisp_Object make_string_from_utf8 (const char *, ptrdiff_t);
+extern Lisp_Object cached_detected_coding (Lisp_Object);
+extern void cache_detected_coding (Lisp_Object, Lisp_Object);
 
 extern void decode_coding_gap (struct coding_system *, ptrdiff_t);
 extern void decode_coding_object (struct coding_system *,
@@ -706,6 +708,8 @@ extern void decode_coding_object (struct coding_system *,
 extern void encode_coding_object (struct coding_system *,
                                   Lisp_Object, ptrdiff_t, ptrdiff_t,
                                   ptrdiff_t, ptrdiff_t, Lisp_Object);
+extern bool encode_coding_passthrough_p (struct coding_system *,
+					 const unsigned char *, ptrdiff_t);
 /* Defined in this file.  */
 INLINE int surrogates_to_codepoint (int, int);
 
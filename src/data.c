@@ -293,6 +293,12 @@ a fixed set of types.  */)
 	  return Qtreesit_compiled_query;
         case PVEC_SQLITE:
           return Qsqlite;
+        case PVEC_REGEXP:
+          return Qregexp;
+        case PVEC_STRING_MATCHER:
+          return Qstring_matcher;
+        case PVEC_BUFFER_SNAPSHOT:
+          return Qbuffer_snapshot;
         case PVEC_SUB_CHAR_TABLE:
           return Qsub_char_table;
         /* "Impossible" cases.  */
@@ -4246,6 +4252,9 @@ syms_of_data (void)
   DEFSYM (Qtreesit_node, "treesit-node");
   DEFSYM (Qtreesit_compiled_query, "treesit-compiled-query");
   DEFSYM (Qobarray, "obarray");
+  DEFSYM (Qregexp, "regexp");
+  DEFSYM (Qstring_matcher, "string-matcher");
+  DEFSYM (Qbuffer_snapshot, "buffer-snapshot");
 
   DEFSYM (Qdefun, "defun");
 
@@ -1736,7 +1736,32 @@ using `string-make-multibyte' or `string-make-unibyte', which see.  */)
   update_buffer_properties (b, e);
   set_buffer_internal_1 (obuf);
 
-  insert_from_buffer (bp, b, e - b, 0);
+  insert_from_buffer (bp, b, e - b, 0, false);
+  return Qnil;
+}
+
+DEFUN ("internal--clone-buffer-text", Finternal__clone_buffer_text,
+       Sinternal__clone_buffer_text, 1, 1, 0,
+       doc: /* Insert before point the whole text of BUFFER, ignoring narrowing.
+This is like `insert-buffer-substring', but if the current buffer is
+empty and BUFFER is large, the two buffers share the memory that holds
+the text until one of them changes, which copies it then.  Sharing
+removes the gap of BUFFER, so this is only meant for `clone-buffer'.  */)
+  (Lisp_Object buffer)
+{
+  Lisp_Object buf = Fget_buffer (buffer);
+  if (NILP (buf))
+    nsberror (buffer);
+  struct buffer *bp = XBUFFER (buf);
+  if (!BUFFER_LIVE_P (bp))
+    error ("Selecting deleted buffer");
+
+  struct buffer *obuf = current_buffer;
+  set_buffer_internal_1 (bp);
+  update_buffer_properties (BEG, Z);
+  set_buffer_internal_1 (obuf);
+
+  insert_from_buffer (bp, BUF_BEG (bp), BUF_Z (bp) - BUF_BEG (bp), 0, true);
   return Qnil;
 }
 
@@ -1899,6 +1924,10 @@ determines whether case is significant or ignored.  */)
      or inserted.  */                           \
   unsigned char *deletions;                     \
   unsigned char *insertions;			\
+  /* When comparing lines instead of characters, the numbers of the
+     classes of equal lines of each buffer.  */ \
+  const ptrdiff_t *ids_a;			\
+  const ptrdiff_t *ids_b;			\
   struct timespec time_limit;			\
   sys_jmp_buf jmp;				\
   unsigned short quitcounter;
@@ -1916,6 +1945,254 @@ static bool compareseq_early_abort (struct context *);
 #include "minmax.h"
 #include "diffseq.h"
 
+/* Minimum number of characters, summed over both buffers, of the
+   differing parts of the texts for which replace-buffer-contents
+   first diffs lines, and then only the characters of changed lines.  */
+enum { RBC_LINE_DIFF_MIN_CHARS = 64 * 1024 };
+
+/* Lines of a contiguous text: line I spans the bytes from STARTS[I] to
+   STARTS[I + 1] of TEXT, newline included.  */
+struct rbc_lines
+{
+  const unsigned char *text;
+  ptrdiff_t *starts;
+  ptrdiff_t n;
+};
+
+/* Make the bytes from BEG_BYTE to END_BYTE of BUF contiguous, by
+   moving its gap to BEG if it is between them.  */
+static void
+rbc_move_gap_out (struct buffer *buf, ptrdiff_t beg, ptrdiff_t beg_byte,
+		  ptrdiff_t end_byte)
+{
+  if (beg_byte < BUF_GPT_BYTE (buf) && BUF_GPT_BYTE (buf) < end_byte)
+    {
+      struct buffer *old = current_buffer;
+      set_buffer_internal (buf);
+      move_gap_both (beg, beg_byte);
+      set_buffer_internal (old);
+    }
+}
+
+/* Return the number of leading bytes, at most N, that A and B have in
+   common.  */
+static ptrdiff_t
+common_prefix_length (const unsigned char *a, const unsigned char *b,
+		      ptrdiff_t n)
+{
+  enum { CHUNK = 4096 };
+  ptrdiff_t i = 0;
+  while (i + CHUNK <= n && memcmp (a + i, b + i, CHUNK) == 0)
+    i += CHUNK;
+  while (i < n && a[i] == b[i])
+    i++;
+  return i;
+}
+
+/* Return the number of bytes, at most N, that the texts ending at
+   A_END and B_END have in common at their end.  */
+static ptrdiff_t
+common_suffix_length (const unsigned char *a_end,
+		      const unsigned char *b_end, ptrdiff_t n)
+{
+  enum { CHUNK = 4096 };
+  ptrdiff_t i = 0;
+  while (i + CHUNK <= n
+	 && memcmp (a_end - i - CHUNK, b_end - i - CHUNK, CHUNK) == 0)
+    i += CHUNK;
+  while (i < n && a_end[-i - 1] == b_end[-i - 1])
+    i++;
+  return i;
+}
+
+/* Return the number of lines of the NBYTES bytes at TEXT, counting a
+   final line without newline.  If STARTS is non-null, store there the
+   offsets of the beginnings of the lines, followed by NBYTES.  */
+static ptrdiff_t
+rbc_split_lines (const unsigned char *text, ptrdiff_t nbytes,
+		 ptrdiff_t *starts)
+{
+  ptrdiff_t n = 0, pos = 0;
+  while (pos < nbytes)
+    {
+      if (starts)
+	starts[n] = pos;
+      n++;
+      const unsigned char *nl = memchr (text + pos, '\n', nbytes - pos);
+      pos = nl ? nl - text + 1 : nbytes;
+    }
+  if (starts)
+    starts[n] = nbytes;
+  return n;
+}
+
+/* Return a hash code of the LEN bytes at P.  Unlike hash_string, this
+   looks at every byte and mixes them into the low bits, because lines
+   often differ only in a few bytes and the table is indexed by the low
+   bits of the code.  */
+static size_t
+rbc_hash_line (const unsigned char *p, ptrdiff_t len)
+{
+  /* FNV-1a.  */
+  uint_least64_t h = 0xcbf29ce484222325;
+  for (ptrdiff_t i = 0; i < len; i++)
+    h = (h ^ p[i]) * 0x100000001b3;
+  return h ^ (h >> 32);
+}
+
+/* Number the lines of A and B so that equal lines get equal numbers.
+   Store the numbers of the lines of A in IDS, followed by those of
+   the lines of B.  */
+static void
+rbc_intern_lines (const struct rbc_lines *a, const struct rbc_lines *b,
+		  ptrdiff_t *ids)
+{
+  ptrdiff_t n = a->n + b->n;
+  ptrdiff_t size = 1;
+  while (size < 2 * n)
+    size *= 2;
+  /* Open addressing table of the first line of each class, plus 1.  */
+  ptrdiff_t *table = xzalloc (size * sizeof *table);
+  for (ptrdiff_t k = 0; k < n; k++)
+    {
+      const struct rbc_lines *l = k < a->n ? a : b;
+      ptrdiff_t i = k < a->n ? k : k - a->n;
+      const unsigned char *p = l->text + l->starts[i];
+      ptrdiff_t len = l->starts[i + 1] - l->starts[i];
+      ptrdiff_t h = rbc_hash_line (p, len) & (size - 1);
+      for (;; h = (h + 1) & (size - 1))
+	{
+	  ptrdiff_t r = table[h] - 1;
+	  if (r < 0)
+	    {
+	      table[h] = k + 1;
+	      ids[k] = k;
+	      break;
+	    }
+	  const struct rbc_lines *rl = r < a->n ? a : b;
+	  ptrdiff_t ri = r < a->n ? r : r - a->n;
+	  if (rl->starts[ri + 1] - rl->starts[ri] == len
+	      && memcmp (rl->text + rl->starts[ri], p, len) == 0)
+	    {
+	      ids[k] = r;
+	      break;
+	    }
+	}
+    }
+  xfree (table);
+}
+
+/* Replace the SIZE_A characters of the current buffer at BEG_A with
+   the SIZE_B characters of SOURCE at BEG_B, touching only the
+   characters that differ, as computed by compareseq with the
+   parameters in PROTO.  If that takes longer than allowed, replace the
+   whole text instead, and return false.  */
+static bool
+rbc_replace_range (struct context *proto, Lisp_Object source,
+		   ptrdiff_t beg_a, ptrdiff_t size_a,
+		   ptrdiff_t beg_b, ptrdiff_t size_b)
+{
+  if (size_a == 0 || size_b == 0)
+    {
+      if (size_a > 0)
+	del_range (beg_a, beg_a + size_a);
+      if (size_b > 0)
+	{
+	  SET_PT (beg_a);
+	  Finsert_buffer_substring (source, make_fixed_natnum (beg_b),
+				    make_fixed_natnum (beg_b + size_b));
+	}
+      return true;
+    }
+
+  ptrdiff_t diags = size_a + size_b + 3;
+  ptrdiff_t del_bytes = size_a / CHAR_BIT + 1;
+  ptrdiff_t ins_bytes = size_b / CHAR_BIT + 1;
+  ptrdiff_t *buffer;
+  ptrdiff_t bytes_needed;
+  if (ckd_mul (&bytes_needed, diags, 2 * sizeof *buffer)
+      || ckd_add (&bytes_needed, bytes_needed, del_bytes + ins_bytes))
+    memory_full (SIZE_MAX);
+  USE_SAFE_ALLOCA;
+  buffer = SAFE_ALLOCA (bytes_needed);
+  unsigned char *deletions_insertions = memset (buffer + 2 * diags, 0,
+						del_bytes + ins_bytes);
+
+  /* FIXME: It is not documented how to initialize the contents of the
+     context structure.  This code cargo-cults from the existing
+     caller in src/analyze.c of GNU Diffutils, which appears to
+     work.  */
+  struct context ctx = *proto;
+  ctx.beg_a = beg_a;
+  ctx.beg_b = beg_b;
+  ctx.ids_a = ctx.ids_b = NULL;
+  ctx.deletions = deletions_insertions;
+  ctx.insertions = deletions_insertions + del_bytes;
+  ctx.fdiag = buffer + size_b + 1;
+  ctx.bdiag = buffer + diags + size_b + 1;
+
+  /* compareseq requires indices to be zero-based.  We add BEG_A and
+     BEG_B back later.  */
+  bool early_abort;
+  if (! sys_setjmp (ctx.jmp))
+    early_abort = compareseq (0, size_a, 0, size_b, false, &ctx);
+  else
+    early_abort = true;
+
+  if (early_abort)
+    {
+      del_range (beg_a, beg_a + size_a);
+      SET_PT (beg_a);
+      Finsert_buffer_substring (source, make_fixed_natnum (beg_b),
+				make_fixed_natnum (beg_b + size_b));
+      SAFE_FREE ();
+      return false;
+    }
+
+  ptrdiff_t i = size_a;
+  ptrdiff_t j = size_b;
+  /* Walk backwards through the lists of changes.  This was also
+     cargo-culted from src/analyze.c in GNU Diffutils.  Because we
+     walk backwards, we don’t have to keep the positions in sync.  */
+  while (i >= 0 || j >= 0)
+    {
+      rarely_quit (++ctx.quitcounter);
+
+      /* Check whether there is a change (insertion or deletion)
+         before the current position.  */
+      if ((i > 0 && bit_is_set (ctx.deletions, i - 1))
+	  || (j > 0 && bit_is_set (ctx.insertions, j - 1)))
+	{
+          ptrdiff_t end_a = beg_a + i;
+          ptrdiff_t end_b = beg_b + j;
+          /* Find the beginning of the current change run.  */
+	  while (i > 0 && bit_is_set (ctx.deletions, i - 1))
+            --i;
+	  while (j > 0 && bit_is_set (ctx.insertions, j - 1))
+            --j;
+
+          ptrdiff_t run_a = beg_a + i;
+          ptrdiff_t run_b = beg_b + j;
+          eassert (run_a <= end_a);
+          eassert (run_b <= end_b);
+          eassert (run_a < end_a || run_b < end_b);
+          if (run_a < end_a)
+            del_range (run_a, end_a);
+          if (run_b < end_b)
+            {
+              SET_PT (run_a);
+              Finsert_buffer_substring (source, make_fixed_natnum (run_b),
+                                        make_fixed_natnum (end_b));
+            }
+	}
+      --i;
+      --j;
+    }
+
+  SAFE_FREE ();
+  return true;
+}
+
 DEFUN ("replace-buffer-contents", Freplace_buffer_contents,
        Sreplace_buffer_contents, 1, 3, "bSource buffer: ",
        doc: /* Replace accessible portion of current buffer with that of SOURCE.
@@ -1926,6 +2203,11 @@ As far as possible the replacement is non-destructive, i.e. existing
 buffer contents, markers, properties, and overlays in the current
 buffer stay intact.
 
+Only the text between the common beginning and end of the two buffers
+is compared and modified.  When that text is large, the lines that
+differ are found first, and then the characters that differ within
+those lines.
+
 Because this function can be very slow if there is a large number of
 differences between the two buffers, there are two optional arguments
 mitigating this issue.
@@ -1933,9 +2215,9 @@ mitigating this issue.
 The MAX-SECS argument, if given, defines a hard limit on the time used
 for comparing the buffers.  If it takes longer than MAX-SECS, the
 function falls back to a plain `delete-region' and
-`insert-buffer-substring'.  (Note that the checks are not performed
-too evenly over time, so in some cases it may run a bit longer than
-allowed).
+`insert-buffer-substring' of the text that differs.  (Note that the
+checks are not performed too evenly over time, so in some cases it may
+run a bit longer than allowed).
 
 The optional argument MAX-COSTS defines the quality of the difference
 computation.  If the actual costs exceed this limit, heuristics are
@@ -2007,55 +2289,124 @@ nil.  */)
     }
 
   specpdl_ref count = SPECPDL_INDEX ();
-
-
-  ptrdiff_t diags = size_a + size_b + 3;
-  ptrdiff_t del_bytes = size_a / CHAR_BIT + 1;
-  ptrdiff_t ins_bytes = size_b / CHAR_BIT + 1;
-  ptrdiff_t *buffer;
-  ptrdiff_t bytes_needed;
-  if (ckd_mul (&bytes_needed, diags, 2 * sizeof *buffer)
-      || ckd_add (&bytes_needed, bytes_needed, del_bytes + ins_bytes))
-    memory_full (SIZE_MAX);
   USE_SAFE_ALLOCA;
-  buffer = SAFE_ALLOCA (bytes_needed);
-  unsigned char *deletions_insertions = memset (buffer + 2 * diags, 0,
-						del_bytes + ins_bytes);
 
-  /* FIXME: It is not documented how to initialize the contents of the
-     context structure.  This code cargo-cults from the existing
-     caller in src/analyze.c of GNU Diffutils, which appears to
-     work.  */
-  struct context ctx = {
+  struct context proto = {
     .buffer_a = a,
     .buffer_b = b,
-    .beg_a = min_a,
-    .beg_b = min_b,
     .a_unibyte = BUF_ZV (a) == BUF_ZV_BYTE (a),
     .b_unibyte = BUF_ZV (b) == BUF_ZV_BYTE (b),
-    .deletions = deletions_insertions,
-    .insertions = deletions_insertions + del_bytes,
-    .fdiag = buffer + size_b + 1,
-    .bdiag = buffer + diags + size_b + 1,
     .heuristic = true,
     .too_expensive = too_expensive,
     .time_limit = time_limit,
   };
 
-  /* compareseq requires indices to be zero-based.  We add BEGV back
-     later.  */
-  bool early_abort;
-  if (! sys_setjmp (ctx.jmp))
-    early_abort = compareseq (0, size_a, 0, size_b, false, &ctx);
-  else
-    early_abort = true;
-
-  if (early_abort)
+  /* If both texts are represented the same way, equal characters are
+     equal byte sequences, so the common prefix and suffix can be
+     skipped with memcmp, and lines can be compared by their bytes.  */
+  bool a_multibyte = !NILP (BVAR (a, enable_multibyte_characters));
+  bool b_multibyte = !NILP (BVAR (b, enable_multibyte_characters));
+  ptrdiff_t min_a_byte = BEGV_BYTE;
+  ptrdiff_t min_b_byte = BUF_BEGV_BYTE (b);
+  ptrdiff_t nbytes_a = ZV_BYTE - min_a_byte;
+  ptrdiff_t nbytes_b = BUF_ZV_BYTE (b) - min_b_byte;
+  bool same_bytes = (a_multibyte == b_multibyte
+		     || (a_multibyte ? nbytes_a == size_a : nbytes_b == size_b));
+  struct rbc_lines lines_a = { 0 }, lines_b = { 0 };
+  unsigned char *line_changes = NULL;
+
+  if (same_bytes)
     {
-      del_range (min_a, ZV);
-      Finsert_buffer_substring (source, Qnil,Qnil);
-      SAFE_FREE_UNBIND_TO (count, Qnil);
-      return Qnil;
+      rbc_move_gap_out (a, min_a, min_a_byte, min_a_byte + nbytes_a);
+      rbc_move_gap_out (b, min_b, min_b_byte, min_b_byte + nbytes_b);
+      const unsigned char *pa = BUF_BYTE_ADDRESS (a, min_a_byte);
+      const unsigned char *pb = BUF_BYTE_ADDRESS (b, min_b_byte);
+
+      ptrdiff_t prefix = common_prefix_length (pa, pb,
+					       min (nbytes_a, nbytes_b));
+      if (a_multibyte)
+	while (prefix < nbytes_a && !CHAR_HEAD_P (pa[prefix]))
+	  prefix--;
+      ptrdiff_t suffix
+	= common_suffix_length (pa + nbytes_a, pb + nbytes_b,
+				min (nbytes_a, nbytes_b) - prefix);
+      if (a_multibyte)
+	while (suffix > 0 && !CHAR_HEAD_P (pa[nbytes_a - suffix]))
+	  suffix--;
+
+      ptrdiff_t end_a = buf_bytepos_to_charpos (a, min_a_byte + nbytes_a
+						   - suffix);
+      ptrdiff_t end_b = buf_bytepos_to_charpos (b, min_b_byte + nbytes_b
+						   - suffix);
+      min_a = buf_bytepos_to_charpos (a, min_a_byte + prefix);
+      min_b = buf_bytepos_to_charpos (b, min_b_byte + prefix);
+      size_a = end_a - min_a;
+      size_b = end_b - min_b;
+      min_a_byte += prefix;
+      min_b_byte += prefix;
+      nbytes_a -= prefix + suffix;
+      nbytes_b -= prefix + suffix;
+      if (size_a == 0 && size_b == 0)
+	{
+	  SAFE_FREE ();
+	  return Qt;
+	}
+
+      /* For large differences, first find the lines that changed, and
+	 compare characters only within those.  */
+      if (size_a + size_b >= RBC_LINE_DIFF_MIN_CHARS
+	  && size_a > 0 && size_b > 0)
+	{
+	  lines_a.n = rbc_split_lines (pa + prefix, nbytes_a, NULL);
+	  lines_b.n = rbc_split_lines (pb + prefix, nbytes_b, NULL);
+	  SAFE_NALLOCA (lines_a.starts, 1, lines_a.n + 1);
+	  SAFE_NALLOCA (lines_b.starts, 1, lines_b.n + 1);
+	  rbc_split_lines (pa + prefix, nbytes_a, lines_a.starts);
+	  rbc_split_lines (pb + prefix, nbytes_b, lines_b.starts);
+	  lines_a.text = pa + prefix;
+	  lines_b.text = pb + prefix;
+
+	  ptrdiff_t nlines = lines_a.n + lines_b.n;
+	  ptrdiff_t *ids;
+	  SAFE_NALLOCA (ids, 1, nlines);
+	  rbc_intern_lines (&lines_a, &lines_b, ids);
+
+	  ptrdiff_t diags = nlines + 3;
+	  ptrdiff_t del_bytes = lines_a.n / CHAR_BIT + 1;
+	  ptrdiff_t ins_bytes = lines_b.n / CHAR_BIT + 1;
+	  ptrdiff_t *buffer;
+	  ptrdiff_t bytes_needed;
+	  if (ckd_mul (&bytes_needed, diags, 2 * sizeof *buffer)
+	      || ckd_add (&bytes_needed, bytes_needed, del_bytes + ins_bytes))
+	    memory_full (SIZE_MAX);
+	  buffer = SAFE_ALLOCA (bytes_needed);
+	  line_changes = memset (buffer + 2 * diags, 0,
+				 del_bytes + ins_bytes);
+
+	  struct context ctx = proto;
+	  ctx.ids_a = ids;
+	  ctx.ids_b = ids + lines_a.n;
+	  ctx.deletions = line_changes;
+	  ctx.insertions = line_changes + del_bytes;
+	  ctx.fdiag = buffer + lines_b.n + 1;
+	  ctx.bdiag = buffer + diags + lines_b.n + 1;
+
+	  bool early_abort;
+	  if (! sys_setjmp (ctx.jmp))
+	    early_abort = compareseq (0, lines_a.n, 0, lines_b.n, false, &ctx);
+	  else
+	    early_abort = true;
+
+	  if (early_abort)
+	    {
+	      del_range (min_a, min_a + size_a);
+	      SET_PT (min_a);
+	      Finsert_buffer_substring (source, make_fixed_natnum (min_b),
+					make_fixed_natnum (min_b + size_b));
+	      SAFE_FREE_UNBIND_TO (count, Qnil);
+	      return Qnil;
+	    }
+	}
     }
 
   Fundo_boundary ();
@@ -2069,57 +2420,60 @@ nil.  */)
      modification hooks, because then they don't want that.  */
   if (!inhibit_modification_hooks)
     {
-      prepare_to_modify_buffer (BEGV, ZV, NULL);
+      prepare_to_modify_buffer (min_a, min_a + size_a, NULL);
       specbind (Qinhibit_modification_hooks, Qt);
       modification_hooks_inhibited = true;
     }
 
-  ptrdiff_t i = size_a;
-  ptrdiff_t j = size_b;
-  /* Walk backwards through the lists of changes.  This was also
-     cargo-culted from src/analyze.c in GNU Diffutils.  Because we
-     walk backwards, we don’t have to keep the positions in sync.  */
-  while (i >= 0 || j >= 0)
+  bool nondestructive = true;
+  if (line_changes)
     {
-      rarely_quit (++ctx.quitcounter);
-
-      /* Check whether there is a change (insertion or deletion)
-         before the current position.  */
-      if ((i > 0 && bit_is_set (ctx.deletions, i - 1))
-	  || (j > 0 && bit_is_set (ctx.insertions, j - 1)))
+      unsigned char *deletions = line_changes;
+      unsigned char *insertions = line_changes + lines_a.n / CHAR_BIT + 1;
+      ptrdiff_t i = lines_a.n;
+      ptrdiff_t j = lines_b.n;
+      unsigned short quitcounter = 0;
+      /* Walk backwards through the changed lines, as below for the
+	 changed characters, and diff the characters of each run.  */
+      while (i >= 0 || j >= 0)
 	{
-          ptrdiff_t end_a = min_a + i;
-          ptrdiff_t end_b = min_b + j;
-          /* Find the beginning of the current change run.  */
-	  while (i > 0 && bit_is_set (ctx.deletions, i - 1))
-            --i;
-	  while (j > 0 && bit_is_set (ctx.insertions, j - 1))
-            --j;
-
-          ptrdiff_t beg_a = min_a + i;
-          ptrdiff_t beg_b = min_b + j;
-          eassert (beg_a <= end_a);
-          eassert (beg_b <= end_b);
-          eassert (beg_a < end_a || beg_b < end_b);
-          if (beg_a < end_a)
-            del_range (beg_a, end_a);
-          if (beg_b < end_b)
-            {
-              SET_PT (beg_a);
-              Finsert_buffer_substring (source, make_fixed_natnum (beg_b),
-                                        make_fixed_natnum (end_b));
-            }
+	  rarely_quit (++quitcounter);
+	  if ((i > 0 && bit_is_set (deletions, i - 1))
+	      || (j > 0 && bit_is_set (insertions, j - 1)))
+	    {
+	      ptrdiff_t end_i = i, end_j = j;
+	      while (i > 0 && bit_is_set (deletions, i - 1))
+		--i;
+	      while (j > 0 && bit_is_set (insertions, j - 1))
+		--j;
+	      ptrdiff_t beg_a
+		= buf_bytepos_to_charpos (a, min_a_byte + lines_a.starts[i]);
+	      ptrdiff_t end_a
+		= buf_bytepos_to_charpos (a, min_a_byte
+					  + lines_a.starts[end_i]);
+	      ptrdiff_t beg_b
+		= buf_bytepos_to_charpos (b, min_b_byte + lines_b.starts[j]);
+	      ptrdiff_t end_b
+		= buf_bytepos_to_charpos (b, min_b_byte
+					  + lines_b.starts[end_j]);
+	      if (!rbc_replace_range (&proto, source, beg_a, end_a - beg_a,
+				      beg_b, end_b - beg_b))
+		nondestructive = false;
+	    }
+	  --i;
+	  --j;
 	}
-      --i;
-      --j;
     }
+  else
+    nondestructive = rbc_replace_range (&proto, source, min_a, size_a,
+					min_b, size_b);
 
   SAFE_FREE_UNBIND_TO (count, Qnil);
 
   if (modification_hooks_inhibited)
     {
-      signal_after_change (BEGV, size_a, ZV - BEGV);
-      update_compositions (BEGV, ZV, CHECK_INSIDE);
+      signal_after_change (min_a, size_a, size_b);
+      update_compositions (min_a, min_a + size_b, CHECK_BORDER);
       /* We've locked the buffer's file above in
 	 prepare_to_modify_buffer; if the buffer is unchanged at this
 	 point, i.e. no insertions or deletions have been made, unlock
@@ -2129,7 +2483,7 @@ nil.  */)
 	Funlock_file (BVAR (a, file_truename));
     }
 
-  return Qt;
+  return nondestructive ? Qt : Qnil;
 }
 
 static void
@@ -2149,7 +2503,8 @@ bit_is_set (const unsigned char *a, ptrdiff_t i)
 /* Return true if the characters at position POS_A of buffer
    CTX->buffer_a and at position POS_B of buffer CTX->buffer_b are
    equal.  POS_A and POS_B are zero-based.  Text properties are
-   ignored.
+   ignored.  If CTX->ids_a is non-null, compare lines POS_A and POS_B
+   instead.
 
    Implementation note: this function is called inside the inner-most
    loops of compareseq, so it absolutely must be optimized for speed,
@@ -2169,6 +2524,9 @@ buffer_chars_equal (struct context *ctx,
 	sys_longjmp (ctx->jmp, 1);
     }
 
+  if (ctx->ids_a)
+    return ctx->ids_a[pos_a] == ctx->ids_b[pos_b];
+
   pos_a += ctx->beg_a;
   pos_b += ctx->beg_b;
 
@@ -2656,7 +3014,145 @@ DEFUN ("delete-and-extract-region", Fdelete_and_extract_region,
     return empty_unibyte_string;
   return del_range_1 (XFIXNUM (start), XFIXNUM (end), 1, 1);
 }
-
+
+/* One element of the EDITS vector of `buffer-apply-edits'.  */
+struct batch_edit
+{
+  ptrdiff_t start, end;
+  /* Index of the edit in EDITS, to keep the order of insertions at
+     the same position.  */
+  ptrdiff_t index;
+};
+
+static int
+compare_batch_edits (const void *a, const void *b)
+{
+  const struct batch_edit *x = a, *y = b;
+  if (x->start != y->start)
+    return x->start < y->start ? -1 : 1;
+  if (x->end != y->end)
+    return x->end < y->end ? -1 : 1;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+DEFUN ("buffer-apply-edits", Fbuffer_apply_edits,
+       Sbuffer_apply_edits, 1, 1, 0,
+       doc: /* Apply the replacements in EDITS to the current buffer as one change.
+EDITS is a vector whose elements have the form (START END REPLACEMENT),
+meaning that the text between START and END is replaced with the string
+REPLACEMENT.  All positions refer to the buffer as it is before any of
+the edits, and the regions must not overlap; several insertions at the
+same position (with START equal to END) keep the order they have in
+EDITS.
+
+This is like applying each edit with `delete-region' and `insert', but
+the change hooks run only once, for the region spanning all the edits,
+and the whole batch is recorded as a single change in the undo list.
+Only the text that the edits replace is checked for read-only
+properties and has its `modification-hooks' properties run.  Markers,
+overlays and point are relocated as they would be by the individual
+edits.  Text properties of REPLACEMENT are kept, but are not inherited
+from the surrounding text.
+
+It is an error for the change hooks to modify the buffer, since the
+positions in EDITS would then be out of date.
+
+Return nil.  */)
+  (Lisp_Object edits)
+{
+  CHECK_VECTOR (edits);
+  ptrdiff_t n = ASIZE (edits);
+  if (n == 0)
+    return Qnil;
+
+  USE_SAFE_ALLOCA;
+  struct batch_edit *e;
+  SAFE_NALLOCA (e, 1, n);
+  /* Copy the replacements, so that change hooks modifying EDITS
+     cannot affect the batch.  */
+  Lisp_Object texts = make_nil_vector (n);
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      Lisp_Object edit = AREF (edits, i);
+      Lisp_Object start = Fcar (edit), end = Fcar (Fcdr (edit));
+      Lisp_Object text = Fcar (Fcdr (Fcdr (edit)));
+      CHECK_STRING (text);
+      validate_region (&start, &end);
+      e[i].start = XFIXNUM (start);
+      e[i].end = XFIXNUM (end);
+      e[i].index = i;
+      ASET (texts, i, text);
+    }
+  qsort (e, n, sizeof *e, compare_batch_edits);
+
+  ptrdiff_t beg = e[0].start, end = e[0].end, delta = 0;
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      if (i > 0 && e[i].start < e[i - 1].end)
+	error ("Edits %"pD"d and %"pD"d of the batch overlap",
+	       e[i - 1].index, e[i].index);
+      end = max (end, e[i].end);
+      delta += SCHARS (AREF (texts, e[i].index)) - (e[i].end - e[i].start);
+    }
+
+  /* Check the text of each edit, rather than all the text from BEG to
+     END, and run the change hooks once for all of them.  */
+  if (!NILP (BVAR (current_buffer, read_only)))
+    Fbarf_if_buffer_read_only (make_fixnum (beg));
+  modiff_count modiff = MODIFF;
+  if (buffer_intervals (current_buffer))
+    {
+      for (ptrdiff_t i = 0; i < n; i++)
+	verify_interval_modification (current_buffer, e[i].start, e[i].end);
+      /* Insertions at several positions don't run the insertion hooks
+	 of text properties, as for any change of more than one
+	 position.  */
+      if (beg < end)
+	interval_insert_behind_hooks = interval_insert_in_front_hooks = Qnil;
+    }
+  prepare_to_modify_buffer_2 (beg, end, NULL, false);
+  if (MODIFF != modiff)
+    error ("Buffer modified by a change hook of `buffer-apply-edits'");
+  /* The change hooks may have narrowed the buffer.  */
+  if (beg < BEGV || end > ZV)
+    args_out_of_range (make_fixnum (beg), make_fixnum (end));
+  unshare_buffer_range (current_buffer, CHAR_TO_BYTE (beg),
+			CHAR_TO_BYTE (end));
+  invalidate_buffer_caches (current_buffer, beg, end);
+  BUF_COMPUTE_UNCHANGED (current_buffer, beg - 1, end);
+  bset_point_before_scroll (current_buffer, Qnil);
+
+  /* Record the batch as one replacement of the whole region, instead
+     of a deletion and an insertion per edit.  The deletion is recorded
+     first, with the adjustments of the markers in the region, so that
+     undo deletes the new text, which moves all these markers to BEG,
+     before it reinserts the old text and puts them back.  */
+  ptrdiff_t newend = end + delta;
+  specpdl_ref count = SPECPDL_INDEX ();
+  if (!EQ (BVAR (current_buffer, undo_list), Qt))
+    {
+      if (beg < end)
+	record_delete (beg, make_buffer_string (beg, end, true), true);
+      if (beg < newend)
+	record_insert (beg, newend - beg);
+      record_unwind_protect (subst_char_in_region_unwind,
+			     BVAR (current_buffer, undo_list));
+      bset_undo_list (current_buffer, Qt);
+    }
+
+  /* Apply the edits from the end of the buffer backwards, so that the
+     positions of the edits still to be done stay valid.  */
+  for (ptrdiff_t i = n - 1; i >= 0; i--)
+    replace_range (e[i].start, e[i].end, AREF (texts, e[i].index),
+		   false, false, true, false, true);
+  unbind_to (count, Qnil);
+  SAFE_FREE ();
+
+  signal_after_change (beg, end - beg, newend - beg);
+  update_compositions (beg, newend, CHECK_BORDER);
+  return Qnil;
+}
+
 /* Alist of buffers in which labeled restrictions are used.  The car
    of each list element is a buffer, the cdr is a list of triplets
    (label begv-marker zv-marker).  The last triplet of that list
@@ -3043,23 +3539,27 @@ save_restriction_restore_1 (Lisp_Object data)
       struct Lisp_Marker *beg = XMARKER (XCAR (data));
       struct Lisp_Marker *end = XMARKER (XCDR (data));
       eassert (buf == end->buffer);
+      ptrdiff_t begpos = marker_charpos (beg);
+      ptrdiff_t endpos = marker_charpos (end);
 
       if (buf /* Verify marker still points to a buffer.  */
-	  && (beg->charpos != BUF_BEGV (buf) || end->charpos != BUF_ZV (buf)))
+	  && (begpos != BUF_BEGV (buf) || endpos != BUF_ZV (buf)))
 	/* The restriction has changed from the saved one, so restore
 	   the saved restriction.  */
 	{
 	  ptrdiff_t pt = BUF_PT (buf);
+	  ptrdiff_t begpos_byte = marker_bytepos (beg);
+	  ptrdiff_t endpos_byte = marker_bytepos (end);
 
-	  SET_BUF_BEGV_BOTH (buf, beg->charpos, beg->bytepos);
-	  SET_BUF_ZV_BOTH (buf, end->charpos, end->bytepos);
+	  SET_BUF_BEGV_BOTH (buf, begpos, begpos_byte);
+	  SET_BUF_ZV_BOTH (buf, endpos, endpos_byte);
 
-	  if (pt < beg->charpos || pt > end->charpos)
+	  if (pt < begpos || pt > endpos)
 	    /* The point is outside the new visible range, move it inside. */
 	    SET_BUF_PT_BOTH (buf,
-			     clip_to_bounds (beg->charpos, pt, end->charpos),
-			     clip_to_bounds (beg->bytepos, BUF_PT_BYTE (buf),
-					     end->bytepos));
+			     clip_to_bounds (begpos, pt, endpos),
+			     clip_to_bounds (begpos_byte, BUF_PT_BYTE (buf),
+					     endpos_byte));
 
 	  buf->clip_changed = 1; /* Remember that the narrowing changed. */
 	}
@@ -4386,6 +4886,9 @@ transpose_markers (ptrdiff_t start1, ptrdiff_t end1,
 {
   register ptrdiff_t amt1, amt1_byte, amt2, amt2_byte, diff, diff_byte, mpos;
   register struct Lisp_Marker *marker;
+  struct Lisp_Marker **markers;
+  ptrdiff_t nmarkers = 0;
+  USE_SAFE_ALLOCA;
 
   /* Update point as if it were a marker.  */
   if (PT < start1)
@@ -4420,31 +4923,44 @@ transpose_markers (ptrdiff_t start1, ptrdiff_t end1,
   amt1_byte = (end2_byte - start2_byte) + (start2_byte - end1_byte);
   amt2_byte = (end1_byte - start1_byte) + (start2_byte - end1_byte);
 
-  for (marker = BUF_MARKERS (current_buffer); marker; marker = marker->next)
+  /* Only the markers from START1 to END2 move.  Collect them first,
+     since moving them changes their order in the marker tree.  */
+  for (marker = marker_tree_first (current_buffer, start1);
+       marker && marker_charpos (marker) < end2;
+       marker = marker_tree_next (marker))
+    nmarkers++;
+  SAFE_NALLOCA (markers, 1, nmarkers);
+  nmarkers = 0;
+  for (marker = marker_tree_first (current_buffer, start1);
+       marker && marker_charpos (marker) < end2;
+       marker = marker_tree_next (marker))
+    markers[nmarkers++] = marker;
+
+  for (ptrdiff_t i = 0; i < nmarkers; i++)
     {
-      mpos = marker->bytepos;
-      if (mpos >= start1_byte && mpos < end2_byte)
-	{
-	  if (mpos < end1_byte)
-	    mpos += amt1_byte;
-	  else if (mpos < start2_byte)
-	    mpos += diff_byte;
-	  else
-	    mpos -= amt2_byte;
-	  marker->bytepos = mpos;
-	}
-      mpos = marker->charpos;
-      if (mpos >= start1 && mpos < end2)
+      ptrdiff_t mpos_byte;
+
+      marker = markers[i];
+      mpos_byte = marker_bytepos (marker);
+      if (mpos_byte >= start1_byte && mpos_byte < end2_byte)
 	{
-	  if (mpos < end1)
-	    mpos += amt1;
-	  else if (mpos < start2)
-	    mpos += diff;
+	  if (mpos_byte < end1_byte)
+	    mpos_byte += amt1_byte;
+	  else if (mpos_byte < start2_byte)
+	    mpos_byte += diff_byte;
 	  else
-	    mpos -= amt2;
+	    mpos_byte -= amt2_byte;
 	}
-      marker->charpos = mpos;
+      mpos = marker_charpos (marker);
+      if (mpos < end1)
+	mpos += amt1;
+      else if (mpos < start2)
+	mpos += diff;
+      else
+	mpos -= amt2;
+      move_marker (marker, mpos, mpos_byte);
     }
+  SAFE_FREE ();
 }
 
 DEFUN ("transpose-regions", Ftranspose_regions, Stranspose_regions, 4, 5,
@@ -4739,14 +5255,14 @@ ring.  */)
       update_compositions (end2 - len1, end2, CHECK_BORDER);
     }
 
-  /* When doing multiple transpositions, it might be nice
-     to optimize this.  Perhaps the markers in any one buffer
-     should be organized in some sorted data tree.  */
   if (NILP (leave_markers))
     {
       transpose_markers (start1, end1, start2, end2,
 			 start1_byte, start1_byte + len1_byte,
 			 start2_byte, start2_byte + len2_byte);
+      adjust_charpos_index (start1, start1_byte, end2 - start1,
+			    end2_byte - start1_byte, end2 - start1,
+			    end2_byte - start1_byte);
     }
   else
     {
@@ -4923,12 +5439,14 @@ it to be non-nil.  */);
   defsubr (&Sformat_message);
 
   defsubr (&Sinsert_buffer_substring);
+  defsubr (&Sinternal__clone_buffer_text);
   defsubr (&Scompare_buffer_substrings);
   defsubr (&Sreplace_buffer_contents);
   defsubr (&Ssubst_char_in_region);
   defsubr (&Stranslate_region_internal);
   defsubr (&Sdelete_region);
   defsubr (&Sdelete_and_extract_region);
+  defsubr (&Sbuffer_apply_edits);
   defsubr (&Swiden);
   defsubr (&Snarrow_to_region);
   defsubr (&Sinternal__labeled_narrow_to_region);
@@ -4735,7 +4735,7 @@ by calling `format-decode', which see.  */)
 				  + BUF_BEG_BYTE (XBUFFER (conversion_buffer)))
 	   - same_at_start_charpos);
       insert_from_buffer (XBUFFER (conversion_buffer),
-			  same_at_start_charpos, inserted_chars, 0);
+			  same_at_start_charpos, inserted_chars, 0, false);
       /* Set `inserted' to the number of inserted characters.  */
       inserted = PT - temp;
       /* Set point before the inserted characters.  */
@@ -4966,6 +4966,35 @@ by calling `format-decode', which see.  */)
   if (CODING_MAY_REQUIRE_DECODING (&coding)
       && (inserted > 0 || CODING_REQUIRE_FLUSHING (&coding)))
     {
+      /* If the coding system of the whole file is to be detected,
+	 reuse what was detected when the file was last read, provided
+	 neither it nor what else detection depends on has changed
+	 since.  */
+      Lisp_Object detection_key = Qnil;
+      if (coding_detection_use_cache
+	  && CODING_REQUIRE_DETECTION (&coding)
+	  && regular && beg_offset == 0 && 0 < inserted
+	  && inserted == st.st_size)
+	{
+	  detection_key = list (CODING_ID_NAME (coding.id),
+				Vcoding_detection_max_bytes,
+				inhibit_null_byte_detection ? Qt : Qnil,
+				inhibit_iso_escape_detection ? Qt : Qnil,
+				inhibit_eol_conversion ? Qt : Qnil,
+				Vcoding_category_list,
+				Fcoding_system_priority_list (Qnil),
+				INT_TO_INTEGER (st.st_dev),
+				INT_TO_INTEGER (st.st_ino),
+				make_lisp_time (mtime),
+				INT_TO_INTEGER (st.st_size));
+	  Lisp_Object detected = cached_detected_coding (detection_key);
+	  if (!NILP (detected))
+	    {
+	      setup_coding_system (detected, &coding);
+	      detection_key = Qnil;
+	    }
+	}
+
       /* Now we have all the new bytes at the beginning of the gap,
          but `decode_coding_gap` can't have them at the beginning of the gap,
          so we need to move them.  */
@@ -4973,6 +5002,8 @@ by calling `format-decode', which see.  */)
       decode_coding_gap (&coding, inserted);
       inserted = coding.produced_char;
       coding_system = CODING_ID_NAME (coding.id);
+      if (!NILP (detection_key))
+	cache_detected_coding (detection_key, coding_system);
     }
   else if (inserted > 0)
     {
@@ -5906,7 +5937,10 @@ e_write (int desc, Lisp_Object string, ptrdiff_t start, ptrdiff_t end,
       if (STRINGP (string))
 	{
 	  coding->src_multibyte = SCHARS (string) < SBYTES (string);
-	  if (CODING_REQUIRE_ENCODING (coding))
+	  if (CODING_REQUIRE_ENCODING (coding)
+	      && ! (coding->src_multibyte
+		    && encode_coding_passthrough_p (coding, SDATA (string),
+						    SBYTES (string))))
 	    {
 	      ptrdiff_t nchars = min (end - start, E_WRITE_MAX);
 
@@ -5930,9 +5964,16 @@ e_write (int desc, Lisp_Object string, ptrdiff_t start, ptrdiff_t end,
 	{
 	  ptrdiff_t start_byte = CHAR_TO_BYTE (start);
 	  ptrdiff_t end_byte = CHAR_TO_BYTE (end);
+	  /* The part before the gap is written first.  */
+	  ptrdiff_t stop_byte = (start < GPT && GPT < end
+				 ? GPT_BYTE : end_byte);
 
 	  coding->src_multibyte = (end - start) < (end_byte - start_byte);
-	  if (CODING_REQUIRE_ENCODING (coding))
+	  if (CODING_REQUIRE_ENCODING (coding)
+	      && ! (coding->src_multibyte
+		    && encode_coding_passthrough_p (coding,
+						    BYTE_POS_ADDR (start_byte),
+						    stop_byte - start_byte)))
 	    {
 	      ptrdiff_t nchars = min (end - start, E_WRITE_MAX);
 
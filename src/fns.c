@@ -2920,7 +2920,8 @@ internal_equal (Lisp_Object o1, Lisp_Object o2, enum equal_kind equal_kind,
 	  {
 	    return (XMARKER (o1)->buffer == XMARKER (o2)->buffer
 		    && (XMARKER (o1)->buffer == 0
-			|| XMARKER (o1)->bytepos == XMARKER (o2)->bytepos));
+			|| (marker_bytepos (XMARKER (o1))
+			    == marker_bytepos (XMARKER (o2)))));
 	  }
 	if (BOOL_VECTOR_P (o1))
 	  {
@@ -3119,8 +3120,8 @@ value_cmp (Lisp_Object a, Lisp_Object b, int maxdepth)
 		  int cmp = value_cmp (buf_a, buf_b, maxdepth - 1);
 		  if (cmp != 0)
 		    return cmp;
-		  ptrdiff_t pa = XMARKER (a)->charpos;
-		  ptrdiff_t pb = XMARKER (b)->charpos;
+		  ptrdiff_t pa = marker_charpos (XMARKER (a));
+		  ptrdiff_t pb = marker_charpos (XMARKER (b));
 		  return pa < pb ? -1 : pa > pb;
 		}
 
@@ -5531,7 +5532,7 @@ sxhash_obj (Lisp_Object obj, int depth)
 	else if (pvec_type == PVEC_MARKER)
 	  {
 	    ptrdiff_t bytepos
-	      = XMARKER (obj)->buffer ? XMARKER (obj)->bytepos : 0;
+	      = XMARKER (obj)->buffer ? marker_bytepos (XMARKER (obj)) : 0;
 	    EMACS_UINT hash
 	      = sxhash_combine ((intptr_t) XMARKER (obj)->buffer, bytepos);
 	    return hash;
@@ -6454,6 +6455,66 @@ It should not be used for anything security-related.  See
   return make_digest_string (digest, SHA1_DIGEST_SIZE);
 }
 
+DEFUN ("buffer-incremental-hash", Fbuffer_incremental_hash,
+       Sbuffer_incremental_hash, 0, 1, 0,
+       doc: /* Return a hash of the contents of BUFFER-OR-NAME that is cheap to update.
+This is like `buffer-hash', but the hash is not SHA-1: in a buffer
+larger than a few kilobytes, it is combined from hashes of blocks of
+the text, which are kept until the text of the block changes.  So
+computing it again after a change takes time proportional to the size
+of the change rather than to that of the buffer.  If nil,
+BUFFER-OR-NAME stands for the current buffer.
+
+The hash depends only on the raw internal contents of the buffer, and
+is meant for comparing buffers in the same Emacs session.  It should
+not be used for anything security-related.  */)
+  (Lisp_Object buffer_or_name)
+{
+  Lisp_Object buffer = (NILP (buffer_or_name) ? Fcurrent_buffer ()
+			: Fget_buffer (buffer_or_name));
+  if (NILP (buffer))
+    nsberror (buffer_or_name);
+
+  uint_least64_t h[3];
+  buffer_text_hash (XBUFFER (buffer), h);
+  char hex[2 * 8 + 16 + 1];
+  return make_formatted_string (hex, "%08"PRIxLEAST64"%08"PRIxLEAST64
+				"%016"PRIxLEAST64, h[0], h[1], h[2]);
+}
+
+DEFUN ("buffer-changed-blocks", Fbuffer_changed_blocks,
+       Sbuffer_changed_blocks, 0, 1, 0,
+       doc: /* Return the parts of BUFFER-OR-NAME that changed since the last call.
+The value is a list of conses (BEG . END) of buffer positions, in
+increasing order, which together cover the text inserted or modified
+since the previous call of this function for the same buffer, as well
+as the places where text was deleted.  The first call covers the whole
+buffer.  The value is nil if the text did not change.  If nil,
+BUFFER-OR-NAME stands for the current buffer.  Narrowing is ignored.
+
+Changes are tracked in blocks of about a kilobyte, so the regions can
+include some unchanged text around the changes.  In a large buffer,
+this function takes time proportional to the number of changed
+blocks, not to the size of the buffer.  */)
+  (Lisp_Object buffer_or_name)
+{
+  Lisp_Object buffer = (NILP (buffer_or_name) ? Fcurrent_buffer ()
+			: Fget_buffer (buffer_or_name));
+  if (NILP (buffer))
+    nsberror (buffer_or_name);
+  struct buffer *b = XBUFFER (buffer);
+
+  if (b->text->changed_blocks_modiff == BUF_CHARS_MODIFF (b))
+    return Qnil;
+  b->text->changed_blocks_modiff = BUF_CHARS_MODIFF (b);
+
+  Lisp_Object regions = buffer_changed_segments (b);
+  if (EQ (regions, Qt))
+    regions = list1 (Fcons (make_fixnum (BUF_BEG (b)),
+			    make_fixnum (BUF_Z (b))));
+  return regions;
+}
+
 DEFUN ("buffer-line-statistics", Fbuffer_line_statistics,
        Sbuffer_line_statistics, 0, 1, 0,
        doc: /* Return data about lines in BUFFER.
@@ -6630,7 +6691,8 @@ DEFUN ("object-intervals", Fobject_intervals, Sobject_intervals, 1, 1, 0,
 OBJECT must be a buffer or a string.
 
 Altering this copy does not change the layout of the text properties
-in OBJECT.  */)
+in OBJECT.  The property lists in it are those of the text, however,
+as with `text-properties-at', so do not modify them.  */)
   (register Lisp_Object object)
 {
   INTERVAL intervals;
@@ -6913,6 +6975,8 @@ For best results this should end in a space.  */);
   defsubr (&Ssecure_hash_algorithms);
   defsubr (&Ssecure_hash);
   defsubr (&Sbuffer_hash);
+  defsubr (&Sbuffer_incremental_hash);
+  defsubr (&Sbuffer_changed_blocks);
   defsubr (&Slocale_info);
   defsubr (&Sbuffer_line_statistics);
 
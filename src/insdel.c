@@ -37,7 +37,8 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 
 static void insert_from_string_1 (Lisp_Object, ptrdiff_t, ptrdiff_t, ptrdiff_t,
 				  ptrdiff_t, bool, bool);
-static void insert_from_buffer_1 (struct buffer *, ptrdiff_t, ptrdiff_t, bool);
+static void insert_from_buffer_1 (struct buffer *, ptrdiff_t, ptrdiff_t, bool,
+				  bool);
 static void gap_left (ptrdiff_t, ptrdiff_t, bool);
 static void gap_right (ptrdiff_t, ptrdiff_t);
 
@@ -72,11 +73,11 @@ check_markers (void)
     {
       if (tail->buffer->text != current_buffer->text)
 	emacs_abort ();
-      if (tail->charpos > Z)
+      if (marker_charpos (tail) > Z)
 	emacs_abort ();
-      if (tail->bytepos > Z_BYTE)
+      if (marker_bytepos (tail) > Z_BYTE)
 	emacs_abort ();
-      if (multibyte && ! CHAR_HEAD_P (FETCH_BYTE (tail->bytepos)))
+      if (multibyte && ! CHAR_HEAD_P (FETCH_BYTE (marker_bytepos (tail))))
 	emacs_abort ();
     }
 }
@@ -116,6 +117,10 @@ gap_left (ptrdiff_t charpos, ptrdiff_t bytepos, bool newgap)
   if (!newgap)
     BUF_COMPUTE_UNCHANGED (current_buffer, charpos, GPT);
 
+  /* The text from BYTEPOS to the gap moves to the end of the gap.  */
+  unshare_buffer_bytes (current_buffer, bytepos - BEG_BYTE,
+			GPT_BYTE - BEG_BYTE + GAP_SIZE);
+
   i = GPT_BYTE;
   to = GAP_END_ADDR;
   from = GPT_ADDR;
@@ -178,6 +183,10 @@ gap_right (ptrdiff_t charpos, ptrdiff_t bytepos)
 
   BUF_COMPUTE_UNCHANGED (current_buffer, charpos, GPT);
 
+  /* The text from the gap to BYTEPOS moves to the start of the gap.  */
+  unshare_buffer_bytes (current_buffer, GPT_BYTE - BEG_BYTE,
+			bytepos - BEG_BYTE + GAP_SIZE);
+
   i = GPT_BYTE;
   from = GAP_END_ADDR;
   to = GPT_ADDR;
@@ -231,8 +240,8 @@ adjust_suspend_auto_hscroll (ptrdiff_t from, ptrdiff_t to)
 
       if (BUFFERP (w->contents)
 	  && XBUFFER (w->contents) == current_buffer
-	  && XMARKER (w->old_pointm)->charpos >= from
-	  && XMARKER (w->old_pointm)->charpos <= to)
+	  && marker_charpos (XMARKER (w->old_pointm)) >= from
+	  && marker_charpos (XMARKER (w->old_pointm)) <= to)
 	w->suspend_auto_hscroll = 0;
     }
 }
@@ -249,29 +258,15 @@ void
 adjust_markers_for_delete (ptrdiff_t from, ptrdiff_t from_byte,
 			   ptrdiff_t to, ptrdiff_t to_byte)
 {
-  struct Lisp_Marker *m;
-  ptrdiff_t charpos;
-
   adjust_suspend_auto_hscroll (from, to);
-  for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-    {
-      charpos = m->charpos;
-      eassert (charpos <= Z);
 
-      /* If the marker is after the deletion,
-	 relocate by number of chars / bytes deleted.  */
-      if (charpos > to)
-	{
-	  m->charpos -= to - from;
-	  m->bytepos -= to_byte - from_byte;
-	}
-      /* Here's the case where a marker is inside text being deleted.  */
-      else if (charpos > from)
-	{
-	  m->charpos = from;
-	  m->bytepos = from_byte;
-	}
-    }
+  /* Markers inside the text being deleted move to its start, and
+     those after it are relocated by the number of chars / bytes
+     deleted.  */
+  collapse_markers (current_buffer, from, from_byte, to);
+  shift_markers (current_buffer, to, true,
+		 from - to, from_byte - to_byte);
+  adjust_charpos_index (from, from_byte, to - from, to_byte - from_byte, 0, 0);
   adjust_overlays_for_delete (from, to - from);
 }
 
@@ -288,30 +283,14 @@ static void
 adjust_markers_for_insert (ptrdiff_t from, ptrdiff_t from_byte,
 			   ptrdiff_t to, ptrdiff_t to_byte, bool before_markers)
 {
-  struct Lisp_Marker *m;
   ptrdiff_t nchars = to - from;
   ptrdiff_t nbytes = to_byte - from_byte;
 
   adjust_suspend_auto_hscroll (from, to);
-  for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-    {
-      eassert (m->bytepos >= m->charpos
-	       && m->bytepos - m->charpos <= Z_BYTE - Z);
-
-      if (m->bytepos == from_byte)
-	{
-	  if (m->insertion_type || before_markers)
-	    {
-	      m->bytepos = to_byte;
-	      m->charpos = to;
-	    }
-	}
-      else if (m->bytepos > from_byte)
-	{
-	  m->bytepos += nbytes;
-	  m->charpos += nchars;
-	}
-    }
+  shift_markers (current_buffer, from, before_markers, nchars, nbytes);
+  if (!before_markers)
+    advance_markers (current_buffer, from, to, to_byte);
+  adjust_charpos_index (from, from_byte, 0, 0, nchars, nbytes);
   adjust_overlays_for_insert (from, to - from, before_markers);
 }
 
@@ -343,8 +322,6 @@ adjust_markers_for_replace (ptrdiff_t from, ptrdiff_t from_byte,
 			    ptrdiff_t old_chars, ptrdiff_t old_bytes,
 			    ptrdiff_t new_chars, ptrdiff_t new_bytes)
 {
-  register struct Lisp_Marker *m;
-  ptrdiff_t prev_to_byte = from_byte + old_bytes;
   ptrdiff_t diff_chars = new_chars - old_chars;
   ptrdiff_t diff_bytes = new_bytes - old_bytes;
 
@@ -354,22 +331,14 @@ adjust_markers_for_replace (ptrdiff_t from, ptrdiff_t from_byte,
      insertion, but the behavior we provide here in that case is that of
      `insert-before-markers` rather than that of `insert`.
      Maybe not a bug, but not a feature either.  */
-  for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-    {
-      if (m->bytepos >= prev_to_byte)
-	{
-	  m->charpos += diff_chars;
-	  m->bytepos += diff_bytes;
-	}
-      else if (m->bytepos > from_byte)
-	{
-	  m->charpos = from;
-	  m->bytepos = from_byte;
-	}
-    }
+  collapse_markers (current_buffer, from, from_byte, from + old_chars);
+  shift_markers (current_buffer, from + old_chars, true,
+		 diff_chars, diff_bytes);
 
   check_markers ();
 
+  adjust_charpos_index (from, from_byte, old_chars, old_bytes,
+			new_chars, new_bytes);
   adjust_overlays_for_insert (from + old_chars, new_chars, true);
   if (old_chars)
     adjust_overlays_for_delete (from, old_chars);
@@ -406,41 +375,25 @@ void
 adjust_markers_bytepos (ptrdiff_t from, ptrdiff_t from_byte,
 			ptrdiff_t to, ptrdiff_t to_byte, int to_z)
 {
-  register struct Lisp_Marker *m;
+  struct Lisp_Marker *m;
   ptrdiff_t beg = from, begbyte = from_byte;
+  bool unibyte = Z == Z_BYTE || (!to_z && to == to_byte);
 
   adjust_suspend_auto_hscroll (from, to);
 
-  if (Z == Z_BYTE || (!to_z && to == to_byte))
+  /* Recompute each affected marker's bytepos, or make sure it is
+     equal to its charpos.  The markers come in order of position,
+     so each is counted from the previous one.  */
+  for (m = marker_tree_first (current_buffer, from + 1);
+       m && (to_z || marker_charpos (m) <= to);
+       m = marker_tree_next (m))
     {
-      /* Make sure each affected marker's bytepos is equal to
-	 its charpos.  */
-      for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-	{
-	  if (m->bytepos > from_byte
-	      && (to_z || m->bytepos <= to_byte))
-	    m->bytepos = m->charpos;
-	}
-    }
-  else
-    {
-      for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-	{
-	  /* Recompute each affected marker's bytepos.  */
-	  if (m->bytepos > from_byte
-	      && (to_z || m->bytepos <= to_byte))
-	    {
-	      if (m->charpos < beg
-		  && beg - m->charpos > m->charpos - from)
-		{
-		  beg = from;
-		  begbyte = from_byte;
-		}
-	      m->bytepos = count_bytes (beg, begbyte, m->charpos);
-	      beg = m->charpos;
-	      begbyte = m->bytepos;
-	    }
-	}
+      ptrdiff_t charpos = marker_charpos (m);
+      ptrdiff_t bytepos = (unibyte ? charpos
+			   : count_bytes (beg, begbyte, charpos));
+      move_marker (m, charpos, bytepos);
+      beg = charpos;
+      begbyte = bytepos;
     }
 
   /* Make sure cached charpos/bytepos is invalid.  */
@@ -529,6 +482,10 @@ make_gap_smaller (ptrdiff_t nbytes_removed)
   tem = Vinhibit_quit;
   Vinhibit_quit = Qt;
 
+  /* The text after the gap moves down.  */
+  unshare_buffer_bytes (current_buffer, GPT_BYTE - BEG_BYTE,
+			Z_BYTE - BEG_BYTE + GAP_SIZE);
+
   real_gap_loc = GPT;
   real_gap_loc_byte = GPT_BYTE;
   new_gap_size = GAP_SIZE - nbytes_removed;
@@ -606,6 +563,41 @@ make_gap_1 (struct buffer *b, ptrdiff_t nbytes)
   current_buffer = oldb;
 }
 
+/* Move the gap to CHARPOS/BYTEPOS and make it at least NBYTES long.
+   Enlarging the gap copies all the text after it, so in a large
+   buffer it matters where that happens: when the gap is moving left,
+   enlarge it first, while less text follows it.  */
+
+static void
+move_gap_and_reserve (ptrdiff_t charpos, ptrdiff_t bytepos, ptrdiff_t nbytes)
+{
+  if (GAP_SIZE < nbytes && bytepos < GPT_BYTE)
+    make_gap (nbytes - GAP_SIZE);
+  if (charpos != GPT)
+    move_gap_both (charpos, bytepos);
+  if (GAP_SIZE < nbytes)
+    make_gap (nbytes - GAP_SIZE);
+}
+
+/* Move the gap into or next to the text from FROM/FROM_BYTE to
+   TO/TO_BYTE, which is about to be replaced with text NBYTES longer.
+   As in move_gap_and_reserve, if the gap has to move left, enlarge it
+   beforehand; the caller still enlarges it if it has to move right.  */
+
+static void
+move_gap_to_range (ptrdiff_t from, ptrdiff_t from_byte,
+		   ptrdiff_t to, ptrdiff_t to_byte, ptrdiff_t nbytes)
+{
+  if (from > GPT)
+    gap_right (from, from_byte);
+  if (to < GPT)
+    {
+      if (GAP_SIZE < nbytes)
+	make_gap (nbytes - GAP_SIZE);
+      gap_left (to, to_byte, 0);
+    }
+}
+
 /* Copy NBYTES bytes of text from FROM_ADDR to TO_ADDR.
    FROM_MULTIBYTE says whether the incoming text is multibyte.
    TO_MULTIBYTE says whether to store the text as multibyte.
@@ -897,10 +889,7 @@ insert_1_both (const char *string,
        or make it smaller.  */
     prepare_to_modify_buffer (PT, PT, NULL);
 
-  if (PT != GPT)
-    move_gap_both (PT, PT_BYTE);
-  if (GAP_SIZE < nbytes)
-    make_gap (nbytes - GAP_SIZE);
+  move_gap_and_reserve (PT, PT_BYTE, nbytes);
 
 #ifdef BYTE_COMBINING_DEBUG
   if (count_combining_before (string, nbytes, PT, PT_BYTE)
@@ -1022,10 +1011,7 @@ insert_from_string_1 (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
      or make it smaller.  */
   prepare_to_modify_buffer (PT, PT, NULL);
 
-  if (PT != GPT)
-    move_gap_both (PT, PT_BYTE);
-  if (GAP_SIZE < outgoing_nbytes)
-    make_gap (outgoing_nbytes - GAP_SIZE);
+  move_gap_and_reserve (PT, PT_BYTE, outgoing_nbytes);
 
   /* Copy the string text into the buffer, perhaps converting
      between single-byte and multibyte.  */
@@ -1170,12 +1156,17 @@ insert_from_gap (ptrdiff_t nchars, ptrdiff_t nbytes, bool text_at_gap_tail)
    current buffer.  If the text in BUF has properties, they are absorbed
    into the current buffer.
 
+   If SHARE, the current buffer is empty and this inserts the whole of
+   a large BUF, share BUF's text instead of copying it; see
+   share_buffer_text.
+
    It does not work to use `insert' for this, because a malloc could happen
    and relocate BUF's text before the copy happens.  */
 
 void
 insert_from_buffer (struct buffer *buf,
-		    ptrdiff_t charpos, ptrdiff_t nchars, bool inherit)
+		    ptrdiff_t charpos, ptrdiff_t nchars, bool inherit,
+		    bool share)
 {
   ptrdiff_t opoint = PT;
 
@@ -1183,7 +1174,7 @@ insert_from_buffer (struct buffer *buf,
   ptrdiff_t obyte = PT_BYTE;
 #endif
 
-  insert_from_buffer_1 (buf, charpos, nchars, inherit);
+  insert_from_buffer_1 (buf, charpos, nchars, inherit, share);
   signal_after_change (opoint, 0, PT - opoint);
   update_compositions (opoint, PT, CHECK_BORDER);
 
@@ -1200,7 +1191,8 @@ insert_from_buffer (struct buffer *buf,
 
 static void
 insert_from_buffer_1 (struct buffer *buf,
-		      ptrdiff_t from, ptrdiff_t nchars, bool inherit)
+		      ptrdiff_t from, ptrdiff_t nchars, bool inherit,
+		      bool share)
 {
   ptrdiff_t chunk, chunk_expanded;
   ptrdiff_t from_byte = buf_charpos_to_bytepos (buf, from);
@@ -1208,6 +1200,7 @@ insert_from_buffer_1 (struct buffer *buf,
   ptrdiff_t incoming_nbytes = to_byte - from_byte;
   ptrdiff_t outgoing_nbytes = incoming_nbytes;
   INTERVAL intervals;
+  bool shared;
 
   if (nchars == 0)
     return;
@@ -1248,32 +1241,39 @@ insert_from_buffer_1 (struct buffer *buf,
      or make it smaller.  */
   prepare_to_modify_buffer (PT, PT, NULL);
 
-  if (PT != GPT)
-    move_gap_both (PT, PT_BYTE);
-  if (GAP_SIZE < outgoing_nbytes)
-    make_gap (outgoing_nbytes - GAP_SIZE);
-
-  if (from < BUF_GPT (buf))
+  /* Copying the whole of BUF into an empty buffer can share BUF's
+     text instead, until one of the buffers changes.  */
+  shared = (share && Z == BEG && from == BUF_BEG (buf)
+	    && nchars == BUF_Z (buf) - BUF_BEG (buf)
+	    && (NILP (BVAR (buf, enable_multibyte_characters))
+		== NILP (BVAR (current_buffer, enable_multibyte_characters)))
+	    && share_buffer_text (current_buffer, buf));
+  if (!shared)
     {
-      chunk = BUF_GPT_BYTE (buf) - from_byte;
-      if (chunk > incoming_nbytes)
-	chunk = incoming_nbytes;
-      /* Record number of output bytes, so we know where
-	 to put the output from the second copy_text.  */
-      chunk_expanded
-	= copy_text (BUF_BYTE_ADDRESS (buf, from_byte),
-		     GPT_ADDR, chunk,
-		     ! NILP (BVAR (buf, enable_multibyte_characters)),
-		     ! NILP (BVAR (current_buffer, enable_multibyte_characters)));
-    }
-  else
-    chunk_expanded = chunk = 0;
+      move_gap_and_reserve (PT, PT_BYTE, outgoing_nbytes);
+
+      if (from < BUF_GPT (buf))
+	{
+	  chunk = BUF_GPT_BYTE (buf) - from_byte;
+	  if (chunk > incoming_nbytes)
+	    chunk = incoming_nbytes;
+	  /* Record number of output bytes, so we know where
+	     to put the output from the second copy_text.  */
+	  chunk_expanded
+	    = copy_text (BUF_BYTE_ADDRESS (buf, from_byte),
+			 GPT_ADDR, chunk,
+			 ! NILP (BVAR (buf, enable_multibyte_characters)),
+			 ! NILP (BVAR (current_buffer, enable_multibyte_characters)));
+	}
+      else
+	chunk_expanded = chunk = 0;
 
-  if (chunk < incoming_nbytes)
-    copy_text (BUF_BYTE_ADDRESS (buf, from_byte + chunk),
-	       GPT_ADDR + chunk_expanded, incoming_nbytes - chunk,
-	       ! NILP (BVAR (buf, enable_multibyte_characters)),
-	       ! NILP (BVAR (current_buffer, enable_multibyte_characters)));
+      if (chunk < incoming_nbytes)
+	copy_text (BUF_BYTE_ADDRESS (buf, from_byte + chunk),
+		   GPT_ADDR + chunk_expanded, incoming_nbytes - chunk,
+		   ! NILP (BVAR (buf, enable_multibyte_characters)),
+		   ! NILP (BVAR (current_buffer, enable_multibyte_characters)));
+    }
 
 #ifdef BYTE_COMBINING_DEBUG
   /* We have copied text into the gap, but we have not altered
@@ -1308,6 +1308,8 @@ insert_from_buffer_1 (struct buffer *buf,
   adjust_markers_for_insert (PT, PT_BYTE, PT + nchars,
 			     PT_BYTE + outgoing_nbytes,
 			     false);
+  if (shared)
+    copy_charpos_index (current_buffer, buf);
 
   offset_intervals (current_buffer, PT, nchars);
 
@@ -1466,11 +1468,11 @@ replace_range (ptrdiff_t from, ptrdiff_t to, Lisp_Object new,
     outgoing_insbytes
       = count_size_as_multibyte (SDATA (new), insbytes);
 
+  unshare_buffer_range (current_buffer, from_byte, to_byte);
+
   /* Make sure the gap is somewhere in or next to what we are deleting.  */
-  if (from > GPT)
-    gap_right (from, from_byte);
-  if (to < GPT)
-    gap_left (to, to_byte, 0);
+  move_gap_to_range (from, from_byte, to, to_byte,
+		     outgoing_insbytes - nbytes_del);
 
   /* Even if we don't record for undo, we must keep the original text
      because we may have to recover it because of inappropriate byte
@@ -1618,11 +1620,10 @@ replace_range_2 (ptrdiff_t from, ptrdiff_t from_byte,
   if (nbytes_del <= 0 && insbytes == 0)
     return;
 
+  unshare_buffer_range (current_buffer, from_byte, to_byte);
+
   /* Make sure the gap is somewhere in or next to what we are deleting.  */
-  if (from > GPT)
-    gap_right (from, from_byte);
-  if (to < GPT)
-    gap_left (to, to_byte, 0);
+  move_gap_to_range (from, from_byte, to, to_byte, insbytes - nbytes_del);
 
   GAP_SIZE += nbytes_del;
   ZV -= nchars_del;
@@ -1888,6 +1889,8 @@ del_range_2 (ptrdiff_t from, ptrdiff_t from_byte,
   nchars_del = to - from;
   nbytes_del = to_byte - from_byte;
 
+  unshare_buffer_range (current_buffer, from_byte, to_byte);
+
   /* Make sure the gap is somewhere in or next to what we are deleting.  */
   if (from > GPT)
     gap_right (from, from_byte);
@@ -2003,6 +2006,18 @@ run_undoable_change (void)
 void
 prepare_to_modify_buffer_1 (ptrdiff_t start, ptrdiff_t end,
 			    ptrdiff_t *preserve_ptr)
+{
+  prepare_to_modify_buffer_2 (start, end, preserve_ptr, true);
+}
+
+/* Like prepare_to_modify_buffer_1, but if CHECK_TEXT is false, don't
+   check the text between START and END for read-only properties, nor
+   run its modification hooks: the caller did that for the parts of
+   it that change.  */
+
+void
+prepare_to_modify_buffer_2 (ptrdiff_t start, ptrdiff_t end,
+			    ptrdiff_t *preserve_ptr, bool check_text)
 {
   struct buffer *base_buffer;
   Lisp_Object temp;
@@ -2023,7 +2038,7 @@ prepare_to_modify_buffer_1 (ptrdiff_t start, ptrdiff_t end,
 
   bset_redisplay (current_buffer);
 
-  if (buffer_intervals (current_buffer))
+  if (check_text && buffer_intervals (current_buffer))
     {
       if (preserve_ptr)
 	{
@@ -2076,6 +2091,15 @@ prepare_to_modify_buffer (ptrdiff_t start, ptrdiff_t end,
 			  ptrdiff_t *preserve_ptr)
 {
   prepare_to_modify_buffer_1 (start, end, preserve_ptr);
+  /* Only now, since the change hooks could have shared the text.  */
+  if (current_buffer->text->share)
+    {
+      /* The hooks may have changed the text around START and END.  */
+      ptrdiff_t from = clip_to_bounds (BEG, min (start, end), Z);
+      ptrdiff_t to = clip_to_bounds (from, max (start, end), Z);
+      unshare_buffer_range (current_buffer, CHAR_TO_BYTE (from),
+			    CHAR_TO_BYTE (to));
+    }
   invalidate_buffer_caches (current_buffer, start, end);
 }
 
@@ -2127,6 +2151,7 @@ invalidate_buffer_caches (struct buffer *buf, ptrdiff_t start, ptrdiff_t end)
     invalidate_region_cache (buf,
                              buf->newline_cache,
                              start - BUF_BEG (buf), BUF_Z (buf) - end);
+  invalidate_charpos_index_text (buf, start, end);
   if (buf->width_run_cache)
     invalidate_region_cache (buf,
                              buf->width_run_cache,
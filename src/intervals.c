@@ -123,7 +123,8 @@ copy_properties (INTERVAL source, INTERVAL target)
     return;
 
   COPY_INTERVAL_CACHE (source, target);
-  set_interval_plist (target, Fcopy_sequence (source->plist));
+  /* Interval plists are never modified in place, so share it.  */
+  set_interval_plist (target, source->plist);
 }
 
 /* Merge the properties of interval SOURCE into the properties
@@ -134,12 +135,14 @@ static void
 merge_properties (register INTERVAL source, register INTERVAL target)
 {
   register Lisp_Object o, sym, val;
+  Lisp_Object plist;
 
   if (DEFAULT_INTERVAL_P (source) && DEFAULT_INTERVAL_P (target))
     return;
 
   MERGE_INTERVAL_CACHE (source, target);
 
+  plist = target->plist;
   o = source->plist;
   while (CONSP (o))
     {
@@ -147,7 +150,7 @@ merge_properties (register INTERVAL source, register INTERVAL target)
       o = XCDR (o);
       CHECK_CONS (o);
 
-      val = target->plist;
+      val = plist;
       while (CONSP (val) && !EQ (XCAR (val), sym))
 	{
 	  val = XCDR (val);
@@ -159,10 +162,13 @@ merge_properties (register INTERVAL source, register INTERVAL target)
       if (NILP (val))
 	{
 	  val = XCAR (o);
-	  set_interval_plist (target, Fcons (sym, Fcons (val, target->plist)));
+	  plist = Fcons (sym, Fcons (val, plist));
 	}
       o = XCDR (o);
     }
+
+  if (!EQ (plist, target->plist))
+    set_interval_plist (target, intern_interval_plist (plist));
 }
 
 /* Return true if the two intervals have the same properties.
@@ -180,6 +186,10 @@ intervals_equal_1 (INTERVAL i0, INTERVAL i1, bool use_equal)
   if (DEFAULT_INTERVAL_P (i0) || DEFAULT_INTERVAL_P (i1))
     return false;
 
+  /* Equal plists are usually the same interned list.  */
+  if (EQ (i0->plist, i1->plist))
+    return true;
+
   i0_cdr = i0->plist;
   i1_cdr = i1->plist;
   while (CONSP (i0_cdr) && CONSP (i1_cdr))
@@ -942,7 +952,9 @@ adjust_intervals_for_insertion (INTERVAL tree,
 	  RESET_INTERVAL (&newi);
 	  pleft = prev ? prev->plist : Qnil;
 	  pright = i ? i->plist : Qnil;
-	  set_interval_plist (&newi, merge_properties_sticky (pleft, pright));
+	  set_interval_plist (&newi,
+			      intern_interval_plist
+			      (merge_properties_sticky (pleft, pright)));
 
 	  if (! prev) /* i.e. position == BEG */
 	    {
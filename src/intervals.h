@@ -282,6 +282,7 @@ extern INTERVAL interval_of (ptrdiff_t, Lisp_Object);
 extern int invisible_prop (Lisp_Object, Lisp_Object);
 
 /* Defined in textprop.c.  */
+extern Lisp_Object intern_interval_plist (Lisp_Object);
 extern Lisp_Object copy_text_properties (Lisp_Object, Lisp_Object,
                                          Lisp_Object, Lisp_Object,
                                          Lisp_Object, Lisp_Object);
@@ -738,6 +738,99 @@ itree_insert (struct itree_tree *tree, struct itree_node *node,
   itree_insert_node (tree, node);
 }
 
+/* Return a balanced tree made of the N nodes NODES, which are sorted
+   by their begin.  The nodes at depth RED_DEPTH are red, the others
+   black: since all the levels above RED_DEPTH are complete, every path
+   then has the same number of black nodes.  */
+
+static struct itree_node *
+itree_build (struct itree_node **nodes, ptrdiff_t n, int depth,
+	     int red_depth, uintmax_t otick)
+{
+  if (n == 0)
+    return NULL;
+
+  ptrdiff_t mid = n / 2;
+  struct itree_node *node = nodes[mid];
+  node->left = itree_build (nodes, mid, depth + 1, red_depth, otick);
+  node->right = itree_build (nodes + mid + 1, n - mid - 1, depth + 1,
+			     red_depth, otick);
+  if (node->left)
+    node->left->parent = node;
+  if (node->right)
+    node->right->parent = node;
+  node->red = depth == red_depth;
+  node->offset = 0;
+  node->otick = otick;
+  node->limit = itree_newlimit (node);
+  return node;
+}
+
+static int
+itree_compare_begin (const void *a, const void *b)
+{
+  struct itree_node *const *na = a, *const *nb = b;
+  return ((*na)->begin > (*nb)->begin) - ((*na)->begin < (*nb)->begin);
+}
+
+/* Insert the N nodes NODES into TREE.  Their begin and end fields
+   must already be set.  When the new nodes are at least as many as
+   those in the tree, rebuild it from scratch, which takes linear time
+   if NODES is sorted by begin, rather than inserting them one by one.
+   The order of NODES may be changed.  */
+
+void
+itree_insert_many (struct itree_tree *tree, struct itree_node **nodes,
+		   ptrdiff_t n)
+{
+  if (n < tree->size)
+    {
+      for (ptrdiff_t i = 0; i < n; i++)
+	{
+	  nodes[i]->otick = tree->otick;
+	  itree_insert_node (tree, nodes[i]);
+	}
+      return;
+    }
+
+  ptrdiff_t i;
+  for (i = 1; i < n; i++)
+    if (nodes[i - 1]->begin > nodes[i]->begin)
+      break;
+  if (i < n)
+    qsort (nodes, n, sizeof *nodes, itree_compare_begin);
+
+  /* Merge the nodes already in the tree, which the iterator yields in
+     order and with their offsets applied, with the new ones.  */
+  ptrdiff_t size = tree->size + n;
+  struct itree_node **all = nodes;
+  if (tree->size)
+    {
+      struct itree_node *node;
+      all = xmalloc (size * sizeof *all);
+      i = 0;
+      ptrdiff_t j = 0;
+      ITREE_FOREACH (node, tree, PTRDIFF_MIN, PTRDIFF_MAX, ASCENDING)
+	{
+	  while (j < n && nodes[j]->begin < node->begin)
+	    all[i++] = nodes[j++];
+	  all[i++] = node;
+	}
+      while (j < n)
+	all[i++] = nodes[j++];
+    }
+
+  int red_depth = 0;
+  for (ptrdiff_t m = size + 1; m > 1; m >>= 1)
+    red_depth++;
+  tree->root = itree_build (all, size, 0, red_depth, tree->otick);
+  tree->root->parent = NULL;
+  tree->size = size;
+  if (all != nodes)
+    xfree (all);
+  eassert (check_tree (tree, true)); /* FIXME: Too expensive.  */
+}
+
 /* Safely modify a node's interval. */
 
 void
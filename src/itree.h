@@ -125,6 +125,8 @@ extern intmax_t itree_size (struct itree_tree *);
 extern void itree_clear (struct itree_tree *);
 extern void itree_insert (struct itree_tree *, struct itree_node *,
 			  ptrdiff_t, ptrdiff_t);
+extern void itree_insert_many (struct itree_tree *, struct itree_node **,
+			       ptrdiff_t);
 extern struct itree_node *itree_remove (struct itree_tree *,
 					struct itree_node *);
 extern void itree_insert_gap (struct itree_tree *, ptrdiff_t, ptrdiff_t, bool);
@@ -1047,6 +1047,9 @@ enum pvec_type
   PVEC_TS_NODE,
   PVEC_TS_COMPILED_QUERY,
   PVEC_SQLITE,
+  PVEC_REGEXP,
+  PVEC_STRING_MATCHER,
+  PVEC_BUFFER_SNAPSHOT,
 
   /* These should be last, for internal_equal and sxhash_obj.  */
   PVEC_COMPILED,
@@ -2855,12 +2858,16 @@ struct Lisp_Marker
      this is used to chain of all the markers in a given buffer.
      The chain does not preserve markers from garbage collection;
      instead, markers are removed from the chain when freed by GC.  */
-  /* We could remove it and use an array in buffer_text instead.
-     That would also allow us to preserve it ordered.  */
-  struct Lisp_Marker *next;
-  /* This is the char position where the marker points.  */
+  struct Lisp_Marker *next, *prev;
+  /* The same markers are also kept in a tree ordered by position
+     (see marker.c), so that insertions and deletions need not visit
+     every marker of the buffer.  These are the links in that tree.  */
+  struct Lisp_Marker *parent, *left, *right;
+  /* This is the char position where the marker points.  While the
+     marker is in its buffer's marker tree and has a parent, it is
+     relative to the parent's position; use marker_charpos to read it.  */
   ptrdiff_t charpos;
-  /* This is the byte position.
+  /* This is the byte position, relative to the parent's like CHARPOS.
      It's mostly used as a charpos<->bytepos cache (i.e. it's not directly
      used to implement the functionality of markers, but rather to (ab)use
      markers as a cache for char<->byte mappings).  */
@@ -2938,6 +2945,70 @@ struct Lisp_Sqlite
   bool is_statement;
 } GCALIGNED_STRUCT;
 
+/* A compiled regexp object; see `make-regexp' in search.c.  */
+struct Lisp_Regexp
+{
+  union vectorlike_header header;
+  /* The regexp string the object was made from.  */
+  Lisp_Object pattern;
+  /* The context PATTERN was last compiled in; these mirror the fields
+     of CACHE so that the garbage collector sees them.  */
+  Lisp_Object translate;
+  Lisp_Object whitespace_regexp;
+  Lisp_Object syntax_table;
+  /* The compiled form, private to search.c.  */
+  struct regexp_cache *cache;
+} GCALIGNED_STRUCT;
+
+/* An object for finding any of a set of strings; see
+   `make-string-matcher' in search.c.  */
+struct Lisp_String_Matcher
+{
+  union vectorlike_header header;
+  /* A vector of the strings the object was made from.  */
+  Lisp_Object strings;
+  /* The case canonicalization table, or nil if case matters.  */
+  Lisp_Object case_table;
+  /* The automata, private to search.c.  */
+  struct string_matcher *matcher;
+} GCALIGNED_STRUCT;
+
+/* An immutable copy of the text of a buffer; see `buffer-snapshot' in
+   buffer.c.  The text may be read from the memory of the buffer until
+   the buffer changes it, so like the text of a buffer, it may only be
+   accessed with the global lock held.  */
+struct Lisp_Buffer_Snapshot
+{
+  union vectorlike_header header;
+  /* The buffer the snapshot was taken of.  */
+  Lisp_Object buffer;
+  /* A vector of the text properties, as consecutive START, END and
+     PLIST elements in increasing order of START, or nil if the
+     snapshot has no properties.  */
+  Lisp_Object properties;
+  /* The rest is not traced by GC.  */
+  /* The text is NBYTES bytes long.  Its first PART1 bytes are at BASE,
+     and the others GAP bytes further, like the two parts of the text
+     of a buffer around its gap.  */
+  unsigned char *base;
+  ptrdiff_t part1, gap;
+  ptrdiff_t nchars, nbytes;
+  bool_bf multibyte : 1;
+  /* Non-NULL if BASE is the memory of the buffer's text; see
+     buffer.c.  */
+  struct text_share *share;
+  /* If BASE is the buffer's, the copies of the chunks of the text that
+     the buffer was about to change, or NULL for those still read from
+     BASE; NCOPIED counts the copies.  */
+  unsigned char **chunks;
+  ptrdiff_t ncopied;
+  /* The other snapshots that read the same buffer memory.  */
+  struct Lisp_Buffer_Snapshot *prev, *next;
+  /* The byte positions of every BUFFER_SNAPSHOT_INDEX_STEP-th
+     character, or NULL if not computed yet.  */
+  ptrdiff_t *index;
+} GCALIGNED_STRUCT;
+
 struct Lisp_User_Ptr
 {
   union vectorlike_header header;
@@ -2989,6 +3060,29 @@ XMARKER (Lisp_Object a)
   return XUNTAG (a, Lisp_Vectorlike, struct Lisp_Marker);
 }
 
+/* Return the character position of marker M, adding up the relative
+   positions along its path to the root of its buffer's marker tree.  */
+
+INLINE ptrdiff_t
+marker_charpos (struct Lisp_Marker const *m)
+{
+  ptrdiff_t charpos = 0;
+  for (; m; m = m->parent)
+    charpos += m->charpos;
+  return charpos;
+}
+
+/* Return the byte position of marker M.  */
+
+INLINE ptrdiff_t
+marker_bytepos (struct Lisp_Marker const *m)
+{
+  ptrdiff_t bytepos = 0;
+  for (; m; m = m->parent)
+    bytepos += m->bytepos;
+  return bytepos;
+}
+
 INLINE bool
 OVERLAYP (Lisp_Object x)
 {
@@ -3040,6 +3134,63 @@ XSQLITE (Lisp_Object a)
   return XUNTAG (a, Lisp_Vectorlike, struct Lisp_Sqlite);
 }
 
+INLINE bool
+REGEXPP (Lisp_Object x)
+{
+  return PSEUDOVECTORP (x, PVEC_REGEXP);
+}
+
+INLINE void
+CHECK_REGEXP (Lisp_Object x)
+{
+  CHECK_TYPE (REGEXPP (x), Qregexpp, x);
+}
+
+INLINE struct Lisp_Regexp *
+XREGEXP (Lisp_Object a)
+{
+  eassert (REGEXPP (a));
+  return XUNTAG (a, Lisp_Vectorlike, struct Lisp_Regexp);
+}
+
+INLINE bool
+STRING_MATCHER_P (Lisp_Object x)
+{
+  return PSEUDOVECTORP (x, PVEC_STRING_MATCHER);
+}
+
+INLINE void
+CHECK_STRING_MATCHER (Lisp_Object x)
+{
+  CHECK_TYPE (STRING_MATCHER_P (x), Qstring_matcher_p, x);
+}
+
+INLINE struct Lisp_String_Matcher *
+XSTRING_MATCHER (Lisp_Object a)
+{
+  eassert (STRING_MATCHER_P (a));
+  return XUNTAG (a, Lisp_Vectorlike, struct Lisp_String_Matcher);
+}
+
+INLINE bool
+BUFFER_SNAPSHOT_P (Lisp_Object x)
+{
+  return PSEUDOVECTORP (x, PVEC_BUFFER_SNAPSHOT);
+}
+
+INLINE void
+CHECK_BUFFER_SNAPSHOT (Lisp_Object x)
+{
+  CHECK_TYPE (BUFFER_SNAPSHOT_P (x), Qbuffer_snapshot_p, x);
+}
+
+INLINE struct Lisp_Buffer_Snapshot *
+XBUFFER_SNAPSHOT (Lisp_Object a)
+{
+  eassert (BUFFER_SNAPSHOT_P (a));
+  return XUNTAG (a, Lisp_Vectorlike, struct Lisp_Buffer_Snapshot);
+}
+
 INLINE bool
 BIGNUMP (Lisp_Object x)
 {
@@ -4347,7 +4498,8 @@ extern void insert_from_gap_1 (ptrdiff_t, ptrdiff_t, bool text_at_gap_tail);
 extern void insert_from_gap (ptrdiff_t, ptrdiff_t, bool text_at_gap_tail);
 extern void insert_from_string (Lisp_Object, ptrdiff_t, ptrdiff_t,
 				ptrdiff_t, ptrdiff_t, bool);
-extern void insert_from_buffer (struct buffer *, ptrdiff_t, ptrdiff_t, bool);
+extern void insert_from_buffer (struct buffer *, ptrdiff_t, ptrdiff_t, bool,
+				bool);
 extern void insert_char (int);
 extern void insert_string (const char *);
 extern void insert_before_markers (const char *, ptrdiff_t);
@@ -4365,6 +4517,8 @@ extern int safe_del_range (ptrdiff_t, ptrdiff_t);
 extern void modify_text (ptrdiff_t, ptrdiff_t);
 extern void prepare_to_modify_buffer (ptrdiff_t, ptrdiff_t, ptrdiff_t *);
 extern void prepare_to_modify_buffer_1 (ptrdiff_t, ptrdiff_t, ptrdiff_t *);
+extern void prepare_to_modify_buffer_2 (ptrdiff_t, ptrdiff_t, ptrdiff_t *,
+					bool);
 extern void invalidate_buffer_caches (struct buffer *, ptrdiff_t, ptrdiff_t);
 extern void signal_after_change (ptrdiff_t, ptrdiff_t, ptrdiff_t);
 extern void adjust_after_insert (ptrdiff_t, ptrdiff_t, ptrdiff_t,
@@ -4480,6 +4634,7 @@ flush_stack_call_func (void (*func) (void *arg), void *arg)
 
 extern void garbage_collect (void);
 extern void maybe_garbage_collect (void);
+extern void request_maybe_gc (void);
 extern bool maybe_garbage_collect_eagerly (EMACS_INT factor);
 extern const char *pending_malloc_warning;
 extern Lisp_Object zero_vector;
@@ -4966,10 +5121,33 @@ extern void syms_of_buffer (void);
 extern ptrdiff_t marker_position (Lisp_Object);
 extern ptrdiff_t marker_byte_position (Lisp_Object);
 extern void clear_charpos_cache (struct buffer *);
+extern void adjust_charpos_index (ptrdiff_t, ptrdiff_t, ptrdiff_t, ptrdiff_t,
+				  ptrdiff_t, ptrdiff_t);
+extern void invalidate_charpos_index_text (struct buffer *,
+					    ptrdiff_t, ptrdiff_t);
+extern void copy_charpos_index (struct buffer *, struct buffer *);
+extern bool buffer_line_index_p (struct buffer *);
+extern ptrdiff_t buffer_newlines_before (struct buffer *, ptrdiff_t);
+extern ptrdiff_t buffer_newline_position (struct buffer *, ptrdiff_t);
+extern void buffer_text_hash (struct buffer *, uint_least64_t[3]);
+extern Lisp_Object buffer_changed_segments (struct buffer *);
 extern ptrdiff_t buf_charpos_to_bytepos (struct buffer *, ptrdiff_t);
 extern ptrdiff_t buf_bytepos_to_charpos (struct buffer *, ptrdiff_t);
 extern void detach_marker (Lisp_Object);
 extern void unchain_marker (struct Lisp_Marker *);
+extern void attach_marker (struct Lisp_Marker *, struct buffer *,
+			   ptrdiff_t, ptrdiff_t);
+extern void move_marker (struct Lisp_Marker *, ptrdiff_t, ptrdiff_t);
+extern struct Lisp_Marker *marker_tree_first (struct buffer *, ptrdiff_t);
+extern struct Lisp_Marker *marker_tree_next (struct Lisp_Marker *);
+extern void shift_markers (struct buffer *, ptrdiff_t, bool,
+			   ptrdiff_t, ptrdiff_t);
+extern void collapse_markers (struct buffer *, ptrdiff_t, ptrdiff_t,
+			      ptrdiff_t);
+extern void advance_markers (struct buffer *, ptrdiff_t, ptrdiff_t,
+			     ptrdiff_t);
+extern void flatten_marker_tree (struct buffer *);
+extern void rebuild_marker_tree (struct buffer *);
 extern Lisp_Object set_marker_restricted (Lisp_Object, Lisp_Object, Lisp_Object);
 extern Lisp_Object set_marker_both (Lisp_Object, Lisp_Object, ptrdiff_t, ptrdiff_t);
 extern Lisp_Object set_marker_restricted_both (Lisp_Object, Lisp_Object,
@@ -5007,6 +5185,10 @@ extern void syms_of_fileio (void);
 
 /* Defined in search.c.  */
 extern void shrink_regexp_cache (void);
+extern void mark_regexp_cache (void);
+extern void pin_regexp (Lisp_Object);
+extern void free_compiled_regexp (struct Lisp_Regexp *);
+extern void free_string_matcher (struct Lisp_String_Matcher *);
 extern void restore_search_regs (void);
 extern void update_search_regs (ptrdiff_t oldstart,
                                 ptrdiff_t oldend, ptrdiff_t newend);
@@ -5268,6 +5450,7 @@ extern void syms_of_macros (void);
 
 /* Defined in undo.c.  */
 extern void truncate_undo_list (struct buffer *);
+extern void truncate_grown_undo_lists (void);
 extern void record_insert (ptrdiff_t, ptrdiff_t);
 extern void record_delete (ptrdiff_t, Lisp_Object, bool);
 extern void record_first_change (void);
@@ -359,8 +359,8 @@ readchar (Lisp_Object readcharfun, bool *multibyte)
 	  bytepos++;
 	}
 
-      XMARKER (readcharfun)->bytepos = bytepos;
-      XMARKER (readcharfun)->charpos++;
+      move_marker (XMARKER (readcharfun),
+		   marker_position (readcharfun) + 1, bytepos);
 
       return c;
     }
@@ -529,15 +529,15 @@ unreadchar (Lisp_Object readcharfun, int c)
   else if (MARKERP (readcharfun))
     {
       struct buffer *b = XMARKER (readcharfun)->buffer;
-      ptrdiff_t bytepos = XMARKER (readcharfun)->bytepos;
+      ptrdiff_t bytepos = marker_byte_position (readcharfun);
 
-      XMARKER (readcharfun)->charpos--;
       if (! NILP (BVAR (b, enable_multibyte_characters)))
 	bytepos -= buf_prev_char_len (b, bytepos);
       else
 	bytepos--;
 
-      XMARKER (readcharfun)->bytepos = bytepos;
+      move_marker (XMARKER (readcharfun),
+		   marker_position (readcharfun) - 1, bytepos);
     }
   else if (STRINGP (readcharfun))
     {
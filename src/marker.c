@@ -75,13 +75,1302 @@ byte_char_debug_check (struct buffer *b, ptrdiff_t charpos, ptrdiff_t bytepos)
 
 #endif /* MARKER_DEBUG */
 
+/* The char/byte position index of a buffer's text.
+
+   In a large multibyte buffer, the text is divided into segments of
+   about CHARPOS_SEGMENT_BYTES bytes, which are kept in order in a
+   treap (a binary search tree balanced by random priorities) with
+   their lengths in characters and bytes and the totals of each
+   subtree.  Finding the segment that holds a position takes a
+   logarithmic number of steps however many markers the buffer has,
+   and leaves at most a segment to scan.  The index is built when a
+   conversion first needs it and then kept up to date by insdel.c
+   through adjust_charpos_index, with small changes applied to the
+   segment they fall in.
+
+   The segments also record how many newlines they hold, for the line
+   queries made when `buffer-line-index-mode' is on.  These counts are
+   filled in lazily: a count of -1 means unknown, and a change to the
+   text only makes the counts of the segments it touches unknown,
+   until the next line query counts them again.
+
+   In the same way, the segments record a hash of their text, which
+   `buffer-incremental-hash' combines into a hash of the whole text,
+   and whether their text changed since `buffer-changed-blocks' last
+   looked.  The hash of a string of bytes is the value of the
+   polynomial whose coefficients are the bytes plus 1 at fixed points,
+   in three lanes: two modulo the prime 2^31 - 1 and one modulo 2^64.
+   The hash of a concatenation AB is then hash (A) * X^len(B) + hash (B)
+   in each lane, so the hash of a text does not depend on how it is
+   divided into segments.  */
+
+enum { CHARPOS_SEGMENT_BYTES = 1024 };
+
+enum { TEXT_HASH_LANES = 3 };
+
+/* The value of the first lane of an unknown hash.  */
+#define TEXT_HASH_UNKNOWN UINT_LEAST64_MAX
+
+/* The modulus of the first two lanes.  */
+#define TEXT_HASH_PRIME 0x7fffffff
+
+static uint_least64_t const text_hash_base[TEXT_HASH_LANES]
+  = { 48271, 1103515245, 0x9e3779b97f4a7c15 };
+
+/* Buffers smaller than this are not indexed.  */
+enum { CHARPOS_INDEX_MIN_BYTES = 8 * CHARPOS_SEGMENT_BYTES };
+
+struct charpos_segment
+{
+  struct charpos_segment *left, *right;
+  unsigned int priority;
+  /* The length of this segment, and the number of newlines in it.  */
+  ptrdiff_t nchars, nbytes, nlines;
+  /* The totals for the segments in this subtree.  */
+  ptrdiff_t sum_chars, sum_bytes, sum_lines;
+  /* The hash of the text of this segment and that of the text of the
+     subtree; see above.  */
+  uint_least64_t hash[TEXT_HASH_LANES], sum_hash[TEXT_HASH_LANES];
+  /* True if the text of this segment, or of some segment of the
+     subtree, changed since `buffer-changed-blocks' last reported it.  */
+  bool_bf changed : 1;
+  bool_bf sum_changed : 1;
+};
+
+struct charpos_index
+{
+  struct charpos_segment *root;
+  ptrdiff_t nsegments;
+};
+
+static ptrdiff_t
+seg_chars (struct charpos_segment *t)
+{
+  return t ? t->sum_chars : 0;
+}
+
+static ptrdiff_t
+seg_bytes (struct charpos_segment *t)
+{
+  return t ? t->sum_bytes : 0;
+}
+
+static ptrdiff_t
+seg_lines (struct charpos_segment *t)
+{
+  return t ? t->sum_lines : 0;
+}
+
+static void
+seg_update_lines (struct charpos_segment *t)
+{
+  t->sum_lines = (t->nlines < 0 || seg_lines (t->left) < 0
+		  || seg_lines (t->right) < 0
+		  ? -1
+		  : seg_lines (t->left) + t->nlines + seg_lines (t->right));
+}
+
+/* Recompute the totals of T after it or its subtrees changed.  The
+   hash of the subtree is recomputed lazily, by hash_segments.  */
+
+static void
+seg_update (struct charpos_segment *t)
+{
+  t->sum_chars = seg_chars (t->left) + t->nchars + seg_chars (t->right);
+  t->sum_bytes = seg_bytes (t->left) + t->nbytes + seg_bytes (t->right);
+  seg_update_lines (t);
+  t->sum_hash[0] = TEXT_HASH_UNKNOWN;
+  t->sum_changed = (t->changed
+		    || (t->left && t->left->sum_changed)
+		    || (t->right && t->right->sum_changed));
+}
+
+/* Forget what is known about the text of T, which changed.  */
+
+static void
+seg_forget (struct charpos_segment *t)
+{
+  t->nlines = -1;
+  t->hash[0] = TEXT_HASH_UNKNOWN;
+  t->changed = true;
+}
+
+static struct charpos_segment *
+make_charpos_segment (struct charpos_index *idx,
+		      ptrdiff_t nchars, ptrdiff_t nbytes)
+{
+  /* A xorshift generator is random enough for balancing.  */
+  static unsigned int seed = 2463534242;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  struct charpos_segment *t = xmalloc (sizeof *t);
+  t->left = t->right = NULL;
+  t->priority = seed;
+  t->nchars = t->sum_chars = nchars;
+  t->nbytes = t->sum_bytes = nbytes;
+  seg_forget (t);
+  seg_update (t);
+  idx->nsegments++;
+  return t;
+}
+
+static void
+free_charpos_segments (struct charpos_index *idx, struct charpos_segment *t)
+{
+  while (t)
+    {
+      struct charpos_segment *right = t->right;
+      free_charpos_segments (idx, t->left);
+      xfree (t);
+      idx->nsegments--;
+      t = right;
+    }
+}
+
+/* Return the concatenation of the trees A and B.  */
+
+static struct charpos_segment *
+merge_charpos_segments (struct charpos_segment *a, struct charpos_segment *b)
+{
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+  if (a->priority >= b->priority)
+    {
+      a->right = merge_charpos_segments (a->right, b);
+      seg_update (a);
+      return a;
+    }
+  else
+    {
+      b->left = merge_charpos_segments (a, b->left);
+      seg_update (b);
+      return b;
+    }
+}
+
+/* Split the tree T at character offset C, byte offset C_BYTE, into
+   the tree *L of the text before it and the tree *R of the text after
+   it, splitting the segment that C falls in if necessary.  */
+
+static void
+split_charpos_segments (struct charpos_index *idx, struct charpos_segment *t,
+			ptrdiff_t c, ptrdiff_t c_byte,
+			struct charpos_segment **l, struct charpos_segment **r)
+{
+  if (!t)
+    {
+      *l = *r = NULL;
+      return;
+    }
+  ptrdiff_t lc = seg_chars (t->left), lb = seg_bytes (t->left);
+  if (c <= lc)
+    {
+      split_charpos_segments (idx, t->left, c, c_byte, l, &t->left);
+      *r = t;
+    }
+  else if (c >= lc + t->nchars)
+    {
+      split_charpos_segments (idx, t->right, c - lc - t->nchars,
+			      c_byte - lb - t->nbytes, &t->right, r);
+      *l = t;
+    }
+  else
+    {
+      struct charpos_segment *n
+	= make_charpos_segment (idx, lc + t->nchars - c,
+				lb + t->nbytes - c_byte);
+      n->priority = t->priority;
+      t->nchars -= n->nchars;
+      t->nbytes -= n->nbytes;
+      t->nlines = -1;
+      t->hash[0] = TEXT_HASH_UNKNOWN;
+      n->changed = t->changed;
+      n->right = t->right;
+      t->right = NULL;
+      seg_update (n);
+      *l = t;
+      *r = n;
+    }
+  seg_update (t);
+}
+
+/* Return a tree of segments for the text of B between byte positions
+   FROM_BYTE and TO_BYTE.  */
+
+static struct charpos_segment *
+scan_charpos_segments (struct charpos_index *idx, struct buffer *b,
+		       ptrdiff_t from_byte, ptrdiff_t to_byte)
+{
+  struct charpos_segment *t = NULL;
+  while (from_byte < to_byte)
+    {
+      ptrdiff_t end = min (to_byte, from_byte + CHARPOS_SEGMENT_BYTES);
+      while (end < to_byte && !CHAR_HEAD_P (BUF_FETCH_BYTE (b, end)))
+	end++;
+
+      /* Count the bytes that start characters, in the one or two
+	 parts of the text around the gap.  */
+      ptrdiff_t nchars = 0;
+      for (ptrdiff_t pos = from_byte; pos < end; )
+	{
+	  ptrdiff_t part_end = (pos < BUF_GPT_BYTE (b)
+				? min (end, BUF_GPT_BYTE (b)) : end);
+	  unsigned char *p = BUF_BYTE_ADDRESS (b, pos);
+	  for (ptrdiff_t i = 0; i < part_end - pos; i++)
+	    nchars += CHAR_HEAD_P (p[i]);
+	  pos = part_end;
+	}
+
+      t = merge_charpos_segments (t, make_charpos_segment (idx, nchars,
+							   end - from_byte));
+      from_byte = end;
+    }
+  return t;
+}
+
+static void
+free_charpos_index (struct buffer_text *text)
+{
+  struct charpos_index *idx = text->charpos_index;
+  if (idx)
+    {
+      free_charpos_segments (idx, idx->root);
+      xfree (idx);
+      text->charpos_index = NULL;
+    }
+}
+
+/* Return the index of B, building it if need be, or NULL if B is too
+   small to need one.  */
+
+static struct charpos_index *
+buffer_charpos_index (struct buffer *b)
+{
+  if (BUF_Z_BYTE (b) - BUF_BEG_BYTE (b) < CHARPOS_INDEX_MIN_BYTES)
+    {
+      free_charpos_index (b->text);
+      return NULL;
+    }
+
+  /* Drop the index if some change did not go through
+     adjust_charpos_index.  */
+  struct charpos_index *idx = b->text->charpos_index;
+  if (idx && (seg_chars (idx->root) != BUF_Z (b) - BUF_BEG (b)
+	      || seg_bytes (idx->root) != BUF_Z_BYTE (b) - BUF_BEG_BYTE (b)))
+    free_charpos_index (b->text);
+
+  if (!b->text->charpos_index)
+    {
+      idx = xmalloc (sizeof *idx);
+      idx->nsegments = 0;
+      idx->root = scan_charpos_segments (idx, b, BUF_BEG_BYTE (b),
+					 BUF_Z_BYTE (b));
+      b->text->charpos_index = idx;
+    }
+  return b->text->charpos_index;
+}
+
+/* Store in *BELOW, *BELOW_BYTE, *ABOVE and *ABOVE_BYTE the bounds of
+   the segment of the index IDX of B that contains POS, which is a
+   byte position if BYTE is true and a character position otherwise.
+   POS must be before the end of B.  */
+
+static void
+charpos_index_bounds (struct charpos_index *idx, struct buffer *b,
+		      ptrdiff_t pos, bool byte,
+		      ptrdiff_t *below, ptrdiff_t *below_byte,
+		      ptrdiff_t *above, ptrdiff_t *above_byte)
+{
+  ptrdiff_t c = 0, c_byte = 0;
+  ptrdiff_t offset = pos - (byte ? BUF_BEG_BYTE (b) : BUF_BEG (b));
+  struct charpos_segment *t = idx->root;
+
+  while (true)
+    {
+      ptrdiff_t lc = seg_chars (t->left), lb = seg_bytes (t->left);
+      ptrdiff_t left = byte ? lb : lc;
+      ptrdiff_t here = byte ? t->nbytes : t->nchars;
+      if (offset < left)
+	t = t->left;
+      else if (offset < left + here)
+	{
+	  c += lc;
+	  c_byte += lb;
+	  break;
+	}
+      else
+	{
+	  offset -= left + here;
+	  c += lc + t->nchars;
+	  c_byte += lb + t->nbytes;
+	  t = t->right;
+	}
+    }
+
+  *below = BUF_BEG (b) + c;
+  *below_byte = BUF_BEG_BYTE (b) + c_byte;
+  *above = *below + t->nchars;
+  *above_byte = *below_byte + t->nbytes;
+}
+
+/* Apply to the segment of T that contains the character offsets C to
+   C + OLD_CHARS a change of DCHARS characters and DBYTES bytes in its
+   length, if it can hold the result.  Return true if it was done.  */
+
+static bool
+adjust_charpos_segment (struct charpos_segment *t, ptrdiff_t c,
+			ptrdiff_t old_chars, ptrdiff_t dchars,
+			ptrdiff_t dbytes)
+{
+  if (!t)
+    return false;
+
+  ptrdiff_t lc = seg_chars (t->left);
+  bool done;
+  if (t->left && c + old_chars <= lc)
+    done = adjust_charpos_segment (t->left, c, old_chars, dchars, dbytes);
+  else if (lc <= c && c + old_chars <= lc + t->nchars)
+    {
+      done = (0 < t->nchars + dchars
+	      && t->nbytes + dbytes <= 2 * CHARPOS_SEGMENT_BYTES);
+      if (done)
+	{
+	  t->nchars += dchars;
+	  t->nbytes += dbytes;
+	  seg_forget (t);
+	}
+    }
+  else if (c >= lc + t->nchars)
+    done = adjust_charpos_segment (t->right, c - lc - t->nchars,
+				   old_chars, dchars, dbytes);
+  else
+    done = false;
+
+  if (done)
+    {
+      t->sum_chars += dchars;
+      t->sum_bytes += dbytes;
+      t->sum_lines = -1;
+      t->sum_hash[0] = TEXT_HASH_UNKNOWN;
+      t->sum_changed = true;
+    }
+  return done;
+}
+
+/* Mark as changed the segment of T that contains the character offset
+   C, or the last one if C is the end of the text.  */
+
+static void
+mark_segment_changed (struct charpos_segment *t, ptrdiff_t c)
+{
+  while (t)
+    {
+      ptrdiff_t lc = seg_chars (t->left);
+      t->sum_changed = true;
+      if (c < lc)
+	t = t->left;
+      else if (c < lc + t->nchars || !t->right)
+	{
+	  t->changed = true;
+	  return;
+	}
+      else
+	{
+	  c -= lc + t->nchars;
+	  t = t->right;
+	}
+    }
+}
+
+/* Update the char/byte position index of the current buffer for the
+   replacement of OLD_CHARS characters (OLD_BYTES bytes) at FROM
+   (FROM_BYTE) by NEW_CHARS characters (NEW_BYTES bytes), which must
+   already be in the buffer if there are any.  */
+
+void
+adjust_charpos_index (ptrdiff_t from, ptrdiff_t from_byte,
+		      ptrdiff_t old_chars, ptrdiff_t old_bytes,
+		      ptrdiff_t new_chars, ptrdiff_t new_bytes)
+{
+  struct charpos_index *idx = current_buffer->text->charpos_index;
+  if (!idx)
+    return;
+
+  ptrdiff_t c = from - BEG, c_byte = from_byte - BEG_BYTE;
+  if (seg_chars (idx->root) < c + old_chars
+      || seg_bytes (idx->root) < c_byte + old_bytes)
+    {
+      free_charpos_index (current_buffer->text);
+      return;
+    }
+
+  if (adjust_charpos_segment (idx->root, c, old_chars,
+			      new_chars - old_chars, new_bytes - old_bytes))
+    return;
+
+  struct charpos_segment *l, *m, *r;
+  split_charpos_segments (idx, idx->root, c, c_byte, &l, &r);
+  split_charpos_segments (idx, r, old_chars, old_bytes, &m, &r);
+  free_charpos_segments (idx, m);
+  m = scan_charpos_segments (idx, current_buffer, from_byte,
+			     from_byte + new_bytes);
+  idx->root = merge_charpos_segments (merge_charpos_segments (l, m), r);
+  /* The new segments are marked as changed; if there are none, mark
+     the segment where the text was deleted.  */
+  if (new_chars == 0)
+    mark_segment_changed (idx->root, c);
+
+  /* Start afresh if changes have fragmented the index.  */
+  if (idx->nsegments
+      > 4 * (seg_bytes (idx->root) / CHARPOS_SEGMENT_BYTES) + 64)
+    free_charpos_index (current_buffer->text);
+}
+
+/* Forget what is known about the correspondence between character and
+   byte positions in B.  */
+
 void
 clear_charpos_cache (struct buffer *b)
 {
   if (cached_buffer == b)
     cached_buffer = 0;
+  free_charpos_index (b->text);
+}
+
+static struct charpos_segment *
+copy_charpos_segments (struct charpos_index *idx, struct charpos_segment *t)
+{
+  if (!t)
+    return NULL;
+  struct charpos_segment *n = xmalloc (sizeof *n);
+  *n = *t;
+  n->changed = n->sum_changed = true;
+  n->left = copy_charpos_segments (idx, t->left);
+  n->right = copy_charpos_segments (idx, t->right);
+  idx->nsegments++;
+  return n;
+}
+
+/* Give B, whose text has just been made the same as that of FROM, a
+   copy of the index of FROM, if FROM has one, so that B does not have
+   to scan its text again.  The segments count as changed in B.  */
+
+void
+copy_charpos_index (struct buffer *b, struct buffer *from)
+{
+  struct charpos_index *idx = from->text->charpos_index;
+
+  free_charpos_index (b->text);
+  if (idx && idx->root
+      && seg_chars (idx->root) == BUF_Z (b) - BUF_BEG (b)
+      && seg_bytes (idx->root) == BUF_Z_BYTE (b) - BUF_BEG_BYTE (b))
+    {
+      struct charpos_index *copy = xmalloc (sizeof *copy);
+      copy->nsegments = 0;
+      copy->root = copy_charpos_segments (copy, idx->root);
+      b->text->charpos_index = copy;
+    }
+}
+
+/* Forget what is known about the text of the segments of T that the
+   character offsets FROM to TO touch.  */
+
+static void
+forget_segments (struct charpos_segment *t, ptrdiff_t from, ptrdiff_t to)
+{
+  ptrdiff_t lc = seg_chars (t->left);
+
+  if (t->left && from <= lc)
+    forget_segments (t->left, from, to);
+  if (from <= lc + t->nchars && lc <= to)
+    seg_forget (t);
+  if (t->right && lc + t->nchars <= to)
+    forget_segments (t->right, from - lc - t->nchars, to - lc - t->nchars);
+  t->sum_lines = -1;
+  t->sum_hash[0] = TEXT_HASH_UNKNOWN;
+  t->sum_changed = true;
+}
+
+/* Forget what the char/byte position index of B knows about the text
+   between positions START and END, which is about to change.  */
+
+void
+invalidate_charpos_index_text (struct buffer *b,
+			       ptrdiff_t start, ptrdiff_t end)
+{
+  struct charpos_index *idx = b->text->charpos_index;
+  if (idx && idx->root)
+    forget_segments (idx->root, start - BUF_BEG (b), end - BUF_BEG (b));
+}
+
+/* Scan the text of B between byte positions FROM and TO for newlines,
+   decrementing *N for each one.  If *N reaches zero, return the byte
+   position after that newline; otherwise return -1.  */
+
+static ptrdiff_t
+scan_newline_bytes (struct buffer *b, ptrdiff_t from, ptrdiff_t to,
+		    ptrdiff_t *n)
+{
+  while (from < to)
+    {
+      ptrdiff_t part_end = (from < BUF_GPT_BYTE (b)
+			    ? min (to, BUF_GPT_BYTE (b)) : to);
+      unsigned char *p = BUF_BYTE_ADDRESS (b, from);
+      unsigned char *lim = p + (part_end - from);
+      unsigned char *nl;
+
+      while ((nl = memchr (p, '\n', lim - p)))
+	{
+	  p = nl + 1;
+	  if (--*n == 0)
+	    return part_end - (lim - p);
+	}
+      from = part_end;
+    }
+  return -1;
+}
+
+/* Count the newlines of the segments of T whose counts are unknown.
+   T starts at byte offset START in the text of B.  */
+
+static void
+count_segment_lines (struct buffer *b, struct charpos_segment *t,
+		     ptrdiff_t start)
+{
+  if (t->sum_lines >= 0)
+    return;
+  if (t->left)
+    count_segment_lines (b, t->left, start);
+  start += seg_bytes (t->left);
+  if (t->nlines < 0)
+    {
+      ptrdiff_t n = PTRDIFF_MAX;
+      scan_newline_bytes (b, BUF_BEG_BYTE (b) + start,
+			  BUF_BEG_BYTE (b) + start + t->nbytes, &n);
+      t->nlines = PTRDIFF_MAX - n;
+    }
+  if (t->right)
+    count_segment_lines (b, t->right, start + t->nbytes);
+  seg_update_lines (t);
+}
+
+/* Return the char/byte position index of B with all its newline
+   counts known, or NULL if B is too small to need an index.  */
+
+static struct charpos_index *
+buffer_line_index (struct buffer *b)
+{
+  struct charpos_index *idx = buffer_charpos_index (b);
+  if (idx && idx->root)
+    count_segment_lines (b, idx->root, 0);
+  return idx;
+}
+
+/* Return true if line queries in B should use its index.  */
+
+bool
+buffer_line_index_p (struct buffer *b)
+{
+  Lisp_Object buffer, val;
+  XSETBUFFER (buffer, b);
+  val = buffer_local_value (Qbuffer_line_index_mode, buffer);
+  return !NILP (val) && !BASE_EQ (val, Qunbound);
+}
+
+/* Return the number of newlines in B before byte position POS_BYTE,
+   or -1 if B has no index.  */
+
+ptrdiff_t
+buffer_newlines_before (struct buffer *b, ptrdiff_t pos_byte)
+{
+  struct charpos_index *idx = buffer_line_index (b);
+  if (!idx)
+    return -1;
+
+  struct charpos_segment *t = idx->root;
+  ptrdiff_t offset = pos_byte - BUF_BEG_BYTE (b), start = 0, lines = 0;
+  while (t)
+    {
+      ptrdiff_t lb = seg_bytes (t->left);
+      if (offset < lb)
+	t = t->left;
+      else if (offset < lb + t->nbytes)
+	{
+	  ptrdiff_t n = PTRDIFF_MAX;
+	  scan_newline_bytes (b, BUF_BEG_BYTE (b) + start + lb, pos_byte, &n);
+	  return lines + seg_lines (t->left) + (PTRDIFF_MAX - n);
+	}
+      else
+	{
+	  offset -= lb + t->nbytes;
+	  start += lb + t->nbytes;
+	  lines += seg_lines (t->left) + t->nlines;
+	  t = t->right;
+	}
+    }
+  return lines;
+}
+
+/* Return the byte position in B just after its Nth newline, counting
+   from 1, or -1 if B has fewer newlines or no index.  */
+
+ptrdiff_t
+buffer_newline_position (struct buffer *b, ptrdiff_t n)
+{
+  struct charpos_index *idx = buffer_line_index (b);
+  if (!idx || n <= 0)
+    return -1;
+
+  struct charpos_segment *t = idx->root;
+  ptrdiff_t start = 0;
+  while (t)
+    {
+      ptrdiff_t ll = seg_lines (t->left);
+      if (n <= ll)
+	t = t->left;
+      else if (n <= ll + t->nlines)
+	{
+	  n -= ll;
+	  start += seg_bytes (t->left);
+	  return scan_newline_bytes (b, BUF_BEG_BYTE (b) + start,
+				     BUF_BEG_BYTE (b) + start + t->nbytes,
+				     &n);
+	}
+      else
+	{
+	  n -= ll + t->nlines;
+	  start += seg_bytes (t->left) + t->nbytes;
+	  t = t->right;
+	}
+    }
+  return -1;
 }
 
+/* Return X modulo TEXT_HASH_PRIME, for X less than 2^62 + 2^32.  */
+
+static uint_least64_t
+text_hash_mod (uint_least64_t x)
+{
+  x = (x & TEXT_HASH_PRIME) + (x >> 31);
+  x = (x & TEXT_HASH_PRIME) + (x >> 31);
+  return x >= TEXT_HASH_PRIME ? x - TEXT_HASH_PRIME : x;
+}
+
+/* Append the N bytes at P to the text whose hash is H.  */
+
+static void
+text_hash_bytes (uint_least64_t *h, unsigned char const *p, ptrdiff_t n)
+{
+  uint_least64_t h0 = h[0], h1 = h[1], h2 = h[2];
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      h0 = text_hash_mod (h0 * text_hash_base[0] + p[i] + 1);
+      h1 = text_hash_mod (h1 * text_hash_base[1] + p[i] + 1);
+      h2 = h2 * text_hash_base[2] + p[i] + 1;
+    }
+  h[0] = h0, h[1] = h1, h[2] = h2;
+}
+
+/* Append the text of N bytes whose hash is G to the text whose hash
+   is H.  */
+
+static void
+text_hash_append (uint_least64_t *h, uint_least64_t const *g, ptrdiff_t n)
+{
+  /* Multiply H by the bases to the power N.  */
+  uint_least64_t x[TEXT_HASH_LANES];
+  memcpy (x, text_hash_base, sizeof x);
+  for (; n; n >>= 1)
+    {
+      if (n & 1)
+	{
+	  h[0] = text_hash_mod (h[0] * x[0]);
+	  h[1] = text_hash_mod (h[1] * x[1]);
+	  h[2] *= x[2];
+	}
+      x[0] = text_hash_mod (x[0] * x[0]);
+      x[1] = text_hash_mod (x[1] * x[1]);
+      x[2] *= x[2];
+    }
+  h[0] = text_hash_mod (h[0] + g[0]);
+  h[1] = text_hash_mod (h[1] + g[1]);
+  h[2] += g[2];
+}
+
+/* Compute the hashes of the segments of T that are unknown.  T starts
+   at byte offset START in the text of B.  */
+
+static void
+hash_segments (struct buffer *b, struct charpos_segment *t, ptrdiff_t start)
+{
+  if (t->sum_hash[0] != TEXT_HASH_UNKNOWN)
+    return;
+  if (t->left)
+    hash_segments (b, t->left, start);
+  start += seg_bytes (t->left);
+  if (t->hash[0] == TEXT_HASH_UNKNOWN)
+    {
+      memset (t->hash, 0, sizeof t->hash);
+      ptrdiff_t from = BUF_BEG_BYTE (b) + start, to = from + t->nbytes;
+      while (from < to)
+	{
+	  ptrdiff_t part_end = (from < BUF_GPT_BYTE (b)
+				? min (to, BUF_GPT_BYTE (b)) : to);
+	  text_hash_bytes (t->hash, BUF_BYTE_ADDRESS (b, from),
+			   part_end - from);
+	  from = part_end;
+	}
+    }
+  if (t->right)
+    hash_segments (b, t->right, start + t->nbytes);
+
+  uint_least64_t h[TEXT_HASH_LANES] = { 0 };
+  if (t->left)
+    memcpy (h, t->left->sum_hash, sizeof h);
+  text_hash_append (h, t->hash, t->nbytes);
+  if (t->right)
+    text_hash_append (h, t->right->sum_hash, t->right->sum_bytes);
+  memcpy (t->sum_hash, h, sizeof h);
+}
+
+/* Store in H the hash of the text of B.  Use and update the hashes of
+   the segments if B has a char/byte position index; otherwise, hash
+   the two parts of the text around the gap.  */
+
+void
+buffer_text_hash (struct buffer *b, uint_least64_t h[3])
+{
+  struct charpos_index *idx = buffer_charpos_index (b);
+  memset (h, 0, TEXT_HASH_LANES * sizeof *h);
+  if (!idx)
+    {
+      text_hash_bytes (h, BUF_BEG_ADDR (b),
+		       BUF_GPT_BYTE (b) - BUF_BEG_BYTE (b));
+      if (BUF_GPT_BYTE (b) < BUF_Z_BYTE (b))
+	text_hash_bytes (h, BUF_GAP_END_ADDR (b),
+			 BUF_Z_ADDR (b) - BUF_GAP_END_ADDR (b));
+    }
+  else if (idx->root)
+    {
+      hash_segments (b, idx->root, 0);
+      memcpy (h, idx->root->sum_hash, TEXT_HASH_LANES * sizeof *h);
+    }
+}
+
+/* Push onto *LIST the regions of the changed segments of T, which
+   starts at character position START of B, and mark them unchanged.
+   Merge adjacent regions.  */
+
+static void
+collect_changed_segments (struct buffer *b, struct charpos_segment *t,
+			  ptrdiff_t start, Lisp_Object *list)
+{
+  if (!t->sum_changed)
+    return;
+  if (t->left)
+    collect_changed_segments (b, t->left, start, list);
+  start += seg_chars (t->left);
+  if (t->changed)
+    {
+      if (CONSP (*list) && XFIXNUM (XCDR (XCAR (*list))) == start)
+	XSETCDR (XCAR (*list), make_fixnum (start + t->nchars));
+      else
+	*list = Fcons (Fcons (make_fixnum (start),
+			      make_fixnum (start + t->nchars)),
+		       *list);
+      t->changed = false;
+    }
+  if (t->right)
+    collect_changed_segments (b, t->right, start + t->nchars, list);
+  t->sum_changed = false;
+}
+
+/* Return a list of the regions of B that changed since the last call,
+   in order, or t if B has no char/byte position index.  */
+
+Lisp_Object
+buffer_changed_segments (struct buffer *b)
+{
+  struct charpos_index *idx = buffer_charpos_index (b);
+  if (!idx)
+    return Qt;
+  Lisp_Object list = Qnil;
+  if (idx->root)
+    collect_changed_segments (b, idx->root, BUF_BEG (b), &list);
+  return Fnreverse (list);
+}
+
+/* The marker tree.
+
+   Besides being on the chain BUF_MARKERS, the markers of a buffer
+   text are kept in a binary search tree ordered by position, whose
+   root is the text's marker_tree.  The tree is a treap whose
+   priorities are hashes of the markers' addresses, so it is balanced
+   on average without any bookkeeping in the markers themselves.
+
+   The CHARPOS and BYTEPOS of a marker in the tree are relative to
+   those of its parent, and absolute only for the root.  Shifting all
+   the markers after some position by the length of an insertion or
+   deletion thus changes only the nodes on one path from the root, so
+   adjusting the markers for a change costs O(log N) for N markers,
+   plus the number of markers inside deleted text, instead of O(N).
+   Reading the position of a marker costs O(log N) as well; see
+   marker_charpos and marker_bytepos.  */
+
+static unsigned int
+marker_priority (struct Lisp_Marker const *m)
+{
+  return ((uint64_t) (uintptr_t) m * 0x9e3779b97f4a7c15) >> 32;
+}
+
+/* Return the link of the tree of T that points to M.  */
+
+static struct Lisp_Marker **
+marker_link (struct buffer_text *t, struct Lisp_Marker *m)
+{
+  struct Lisp_Marker *p = m->parent;
+  return !p ? &t->marker_tree : p->left == m ? &p->left : &p->right;
+}
+
+/* Rotate M above its parent in the tree of T, keeping the absolute
+   positions of all the markers.  */
+
+static void
+rotate_marker_up (struct buffer_text *t, struct Lisp_Marker *m)
+{
+  struct Lisp_Marker *p = m->parent;
+  struct Lisp_Marker **link = marker_link (t, p);
+  struct Lisp_Marker *child;
+  ptrdiff_t charpos = m->charpos, bytepos = m->bytepos;
+
+  if (p->left == m)
+    {
+      child = m->right;
+      p->left = child;
+      m->right = p;
+    }
+  else
+    {
+      child = m->left;
+      p->right = child;
+      m->left = p;
+    }
+  if (child)
+    {
+      child->parent = p;
+      child->charpos += charpos;
+      child->bytepos += bytepos;
+    }
+  m->parent = p->parent;
+  m->charpos += p->charpos;
+  m->bytepos += p->bytepos;
+  p->parent = m;
+  p->charpos = -charpos;
+  p->bytepos = -bytepos;
+  *link = m;
+}
+
+/* Insert M in the tree of T at CHARPOS and BYTEPOS, after any markers
+   already there.  */
+
+static void
+insert_marker_node (struct buffer_text *t, struct Lisp_Marker *m,
+		    ptrdiff_t charpos, ptrdiff_t bytepos)
+{
+  struct Lisp_Marker *p = NULL, **link = &t->marker_tree;
+  ptrdiff_t pcharpos = 0, pbytepos = 0;
+
+  while (*link)
+    {
+      p = *link;
+      pcharpos += p->charpos;
+      pbytepos += p->bytepos;
+      link = charpos < pcharpos ? &p->left : &p->right;
+    }
+  m->parent = p;
+  m->left = m->right = NULL;
+  m->charpos = charpos - pcharpos;
+  m->bytepos = bytepos - pbytepos;
+  *link = m;
+
+  unsigned int priority = marker_priority (m);
+  while (m->parent && marker_priority (m->parent) < priority)
+    rotate_marker_up (t, m);
+}
+
+/* Remove M from the tree of T, and leave its absolute position in it.  */
+
+static void
+remove_marker_node (struct buffer_text *t, struct Lisp_Marker *m)
+{
+  while (m->left || m->right)
+    rotate_marker_up (t, (!m->right ? m->left
+			  : !m->left ? m->right
+			  : (marker_priority (m->left)
+			     > marker_priority (m->right))
+			  ? m->left : m->right));
+  if (m->parent)
+    {
+      ptrdiff_t charpos = marker_charpos (m);
+      ptrdiff_t bytepos = marker_bytepos (m);
+      *marker_link (t, m) = NULL;
+      m->parent = NULL;
+      m->charpos = charpos;
+      m->bytepos = bytepos;
+    }
+  else if (t->marker_tree == m)
+    t->marker_tree = NULL;
+}
+
+/* Change M so it points to B at CHARPOS and BYTEPOS.  */
+
+void
+attach_marker (struct Lisp_Marker *m, struct buffer *b,
+	       ptrdiff_t charpos, ptrdiff_t bytepos)
+{
+  /* In a single-byte buffer, two positions must be equal.
+     Otherwise, every character is at least one byte.  */
+  if (BUF_Z (b) == BUF_Z_BYTE (b))
+    eassert (charpos == bytepos);
+  else
+    eassert (charpos <= bytepos);
+
+  if (m->buffer == b)
+    move_marker (m, charpos, bytepos);
+  else
+    {
+      unchain_marker (m);
+      m->buffer = b;
+      m->prev = NULL;
+      m->next = BUF_MARKERS (b);
+      if (m->next)
+	m->next->prev = m;
+      BUF_MARKERS (b) = m;
+      insert_marker_node (b->text, m, charpos, bytepos);
+    }
+}
+
+/* Return the marker before M in the marker tree, or NULL.  */
+
+static struct Lisp_Marker *
+marker_tree_prev (struct Lisp_Marker *m)
+{
+  if (m->left)
+    {
+      for (m = m->left; m->right; m = m->right)
+	;
+      return m;
+    }
+  while (m->parent && m->parent->left == m)
+    m = m->parent;
+  return m->parent;
+}
+
+/* Return the marker after M in the marker tree, or NULL.  */
+
+struct Lisp_Marker *
+marker_tree_next (struct Lisp_Marker *m)
+{
+  if (m->right)
+    {
+      for (m = m->right; m->left; m = m->left)
+	;
+      return m;
+    }
+  while (m->parent && m->parent->right == m)
+    m = m->parent;
+  return m->parent;
+}
+
+/* Return the first marker of B, in the order of positions, whose
+   position is CHARPOS or more, or NULL if there is none.  */
+
+struct Lisp_Marker *
+marker_tree_first (struct buffer *b, ptrdiff_t charpos)
+{
+  struct Lisp_Marker *m = b->text->marker_tree, *found = NULL;
+  ptrdiff_t mcharpos = 0;
+
+  while (m)
+    {
+      mcharpos += m->charpos;
+      if (mcharpos >= charpos)
+	{
+	  found = m;
+	  m = m->left;
+	}
+      else
+	m = m->right;
+    }
+  return found;
+}
+
+/* Move marker M, which points somewhere, to CHARPOS and BYTEPOS in the
+   same buffer.  */
+
+void
+move_marker (struct Lisp_Marker *m, ptrdiff_t charpos, ptrdiff_t bytepos)
+{
+  struct Lisp_Marker *prev = marker_tree_prev (m);
+  struct Lisp_Marker *next = marker_tree_next (m);
+
+  eassert (m->buffer);
+  if ((!prev || marker_charpos (prev) <= charpos)
+      && (!next || charpos <= marker_charpos (next)))
+    {
+      /* M stays between the same neighbors, so change it in place.  */
+      ptrdiff_t dcharpos = charpos - marker_charpos (m);
+      ptrdiff_t dbytepos = bytepos - marker_bytepos (m);
+
+      m->charpos += dcharpos;
+      m->bytepos += dbytepos;
+      if (m->left)
+	{
+	  m->left->charpos -= dcharpos;
+	  m->left->bytepos -= dbytepos;
+	}
+      if (m->right)
+	{
+	  m->right->charpos -= dcharpos;
+	  m->right->bytepos -= dbytepos;
+	}
+    }
+  else
+    {
+      struct buffer_text *t = m->buffer->text;
+      remove_marker_node (t, m);
+      insert_marker_node (t, m, charpos, bytepos);
+    }
+}
+
+/* Add NCHARS and NBYTES to the positions of the markers of B that are
+   after CHARPOS, or at CHARPOS or after it if INCLUSIVE.  This must not
+   change the order of the markers.  */
+
+void
+shift_markers (struct buffer *b, ptrdiff_t charpos, bool inclusive,
+	       ptrdiff_t nchars, ptrdiff_t nbytes)
+{
+  struct Lisp_Marker *m = b->text->marker_tree;
+  ptrdiff_t mcharpos = 0;
+
+  if (nchars == 0 && nbytes == 0)
+    return;
+
+  while (m)
+    {
+      mcharpos += m->charpos;
+      if (mcharpos > charpos || (inclusive && mcharpos == charpos))
+	{
+	  /* M and its right subtree move, its left subtree may not.  */
+	  m->charpos += nchars;
+	  m->bytepos += nbytes;
+	  mcharpos += nchars;
+	  m = m->left;
+	  if (m)
+	    {
+	      m->charpos -= nchars;
+	      m->bytepos -= nbytes;
+	    }
+	}
+      else
+	m = m->right;
+    }
+}
+
+/* Move the markers in the subtree M, whose parent is at BASE and
+   BASE_BYTE, that are after FROM and before TO to FROM and FROM_BYTE.  */
+
+static void
+collapse_marker_nodes (struct Lisp_Marker *m,
+		       ptrdiff_t base, ptrdiff_t base_byte,
+		       ptrdiff_t from, ptrdiff_t from_byte, ptrdiff_t to)
+{
+  while (m)
+    {
+      ptrdiff_t charpos = base + m->charpos;
+      struct Lisp_Marker *left = m->left, *right = m->right;
+
+      base = charpos;
+      base_byte += m->bytepos;
+      if (from < charpos && charpos < to)
+	{
+	  ptrdiff_t dcharpos = from - charpos;
+	  ptrdiff_t dbytepos = from_byte - base_byte;
+
+	  m->charpos += dcharpos;
+	  m->bytepos += dbytepos;
+	  if (left)
+	    {
+	      left->charpos -= dcharpos;
+	      left->bytepos -= dbytepos;
+	    }
+	  if (right)
+	    {
+	      right->charpos -= dcharpos;
+	      right->bytepos -= dbytepos;
+	    }
+	  base = from;
+	  base_byte = from_byte;
+	}
+
+      /* The left subtree has the markers up to CHARPOS, the right
+	 subtree those from CHARPOS on.  */
+      if (!(left && from < charpos))
+	left = NULL;
+      if (!(right && charpos < to))
+	right = NULL;
+      if (left && right)
+	collapse_marker_nodes (left, base, base_byte, from, from_byte, to);
+      m = right ? right : left;
+    }
+}
+
+/* Move the markers of B that are after FROM and before TO to FROM and
+   FROM_BYTE.  */
+
+void
+collapse_markers (struct buffer *b, ptrdiff_t from, ptrdiff_t from_byte,
+		  ptrdiff_t to)
+{
+  if (from + 1 < to)
+    collapse_marker_nodes (b->text->marker_tree, 0, 0, from, from_byte, to);
+}
+
+/* Move the markers of B at FROM whose insertion type is t to TO and
+   TO_BYTE.  This is for text inserted at FROM, once the markers after
+   FROM have been shifted.  */
+
+void
+advance_markers (struct buffer *b, ptrdiff_t from,
+		 ptrdiff_t to, ptrdiff_t to_byte)
+{
+  struct Lisp_Marker *m = marker_tree_first (b, from);
+
+  while (m && marker_charpos (m) == from)
+    {
+      struct Lisp_Marker *next = marker_tree_next (m);
+      if (m->insertion_type)
+	{
+	  remove_marker_node (b->text, m);
+	  insert_marker_node (b->text, m, to, to_byte);
+	}
+      m = next;
+    }
+}
+
+/* Make the positions of all the markers of B absolute and empty its
+   marker tree, so that code changing the positions of many markers at
+   once can just walk BUF_MARKERS and set them.  The tree must be
+   rebuilt afterwards with rebuild_marker_tree.  */
+
+void
+flatten_marker_tree (struct buffer *b)
+{
+  struct Lisp_Marker *m = b->text->marker_tree;
+
+  /* Walk the tree in preorder, so parents are made absolute before
+     their children.  */
+  while (m)
+    {
+      if (m->parent)
+	{
+	  m->charpos += m->parent->charpos;
+	  m->bytepos += m->parent->bytepos;
+	}
+      if (m->left)
+	m = m->left;
+      else if (m->right)
+	m = m->right;
+      else
+	{
+	  struct Lisp_Marker *p;
+	  while ((p = m->parent) && (p->right == m || !p->right))
+	    m = p;
+	  m = p ? p->right : NULL;
+	}
+    }
+
+  for (m = BUF_MARKERS (b); m; m = m->next)
+    m->parent = m->left = m->right = NULL;
+  b->text->marker_tree = NULL;
+}
+
+static int
+compare_marker_positions (void const *a, void const *b)
+{
+  struct Lisp_Marker const *m1 = *(struct Lisp_Marker *const *) a;
+  struct Lisp_Marker const *m2 = *(struct Lisp_Marker *const *) b;
+  return (m1->charpos > m2->charpos) - (m1->charpos < m2->charpos);
+}
+
+/* Make the positions in the subtree M relative to BASE and BASE_BYTE,
+   the absolute positions of its parent.  */
+
+static void
+make_marker_nodes_relative (struct Lisp_Marker *m,
+			    ptrdiff_t base, ptrdiff_t base_byte)
+{
+  while (m)
+    {
+      ptrdiff_t charpos = m->charpos, bytepos = m->bytepos;
+      m->charpos -= base;
+      m->bytepos -= base_byte;
+      make_marker_nodes_relative (m->left, charpos, bytepos);
+      m = m->right;
+      base = charpos;
+      base_byte = bytepos;
+    }
+}
+
+/* Rebuild the marker tree of B from its chain of markers.  */
+
+void
+rebuild_marker_tree (struct buffer *b)
+{
+  struct Lisp_Marker *m, **v, **stack;
+  ptrdiff_t n = 0, sp = 0;
+  USE_SAFE_ALLOCA;
+
+  flatten_marker_tree (b);
+  for (m = BUF_MARKERS (b); m; m = m->next)
+    n++;
+  if (n == 0)
+    return;
+  SAFE_NALLOCA (v, 2, n);
+  stack = v + n;
+  n = 0;
+  for (m = BUF_MARKERS (b); m; m = m->next)
+    v[n++] = m;
+  qsort (v, n, sizeof *v, compare_marker_positions);
+
+  /* Build the treap of the sorted markers, keeping on STACK its right
+     spine.  */
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      struct Lisp_Marker *last = NULL;
+      unsigned int priority = marker_priority (v[i]);
+
+      m = v[i];
+      while (sp > 0 && marker_priority (stack[sp - 1]) < priority)
+	last = stack[--sp];
+      m->left = last;
+      if (last)
+	last->parent = m;
+      m->parent = sp > 0 ? stack[sp - 1] : NULL;
+      if (m->parent)
+	m->parent->right = m;
+      stack[sp++] = m;
+    }
+  b->text->marker_tree = stack[0];
+  make_marker_nodes_relative (stack[0], 0, 0);
+  SAFE_FREE ();
+}
+
 /* Converting between character positions and byte positions.  */
 
 /* There are several places in the buffer where we know
@@ -139,27 +1428,15 @@ CHECK_MARKER (Lisp_Object x)
   CHECK_TYPE (MARKERP (x), Qmarkerp, x);
 }
 
-/* When converting bytes from/to chars, we look through the list of
-   markers to try and find a good starting point (since markers keep
-   track of both bytepos and charpos at the same time).
-   But if there are many markers, it can take too much time to find a "good"
-   marker from which to start.  Worse yet: if it takes a long time and we end
-   up finding a nearby markers, we won't add a new marker to cache this
-   result, so next time around we'll have to go through this same long list
-   to (re)find this best marker.  So the further down the list of
-   markers we go, the less demanding we are w.r.t what is a good marker.
-
-   The previous code used INITIAL=50 and INCREMENT=0 and this lead to
-   really poor performance when there are many markers.
-   I haven't tried to tweak INITIAL, but experiments on my trusty Thinkpad
-   T61 using various artificial test cases seem to suggest that INCREMENT=50
-   might be "the best compromise": it significantly improved the
-   worst case and it was rarely slower and never by much.
-
-   The asymptotic behavior is still poor, tho, so in largish buffers with many
-   overlays (e.g. 300KB and 30K overlays), it can still be a bottleneck.  */
-#define BYTECHAR_DISTANCE_INITIAL 50
-#define BYTECHAR_DISTANCE_INCREMENT 50
+/* When converting bytes from/to chars, we look for the markers closest
+   to the position to try and find a good starting point (since markers
+   keep track of both bytepos and charpos at the same time).  These
+   markers are on the path from the root of the marker tree to the
+   position.  We don't bother if a known place is already within
+   BYTECHAR_DISTANCE of the position.  In buffers larger than
+   CHARPOS_INDEX_MIN_BYTES, the index also gives known places at most
+   CHARPOS_SEGMENT_BYTES apart.  */
+#define BYTECHAR_DISTANCE 50
 
 /* Return the byte position corresponding to CHARPOS in B.  */
 
@@ -167,9 +1444,9 @@ ptrdiff_t
 buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
 {
   struct Lisp_Marker *tail;
+  struct charpos_index *idx;
   ptrdiff_t best_above, best_above_byte;
   ptrdiff_t best_below, best_below_byte;
-  ptrdiff_t distance = BYTECHAR_DISTANCE_INITIAL;
 
   eassert (BUF_BEG (b) <= charpos && charpos <= BUF_Z (b));
 
@@ -202,18 +1479,29 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
   if (b == cached_buffer && BUF_MODIFF (b) == cached_modiff)
     CONSIDER (cached_charpos, cached_bytepos);
 
-  for (tail = BUF_MARKERS (b); tail; tail = tail->next)
+  if (best_above - charpos >= BYTECHAR_DISTANCE
+      && charpos - best_below >= BYTECHAR_DISTANCE)
     {
-      CONSIDER (tail->charpos, tail->bytepos);
+      ptrdiff_t mcharpos = 0, mbytepos = 0;
 
-      /* If we are down to a range of 50 chars,
-	 don't bother checking any other markers;
-	 scan the intervening chars directly now.  */
-      if (best_above - charpos < distance
-          || charpos - best_below < distance)
-	break;
-      else
-        distance += BYTECHAR_DISTANCE_INCREMENT;
+      for (tail = b->text->marker_tree; tail;
+	   tail = charpos < mcharpos ? tail->left : tail->right)
+	{
+	  mcharpos += tail->charpos;
+	  mbytepos += tail->bytepos;
+	  CONSIDER (mcharpos, mbytepos);
+	}
+    }
+
+  if (best_above - charpos >= BYTECHAR_DISTANCE
+      && charpos - best_below >= BYTECHAR_DISTANCE
+      && (idx = buffer_charpos_index (b)))
+    {
+      ptrdiff_t below, below_byte, above, above_byte;
+      charpos_index_bounds (idx, b, charpos, false,
+			    &below, &below_byte, &above, &above_byte);
+      CONSIDER (below, below_byte);
+      CONSIDER (above, above_byte);
     }
 
   /* We get here if we did not exactly hit one of the known places.
@@ -324,9 +1612,9 @@ ptrdiff_t
 buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
 {
   struct Lisp_Marker *tail;
+  struct charpos_index *idx;
   ptrdiff_t best_above, best_above_byte;
   ptrdiff_t best_below, best_below_byte;
-  ptrdiff_t distance = BYTECHAR_DISTANCE_INITIAL;
 
   eassert (BUF_BEG_BYTE (b) <= bytepos && bytepos <= BUF_Z_BYTE (b));
 
@@ -354,18 +1642,29 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
   if (b == cached_buffer && BUF_MODIFF (b) == cached_modiff)
     CONSIDER (cached_bytepos, cached_charpos);
 
-  for (tail = BUF_MARKERS (b); tail; tail = tail->next)
+  if (best_above_byte - bytepos >= BYTECHAR_DISTANCE
+      && bytepos - best_below_byte >= BYTECHAR_DISTANCE)
     {
-      CONSIDER (tail->bytepos, tail->charpos);
+      ptrdiff_t mcharpos = 0, mbytepos = 0;
 
-      /* If we are down to a range of 50 chars,
-	 don't bother checking any other markers;
-	 scan the intervening chars directly now.  */
-      if (best_above - bytepos < distance
-          || bytepos - best_below < distance)
-	break;
-      else
-        distance += BYTECHAR_DISTANCE_INCREMENT;
+      for (tail = b->text->marker_tree; tail;
+	   tail = bytepos < mbytepos ? tail->left : tail->right)
+	{
+	  mcharpos += tail->charpos;
+	  mbytepos += tail->bytepos;
+	  CONSIDER (mbytepos, mcharpos);
+	}
+    }
+
+  if (best_above_byte - bytepos >= BYTECHAR_DISTANCE
+      && bytepos - best_below_byte >= BYTECHAR_DISTANCE
+      && (idx = buffer_charpos_index (b)))
+    {
+      ptrdiff_t below, below_byte, above, above_byte;
+      charpos_index_bounds (idx, b, bytepos, true,
+			    &below, &below_byte, &above, &above_byte);
+      CONSIDER (below_byte, below);
+      CONSIDER (above_byte, above);
     }
 
   /* We get here if we did not exactly hit one of the known places.
@@ -458,7 +1757,7 @@ DEFUN ("marker-position", Fmarker_position, Smarker_position, 1, 1, 0,
 {
   CHECK_MARKER (marker);
   if (XMARKER (marker)->buffer)
-    return make_fixnum (XMARKER (marker)->charpos);
+    return make_fixnum (marker_charpos (XMARKER (marker)));
 
   return Qnil;
 }
@@ -472,32 +1771,7 @@ before it was killed.  */)
 {
   CHECK_MARKER (marker);
 
-  return make_fixnum (XMARKER (marker)->charpos);
-}
-
-/* Change M so it points to B at CHARPOS and BYTEPOS.  */
-
-static void
-attach_marker (struct Lisp_Marker *m, struct buffer *b,
-	       ptrdiff_t charpos, ptrdiff_t bytepos)
-{
-  /* In a single-byte buffer, two positions must be equal.
-     Otherwise, every character is at least one byte.  */
-  if (BUF_Z (b) == BUF_Z_BYTE (b))
-    eassert (charpos == bytepos);
-  else
-    eassert (charpos <= bytepos);
-
-  m->charpos = charpos;
-  m->bytepos = bytepos;
-
-  if (m->buffer != b)
-    {
-      unchain_marker (m);
-      m->buffer = b;
-      m->next = BUF_MARKERS (b);
-      BUF_MARKERS (b) = m;
-    }
+  return make_fixnum (marker_charpos (XMARKER (marker)));
 }
 
 /* If BUFFER is nil, return current buffer pointer.  Next, check
@@ -535,10 +1809,8 @@ set_marker_internal (Lisp_Object marker, Lisp_Object position,
      an existing marker, and MARKER is already in the same buffer.  */
   else if (MARKERP (position) && b == XMARKER (position)->buffer
 	   && b == m->buffer)
-    {
-      m->bytepos = XMARKER (position)->bytepos;
-      m->charpos = XMARKER (position)->charpos;
-    }
+    move_marker (m, marker_charpos (XMARKER (position)),
+		 marker_bytepos (XMARKER (position)));
 
   else
     {
@@ -562,8 +1834,8 @@ set_marker_internal (Lisp_Object marker, Lisp_Object position,
 	}
       else if (MARKERP (position))
 	{
-	  charpos = XMARKER (position)->charpos;
-	  bytepos = XMARKER (position)->bytepos;
+	  charpos = marker_charpos (XMARKER (position));
+	  bytepos = marker_bytepos (XMARKER (position));
 	}
       else
 	wrong_type_argument (Qinteger_or_marker_p, position);
@@ -685,8 +1957,8 @@ detach_marker (Lisp_Object marker)
   Fset_marker (marker, Qnil, Qnil);
 }
 
-/* Remove MARKER from the chain of whatever buffer it is in.  Set its
-   buffer NULL.  */
+/* Remove MARKER from the chain and the tree of whatever buffer it is
+   in.  Set its buffer NULL.  */
 
 void
 unchain_marker (register struct Lisp_Marker *marker)
@@ -695,34 +1967,21 @@ unchain_marker (register struct Lisp_Marker *marker)
 
   if (b)
     {
-      register struct Lisp_Marker *tail, **prev;
-
       /* No dead buffers here.  */
       eassert (BUFFER_LIVE_P (b));
 
+      remove_marker_node (b->text, marker);
+      if (marker->prev)
+	marker->prev->next = marker->next;
+      else
+	{
+	  eassert (BUF_MARKERS (b) == marker);
+	  BUF_MARKERS (b) = marker->next;
+	}
+      if (marker->next)
+	marker->next->prev = marker->prev;
+      marker->next = marker->prev = NULL;
       marker->buffer = NULL;
-      prev = &BUF_MARKERS (b);
-
-      for (tail = BUF_MARKERS (b); tail; prev = &tail->next, tail = *prev)
-	if (marker == tail)
-	  {
-	    if (*prev == BUF_MARKERS (b))
-	      {
-		/* Deleting first marker from the buffer's chain.  Crash
-		   if new first marker in chain does not say it belongs
-		   to the same buffer, or at least that they have the same
-		   base buffer.  */
-		if (tail->next && b->text != tail->next->buffer->text)
-		  emacs_abort ();
-	      }
-	    *prev = tail->next;
-	    /* We have removed the marker from the chain;
-	       no need to scan the rest of the chain.  */
-	    break;
-	  }
-
-      /* Error if marker was not in it's chain.  */
-      eassert (tail != NULL);
     }
 }
 
@@ -737,9 +1996,10 @@ marker_position (Lisp_Object marker)
   if (!buf)
     error ("Marker does not point anywhere");
 
-  eassert (BUF_BEG (buf) <= m->charpos && m->charpos <= BUF_Z (buf));
+  ptrdiff_t charpos = marker_charpos (m);
+  eassert (BUF_BEG (buf) <= charpos && charpos <= BUF_Z (buf));
 
-  return m->charpos;
+  return charpos;
 }
 
 /* Return the byte position of marker MARKER, as a C integer.  */
@@ -753,9 +2013,10 @@ marker_byte_position (Lisp_Object marker)
   if (!buf)
     error ("Marker does not point anywhere");
 
-  eassert (BUF_BEG_BYTE (buf) <= m->bytepos && m->bytepos <= BUF_Z_BYTE (buf));
+  ptrdiff_t bytepos = marker_bytepos (m);
+  eassert (BUF_BEG_BYTE (buf) <= bytepos && bytepos <= BUF_Z_BYTE (buf));
 
-  return m->bytepos;
+  return bytepos;
 }
 
 DEFUN ("copy-marker", Fcopy_marker, Scopy_marker, 0, 2, 0,
@@ -848,4 +2109,6 @@ syms_of_marker (void)
   defsubr (&Scopy_marker);
   defsubr (&Smarker_insertion_type);
   defsubr (&Sset_marker_insertion_type);
+
+  DEFSYM (Qbuffer_line_index_mode, "buffer-line-index-mode");
 }
@@ -2104,7 +2104,7 @@ dump_string (struct dump_context *ctx, const struct Lisp_String *string)
 static dump_off
 dump_marker (struct dump_context *ctx, const struct Lisp_Marker *marker)
 {
-#if CHECK_STRUCTS && !defined (HASH_Lisp_Marker_642DBAF866)
+#if CHECK_STRUCTS && !defined (HASH_Lisp_Marker_BBC041349A)
 # error "Lisp_Marker changed. See CHECK_STRUCTS comment in config.h."
 #endif
 
@@ -2118,6 +2118,14 @@ dump_marker (struct dump_context *ctx, const struct Lisp_Marker *marker)
 			    Lisp_Vectorlike, WEIGHT_NORMAL);
       dump_field_lv_rawptr (ctx, out, marker, &marker->next,
 			    Lisp_Vectorlike, WEIGHT_STRONG);
+      dump_field_lv_rawptr (ctx, out, marker, &marker->prev,
+			    Lisp_Vectorlike, WEIGHT_NORMAL);
+      dump_field_lv_rawptr (ctx, out, marker, &marker->parent,
+			    Lisp_Vectorlike, WEIGHT_NORMAL);
+      dump_field_lv_rawptr (ctx, out, marker, &marker->left,
+			    Lisp_Vectorlike, WEIGHT_NORMAL);
+      dump_field_lv_rawptr (ctx, out, marker, &marker->right,
+			    Lisp_Vectorlike, WEIGHT_NORMAL);
       DUMP_FIELD_COPY (out, marker, charpos);
       DUMP_FIELD_COPY (out, marker, bytepos);
     }
@@ -2798,6 +2806,9 @@ dump_buffer (struct dump_context *ctx, const struct buffer *in_buffer)
 {
 #if CHECK_STRUCTS && !defined HASH_buffer_B02F648B82
 # error "buffer changed. See CHECK_STRUCTS comment in config.h."
+#endif
+#if CHECK_STRUCTS && !defined HASH_buffer_text_D07E20372C
+# error "buffer_text changed. See CHECK_STRUCTS comment in config.h."
 #endif
   struct buffer munged_buffer = *in_buffer;
   struct buffer *buffer = &munged_buffer;
@@ -2864,6 +2875,11 @@ dump_buffer (struct dump_context *ctx, const struct buffer *in_buffer)
         dump_field_fixup_later (ctx, out, buffer, &buffer->own_text.intervals);
       dump_field_lv_rawptr (ctx, out, buffer, &buffer->own_text.markers,
                             Lisp_Vectorlike, WEIGHT_NORMAL);
+      dump_field_lv_rawptr (ctx, out, buffer, &buffer->own_text.marker_tree,
+                            Lisp_Vectorlike, WEIGHT_NORMAL);
+      /* The char/byte index, the sharing record, the undo growth
+         and changed_blocks_modiff start out null in the loaded
+         buffer.  */
       DUMP_FIELD_COPY (out, buffer, own_text.inhibit_shrinking);
       DUMP_FIELD_COPY (out, buffer, own_text.redisplay);
     }
@@ -3050,7 +3066,7 @@ dump_vectorlike (struct dump_context *ctx,
                  Lisp_Object lv,
                  dump_off offset)
 {
-#if CHECK_STRUCTS && !defined HASH_pvec_type_2D583AC566
+#if CHECK_STRUCTS && !defined HASH_pvec_type_4E299474AE
 # error "pvec_type changed. See CHECK_STRUCTS comment in config.h."
 #endif
   const struct Lisp_Vector *v = XVECTOR (lv);
@@ -3117,6 +3133,9 @@ dump_vectorlike (struct dump_context *ctx,
     case PVEC_MUTEX:
     case PVEC_CONDVAR:
     case PVEC_SQLITE:
+    case PVEC_REGEXP:
+    case PVEC_STRING_MATCHER:
+    case PVEC_BUFFER_SNAPSHOT:
     case PVEC_MODULE_FUNCTION:
     case PVEC_SYMBOL_WITH_POS:
     case PVEC_FREE:
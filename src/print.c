@@ -1489,7 +1489,10 @@ if `print-circle' is nil.  */)
 static void
 print_preprocess_string (INTERVAL interval, void *arg)
 {
-  print_preprocess (interval->plist);
+  /* Intervals can share their plist (see intern_interval_plist), so
+     look only at its elements, lest the sharing show up as #N#.  */
+  for (Lisp_Object tail = interval->plist; CONSP (tail); tail = XCDR (tail))
+    print_preprocess (XCAR (tail));
 }
 
 #define PRINT_STRING_NON_CHARSET_FOUND 1
@@ -2078,6 +2081,32 @@ print_vectorlike_unreadable (Lisp_Object obj, Lisp_Object printcharfun,
       }
       return;
 
+    case PVEC_REGEXP:
+      print_c_string ("#<regexp ", printcharfun);
+      print_object (XREGEXP (obj)->pattern, printcharfun, escapeflag);
+      printchar ('>', printcharfun);
+      return;
+
+    case PVEC_BUFFER_SNAPSHOT:
+      {
+	Lisp_Object buffer = XBUFFER_SNAPSHOT (obj)->buffer;
+	print_c_string ("#<buffer-snapshot of ", printcharfun);
+	if (BUFFER_LIVE_P (XBUFFER (buffer)))
+	  print_string (BVAR (XBUFFER (buffer), name), printcharfun);
+	else
+	  print_c_string ("killed buffer", printcharfun);
+	printchar ('>', printcharfun);
+      }
+      return;
+
+    case PVEC_STRING_MATCHER:
+      {
+	int len = sprintf (buf, "#<string-matcher %"pD"d strings>",
+			   ASIZE (XSTRING_MATCHER (obj)->strings));
+	strout (buf, len, len, printcharfun);
+      }
+      return;
+
     case PVEC_OBARRAY:
       {
 	struct Lisp_Obarray *o = XOBARRAY (obj);
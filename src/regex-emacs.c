@@ -193,6 +193,14 @@ static ptrdiff_t re_match_2_internal (struct re_pattern_buffer *bufp,
 				     ptrdiff_t pos,
 				     struct re_registers *regs,
 				     ptrdiff_t stop);
+static struct re_dfa *dfa_get (struct re_pattern_buffer *);
+static ptrdiff_t dfa_execute (struct re_pattern_buffer *,
+			      re_char *, ptrdiff_t, re_char *, ptrdiff_t,
+			      ptrdiff_t, ptrdiff_t, ptrdiff_t);
+static ptrdiff_t re_match_2_dfa (struct re_pattern_buffer *,
+				 re_char *, ptrdiff_t, re_char *, ptrdiff_t,
+				 ptrdiff_t, struct re_registers *,
+				 ptrdiff_t, bool);
 
 /* These are the command codes that appear in compiled regular
    expressions.  Some opcodes are followed by argument bytes.  A
@@ -1179,6 +1187,7 @@ static void insert_op2 (re_opcode_t op, unsigned char *loc,
 static bool at_begline_loc_p (re_char *pattern, re_char *p);
 static bool at_endline_loc_p (re_char *p, re_char *pend);
 static re_char *skip_one_char (re_char *p);
+static void analyze_literal (struct re_pattern_buffer *bufp);
 static bool analyze_first (struct re_pattern_buffer *bufp,
                            re_char *p, re_char *pend, char *fastmap);
 
@@ -1799,6 +1808,9 @@ regex_compile (re_char *pattern, ptrdiff_t size,
 
   bufp->re_nsub = 0;
 
+  re_free_dfa (bufp);
+  bufp->dfa_unusable = false;
+
   if (bufp->allocated == 0)
     {
       /* This loses if BUFP->buffer is bogus, but that is the user's
@@ -2688,6 +2700,8 @@ regex_compile (re_char *pattern, ptrdiff_t size,
   /* Success; set the length of the buffer.  */
   bufp->used = b - bufp->buffer;
 
+  analyze_literal (bufp);
+
 #ifdef REGEX_EMACS_DEBUG
   if (regex_emacs_debug > 0)
     {
@@ -3417,7 +3431,7 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, ptrdiff_t size1,
   Lisp_Object translate = bufp->translate;
   ptrdiff_t total_size = size1 + size2;
   ptrdiff_t endpos = startpos + range;
-  bool anchored_start;
+  bool anchored_start, use_dfa;
   /* Nonzero if we are searching multibyte string.  */
   bool multibyte = RE_TARGET_MULTIBYTE_P (bufp);
 
@@ -3459,6 +3473,19 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, ptrdiff_t size1,
   /* See whether the pattern is anchored.  */
   anchored_start = (bufp->buffer[0] == begline);
 
+  /* If the pattern can be matched by a DFA, a forward search first
+     finds out in one pass whether there is a match at all, and where
+     the first one ends; no match can start after that.  */
+  use_dfa = startpos <= stop && dfa_get (bufp);
+  if (use_dfa && range >= 0)
+    {
+      ptrdiff_t end = dfa_execute (bufp, string1, size1, string2, size2,
+				   startpos, stop, startpos + range);
+      if (end < 0)
+	return -1;
+      range = min (range, end - startpos);
+    }
+
   RE_SETUP_SYNTAX_TABLE_FOR_OBJECT (re_match_object, startpos);
 
   /* Loop through the string, looking for a place to start matching.  */
@@ -3576,8 +3603,8 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, ptrdiff_t size1,
 	  && !bufp->can_be_null)
 	return -1;
 
-      val = re_match_2_internal (bufp, string1, size1, string2, size2,
-				 startpos, regs, stop);
+      val = re_match_2_dfa (bufp, string1, size1, string2, size2,
+			    startpos, regs, stop, use_dfa);
 
       if (val >= 0)
 	return startpos;
@@ -3746,6 +3773,140 @@ skip_one_char (re_char *p)
 }
 
 
+/* Return a pointer to the operation after the one at P, or NULL if
+   P is not an operation this function knows about.  */
+static re_char *
+skip_one_op (re_char *p)
+{
+  re_char *next = skip_one_char (p);
+  if (next)
+    return next;
+
+  switch (*p)
+    {
+    case no_op: case succeed:
+    case begline: case endline: case begbuf: case endbuf:
+    case wordbeg: case wordend: case wordbound: case notwordbound:
+    case symbeg: case symend: case at_dot:
+      return p + 1;
+
+    case start_memory: case stop_memory: case duplicate:
+      return p + 2;
+
+    case jump: case on_failure_jump: case on_failure_keep_string_jump:
+    case on_failure_jump_loop: case on_failure_jump_nastyloop:
+    case on_failure_jump_smart:
+      return p + 3;
+
+    case succeed_n: case jump_n: case set_number_at:
+      return p + 5;
+
+    default:
+      return NULL;
+    }
+}
+
+/* Look for a literal string that every match of the compiled pattern
+   in BUFP contains, and set the 'must_*' fields of BUFP accordingly.
+   Only the operations that every match goes through are considered:
+   loops, optional parts and alternatives are skipped over, and the
+   analysis stops at the first operation it does not understand.  A
+   literal that starts every match is preferred, since searches can
+   then jump from one occurrence to the next; otherwise the longest
+   literal is used.  */
+static void
+analyze_literal (struct re_pattern_buffer *bufp)
+{
+  re_char *p = bufp->buffer;
+  re_char *pend = p + bufp->used;
+  /* Minimum number of characters matched before P.  */
+  ptrdiff_t offset = 0;
+  /* True if nothing has to be matched before P.  */
+  bool at_start = true;
+
+  bufp->must_start = -1;
+  bufp->must_size = 0;
+  bufp->must_offset = 0;
+  bufp->must_prefix = false;
+
+  /* A pattern anchored at the beginning of the text is tried at one
+     position at most, which is much cheaper than looking for a literal
+     through the whole text.  */
+  if (p < pend && *p == begbuf)
+    return;
+
+  while (p < pend)
+    switch (*p)
+      {
+      case exactn:
+	{
+	  int n = p[1];
+	  if (! bufp->must_prefix && n > bufp->must_size)
+	    {
+	      bufp->must_start = p + 2 - bufp->buffer;
+	      bufp->must_size = n;
+	      bufp->must_offset = offset;
+	      bufp->must_prefix = at_start && n > 1;
+	    }
+	  offset += bufp->multibyte ? multibyte_chars_in_text (p + 2, n) : n;
+	  at_start = false;
+	  p += 2 + n;
+	}
+	break;
+
+      case anychar: case charset: case charset_not:
+      case syntaxspec: case notsyntaxspec:
+      case categoryspec: case notcategoryspec:
+	offset++;
+	at_start = false;
+	p = skip_one_char (p);
+	break;
+
+      case no_op:
+      case start_memory: case stop_memory:
+      case begline: case endline: case begbuf: case endbuf:
+      case wordbeg: case wordend: case wordbound: case notwordbound:
+      case symbeg: case symend: case at_dot:
+	p = skip_one_op (p);
+	break;
+
+      case on_failure_jump:
+      case on_failure_keep_string_jump:
+      case on_failure_jump_loop:
+      case on_failure_jump_smart:
+	{
+	  /* The code up to the failure address is a loop body, an
+	     optional part, or the first of several alternatives, which
+	     then ends with a jump past the others.  */
+	  re_char *alt = p + 3 + extract_number (p + 1);
+	  re_char *q = p + 3, *last = NULL;
+	  if (alt <= p || alt > pend)
+	    return;
+	  while (q && q < alt)
+	    {
+	      last = q;
+	      q = skip_one_op (q);
+	    }
+	  if (q != alt)
+	    return;
+	  p = alt;
+	  if (last && *last == jump)
+	    {
+	      re_char *dest = last + 3 + extract_number (last + 1);
+	      if (dest > pend)
+		return;
+	      if (dest > alt)
+		p = dest;
+	    }
+	  at_start = false;
+	}
+	break;
+
+      default:
+	return;
+      }
+}
+
 /* Test if C matches charset op.  *PP points to the charset or charset_not
    opcode.  When the function finishes, *PP will be advanced past that opcode.
    C is character to test (possibly after translations) and CORIG is original
@@ -4026,9 +4187,1072 @@ mutually_exclusive_p (struct re_pattern_buffer *bufp, re_char *p1,
 		      re_char *p2)
 {
   struct mutexcl_data data = { bufp, p1, true };
-  return forall_firstchar (bufp, p2, NULL, mutually_exclusive_one, &data);
+  /* Without a final 'succeed' (i.e., for POSIX backtracking), P2 can
+     lead to the end of the pattern, which matches anything.  */
+  return forall_firstchar (bufp, p2, bufp->buffer + bufp->used,
+			   mutually_exclusive_one, &data);
 }
 
+/* Lazy DFA matching.
+
+   Patterns that use none of the context-dependent operators (back
+   references, word and symbol boundaries, syntax and category tests,
+   point) can be matched without backtracking.  For such a pattern the
+   compiled bytecode is translated into a small Thompson-style program
+   the first time it is searched, and that program is simulated one
+   input character at a time.  Each set of simultaneously active program
+   positions is a state of a DFA; states and their transitions are
+   created on demand and cached in the pattern buffer, so a search costs
+   time linear in the text it examines and never uses the failure stack.
+
+   The threads of a state are kept in priority order, and everything of
+   lower priority than a thread that reaches the end of the pattern is
+   dropped.  This reproduces the choice of the backtracking matcher,
+   whose alternatives are tried in the same order.  Patterns compiled
+   for POSIX backtracking keep every thread and find the longest match
+   instead.  The backtracking matcher is still run when the caller wants
+   the contents of subexpressions, but only at positions where the DFA
+   has found a match.  */
+
+/* Operations of the DFA program.  */
+enum dfa_op
+{
+  DFA_CHAR,			/* Match character C.  */
+  DFA_ANYCHAR,			/* Match any character except newline.  */
+  DFA_CHARSET,			/* Match the charset opcode at offset X.  */
+  DFA_BEGLINE,			/* Empty, at beginning of line.  */
+  DFA_ENDLINE,			/* Empty, at end of line.  */
+  DFA_BEGBUF,			/* Empty, at beginning of text.  */
+  DFA_ENDBUF,			/* Empty, at end of text.  */
+  DFA_JUMP,			/* Continue at X.  */
+  DFA_SPLIT,			/* Continue at X, else at Y.  */
+  DFA_LOOP,			/* Like DFA_SPLIT, for a loop whose body
+				   might match the empty string.  */
+  DFA_MATCH			/* End of the pattern.  */
+};
+
+/* An instruction of the DFA program.  Every instruction except
+   DFA_JUMP, DFA_SPLIT and DFA_LOOP continues with the instruction
+   after it.  */
+struct dfa_insn
+{
+  enum dfa_op op;
+  int c, x, y;
+};
+
+/* Context flags.  The first three are part of the identity of a DFA
+   state; the others are only used while following empty transitions.  */
+enum
+{
+  DFA_AT_BOL = 1,		/* At the beginning of a line.  */
+  DFA_AT_BOB = 2,		/* At the beginning of the text.  */
+  DFA_SEED = 4,			/* Start a new thread at every position.  */
+  DFA_KEY_FLAGS = DFA_AT_BOL | DFA_AT_BOB | DFA_SEED,
+  DFA_ACCEPT = 8,		/* The state contains DFA_MATCH.  */
+  DFA_AT_EOL = 16,		/* At the end of a line.  */
+  DFA_NOT_EOL = 32,		/* Not at the end of a line.  */
+  DFA_AT_EOB = 64,		/* At the end of the text.  */
+  DFA_NOT_EOB = 128		/* Not at the end of the text.  */
+};
+
+/* Limits on the size of a DFA.  Patterns whose program would be
+   larger than DFA_MAX_INSNS are not handled; when a DFA reaches
+   DFA_MAX_STATES states, its cache of states is flushed and rebuilt
+   as needed, so pathological patterns degrade gracefully.  */
+enum { DFA_MAX_INSNS = 4000, DFA_MAX_STATES = 256, DFA_INDEX_SIZE = 512,
+       DFA_WIDE_CACHE_SIZE = 256 };
+
+/* When re_shrink_dfa is called, DFAs with more states than this lose
+   their cache of states.  */
+enum { DFA_KEEP_STATES = 32 };
+
+struct dfa_state
+{
+  /* The threads of this state, as indices of the program, are
+     NTHREADS elements of the pool starting at FIRST.  */
+  int first, nthreads;
+
+  /* Next state in the same hash bucket, or -1.  */
+  int hash_next;
+
+  /* Context flags; see above.  */
+  int flags;
+
+  /* Transitions on characters whose first byte is B, for the bytes
+     that are complete characters.  Each element is -1 if not known
+     yet, else the index of the next state shifted left by one, ORed
+     with 1 if the text matches before that character.  */
+  int next[1 << BYTEWIDTH];
+};
+
+struct re_dfa
+{
+  /* The program, with NINSNS instructions starting at index 0.  */
+  struct dfa_insn *prog;
+  int ninsns;
+
+  /* The values of the pattern buffer that the program depends on.  */
+  bool target_multibyte;
+  Lisp_Object translate;
+
+  /* True if the longest match is wanted, i.e. the pattern was
+     compiled for POSIX backtracking.  */
+  bool longest;
+
+  /* Context flags that make a difference for this program.  */
+  int ctx_mask;
+
+  /* The states built so far.  */
+  struct dfa_state *states;
+  int nstates;
+  ptrdiff_t states_alloc;
+
+  /* Storage for the threads of all states.  */
+  int *pool;
+  ptrdiff_t npool, pool_alloc;
+
+  /* Heads of the hash chains of states.  */
+  int index[DFA_INDEX_SIZE];
+
+  /* Incremented whenever the states are flushed.  */
+  unsigned generation;
+
+  /* Transitions on characters not covered by the NEXT arrays.  */
+  struct { int state, c, next; } wide[DFA_WIDE_CACHE_SIZE];
+
+  /* Scratch space for building states, each with NINSNS elements
+     (four times that for STACK).  */
+  int *list, *list2, *stack;
+  unsigned *seen, *seen2;
+  unsigned stamp;
+};
+
+/* A list of threads under construction.  */
+struct dfa_list
+{
+  int *threads;
+  int n;
+  unsigned *seen;
+  unsigned stamp;
+
+  /* True if the list contains DFA_MATCH.  */
+  bool match;
+
+  /* True if threads may no longer be added, because a thread of higher
+     priority has matched.  */
+  bool cut;
+};
+
+/* A character of the text, converted in every way that the matching
+   operations need.  */
+struct dfa_char
+{
+  /* The character to compare with a DFA_CHAR.  */
+  int key;
+
+  /* The character to compare with newline for DFA_ANYCHAR.  */
+  int any;
+
+  /* Arguments for execute_charset.  */
+  int c, corig;
+  bool unibyte;
+
+  /* True if the character is a newline.  */
+  bool newline;
+};
+
+/* State of the translation of bytecode into a DFA program.  */
+struct dfa_builder
+{
+  struct re_pattern_buffer *bufp;
+  struct dfa_insn *prog;
+  int ninsns;
+  ptrdiff_t alloc;
+  bool ok, saw_succeed;
+};
+
+static int
+dfa_emit (struct dfa_builder *b, enum dfa_op op, int c, int x, int y)
+{
+  if (b->ninsns == DFA_MAX_INSNS)
+    {
+      b->ok = false;
+      return b->ninsns - 1;
+    }
+  if (b->ninsns == b->alloc)
+    b->prog = xpalloc (b->prog, &b->alloc, 1, DFA_MAX_INSNS, sizeof *b->prog);
+  b->prog[b->ninsns] = (struct dfa_insn) { op, c, x, y };
+  return b->ninsns++;
+}
+
+static void dfa_emit_range (struct dfa_builder *, re_char *, re_char *);
+
+/* Emit the interval loop whose first set_number_at is at *PP, and set
+   *PP past it.  The loop is unrolled, since the counters of succeed_n
+   and jump_n cannot be represented in DFA states.  See the comment in
+   regex_compile for the shape of the bytecode.  */
+
+static void
+dfa_emit_interval (struct dfa_builder *b, re_char **pp, re_char *to)
+{
+  re_char *p = *pp;
+  re_char *loc[2];
+  int val[2], nset = 0;
+
+  while (p < to && (re_opcode_t) *p == set_number_at)
+    {
+      if (nset == 2)
+	{
+	  b->ok = false;
+	  return;
+	}
+      loc[nset] = p + 3 + extract_number (p + 1);
+      val[nset++] = extract_number (p + 3) & 0xffff;
+      p += 5;
+    }
+
+  re_char *loop = p, *body, *after;
+  int lower = -1, upper = -1;
+  if (p < to && (re_opcode_t) *p == succeed_n)
+    {
+      body = p + 5;
+      after = p + 3 + extract_number (p + 1);
+      for (int i = 0; i < nset; i++)
+	if (loc[i] == p + 3)
+	  lower = val[i];
+    }
+  else if (p < to && (re_opcode_t) *p == on_failure_jump_loop)
+    {
+      body = p + 3;
+      after = p + 3 + extract_number (p + 1);
+      lower = 0;
+    }
+  else
+    {
+      b->ok = false;
+      return;
+    }
+  if (lower < 0 || after < body || after > to)
+    {
+      b->ok = false;
+      return;
+    }
+
+  /* Find the end of the body, and the upper bound.  Without a jump_n,
+     the loop either ends in a jump back (no upper bound) or is not a
+     loop at all.  */
+  re_char *body_end = after;
+  bool infinite = false;
+  for (int i = 0; i < nset; i++)
+    if (loc[i] != loop + 3)
+      {
+	re_char *jn = loc[i] - 3;
+	if (jn < body || jn + 5 != after || (re_opcode_t) *jn != jump_n
+	    || jn + 3 + extract_number (jn + 1) != loop)
+	  {
+	    b->ok = false;
+	    return;
+	  }
+	body_end = jn;
+	upper = val[i] + 1;
+      }
+  if (upper < 0)
+    {
+      if (after - 3 >= body && (re_opcode_t) after[-3] == jump
+	  && after + extract_number (after - 2) == loop)
+	{
+	  body_end = after - 3;
+	  infinite = true;
+	}
+      else
+	upper = 1;
+    }
+
+  if (!infinite && upper < lower)
+    {
+      b->ok = false;
+      return;
+    }
+
+  /* The exits of the optional iterations, to be patched below.  */
+  int first = b->ninsns;
+  for (int i = 0; i < lower && b->ok; i++)
+    dfa_emit_range (b, body, body_end);
+  if (infinite)
+    {
+      int split = dfa_emit (b, DFA_LOOP, 0, b->ninsns + 1, -1);
+      dfa_emit_range (b, body, body_end);
+      dfa_emit (b, DFA_JUMP, 0, split, 0);
+    }
+  else
+    for (int i = lower; i < upper && b->ok; i++)
+      {
+	dfa_emit (b, DFA_SPLIT, 0, b->ninsns + 1, -1);
+	dfa_emit_range (b, body, body_end);
+      }
+  for (int i = first; i < b->ninsns; i++)
+    if ((b->prog[i].op == DFA_SPLIT || b->prog[i].op == DFA_LOOP)
+	&& b->prog[i].y == -1)
+      b->prog[i].y = b->ninsns;
+
+  *pp = after;
+}
+
+/* Emit the program for the bytecode from FROM to TO.  Jumps from that
+   range must stay within it; a jump to TO continues with whatever is
+   emitted next.  */
+
+static void
+dfa_emit_range (struct dfa_builder *b, re_char *from, re_char *to)
+{
+  struct re_pattern_buffer *bufp = b->bufp;
+  bool multibyte = RE_MULTIBYTE_P (bufp);
+  bool target_multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  ptrdiff_t size = to - from;
+  int first = b->ninsns;
+
+  /* MAP[I] is the instruction emitted for the bytecode at FROM + I, or
+     -1.  REDIRECT[I] is the offset of the on_failure_keep_string_jump
+     just before FROM + I, if any; jumps to the body of such a loop
+     actually repeat the loop (see on_failure_jump_smart).  */
+  int *map = xnmalloc (2 * (size + 1), sizeof *map);
+  int *redirect = map + size + 1;
+  for (ptrdiff_t i = 0; i <= size; i++)
+    map[i] = redirect[i] = -1;
+
+  re_char *p = from;
+  while (p < to && b->ok)
+    {
+      map[p - from] = b->ninsns;
+      switch ((re_opcode_t) *p)
+	{
+	case no_op:
+	  p++;
+	  break;
+
+	case succeed:
+	  b->saw_succeed = true;
+	  dfa_emit (b, DFA_MATCH, 0, 0, 0);
+	  p++;
+	  break;
+
+	case exactn:
+	  {
+	    re_char *q = p + 2, *end = q + p[1];
+	    while (q < end)
+	      {
+		int pat_ch, pat_charlen;
+		if (multibyte)
+		  pat_ch = string_char_and_length (q, &pat_charlen);
+		else
+		  pat_ch = *q, pat_charlen = 1;
+		if (target_multibyte)
+		  {
+		    if (!multibyte)
+		      pat_ch = RE_CHAR_TO_MULTIBYTE (pat_ch);
+		  }
+		else if (multibyte)
+		  pat_ch = RE_CHAR_TO_UNIBYTE (pat_ch);
+		dfa_emit (b, DFA_CHAR, pat_ch, 0, 0);
+		q += pat_charlen;
+	      }
+	    p = end;
+	  }
+	  break;
+
+	case anychar:
+	  dfa_emit (b, DFA_ANYCHAR, 0, 0, 0);
+	  p++;
+	  break;
+
+	case charset:
+	case charset_not:
+	  /* Classes that depend on the syntax or case table of the
+	     current buffer cannot be cached in states.  */
+	  if (CHARSET_RANGE_TABLE_EXISTS_P (p)
+	      && (CHARSET_RANGE_TABLE_BITS (p)
+		  & (BIT_WORD | BIT_SPACE | BIT_UPPER | BIT_LOWER)))
+	    b->ok = false;
+	  dfa_emit (b, DFA_CHARSET, 0, p - bufp->buffer, 0);
+	  p = skip_one_char (p);
+	  break;
+
+	case start_memory:
+	case stop_memory:
+	  p += 2;
+	  break;
+
+	case begline:
+	  dfa_emit (b, DFA_BEGLINE, 0, 0, 0);
+	  p++;
+	  break;
+
+	case endline:
+	  dfa_emit (b, DFA_ENDLINE, 0, 0, 0);
+	  p++;
+	  break;
+
+	case begbuf:
+	  dfa_emit (b, DFA_BEGBUF, 0, 0, 0);
+	  p++;
+	  break;
+
+	case endbuf:
+	  dfa_emit (b, DFA_ENDBUF, 0, 0, 0);
+	  p++;
+	  break;
+
+	case jump:
+	  dfa_emit (b, DFA_JUMP, 1, p + 3 + extract_number (p + 1) - from, 0);
+	  p += 3;
+	  break;
+
+	case on_failure_keep_string_jump:
+	  redirect[p + 3 - from] = p - from;
+	  FALLTHROUGH;
+	case on_failure_jump:
+	case on_failure_jump_smart:
+	case on_failure_jump_loop:
+	  dfa_emit (b, ((re_opcode_t) *p == on_failure_jump_loop
+			? DFA_LOOP : DFA_SPLIT),
+		    1, p + 3 - from, p + 3 + extract_number (p + 1) - from);
+	  p += 3;
+	  break;
+
+	case set_number_at:
+	  dfa_emit_interval (b, &p, to);
+	  break;
+
+	default:
+	  /* Back references, counters outside of an interval, lazy
+	     loops that can match the empty string, and everything that
+	     looks at syntax, categories or point.  */
+	  b->ok = false;
+	  break;
+	}
+    }
+  map[size] = b->ninsns;
+
+  /* Resolve the jumps emitted for this range.  Those of nested
+     intervals are already resolved, and have C == 0.  */
+  for (int i = first; i < b->ninsns && b->ok; i++)
+    {
+      struct dfa_insn *in = &b->prog[i];
+      if ((in->op == DFA_JUMP || in->op == DFA_SPLIT || in->op == DFA_LOOP)
+	  && in->c)
+	{
+	  int x = in->x, y = in->op == DFA_JUMP ? x : in->y;
+	  if (x < 0 || x > size || y < 0 || y > size)
+	    {
+	      b->ok = false;
+	      break;
+	    }
+	  if (in->op == DFA_JUMP && redirect[x] >= 0)
+	    x = redirect[x];
+	  in->c = 0;
+	  in->x = map[x];
+	  in->y = map[y];
+	  if (in->x < 0 || in->y < 0)
+	    b->ok = false;
+	}
+    }
+
+  xfree (map);
+}
+
+/* Free the DFA of BUFP.  */
+
+void
+re_free_dfa (struct re_pattern_buffer *bufp)
+{
+  struct re_dfa *dfa = bufp->dfa;
+  if (dfa)
+    {
+      xfree (dfa->prog);
+      xfree (dfa->states);
+      xfree (dfa->pool);
+      xfree (dfa->list);
+      xfree (dfa->seen);
+      xfree (dfa);
+      bufp->dfa = NULL;
+    }
+}
+
+/* Forget all the states of DFA.  */
+
+static void
+dfa_flush (struct re_dfa *dfa)
+{
+  dfa->nstates = 0;
+  dfa->npool = 0;
+  for (int i = 0; i < DFA_INDEX_SIZE; i++)
+    dfa->index[i] = -1;
+  for (int i = 0; i < DFA_WIDE_CACHE_SIZE; i++)
+    dfa->wide[i].state = -1;
+  dfa->generation++;
+}
+
+void
+re_shrink_dfa (struct re_pattern_buffer *bufp)
+{
+  struct re_dfa *dfa = bufp->dfa;
+  if (dfa && dfa->nstates > DFA_KEEP_STATES)
+    {
+      dfa_flush (dfa);
+      xfree (dfa->states);
+      dfa->states = NULL;
+      dfa->states_alloc = 0;
+      xfree (dfa->pool);
+      dfa->pool = NULL;
+      dfa->pool_alloc = 0;
+    }
+}
+
+/* Return true if the body of a loop in PROG, which has NINSNS
+   instructions, can match the empty string.  The backtracking matcher
+   leaves such a loop after an empty iteration (see CHECK_INFINITE_LOOP),
+   which depends on the path taken and cannot be expressed by DFA
+   states.  */
+
+static bool
+dfa_empty_loop_p (struct dfa_insn *prog, int ninsns)
+{
+  int *stack = xnmalloc (2 * ninsns, sizeof *stack);
+  unsigned char *seen = xmalloc (ninsns);
+  bool found = false;
+
+  for (int loop = 0; loop < ninsns && !found; loop++)
+    {
+      if (prog[loop].op != DFA_LOOP)
+	continue;
+      memset (seen, 0, ninsns);
+      int sp = 0;
+      stack[sp++] = prog[loop].x;
+      while (sp > 0 && !found)
+	{
+	  int pc = stack[--sp];
+	  if (pc == loop)
+	    found = true;
+	  else if (!seen[pc])
+	    {
+	      seen[pc] = 1;
+	      switch (prog[pc].op)
+		{
+		case DFA_JUMP:
+		  stack[sp++] = prog[pc].x;
+		  break;
+		case DFA_SPLIT:
+		case DFA_LOOP:
+		  stack[sp++] = prog[pc].x;
+		  stack[sp++] = prog[pc].y;
+		  break;
+		case DFA_BEGLINE:
+		case DFA_BEGBUF:
+		case DFA_ENDLINE:
+		case DFA_ENDBUF:
+		  stack[sp++] = pc + 1;
+		  break;
+		default:
+		  break;
+		}
+	    }
+	}
+    }
+
+  xfree (seen);
+  xfree (stack);
+  return found;
+}
+
+/* Return the DFA to use for BUFP, building it if needed, or NULL if
+   the pattern cannot be matched with a DFA.  */
+
+static struct re_dfa *
+dfa_get (struct re_pattern_buffer *bufp)
+{
+  struct re_dfa *dfa = bufp->dfa;
+  if (dfa)
+    {
+      if (dfa->target_multibyte == RE_TARGET_MULTIBYTE_P (bufp)
+	  && EQ (dfa->translate, bufp->translate))
+	return dfa;
+      re_free_dfa (bufp);
+    }
+  if (bufp->dfa_unusable)
+    return NULL;
+
+  struct dfa_builder b = { .bufp = bufp, .ok = true };
+  dfa_emit_range (&b, bufp->buffer, bufp->buffer + bufp->used);
+  dfa_emit (&b, DFA_MATCH, 0, 0, 0);
+  if (!b.ok || dfa_empty_loop_p (b.prog, b.ninsns))
+    {
+      xfree (b.prog);
+      bufp->dfa_unusable = true;
+      return NULL;
+    }
+
+  dfa = xzalloc (sizeof *dfa);
+  dfa->prog = b.prog;
+  dfa->ninsns = b.ninsns;
+  dfa->target_multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  dfa->translate = bufp->translate;
+  dfa->longest = !b.saw_succeed;
+  for (int i = 0; i < b.ninsns; i++)
+    switch (b.prog[i].op)
+      {
+      case DFA_BEGLINE:
+	dfa->ctx_mask |= DFA_AT_BOL;
+	break;
+      case DFA_BEGBUF:
+	dfa->ctx_mask |= DFA_AT_BOB;
+	break;
+      default:
+	break;
+      }
+  dfa->list = xnmalloc (6 * b.ninsns + 1, sizeof *dfa->list);
+  dfa->list2 = dfa->list + b.ninsns;
+  dfa->stack = dfa->list2 + b.ninsns;
+  dfa->seen = xzalloc (2 * b.ninsns * sizeof *dfa->seen);
+  dfa->seen2 = dfa->seen + b.ninsns;
+  dfa_flush (dfa);
+  bufp->dfa = dfa;
+  return dfa;
+}
+
+/* Start a new list of threads in THREADS, with SEEN for marking the
+   threads already in it.  */
+
+static void
+dfa_list_init (struct re_dfa *dfa, struct dfa_list *l, int *threads,
+	       unsigned *seen)
+{
+  if (++dfa->stamp == 0)
+    {
+      memset (dfa->seen, 0, 2 * dfa->ninsns * sizeof *dfa->seen);
+      dfa->stamp = 1;
+    }
+  *l = (struct dfa_list) { .threads = threads, .seen = seen,
+			   .stamp = dfa->stamp };
+}
+
+/* Add to L the thread at PC and the threads reachable from it by empty
+   transitions in context CTX, in priority order.  */
+
+static void
+dfa_add (struct re_dfa *dfa, struct dfa_list *l, int pc, int ctx)
+{
+  int *stack = dfa->stack;
+  int sp = 0;
+
+  if (l->cut)
+    return;
+  stack[sp++] = pc;
+  while (sp > 0)
+    {
+      pc = stack[--sp];
+      if (l->seen[pc] == l->stamp)
+	continue;
+      l->seen[pc] = l->stamp;
+      struct dfa_insn *in = &dfa->prog[pc];
+      switch (in->op)
+	{
+	case DFA_JUMP:
+	  stack[sp++] = in->x;
+	  break;
+
+	case DFA_SPLIT:
+	case DFA_LOOP:
+	  stack[sp++] = in->y;
+	  stack[sp++] = in->x;
+	  break;
+
+	case DFA_BEGLINE:
+	  if (ctx & DFA_AT_BOL)
+	    stack[sp++] = pc + 1;
+	  break;
+
+	case DFA_BEGBUF:
+	  if (ctx & DFA_AT_BOB)
+	    stack[sp++] = pc + 1;
+	  break;
+
+	case DFA_ENDLINE:
+	  if (ctx & DFA_AT_EOL)
+	    stack[sp++] = pc + 1;
+	  else if (! (ctx & DFA_NOT_EOL))
+	    l->threads[l->n++] = pc;
+	  break;
+
+	case DFA_ENDBUF:
+	  if (ctx & DFA_AT_EOB)
+	    stack[sp++] = pc + 1;
+	  else if (! (ctx & DFA_NOT_EOB))
+	    l->threads[l->n++] = pc;
+	  break;
+
+	case DFA_MATCH:
+	  l->threads[l->n++] = pc;
+	  l->match = true;
+	  if (!dfa->longest)
+	    {
+	      l->cut = true;
+	      return;
+	    }
+	  break;
+
+	default:
+	  l->threads[l->n++] = pc;
+	  break;
+	}
+    }
+}
+
+/* Return the state with the threads of L and context flags FLAGS,
+   creating it if necessary.  */
+
+static int
+dfa_intern (struct re_dfa *dfa, struct dfa_list *l, int flags)
+{
+  EMACS_UINT hash = flags;
+  for (int i = 0; i < l->n; i++)
+    hash = sxhash_combine (hash, l->threads[i]);
+  int bucket = hash & (DFA_INDEX_SIZE - 1);
+
+  for (int s = dfa->index[bucket]; s >= 0; s = dfa->states[s].hash_next)
+    {
+      struct dfa_state *st = &dfa->states[s];
+      if ((st->flags & DFA_KEY_FLAGS) == flags && st->nthreads == l->n
+	  && !memcmp (dfa->pool + st->first, l->threads,
+		      l->n * sizeof *l->threads))
+	return s;
+    }
+
+  if (dfa->nstates == DFA_MAX_STATES)
+    dfa_flush (dfa);
+  if (dfa->nstates == dfa->states_alloc)
+    dfa->states = xpalloc (dfa->states, &dfa->states_alloc, 1,
+			   DFA_MAX_STATES, sizeof *dfa->states);
+  if (dfa->pool_alloc - dfa->npool < l->n)
+    dfa->pool = xpalloc (dfa->pool, &dfa->pool_alloc,
+			 l->n - (dfa->pool_alloc - dfa->npool), -1,
+			 sizeof *dfa->pool);
+
+  int s = dfa->nstates++;
+  struct dfa_state *st = &dfa->states[s];
+  st->first = dfa->npool;
+  st->nthreads = l->n;
+  memcpy (dfa->pool + st->first, l->threads, l->n * sizeof *l->threads);
+  dfa->npool += l->n;
+  st->flags = flags | (l->match ? DFA_ACCEPT : 0);
+  memset (st->next, -1, sizeof st->next);
+  st->hash_next = dfa->index[bucket];
+  dfa->index[bucket] = s;
+  return s;
+}
+
+/* Return the state for starting a match in context FLAGS.  */
+
+static int
+dfa_initial (struct re_dfa *dfa, int flags)
+{
+  struct dfa_list l;
+  flags &= dfa->ctx_mask | DFA_SEED;
+  dfa_list_init (dfa, &l, dfa->list, dfa->seen);
+  dfa_add (dfa, &l, 0, flags);
+  return dfa_intern (dfa, &l, flags);
+}
+
+/* Return state S without starting new threads any more.  */
+
+static int
+dfa_unseed (struct re_dfa *dfa, int s)
+{
+  struct dfa_state *st = &dfa->states[s];
+  struct dfa_list l;
+  dfa_list_init (dfa, &l, dfa->list, dfa->seen);
+  memcpy (l.threads, dfa->pool + st->first, st->nthreads * sizeof *l.threads);
+  l.n = st->nthreads;
+  l.match = st->flags & DFA_ACCEPT;
+  return dfa_intern (dfa, &l, st->flags & (DFA_KEY_FLAGS & ~DFA_SEED));
+}
+
+/* Convert C, a character of the text as fetched by RE_STRING_CHAR, the
+   way the backtracking matcher does for each kind of operation.  */
+
+static void
+dfa_convert_char (struct re_dfa *dfa, int c, struct dfa_char *ch)
+{
+  Lisp_Object translate = dfa->translate;
+
+  ch->newline = c == '\n';
+  ch->corig = c;
+  ch->unibyte = false;
+  if (dfa->target_multibyte)
+    {
+      ch->key = ch->any = ch->c = TRANSLATE (c);
+      int c1 = RE_CHAR_TO_UNIBYTE (ch->c);
+      if (c1 >= 0)
+	{
+	  ch->unibyte = true;
+	  ch->c = c1;
+	}
+    }
+  else
+    {
+      ch->any = TRANSLATE (c);
+      ch->key = ch->c = c;
+      int c1 = RE_CHAR_TO_MULTIBYTE (c);
+      if (! CHAR_BYTE8_P (c1))
+	{
+	  c1 = TRANSLATE (c1);
+	  c1 = RE_CHAR_TO_UNIBYTE (c1);
+	  if (c1 >= 0)
+	    {
+	      ch->unibyte = true;
+	      ch->key = ch->c = c1;
+	    }
+	}
+      else
+	ch->unibyte = true;
+    }
+}
+
+/* Return true if the consuming instruction IN matches CH.  */
+
+static bool
+dfa_insn_matches (struct re_pattern_buffer *bufp, struct dfa_insn *in,
+		  struct dfa_char *ch)
+{
+  switch (in->op)
+    {
+    case DFA_CHAR:
+      return ch->key == in->c;
+
+    case DFA_ANYCHAR:
+      return ch->any != '\n';
+
+    case DFA_CHARSET:
+      {
+	re_char *p = bufp->buffer + in->x;
+	return execute_charset (&p, ch->c, ch->corig, ch->unibyte,
+				bufp->translate);
+      }
+
+    default:
+      return false;
+    }
+}
+
+/* Compute the transition of state S on the character C, in the same
+   format as the elements of the NEXT array of states.  */
+
+static int
+dfa_transition (struct re_pattern_buffer *bufp, int s, int c)
+{
+  struct re_dfa *dfa = bufp->dfa;
+  struct dfa_char ch;
+  struct dfa_list l;
+  bool match_here = false;
+  int flags = dfa->states[s].flags;
+  int next_flags = (flags & DFA_SEED) | (c == '\n' ? DFA_AT_BOL : 0);
+  next_flags &= dfa->ctx_mask | DFA_SEED;
+
+  dfa_convert_char (dfa, c, &ch);
+  dfa_list_init (dfa, &l, dfa->list, dfa->seen);
+
+  for (int i = 0; i < dfa->states[s].nthreads; i++)
+    {
+      int pc = dfa->pool[dfa->states[s].first + i];
+      struct dfa_insn *in = &dfa->prog[pc];
+      switch (in->op)
+	{
+	case DFA_MATCH:
+	  if (!dfa->longest)
+	    goto done;
+	  break;
+
+	case DFA_ENDLINE:
+	  /* We are at the end of a line if C is a newline; then follow
+	     the threads that continue from here.  */
+	  if (ch.newline)
+	    {
+	      struct dfa_list e;
+	      dfa_list_init (dfa, &e, dfa->list2, dfa->seen2);
+	      dfa_add (dfa, &e, pc + 1,
+		       (flags & (DFA_AT_BOL | DFA_AT_BOB))
+		       | DFA_AT_EOL | DFA_NOT_EOB);
+	      for (int j = 0; j < e.n; j++)
+		{
+		  struct dfa_insn *ein = &dfa->prog[e.threads[j]];
+		  if (ein->op == DFA_MATCH)
+		    {
+		      match_here = true;
+		      if (!dfa->longest)
+			goto done;
+		    }
+		  else if (dfa_insn_matches (bufp, ein, &ch))
+		    dfa_add (dfa, &l, e.threads[j] + 1, next_flags);
+		}
+	    }
+	  break;
+
+	case DFA_ENDBUF:
+	  break;
+
+	default:
+	  if (dfa_insn_matches (bufp, in, &ch))
+	    dfa_add (dfa, &l, pc + 1, next_flags);
+	  break;
+	}
+    }
+  if (flags & DFA_SEED)
+    dfa_add (dfa, &l, 0, next_flags);
+
+ done:
+  return dfa_intern (dfa, &l, next_flags) << 1 | match_here;
+}
+
+/* Return true if the text matches in state S at its end, or before
+   text that is not to be matched.  EOL and EOB say whether that is at
+   the end of a line and of the whole text.  */
+
+static bool
+dfa_final (struct re_dfa *dfa, int s, bool eol, bool eob)
+{
+  struct dfa_state *st = &dfa->states[s];
+  int ctx = ((st->flags & (DFA_AT_BOL | DFA_AT_BOB))
+	     | (eol ? DFA_AT_EOL : DFA_NOT_EOL)
+	     | (eob ? DFA_AT_EOB : DFA_NOT_EOB));
+
+  if (st->flags & DFA_ACCEPT)
+    return true;
+  for (int i = 0; i < st->nthreads; i++)
+    {
+      int pc = dfa->pool[st->first + i];
+      if (dfa->prog[pc].op == DFA_ENDLINE || dfa->prog[pc].op == DFA_ENDBUF)
+	{
+	  struct dfa_list e;
+	  dfa_list_init (dfa, &e, dfa->list2, dfa->seen2);
+	  dfa_add (dfa, &e, pc, ctx);
+	  if (e.match)
+	    return true;
+	}
+    }
+  return false;
+}
+
+/* Run the DFA of BUFP on the virtual concatenation of STRING1 and
+   STRING2 (of sizes SIZE1 and SIZE2), from POS, without looking at the
+   text at or after STOP.  If SEED_LIMIT is at least POS, look for a
+   match that starts anywhere from POS to SEED_LIMIT, and return where
+   the first such match to be found ends.  Otherwise, look only for a
+   match that starts at POS, and return where the match that the
+   backtracking matcher would choose ends.  Return -1 if there is no
+   match.  */
+
+static ptrdiff_t
+dfa_execute (struct re_pattern_buffer *bufp,
+	     re_char *string1, ptrdiff_t size1,
+	     re_char *string2, ptrdiff_t size2,
+	     ptrdiff_t pos, ptrdiff_t stop, ptrdiff_t seed_limit)
+{
+  struct re_dfa *dfa = bufp->dfa;
+  bool multibyte = dfa->target_multibyte;
+  ptrdiff_t total_size = size1 + size2, start = pos, last = -1;
+  bool searching = pos <= seed_limit, seeding = searching;
+  int s, flags = seeding ? DFA_SEED : 0;
+
+#define DFA_BYTE_AT(pos) \
+  ((pos) < size1 ? string1[pos] : string2[(pos) - size1])
+
+  if (pos == 0)
+    flags |= DFA_AT_BOL | DFA_AT_BOB;
+  else if (DFA_BYTE_AT (pos - 1) == '\n')
+    flags |= DFA_AT_BOL;
+  s = dfa_initial (dfa, flags);
+
+  while (true)
+    {
+      if (dfa->states[s].flags & DFA_ACCEPT)
+	{
+	  last = pos;
+	  if (searching || dfa->states[s].nthreads == 1)
+	    break;
+	}
+      if (pos == stop)
+	{
+	  if (last < pos
+	      && dfa_final (dfa, s, (pos == total_size
+				     || DFA_BYTE_AT (pos) == '\n'),
+			    pos == total_size))
+	    last = pos;
+	  break;
+	}
+      if (dfa->states[s].nthreads == 0 && ! (dfa->states[s].flags & DFA_SEED))
+	break;
+
+      re_char *d = pos < size1 ? string1 + pos : string2 + (pos - size1);
+      int len, t;
+      if (!multibyte || ASCII_CHAR_P (*d))
+	{
+	  len = 1;
+	  if (seeding && pos + 1 > seed_limit)
+	    {
+	      s = dfa_unseed (dfa, s);
+	      seeding = false;
+	    }
+	  t = dfa->states[s].next[*d];
+	  if (t < 0)
+	    {
+	      unsigned generation = dfa->generation;
+	      t = dfa_transition (bufp, s, *d);
+	      if (dfa->generation == generation)
+		dfa->states[s].next[*d] = t;
+	    }
+	}
+      else
+	{
+	  int c = string_char_and_length (d, &len);
+	  if (seeding && pos + len > seed_limit)
+	    {
+	      s = dfa_unseed (dfa, s);
+	      seeding = false;
+	    }
+	  int h = (s * 31 + c) & (DFA_WIDE_CACHE_SIZE - 1);
+	  if (dfa->wide[h].state == s && dfa->wide[h].c == c)
+	    t = dfa->wide[h].next;
+	  else
+	    {
+	      unsigned generation = dfa->generation;
+	      t = dfa_transition (bufp, s, c);
+	      if (dfa->generation == generation)
+		{
+		  dfa->wide[h].state = s;
+		  dfa->wide[h].c = c;
+		  dfa->wide[h].next = t;
+		}
+	    }
+	}
+
+      if (t & 1)
+	{
+	  last = pos;
+	  if (searching)
+	    break;
+	}
+      s = t >> 1;
+      pos += len;
+    }
+
+#undef DFA_BYTE_AT
+
+  /* See the comment at the end of re_match_2_internal.  */
+  if (max_redisplay_ticks > 0 && pos > start)
+    update_redisplay_ticks ((pos - start) / 50 + 1, NULL);
+
+  return last;
+}
+
 /* Matching routines.  */
 
 /* re_match_2 matches the compiled pattern in BUFP against the
@@ -4053,12 +5277,86 @@ re_match_2 (struct re_pattern_buffer *bufp,
 
   RE_SETUP_SYNTAX_TABLE_FOR_OBJECT (re_match_object, pos);
 
-  result = re_match_2_internal (bufp, (re_char *) string1, size1,
-				(re_char *) string2, size2,
-				pos, regs, stop);
+  result = re_match_2_dfa (bufp, (re_char *) string1, size1,
+			   (re_char *) string2, size2,
+			   pos, regs, stop, dfa_get (bufp));
   return result;
 }
 
+/* Make REGS big enough for NUM_REGS registers, allocating its arrays
+   if BUFP says so.  */
+
+static void
+re_alloc_registers (struct re_pattern_buffer *bufp,
+		    struct re_registers *regs, ptrdiff_t num_regs)
+{
+  /* Have the register data arrays been allocated?	*/
+  if (bufp->regs_allocated == REGS_UNALLOCATED)
+    { /* No.  So allocate them with malloc.  */
+      ptrdiff_t n = max (RE_NREGS, num_regs);
+      regs->start = xnmalloc (n, sizeof *regs->start);
+      regs->end = xnmalloc (n, sizeof *regs->end);
+      regs->num_regs = n;
+      bufp->regs_allocated = REGS_REALLOCATE;
+    }
+  else if (bufp->regs_allocated == REGS_REALLOCATE)
+    { /* Yes.  If we need more elements than were already
+	 allocated, reallocate them.  If we need fewer, just
+	 leave it alone.  */
+      ptrdiff_t n = regs->num_regs;
+      if (n < num_regs)
+	{
+	  n = max (n + (n >> 1), num_regs);
+	  regs->start = xnrealloc (regs->start, n, sizeof *regs->start);
+	  regs->end = xnrealloc (regs->end, n, sizeof *regs->end);
+	  regs->num_regs = n;
+	}
+    }
+  else
+    eassert (bufp->regs_allocated == REGS_FIXED);
+}
+
+/* Like re_match_2_internal, but if USE_DFA, try the DFA of BUFP first.
+   It rules out positions where nothing matches, and if the caller does
+   not need the extent of subexpressions, it finds the match itself.  */
+
+static ptrdiff_t
+re_match_2_dfa (struct re_pattern_buffer *bufp,
+		re_char *string1, ptrdiff_t size1,
+		re_char *string2, ptrdiff_t size2,
+		ptrdiff_t pos, struct re_registers *regs, ptrdiff_t stop,
+		bool use_dfa)
+{
+  if (use_dfa)
+    {
+      if (regs && bufp->re_nsub > 0)
+	{
+	  if (dfa_execute (bufp, string1, size1, string2, size2,
+			   pos, stop, pos) < 0)
+	    return -1;
+	}
+      else
+	{
+	  ptrdiff_t end = dfa_execute (bufp, string1, size1, string2, size2,
+				       pos, stop, -1);
+	  if (end >= 0 && regs)
+	    {
+	      re_alloc_registers (bufp, regs, 1);
+	      if (regs->num_regs > 0)
+		{
+		  regs->start[0] = pos;
+		  regs->end[0] = end;
+		}
+	      for (ptrdiff_t reg = 1; reg < regs->num_regs; reg++)
+		regs->start[reg] = regs->end[reg] = -1;
+	    }
+	  return end < 0 ? -1 : end - pos;
+	}
+    }
+  return re_match_2_internal (bufp, string1, size1, string2, size2,
+			      pos, regs, stop);
+}
+
 static void
 unwind_re_match (void *ptr)
 {
@@ -4350,31 +5648,7 @@ re_match_2_internal (struct re_pattern_buffer *bufp,
 	  /* If caller wants register contents data back, do it.  */
 	  if (regs)
 	    {
-	      /* Have the register data arrays been allocated?	*/
-	      if (bufp->regs_allocated == REGS_UNALLOCATED)
-		{ /* No.  So allocate them with malloc.  */
-		  ptrdiff_t n = max (RE_NREGS, num_regs);
-		  regs->start = xnmalloc (n, sizeof *regs->start);
-		  regs->end = xnmalloc (n, sizeof *regs->end);
-		  regs->num_regs = n;
-		  bufp->regs_allocated = REGS_REALLOCATE;
-		}
-	      else if (bufp->regs_allocated == REGS_REALLOCATE)
-		{ /* Yes.  If we need more elements than were already
-		     allocated, reallocate them.  If we need fewer, just
-		     leave it alone.  */
-		  ptrdiff_t n = regs->num_regs;
-		  if (n < num_regs)
-		    {
-		      n = max (n + (n >> 1), num_regs);
-		      regs->start
-			= xnrealloc (regs->start, n, sizeof *regs->start);
-		      regs->end = xnrealloc (regs->end, n, sizeof *regs->end);
-		      regs->num_regs = n;
-		    }
-		}
-	      else
-		eassert (bufp->regs_allocated == REGS_FIXED);
+	      re_alloc_registers (bufp, regs, num_regs);
 
 	      /* Convert the pointer data in 'regstart' and 'regend' to
 		 indices.  Register zero has to be set differently,
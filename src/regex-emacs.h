@@ -118,6 +118,27 @@ struct re_pattern_buffer
   /* If true, multi-byte form in the target of match should be
      recognized as a multibyte character.  */
   bool_bf target_multibyte : 1;
+
+  /* If true, the pattern uses operators that the DFA matcher cannot
+     handle, so searches always use the backtracking matcher.  */
+  bool_bf dfa_unusable : 1;
+
+  /* If true, every match begins with the literal described by
+     'must_start' and 'must_size'.  */
+  bool_bf must_prefix : 1;
+
+  /* Lazily built DFA for the pattern, or NULL.  See regex-emacs.c.  */
+  struct re_dfa *dfa;
+
+  /* Offset in 'buffer' of a string of bytes that every match contains,
+     or -1 if no such string was found.  Searches look for it first.  */
+  ptrdiff_t must_start;
+
+  /* Length in bytes of that string.  */
+  ptrdiff_t must_size;
+
+  /* Minimum number of characters that a match has before it.  */
+  ptrdiff_t must_offset;
 };
 
 /* Declarations for routines.  */
@@ -161,6 +182,13 @@ extern ptrdiff_t re_match_2 (struct re_pattern_buffer *buffer,
 			    ptrdiff_t stop);
 
 
+/* Free the DFA state built for BUFFER, if any.  */
+extern void re_free_dfa (struct re_pattern_buffer *buffer);
+
+/* Release the cached DFA states of BUFFER if there are many of them.  */
+extern void re_shrink_dfa (struct re_pattern_buffer *buffer);
+
+
 /* Set REGS to hold NUM_REGS registers, storing them in STARTS and
    ENDS.  Subsequent matches using BUFFER and REGS will use this memory
    for recording register information.  STARTS and ENDS must be
@@ -31,16 +31,22 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "intervals.h"
 #include "pdumper.h"
 #include "composite.h"
+#include "systime.h"
 
 #include "regex-emacs.h"
 
-#define REGEXP_CACHE_SIZE 20
+/* Number of entries in the regexp cache, unless the user says
+   otherwise through `regexp-cache-size'.  */
+#define REGEXP_CACHE_SIZE 100
 
 /* If the regexp is non-nil, then the buffer contains the compiled form
    of that regexp, suitable for searching.  */
 struct regexp_cache
 {
-  struct regexp_cache *next;
+  /* Neighbors in the LRU list.  NEXT is less recently used.  */
+  struct regexp_cache *next, *prev;
+  /* Next entry in the same bucket of the hash index.  */
+  struct regexp_cache *hash_next;
   Lisp_Object regexp, f_whitespace_regexp;
   /* Syntax table for which the regexp applies.  We need this because
      of character classes.  If this is t, then the compiled pattern is valid
@@ -48,18 +54,50 @@ struct regexp_cache
   Lisp_Object syntax_table;
   struct re_pattern_buffer buf;
   char fastmap[0400];
+  /* Hash of REGEXP and the context it was compiled in; see
+     regexp_cache_hash.  Meaningful only if REGEXP is non-nil.  */
+  EMACS_UINT hash;
+  /* Value of regexp_syntax_generation when the regexp was compiled.  */
+  EMACS_UINT syntax_generation;
   /* True means regexp was compiled to do full POSIX backtracking.  */
   bool posix;
   /* True means we're inside a buffer match.  */
   bool busy;
+  /* True means the entry is never evicted from the cache.  */
+  bool pinned;
+  /* True means the entry belongs to a compiled regexp object rather
+     than to the cache.  */
+  bool owned;
 };
 
-/* The instances of that struct.  */
-static struct regexp_cache searchbufs[REGEXP_CACHE_SIZE];
-
 /* The head of the linked list; points to the most recently used buffer.  */
 static struct regexp_cache *searchbuf_head;
 
+/* The least recently used buffer.  */
+static struct regexp_cache *searchbuf_tail;
+
+/* Number of entries in the cache.  */
+static ptrdiff_t searchbuf_count;
+
+/* Hash index of the cache entries that hold a compiled regexp.
+   Its size is a power of two.  */
+static struct regexp_cache **searchbuf_index;
+static ptrdiff_t searchbuf_index_size;
+
+/* Patterns whose cache entries should never be evicted; see
+   pin_regexp.  This is an `equal' hash table whose keys are the
+   pattern strings.  */
+static Lisp_Object regexp_cache_pinned;
+
+/* Incremented whenever a syntax table changes.  Compiled regexp
+   objects use it to notice that their compiled form is stale, since
+   they are not reached by clear_regexp_cache.  */
+static EMACS_UINT regexp_syntax_generation;
+
+/* Statistics reported by `regexp-cache-statistics'.  */
+static intmax_t regexp_cache_hits, regexp_cache_misses;
+static struct timespec regexp_cache_compile_time;
+
 static void set_search_regs (ptrdiff_t, ptrdiff_t);
 static void save_search_regs (void);
 static EMACS_INT simple_search (EMACS_INT, unsigned char *, ptrdiff_t,
@@ -88,64 +126,229 @@ freeze_buffer_relocation (void)
 #endif
 }
 
+/* Return the hash of PATTERN compiled with TRANSLATE and POSIX.
+   The syntax table and the whitespace regexp are not part of the
+   hash; they are compared when an entry is looked up.  */
+
+static EMACS_UINT
+regexp_cache_hash (Lisp_Object pattern, Lisp_Object translate, bool posix)
+{
+  EMACS_UINT hash = hash_string (SSDATA (pattern), SBYTES (pattern));
+  hash = sxhash_combine (hash, XHASH (translate));
+  hash = sxhash_combine (hash, posix + 2 * STRING_MULTIBYTE (pattern));
+  return sxhash_combine (hash, charset_unibyte);
+}
+
+static struct regexp_cache **
+regexp_cache_bucket (EMACS_UINT hash)
+{
+  return &searchbuf_index[hash & (searchbuf_index_size - 1)];
+}
+
+static void
+regexp_cache_index_entry (struct regexp_cache *cp)
+{
+  struct regexp_cache **bucket = regexp_cache_bucket (cp->hash);
+  cp->hash_next = *bucket;
+  *bucket = cp;
+}
+
+static void
+regexp_cache_unindex_entry (struct regexp_cache *cp)
+{
+  for (struct regexp_cache **p = regexp_cache_bucket (cp->hash);
+       *p; p = &(*p)->hash_next)
+    if (*p == cp)
+      {
+	*p = cp->hash_next;
+	break;
+      }
+  cp->hash_next = NULL;
+}
+
+/* Make the hash index large enough for the current number of cache
+   entries, rebuilding it if necessary.  */
+
+static void
+regexp_cache_reindex (void)
+{
+  ptrdiff_t wanted = max (2 * searchbuf_count, 16);
+  if (wanted <= searchbuf_index_size)
+    return;
+
+  ptrdiff_t size = 16;
+  while (size < wanted)
+    size *= 2;
+  xfree (searchbuf_index);
+  searchbuf_index = xzalloc (size * sizeof *searchbuf_index);
+  searchbuf_index_size = size;
+  for (struct regexp_cache *cp = searchbuf_head; cp; cp = cp->next)
+    if (!NILP (cp->regexp))
+      regexp_cache_index_entry (cp);
+}
+
+static void
+regexp_cache_unlink (struct regexp_cache *cp)
+{
+  if (cp->prev)
+    cp->prev->next = cp->next;
+  else
+    searchbuf_head = cp->next;
+  if (cp->next)
+    cp->next->prev = cp->prev;
+  else
+    searchbuf_tail = cp->prev;
+  cp->next = cp->prev = NULL;
+}
+
+static void
+regexp_cache_push_front (struct regexp_cache *cp)
+{
+  cp->prev = NULL;
+  cp->next = searchbuf_head;
+  if (searchbuf_head)
+    searchbuf_head->prev = cp;
+  else
+    searchbuf_tail = cp;
+  searchbuf_head = cp;
+}
+
+static void
+regexp_cache_push_back (struct regexp_cache *cp)
+{
+  cp->next = NULL;
+  cp->prev = searchbuf_tail;
+  if (searchbuf_tail)
+    searchbuf_tail->next = cp;
+  else
+    searchbuf_head = cp;
+  searchbuf_tail = cp;
+}
+
+static struct regexp_cache *
+make_regexp_cache_entry (void)
+{
+  struct regexp_cache *cp = xzalloc (sizeof *cp);
+  cp->buf.allocated = 100;
+  cp->buf.buffer = xmalloc (100);
+  cp->buf.fastmap = cp->fastmap;
+  cp->buf.translate = Qnil;
+  cp->regexp = Qnil;
+  cp->f_whitespace_regexp = Qnil;
+  cp->syntax_table = Qnil;
+  return cp;
+}
+
+static void
+free_regexp_cache_entry (struct regexp_cache *cp)
+{
+  eassert (!cp->busy);
+  re_free_dfa (&cp->buf);
+  xfree (cp->buf.buffer);
+  xfree (cp);
+}
+
 /* Compile a regexp and signal a Lisp error if anything goes wrong.
    PATTERN is the pattern to compile.
    CP is the place to put the result.
    TRANSLATE is a translation table for ignoring case, or nil for none.
+   WHITESPACE is the regexp to substitute for runs of spaces, or nil;
+   this is normally the value of Vsearch_spaces_regexp.
    POSIX is true if we want full backtracking (POSIX style) for this pattern.
-   False means backtrack only enough to get a valid match.
-
-   The behavior also depends on Vsearch_spaces_regexp.  */
+   False means backtrack only enough to get a valid match.  */
 
 static void
 compile_pattern_1 (struct regexp_cache *cp, Lisp_Object pattern,
-		   Lisp_Object translate, bool posix)
+		   Lisp_Object translate, Lisp_Object whitespace, bool posix)
 {
   const char *whitespace_regexp;
   char *val;
 
   eassert (!cp->busy);
+  if (!cp->owned && !NILP (cp->regexp))
+    regexp_cache_unindex_entry (cp);
   cp->regexp = Qnil;
   cp->buf.translate = translate;
   cp->posix = posix;
   cp->buf.multibyte = STRING_MULTIBYTE (pattern);
   cp->buf.charset_unibyte = charset_unibyte;
-  if (STRINGP (Vsearch_spaces_regexp))
-    cp->f_whitespace_regexp = Vsearch_spaces_regexp;
+  if (STRINGP (whitespace))
+    cp->f_whitespace_regexp = whitespace;
   else
     cp->f_whitespace_regexp = Qnil;
 
-  whitespace_regexp = STRINGP (Vsearch_spaces_regexp) ?
-    SSDATA (Vsearch_spaces_regexp) : NULL;
+  whitespace_regexp = STRINGP (whitespace) ? SSDATA (whitespace) : NULL;
 
+  struct timespec start = current_timespec ();
   val = (char *) re_compile_pattern (SSDATA (pattern), SBYTES (pattern),
 				     posix, whitespace_regexp, &cp->buf);
+  regexp_cache_compile_time
+    = timespec_add (regexp_cache_compile_time,
+		    timespec_sub (current_timespec (), start));
 
   /* If the compiled pattern hard codes some of the contents of the
      syntax-table, it can only be reused with *this* syntax table.  */
   cp->syntax_table = cp->buf.used_syntax ? BVAR (current_buffer, syntax_table) : Qt;
+  cp->syntax_generation = regexp_syntax_generation;
 
   if (val)
     xsignal1 (Qinvalid_regexp, build_string (val));
 
   cp->regexp = Fcopy_sequence (pattern);
+  if (!cp->owned)
+    {
+      cp->hash = regexp_cache_hash (pattern, translate, posix);
+      cp->pinned = !NILP (Fgethash (pattern, regexp_cache_pinned, Qnil));
+      regexp_cache_index_entry (cp);
+    }
 }
 
 /* Shrink each compiled regexp buffer in the cache
-   to the size actually used right now.
+   to the size actually used right now, and drop the least recently
+   used entries if the cache has grown past `regexp-cache-size'.
    This is called from garbage collection.  */
 
 void
 shrink_regexp_cache (void)
 {
-  struct regexp_cache *cp;
+  struct regexp_cache *cp, *prev;
 
   for (cp = searchbuf_head; cp != 0; cp = cp->next)
     if (!cp->busy)
       {
         cp->buf.allocated = cp->buf.used;
         cp->buf.buffer = xrealloc (cp->buf.buffer, cp->buf.used);
+        re_shrink_dfa (&cp->buf);
       }
+
+  for (cp = searchbuf_tail;
+       cp && searchbuf_count > max (regexp_cache_size, 1);
+       cp = prev)
+    {
+      prev = cp->prev;
+      if (cp->busy || cp->pinned)
+	continue;
+      if (!NILP (cp->regexp))
+	regexp_cache_unindex_entry (cp);
+      regexp_cache_unlink (cp);
+      free_regexp_cache_entry (cp);
+      searchbuf_count--;
+    }
+}
+
+/* Mark the Lisp objects referenced from the regexp cache.
+   This is called from garbage collection.  */
+
+void
+mark_regexp_cache (void)
+{
+  for (struct regexp_cache *cp = searchbuf_head; cp; cp = cp->next)
+    {
+      mark_object (cp->regexp);
+      mark_object (cp->f_whitespace_regexp);
+      mark_object (cp->syntax_table);
+      mark_object (cp->buf.translate);
+    }
 }
 
 /* Clear the regexp cache w.r.t. a particular syntax table,
@@ -156,14 +359,51 @@ shrink_regexp_cache (void)
 void
 clear_regexp_cache (void)
 {
-  int i;
+  struct regexp_cache *cp, *next;
+
+  regexp_syntax_generation++;
 
-  for (i = 0; i < REGEXP_CACHE_SIZE; ++i)
-    /* It's tempting to compare with the syntax-table we've actually changed,
-       but it's not sufficient because char-table inheritance means that
-       modifying one syntax-table can change others at the same time.  */
-    if (!searchbufs[i].busy && !BASE_EQ (searchbufs[i].syntax_table, Qt))
-      searchbufs[i].regexp = Qnil;
+  for (cp = searchbuf_head; cp; cp = next)
+    {
+      next = cp->next;
+      /* It's tempting to compare with the syntax-table we've actually changed,
+	 but it's not sufficient because char-table inheritance means that
+	 modifying one syntax-table can change others at the same time.  */
+      if (!cp->busy && !NILP (cp->regexp)
+	  && !BASE_EQ (cp->syntax_table, Qt))
+	{
+	  regexp_cache_unindex_entry (cp);
+	  cp->regexp = Qnil;
+	  /* Make the entry the first candidate for reuse.  */
+	  regexp_cache_unlink (cp);
+	  regexp_cache_push_back (cp);
+	}
+    }
+}
+
+/* Arrange for the compiled form of REGEXP to stay in the regexp cache
+   once it has been compiled, regardless of how many other regexps are
+   used.  This is meant for regexps that C code matches often, such as
+   those used by redisplay.  */
+
+void
+pin_regexp (Lisp_Object regexp)
+{
+  CHECK_STRING (regexp);
+  Fputhash (Fcopy_sequence (regexp), Qt, regexp_cache_pinned);
+  for (struct regexp_cache *cp = searchbuf_head; cp; cp = cp->next)
+    if (!NILP (cp->regexp) && !NILP (Fstring_equal (cp->regexp, regexp)))
+      cp->pinned = true;
+}
+
+/* Signal an error unless REGEXP is a string or a compiled regexp
+   object.  */
+
+static void
+check_regexp (Lisp_Object regexp)
+{
+  if (!REGEXPP (regexp))
+    CHECK_STRING (regexp);
 }
 
 static void
@@ -181,9 +421,130 @@ freeze_pattern (struct regexp_cache *searchbuf)
   searchbuf->busy = true;
 }
 
+/* Return true if the compiled form in CP can be used for PATTERN with
+   TRANSLATE, WHITESPACE and POSIX in the current buffer.  */
+
+static bool
+regexp_cache_entry_usable_p (struct regexp_cache *cp, Lisp_Object pattern,
+			     Lisp_Object translate, Lisp_Object whitespace,
+			     bool posix)
+{
+  return (!cp->busy
+	  && !NILP (cp->regexp)
+	  && SCHARS (cp->regexp) == SCHARS (pattern)
+	  && STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
+	  && !NILP (Fstring_equal (cp->regexp, pattern))
+	  && BASE_EQ (cp->buf.translate, translate)
+	  && cp->posix == posix
+	  && (BASE_EQ (cp->syntax_table, Qt)
+	      || (BASE_EQ (cp->syntax_table,
+			   BVAR (current_buffer, syntax_table))
+		  && cp->syntax_generation == regexp_syntax_generation))
+	  && !NILP (Fequal (cp->f_whitespace_regexp, whitespace))
+	  && cp->buf.charset_unibyte == charset_unibyte);
+}
+
+/* Return a cache entry that may be recompiled: a new entry if the
+   cache has room, otherwise the least recently used entry that is
+   neither busy nor pinned.  */
+
+static struct regexp_cache *
+regexp_cache_victim (void)
+{
+  struct regexp_cache *cp;
+
+  if (searchbuf_count >= max (regexp_cache_size, 1))
+    for (cp = searchbuf_tail; cp; cp = cp->prev)
+      if (!cp->busy && !cp->pinned)
+	return cp;
+
+  /* Either there is room left, or every entry is in use by a match
+     further up the stack or pinned.  In the latter case, exceed the
+     limit rather than fail; shrink_regexp_cache trims the cache back
+     when the entries are released.  */
+  cp = make_regexp_cache_entry ();
+  regexp_cache_push_front (cp);
+  searchbuf_count++;
+  regexp_cache_reindex ();
+  return cp;
+}
+
+/* Look up PATTERN in the regexp cache, compiling it if necessary.
+   The arguments are as for compile_pattern_1.  */
+
+static struct regexp_cache *
+regexp_cache_lookup (Lisp_Object pattern, Lisp_Object translate,
+		     Lisp_Object whitespace, bool posix)
+{
+  struct regexp_cache *cp;
+  EMACS_UINT hash = regexp_cache_hash (pattern, translate, posix);
+
+  regexp_cache_reindex ();
+  for (cp = *regexp_cache_bucket (hash); cp; cp = cp->hash_next)
+    if (cp->hash == hash
+	&& regexp_cache_entry_usable_p (cp, pattern, translate,
+					whitespace, posix))
+      break;
+
+  if (cp)
+    regexp_cache_hits++;
+  else
+    {
+      regexp_cache_misses++;
+      cp = regexp_cache_victim ();
+      compile_pattern_1 (cp, pattern, translate, whitespace, posix);
+    }
+
+  /* Move the entry to the front of the list to mark it as most
+     recently used.  */
+  if (cp != searchbuf_head)
+    {
+      regexp_cache_unlink (cp);
+      regexp_cache_push_front (cp);
+    }
+  return cp;
+}
+
+/* Return the compiled form of the regexp object RE, recompiling it if
+   the context it was last compiled in does not match the arguments.
+   If RE is already in use further up the stack, go through the cache
+   instead.  */
+
+static struct regexp_cache *
+compiled_regexp_entry (struct Lisp_Regexp *re, Lisp_Object translate,
+		       Lisp_Object whitespace, bool posix)
+{
+  struct regexp_cache *cp = re->cache;
+
+  if (cp->busy)
+    return regexp_cache_lookup (re->pattern, translate, whitespace, posix);
+
+  /* The common case: the object is used in the same context as last
+     time, and no hashing or string comparison is needed at all.  */
+  if (!(!NILP (cp->regexp)
+	&& BASE_EQ (cp->buf.translate, translate)
+	&& cp->posix == posix
+	&& (BASE_EQ (cp->syntax_table, Qt)
+	    || (BASE_EQ (cp->syntax_table,
+			 BVAR (current_buffer, syntax_table))
+		&& cp->syntax_generation == regexp_syntax_generation))
+	&& BASE_EQ (cp->f_whitespace_regexp,
+		    STRINGP (whitespace) ? whitespace : Qnil)
+	&& cp->buf.charset_unibyte == charset_unibyte))
+    {
+      compile_pattern_1 (cp, re->pattern, translate, whitespace, posix);
+      re->pattern = cp->regexp;
+      re->translate = cp->buf.translate;
+      re->whitespace_regexp = cp->f_whitespace_regexp;
+      re->syntax_table = cp->syntax_table;
+    }
+  return cp;
+}
+
 /* Compile a regexp if necessary, but first check to see if there's one in
    the cache.
-   PATTERN is the pattern to compile.
+   PATTERN is the pattern to compile, either a string or a compiled
+   regexp object.
    TRANSLATE is a translation table for ignoring case, or nil for none.
    REGP is the structure that says where to store the "register"
    values that will result from matching this pattern.
@@ -196,54 +557,12 @@ static struct regexp_cache *
 compile_pattern (Lisp_Object pattern, struct re_registers *regp,
 		 Lisp_Object translate, bool posix, bool multibyte)
 {
-  struct regexp_cache *cp, **cpp, **lru_nonbusy;
-
-  for (cpp = &searchbuf_head, lru_nonbusy = NULL; ; cpp = &cp->next)
-    {
-      cp = *cpp;
-      if (!cp->busy)
-        lru_nonbusy = cpp;
-      /* Entries are initialized to nil, and may be set to nil by
-	 compile_pattern_1 if the pattern isn't valid.  Don't apply
-	 string accessors in those cases.  However, compile_pattern_1
-	 is only applied to the cache entry we pick here to reuse.  So
-	 nil should never appear before a non-nil entry.  */
-      if (NILP (cp->regexp))
-	goto compile_it;
-      if (SCHARS (cp->regexp) == SCHARS (pattern)
-          && !cp->busy
-	  && STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
-	  && !NILP (Fstring_equal (cp->regexp, pattern))
-	  && BASE_EQ (cp->buf.translate, translate)
-	  && cp->posix == posix
-	  && (BASE_EQ (cp->syntax_table, Qt)
-	      || BASE_EQ (cp->syntax_table,
-			  BVAR (current_buffer, syntax_table)))
-	  && !NILP (Fequal (cp->f_whitespace_regexp, Vsearch_spaces_regexp))
-	  && cp->buf.charset_unibyte == charset_unibyte)
-	break;
-
-      /* If we're at the end of the cache, compile into the last
-	 (least recently used) non-busy cell in the cache.  */
-      if (cp->next == 0)
-	{
-          if (!lru_nonbusy)
-            error ("Too much matching reentrancy");
-          cpp = lru_nonbusy;
-          cp = *cpp;
-	compile_it:
-          eassert (!cp->busy);
-	  compile_pattern_1 (cp, pattern, translate, posix);
-	  break;
-	}
-    }
-
-  /* When we get here, cp (aka *cpp) contains the compiled pattern,
-     either because we found it in the cache or because we just compiled it.
-     Move it to the front of the queue to mark it as most recently used.  */
-  *cpp = cp->next;
-  cp->next = searchbuf_head;
-  searchbuf_head = cp;
+  struct regexp_cache *cp
+    = (REGEXPP (pattern)
+       ? compiled_regexp_entry (XREGEXP (pattern), translate,
+				Vsearch_spaces_regexp, posix)
+       : regexp_cache_lookup (pattern, translate,
+			      Vsearch_spaces_regexp, posix));
 
   /* Advise the searching functions about the space we have allocated
      for register data.  */
@@ -256,6 +575,98 @@ compile_pattern (Lisp_Object pattern, struct re_registers *regp,
   return cp;
 }
 
+/* Free the compiled form of the regexp object RE.  This is called
+   when RE is garbage collected.  */
+
+void
+free_compiled_regexp (struct Lisp_Regexp *re)
+{
+  if (re->cache)
+    free_regexp_cache_entry (re->cache);
+  re->cache = NULL;
+}
+
+DEFUN ("make-regexp", Fmake_regexp, Smake_regexp, 1, 1, 0,
+       doc: /* Return a compiled regexp object for the regular expression PATTERN.
+The object can be used in place of PATTERN by `string-match',
+`looking-at', `re-search-forward' and the other primitive regexp
+matching and searching functions.  It keeps its own compiled form,
+so using it does not involve the regexp cache at all, and it is never
+recompiled as long as it is used with the same value of
+`case-fold-search', the same syntax table and so on.
+
+PATTERN is compiled immediately for the current buffer, and an
+`invalid-regexp' error is signaled if it is not a valid regexp.  */)
+  (Lisp_Object pattern)
+{
+  CHECK_STRING (pattern);
+  struct Lisp_Regexp *re
+    = ALLOCATE_PSEUDOVECTOR (struct Lisp_Regexp, syntax_table, PVEC_REGEXP);
+  re->pattern = pattern;
+  re->cache = make_regexp_cache_entry ();
+  re->cache->owned = true;
+  Lisp_Object obj = make_lisp_ptr (re, Lisp_Vectorlike);
+  compiled_regexp_entry (re, (!NILP (Vcase_fold_search)
+			      ? BVAR (current_buffer, case_canon_table)
+			      : Qnil),
+			 Vsearch_spaces_regexp, false);
+  return obj;
+}
+
+DEFUN ("regexpp", Fregexpp, Sregexpp, 1, 1, 0,
+       doc: /* Return t if OBJECT is a compiled regexp object.
+See `make-regexp'.  */)
+  (Lisp_Object object)
+{
+  return REGEXPP (object) ? Qt : Qnil;
+}
+
+DEFUN ("regexp-source", Fregexp_source, Sregexp_source, 1, 1, 0,
+       doc: /* Return the regexp string that the compiled REGEXP was made from.  */)
+  (Lisp_Object regexp)
+{
+  CHECK_REGEXP (regexp);
+  return Fcopy_sequence (XREGEXP (regexp)->pattern);
+}
+
+DEFUN ("regexp-cache-statistics", Fregexp_cache_statistics,
+       Sregexp_cache_statistics, 0, 1, 0,
+       doc: /* Return statistics about the cache of compiled regexps.
+The value is a plist with the following properties:
+
+ :size          the maximum number of entries, `regexp-cache-size'
+ :entries       the number of entries currently in the cache
+ :pinned        how many of them can never be evicted
+ :hits          how many lookups found a compiled regexp in the cache
+ :misses        how many lookups had to compile the regexp
+ :compile-time  the total time in seconds spent compiling regexps,
+                including those compiled for `make-regexp' objects
+
+If RESET is non-nil, reset the counters to zero after computing the
+value.  */)
+  (Lisp_Object reset)
+{
+  ptrdiff_t pinned = 0;
+  for (struct regexp_cache *cp = searchbuf_head; cp; cp = cp->next)
+    pinned += cp->pinned;
+
+  Lisp_Object val
+    = list (QCsize, make_int (regexp_cache_size),
+	    QCentries, make_int (searchbuf_count),
+	    QCpinned, make_int (pinned),
+	    QChits, make_int (regexp_cache_hits),
+	    QCmisses, make_int (regexp_cache_misses),
+	    QCcompile_time,
+	    make_float (timespectod (regexp_cache_compile_time)));
+
+  if (!NILP (reset))
+    {
+      regexp_cache_hits = regexp_cache_misses = 0;
+      regexp_cache_compile_time = make_timespec (0, 0);
+    }
+  return val;
+}
+
 
 static Lisp_Object
 looking_at_1 (Lisp_Object string, bool posix, bool modify_data)
@@ -273,7 +684,7 @@ looking_at_1 (Lisp_Object string, bool posix, bool modify_data)
   set_char_table_extras (BVAR (current_buffer, case_canon_table), 2,
 			 BVAR (current_buffer, case_eqv_table));
 
-  CHECK_STRING (string);
+  check_regexp (string);
 
   /* Snapshot in case Lisp changes the value.  */
   bool modify_match_data = NILP (Vinhibit_changing_match_data) && modify_data;
@@ -375,7 +786,7 @@ string_match_1 (Lisp_Object regexp, Lisp_Object string, Lisp_Object start,
   if (running_asynch_code)
     save_search_regs ();
 
-  CHECK_STRING (regexp);
+  check_regexp (regexp);
   CHECK_STRING (string);
 
   if (NILP (start))
@@ -643,6 +1054,42 @@ newline_cache_on_off (struct buffer *buf)
 }
 
 
+/* Line motions of fewer lines than this scan the text even in a buffer
+   with a line index.  */
+enum { LINE_INDEX_MIN_COUNT = 16 };
+
+/* Do what find_newline does, using the line index of the current
+   buffer, with START_BYTE and END_BYTE known.  Return false if the
+   buffer has no index.  */
+
+static bool
+find_newline_by_index (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
+		       ptrdiff_t end_byte, ptrdiff_t count,
+		       ptrdiff_t *counted, ptrdiff_t *pos, ptrdiff_t *bytepos)
+{
+  ptrdiff_t before = buffer_newlines_before (current_buffer, start_byte);
+  if (before < 0)
+    return false;
+
+  /* Forward, the COUNTth newline at or after START; backward, the
+     -COUNTth newline before START.  */
+  ptrdiff_t nl = count > 0 ? before + count : before + count + 1;
+  ptrdiff_t nl_byte = buffer_newline_position (current_buffer, nl);
+  if (nl_byte >= 0 && (count > 0 ? nl_byte <= end_byte : nl_byte > end_byte))
+    {
+      *counted = count;
+      *pos = BYTE_TO_CHAR (nl_byte);
+      *bytepos = nl_byte;
+    }
+  else
+    {
+      *counted = buffer_newlines_before (current_buffer, end_byte) - before;
+      *pos = end;
+      *bytepos = end_byte;
+    }
+  return true;
+}
+
 /* Search for COUNT newlines between START/START_BYTE and END/END_BYTE.
 
    If COUNT is positive, search forwards; END must be >= START.
@@ -686,6 +1133,23 @@ find_newline (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
   if (end_byte == -1)
     end_byte = CHAR_TO_BYTE (end);
 
+  if (eabs (count) >= LINE_INDEX_MIN_COUNT
+      && buffer_line_index_p (current_buffer))
+    {
+      ptrdiff_t found, pos, pos_byte;
+      if (start_byte == -1)
+	start_byte = CHAR_TO_BYTE (start);
+      if (find_newline_by_index (start, start_byte, end, end_byte, count,
+				 &found, &pos, &pos_byte))
+	{
+	  if (counted)
+	    *counted = found;
+	  if (bytepos)
+	    *bytepos = pos_byte;
+	  return pos;
+	}
+    }
+
   newline_cache = newline_cache_on_off (current_buffer);
   if (current_buffer->base_buffer)
     cache_buffer = current_buffer->base_buffer;
@@ -1041,7 +1505,10 @@ search_command (Lisp_Object string, Lisp_Object bound, Lisp_Object noerror,
       n *= XFIXNUM (count);
     }
 
-  CHECK_STRING (string);
+  if (RE)
+    check_regexp (string);
+  else if (!STRING_MATCHER_P (string))
+    CHECK_STRING (string);
   if (NILP (bound))
     {
       if (n > 0)
@@ -1153,6 +1620,60 @@ while (0)
    (i.e. Vinhibit_changing_match_data is non-nil).  */
 static struct re_registers search_regs_1;
 
+static EMACS_INT search_buffer_non_re (Lisp_Object, ptrdiff_t, ptrdiff_t,
+                                       ptrdiff_t, ptrdiff_t, EMACS_INT, bool,
+                                       Lisp_Object, Lisp_Object, bool);
+
+/* Return the literal string that every match of BUFP contains, as
+   recorded by the regexp compiler, or nil if there is none or it
+   cannot be searched for in the current buffer.  */
+
+static Lisp_Object
+required_literal (struct re_pattern_buffer *bufp)
+{
+  if (bufp->must_start < 0)
+    return Qnil;
+
+  unsigned char *lit = bufp->buffer + bufp->must_start;
+  ptrdiff_t nbytes = bufp->must_size;
+  bool multibyte = !NILP (BVAR (current_buffer, enable_multibyte_characters));
+
+  if (bufp->multibyte == multibyte)
+    return (multibyte
+	    ? make_multibyte_string ((char *) lit,
+				     multibyte_chars_in_text (lit, nbytes),
+				     nbytes)
+	    : make_unibyte_string ((char *) lit, nbytes));
+
+  /* The matcher converts characters between unibyte and multibyte
+     forms; ASCII is the same in both.  */
+  for (ptrdiff_t i = 0; i < nbytes; i++)
+    if (!ASCII_CHAR_P (lit[i]))
+      return Qnil;
+  return make_unibyte_string ((char *) lit, nbytes);
+}
+
+/* Search the current buffer for the literal string LIT, forward from
+   POS/POS_BYTE to LIM/LIM_BYTE if N is positive, else backward.
+   Return the position where the occurrence found starts and store its
+   byte position in *START_BYTE, or return -1 if there is none.  */
+
+static ptrdiff_t
+search_literal (Lisp_Object lit, ptrdiff_t pos, ptrdiff_t pos_byte,
+		ptrdiff_t lim, ptrdiff_t lim_byte, EMACS_INT n,
+		Lisp_Object trt, Lisp_Object inverse_trt,
+		ptrdiff_t *start_byte)
+{
+  EMACS_INT found = search_buffer_non_re (lit, pos, pos_byte, lim, lim_byte,
+					  n, false, trt, inverse_trt, false);
+  if (found <= 0)
+    return -1;
+  if (n > 0)
+    found -= SCHARS (lit);
+  *start_byte = CHAR_TO_BYTE (found);
+  return found;
+}
+
 static EMACS_INT
 search_buffer_re (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
                   ptrdiff_t lim, ptrdiff_t lim_byte, EMACS_INT n,
@@ -1196,16 +1717,61 @@ search_buffer_re (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
   freeze_buffer_relocation ();
   freeze_pattern (cache_entry);
 
+  /* If every match contains some literal string, look for that string
+     first, with the same machinery as non-regexp searches.  When the
+     matches start with it, try to match only where it occurs;
+     otherwise, give up at once if it does not occur at all in the
+     direction of the search.  The literal searches must leave the
+     match data alone.  */
+  Lisp_Object must = required_literal (bufp);
+  ptrdiff_t must_pos = -1, must_byte = -1;
+  /* Where to look for the next occurrence of a prefix literal.  */
+  ptrdiff_t from = pos, from_byte = pos_byte;
+  if (!NILP (must))
+    specbind (Qinhibit_changing_match_data, Qt);
+
   while (n < 0)
     {
-      ptrdiff_t val;
+      ptrdiff_t val, start_byte = pos_byte, range = lim_byte - pos_byte;
+
+      if (!NILP (must))
+	{
+	  /* Matches may not extend past POS, so neither may the
+	     literal.  */
+	  must_pos = search_literal (must, from, from_byte, lim, lim_byte, -1,
+				     trt, inverse_trt, &must_byte);
+	  if (must_pos >= 0 && bufp->must_prefix)
+	    {
+	      start_byte = must_byte;
+	      range = 0;
+	    }
+	  else if (must_pos - bufp->must_offset >= lim)
+	    {
+	      ptrdiff_t start = min (pos, must_pos - bufp->must_offset);
+	      start_byte = CHAR_TO_BYTE (start);
+	      range = lim_byte - start_byte;
+	    }
+	  else
+	    {
+	      unbind_to (count, Qnil);
+	      return (n);
+	    }
+	}
 
       re_match_object = Qnil;
       val = re_search_2 (bufp, (char *) p1, s1, (char *) p2, s2,
-                         pos_byte - BEGV_BYTE, lim_byte - pos_byte,
+                         start_byte - BEGV_BYTE, range,
                          preserve_match_data ? &search_regs : &search_regs_1,
                          /* Don't allow match past current point */
                          pos_byte - BEGV_BYTE);
+      if (val == -1 && !NILP (must) && bufp->must_prefix)
+	{
+	  /* Try the previous occurrence of the literal.  */
+	  from = must_pos + SCHARS (must) - 1;
+	  from_byte = CHAR_TO_BYTE (from);
+	  maybe_quit ();
+	  continue;
+	}
       if (val == -2)
         {
           unbind_to (count, Qnil);
@@ -1234,6 +1800,8 @@ search_buffer_re (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
               /* Set pos to the new position.  */
               pos = BYTE_TO_CHAR (search_regs_1.start[0] + BEGV_BYTE);
             }
+          from = pos;
+          from_byte = pos_byte;
         }
       else
         {
@@ -1245,13 +1813,45 @@ search_buffer_re (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
     }
   while (n > 0)
     {
-      ptrdiff_t val;
+      ptrdiff_t val, start_byte = pos_byte, range = lim_byte - pos_byte;
+
+      if (!NILP (must))
+	{
+	  if (bufp->must_prefix)
+	    {
+	      must_pos = search_literal (must, from, from_byte, lim, lim_byte, 1,
+					 trt, inverse_trt, &must_byte);
+	      start_byte = must_byte;
+	      range = 0;
+	    }
+	  else if (must_pos < pos)
+	    /* Look for the first occurrence after POS, which stays
+	       after it until a match passes it.  Looking for the last
+	       one instead would scan the text after the last match
+	       on every search.  */
+	    must_pos = search_literal (must, pos, pos_byte, lim, lim_byte, 1,
+				       trt, inverse_trt, &must_byte);
+	  if (must_pos < 0)
+	    {
+	      unbind_to (count, Qnil);
+	      return (0 - n);
+	    }
+	}
 
       re_match_object = Qnil;
       val = re_search_2 (bufp, (char *) p1, s1, (char *) p2, s2,
-                         pos_byte - BEGV_BYTE, lim_byte - pos_byte,
+                         start_byte - BEGV_BYTE, range,
                          preserve_match_data ? &search_regs : &search_regs_1,
                          lim_byte - BEGV_BYTE);
+      if (val == -1 && !NILP (must) && bufp->must_prefix)
+	{
+	  /* Try the next occurrence of the literal.  */
+	  from = must_pos;
+	  from_byte = must_byte;
+	  inc_both (&from, &from_byte);
+	  maybe_quit ();
+	  continue;
+	}
       if (val == -2)
         {
           unbind_to (count, Qnil);
@@ -1278,6 +1878,8 @@ search_buffer_re (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
               pos_byte = search_regs_1.end[0] + BEGV_BYTE;
               pos = BYTE_TO_CHAR (search_regs_1.end[0] + BEGV_BYTE);
             }
+          from = pos;
+          from_byte = pos_byte;
         }
       else
         {
@@ -1493,6 +2095,487 @@ search_buffer_non_re (Lisp_Object string, ptrdiff_t pos,
   return result;
 }
 
+/* Matching any of a set of strings.
+
+   A string matcher (see `make-string-matcher') holds two Aho-Corasick
+   automata over the bytes of the multibyte forms of its strings: one
+   for the strings themselves, used by forward searches, and one for
+   the strings with their characters reversed, used by backward
+   searches.  The text is fed to them one character at a time,
+   canonicalized through the matcher's case table if it has one; when
+   no conversion is needed, bytes that cannot start a string are
+   skipped without looking at the automaton.  */
+
+/* A node of an automaton, i.e., a prefix of some of the strings.  */
+struct sm_node
+{
+  /* The node for the longest proper suffix of this prefix.  */
+  int fail;
+  /* The longest string that is a suffix of this prefix, or -1.  */
+  int output;
+  /* Length of the prefix, in bytes and in characters.  */
+  int nbytes, nchars;
+  /* The transitions from this node, sorted by byte, in EDGES.  */
+  int edges, nedges;
+};
+
+struct sm_edge
+{
+  unsigned char byte;
+  int next;
+};
+
+struct sm_automaton
+{
+  struct sm_node *nodes;
+  struct sm_edge *edges;
+  /* The transitions from the root, which is node 0.  */
+  int root[256];
+};
+
+struct string_matcher
+{
+  struct sm_automaton forward, backward;
+  /* The length of each string in bytes and in characters.  */
+  int *nbytes, *nchars;
+  /* The length of the longest string in characters.  */
+  int max_nchars;
+};
+
+/* Return the state after byte B in state S of automaton A.  */
+
+static int
+sm_next (struct sm_automaton *a, int s, unsigned char b)
+{
+  for (; s != 0; s = a->nodes[s].fail)
+    {
+      struct sm_edge *e = a->edges + a->nodes[s].edges;
+      int lo = 0, hi = a->nodes[s].nedges;
+      while (lo < hi)
+	{
+	  int mid = (lo + hi) >> 1;
+	  if (e[mid].byte < b)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      if (lo < a->nodes[s].nedges && e[lo].byte == b)
+	return e[lo].next;
+    }
+  return a->root[b];
+}
+
+/* Build in A the automaton for the N multibyte strings in STRINGS,
+   with their characters in reverse order if REVERSE.  */
+
+static void
+sm_build (struct sm_automaton *a, Lisp_Object *strings, ptrdiff_t n,
+	  bool reverse)
+{
+  ptrdiff_t total = 1;
+  for (ptrdiff_t i = 0; i < n; i++)
+    total += SBYTES (strings[i]);
+  if (INT_MAX <= total)
+    memory_full (SIZE_MAX);
+
+  /* First build a trie, with the children of each node in a list.  */
+  int *child = xnmalloc (total, sizeof *child);
+  int *sibling = xnmalloc (total, sizeof *sibling);
+  unsigned char *label = xmalloc (total);
+  struct sm_node *nodes = xnmalloc (total, sizeof *nodes);
+  int nnodes = 1;
+  nodes[0] = (struct sm_node) { .output = -1 };
+  child[0] = -1;
+  USE_SAFE_ALLOCA;
+  unsigned char *buf;
+  SAFE_NALLOCA (buf, 1, total);
+
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      unsigned char *p = SDATA (strings[i]);
+      ptrdiff_t len = SBYTES (strings[i]);
+      if (reverse)
+	{
+	  unsigned char *q = buf + len;
+	  for (ptrdiff_t j = 0, clen; j < len; j += clen)
+	    {
+	      clen = BYTES_BY_CHAR_HEAD (p[j]);
+	      q -= clen;
+	      memcpy (q, p + j, clen);
+	    }
+	  p = buf;
+	}
+
+      int s = 0;
+      for (ptrdiff_t j = 0; j < len; j++)
+	{
+	  int c = child[s];
+	  while (c >= 0 && label[c] != p[j])
+	    c = sibling[c];
+	  if (c < 0)
+	    {
+	      c = nnodes++;
+	      label[c] = p[j];
+	      child[c] = -1;
+	      sibling[c] = child[s];
+	      child[s] = c;
+	      nodes[c] = (struct sm_node)
+		{ .output = -1, .nbytes = nodes[s].nbytes + 1,
+		  .nchars = nodes[s].nchars + CHAR_HEAD_P (p[j]) };
+	    }
+	  s = c;
+	}
+      if (nodes[s].output < 0)
+	nodes[s].output = i;
+    }
+
+  /* Then compute the failure transitions and the outputs breadth
+     first, so that those of shorter prefixes are known, and lay out
+     the transitions of each node in order.  */
+  int *queue = xnmalloc (nnodes, sizeof *queue);
+  struct sm_edge *edges = xnmalloc (nnodes, sizeof *edges);
+  int head = 0, tail = 0, nedges = 0;
+  a->nodes = nodes;
+  a->edges = edges;
+  for (int b = 0; b < 256; b++)
+    a->root[b] = 0;
+  queue[tail++] = 0;
+  while (head < tail)
+    {
+      int s = queue[head++];
+      int first = nedges;
+      for (int c = child[s]; c >= 0; c = sibling[c])
+	{
+	  int k = nedges++;
+	  while (k > first && edges[k - 1].byte > label[c])
+	    {
+	      edges[k] = edges[k - 1];
+	      k--;
+	    }
+	  edges[k] = (struct sm_edge) { label[c], c };
+	}
+      nodes[s].edges = first;
+      nodes[s].nedges = nedges - first;
+
+      for (int k = first; k < nedges; k++)
+	{
+	  int c = edges[k].next;
+	  nodes[c].fail = s == 0 ? 0 : sm_next (a, nodes[s].fail, label[c]);
+	  if (nodes[c].output < 0)
+	    nodes[c].output = nodes[nodes[c].fail].output;
+	  queue[tail++] = c;
+	}
+      if (s == 0)
+	for (int k = first; k < nedges; k++)
+	  a->root[edges[k].byte] = edges[k].next;
+    }
+
+  xfree (queue);
+  xfree (label);
+  xfree (sibling);
+  xfree (child);
+  SAFE_FREE ();
+}
+
+/* Free the automata of the string matcher SM.  This is called when SM
+   is garbage collected.  */
+
+void
+free_string_matcher (struct Lisp_String_Matcher *sm)
+{
+  struct string_matcher *m = sm->matcher;
+  if (m)
+    {
+      xfree (m->forward.nodes);
+      xfree (m->forward.edges);
+      xfree (m->backward.nodes);
+      xfree (m->backward.edges);
+      xfree (m->nbytes);
+      xfree (m->nchars);
+      xfree (m);
+    }
+  sm->matcher = NULL;
+}
+
+/* The text to search, in two parts like the text of a buffer.  */
+struct sm_text
+{
+  unsigned char *p1, *p2;
+  ptrdiff_t s1, s2;
+  bool multibyte;
+};
+
+#define SM_BYTE_ADDR(t, i) \
+  ((i) < (t)->s1 ? (t)->p1 + (i) : (t)->p2 + ((i) - (t)->s1))
+
+/* Store in BUF the canonical multibyte form of the character at byte
+   offset I of T, using the case table TRT if it is not nil, and
+   return the length of that character in T.  Set *NBYTES to the length
+   of the form stored.  */
+
+static int
+sm_char (struct sm_text *t, ptrdiff_t i, Lisp_Object trt,
+	 unsigned char *buf, int *nbytes)
+{
+  unsigned char *p = SM_BYTE_ADDR (t, i);
+  int len, c;
+  if (t->multibyte)
+    c = string_char_and_length (p, &len);
+  else
+    c = UNIBYTE_TO_CHAR (*p), len = 1;
+  if (!NILP (trt))
+    c = char_table_translate (trt, c);
+  *nbytes = CHAR_STRING (c, buf);
+  return len;
+}
+
+/* Fill SKIP with true for the bytes B such that no string of the
+   matcher SM can start, if FORWARD, or end, otherwise, with a character
+   of T whose only or first byte is B.  */
+
+static void
+sm_skip_table (struct Lisp_String_Matcher *sm, struct sm_text *t,
+	       bool forward, bool *skip)
+{
+  struct sm_automaton *a = (forward ? &sm->matcher->forward
+			    : &sm->matcher->backward);
+  Lisp_Object trt = sm->case_table;
+  for (int b = 0; b < 256; b++)
+    if (forward && t->multibyte && NILP (trt))
+      /* The bytes are fed to the automaton as they are.  */
+      skip[b] = a->root[b] == 0;
+    else if (t->multibyte && !ASCII_CHAR_P (b))
+      skip[b] = false;
+    else
+      {
+	int c = t->multibyte ? b : UNIBYTE_TO_CHAR (b);
+	unsigned char buf[MAX_MULTIBYTE_LENGTH];
+	if (!NILP (trt))
+	  c = char_table_translate (trt, c);
+	CHAR_STRING (c, buf);
+	skip[b] = a->root[buf[0]] == 0;
+      }
+}
+
+/* Look in T between byte offsets FROM and LIM for the leftmost
+   occurrence of a string of the matcher SM, and the longest one if
+   several start there.  If one is found, store its bounds in *BEG and
+   *END and return true.  */
+
+static bool
+sm_search_forward (struct Lisp_String_Matcher *sm, struct sm_text *t,
+		   ptrdiff_t from, ptrdiff_t lim,
+		   ptrdiff_t *beg, ptrdiff_t *end)
+{
+  struct string_matcher *m = sm->matcher;
+  struct sm_automaton *a = &m->forward;
+  Lisp_Object trt = sm->case_table;
+  bool direct = t->multibyte && NILP (trt);
+  bool skip[256];
+  sm_skip_table (sm, t, true, skip);
+
+  /* The only byte that can start a string, or a negative number.  */
+  int only = -1;
+  for (int b = 0; b < 256; b++)
+    if (!skip[b])
+      only = only == -1 ? b : -2;
+
+  /* The byte offsets of the last characters fed to the automaton, when
+     characters are converted first.  */
+  int ring_size = m->max_nchars + 1;
+  USE_SAFE_ALLOCA;
+  ptrdiff_t *ring;
+  SAFE_NALLOCA (ring, 1, ring_size);
+  ptrdiff_t nfed = 0;
+
+  ptrdiff_t best = -1, best_end = -1;
+  int s = 0;
+  ptrdiff_t i = from;
+  unsigned short quit_count = 0;
+
+  while (i < lim)
+    {
+      if (s == 0)
+	{
+	  if (best >= 0)
+	    break;
+
+	  /* Skip what cannot start a string, within one part of T.  */
+	  ptrdiff_t part_end = i < t->s1 ? min (lim, t->s1) : lim;
+	  unsigned char *p = SM_BYTE_ADDR (t, i);
+	  unsigned char *pend = p + (part_end - i);
+	  if (only >= 0)
+	    {
+	      unsigned char *q = memchr (p, only, pend - p);
+	      p = q ? q : pend;
+	    }
+	  else
+	    while (p < pend && skip[*p])
+	      p++;
+	  i = part_end - (pend - p);
+	  rarely_quit (++quit_count);
+	  if (p == pend)
+	    continue;
+	}
+
+      int k;
+      ptrdiff_t start = 0;
+      if (direct)
+	{
+	  s = sm_next (a, s, *SM_BYTE_ADDR (t, i));
+	  i++;
+	  k = a->nodes[s].output;
+	  if (k >= 0)
+	    start = i - m->nbytes[k];
+	}
+      else
+	{
+	  unsigned char buf[MAX_MULTIBYTE_LENGTH];
+	  int nbytes;
+	  ring[nfed++ % ring_size] = i;
+	  i += sm_char (t, i, trt, buf, &nbytes);
+	  for (int j = 0; j < nbytes; j++)
+	    s = sm_next (a, s, buf[j]);
+	  k = a->nodes[s].output;
+	  if (k >= 0)
+	    start = ring[(nfed - m->nchars[k]) % ring_size];
+	}
+      if (k >= 0 && (best < 0 || start <= best))
+	{
+	  best = start;
+	  best_end = i;
+	}
+
+      /* Stop once no occurrence can start at or before BEST.  */
+      if (best >= 0 && s != 0
+	  && best < (direct ? i - a->nodes[s].nbytes
+		     : ring[(nfed - a->nodes[s].nchars) % ring_size]))
+	break;
+    }
+
+  SAFE_FREE ();
+  if (best < 0)
+    return false;
+  *beg = best;
+  *end = best_end;
+  return true;
+}
+
+/* Look in T between byte offsets LIM and FROM, which is after LIM, for
+   the occurrence of a string of the matcher SM that starts last, and
+   the longest one if several start there.  If one is found, store its
+   bounds in *BEG and *END and return true.  */
+
+static bool
+sm_search_backward (struct Lisp_String_Matcher *sm, struct sm_text *t,
+		    ptrdiff_t from, ptrdiff_t lim,
+		    ptrdiff_t *beg, ptrdiff_t *end)
+{
+  struct string_matcher *m = sm->matcher;
+  struct sm_automaton *a = &m->backward;
+  Lisp_Object trt = sm->case_table;
+  bool skip[256];
+  sm_skip_table (sm, t, false, skip);
+
+  /* RING[N] is the byte offset where the Nth character fed to the
+     automaton ends, modulo the ring size.  */
+  int ring_size = m->max_nchars + 1;
+  USE_SAFE_ALLOCA;
+  ptrdiff_t *ring;
+  SAFE_NALLOCA (ring, 1, ring_size);
+  ptrdiff_t nfed = 0;
+  bool found = false;
+  int s = 0;
+  ptrdiff_t i = from;
+  unsigned short quit_count = 0;
+
+  while (i > lim)
+    {
+      if (s == 0)
+	{
+	  while (i > lim && skip[*SM_BYTE_ADDR (t, i - 1)])
+	    i--;
+	  rarely_quit (++quit_count);
+	  if (i == lim)
+	    break;
+	}
+
+      ring[nfed % ring_size] = i;
+      ptrdiff_t j = i - 1;
+      if (t->multibyte)
+	while (j > lim && !CHAR_HEAD_P (*SM_BYTE_ADDR (t, j)))
+	  j--;
+      unsigned char buf[MAX_MULTIBYTE_LENGTH];
+      int nbytes;
+      sm_char (t, j, trt, buf, &nbytes);
+      nfed++;
+      i = j;
+      for (int k = 0; k < nbytes; k++)
+	s = sm_next (a, s, buf[k]);
+
+      int k = a->nodes[s].output;
+      if (k >= 0)
+	{
+	  *beg = i;
+	  *end = ring[(nfed - m->nchars[k]) % ring_size];
+	  found = true;
+	  break;
+	}
+    }
+
+  SAFE_FREE ();
+  return found;
+}
+
+/* Search the accessible portion of the current buffer from POS/POS_BYTE
+   to LIM/LIM_BYTE for the Nth occurrence of a string of MATCHER, like
+   search_buffer.  */
+
+static EMACS_INT
+search_buffer_matcher (Lisp_Object matcher, ptrdiff_t pos, ptrdiff_t pos_byte,
+		       ptrdiff_t lim, ptrdiff_t lim_byte, EMACS_INT n)
+{
+  struct Lisp_String_Matcher *sm = XSTRING_MATCHER (matcher);
+  struct sm_text t = {
+    .p1 = BEGV_ADDR, .s1 = GPT_BYTE - BEGV_BYTE,
+    .p2 = GAP_END_ADDR, .s2 = ZV_BYTE - GPT_BYTE,
+    .multibyte = !NILP (BVAR (current_buffer, enable_multibyte_characters))
+  };
+  if (t.s1 < 0)
+    {
+      t.p2 = t.p1;
+      t.s2 = ZV_BYTE - BEGV_BYTE;
+      t.s1 = 0;
+    }
+  if (t.s2 < 0)
+    {
+      t.s1 = ZV_BYTE - BEGV_BYTE;
+      t.s2 = 0;
+    }
+
+  specpdl_ref count = SPECPDL_INDEX ();
+  freeze_buffer_relocation ();
+
+  for (; n != 0; n += n < 0 ? 1 : -1)
+    {
+      ptrdiff_t beg, end;
+      if (! (n > 0
+	     ? sm_search_forward (sm, &t, pos_byte - BEGV_BYTE,
+				  lim_byte - BEGV_BYTE, &beg, &end)
+	     : sm_search_backward (sm, &t, pos_byte - BEGV_BYTE,
+				   lim_byte - BEGV_BYTE, &beg, &end)))
+	{
+	  unbind_to (count, Qnil);
+	  return n < 0 ? n : -n;
+	}
+      pos_byte = BEGV_BYTE + (n > 0 ? end : beg);
+      set_search_regs (BEGV_BYTE + beg, end - beg);
+    }
+
+  unbind_to (count, Qnil);
+  return BYTE_TO_CHAR (pos_byte);
+}
+
 /* Search for the Nth occurrence of STRING in the current buffer,
    from buffer position POS/POS_BYTE until LIM/LIM_BYTE.
 
@@ -1519,19 +2602,27 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
   if (running_asynch_code)
     save_search_regs ();
 
+  /* A compiled regexp object is searched for like its source string,
+     except that its compiled form comes from the object.  */
+  Lisp_Object source = REGEXPP (string) ? XREGEXP (string)->pattern : string;
+
   /* Searching 0 times means don't move.  */
   /* Null string is found at starting position.  */
-  if (n == 0 || SCHARS (string) == 0)
+  if (n == 0 || (STRINGP (source) && SCHARS (source) == 0))
     {
       set_search_regs (pos_byte, 0);
       return pos;
     }
 
-  if (RE && !(trivial_regexp_p (string) && NILP (Vsearch_spaces_regexp)))
+  if (STRING_MATCHER_P (string))
+    return search_buffer_matcher (string, pos, pos_byte,
+				  lim, lim_byte, n);
+
+  if (RE && !(trivial_regexp_p (source) && NILP (Vsearch_spaces_regexp)))
     pos = search_buffer_re (string, pos, pos_byte, lim, lim_byte,
                             n, trt, inverse_trt, posix);
   else
-    pos = search_buffer_non_re (string, pos, pos_byte, lim, lim_byte,
+    pos = search_buffer_non_re (source, pos, pos_byte, lim, lim_byte,
                                 n, RE, trt, inverse_trt, posix);
 
   return pos;
@@ -2354,6 +3445,352 @@ and `replace-match'.  */)
   return search_command (regexp, bound, noerror, count, 1, true, true);
 }
 
+/* Free the register arrays of the re_registers structure ARG.  */
+
+static void
+free_registers (void *arg)
+{
+  struct re_registers *regs = arg;
+  xfree (regs->start);
+  xfree (regs->end);
+}
+
+/* Find the matches for REGEXP between START and END in the current
+   buffer, as `re-search-all' and `re-count-matches' do.  If COLLECT,
+   return a vector of their bounds, with those of their subexpressions
+   if SUBGROUPS is non-nil; otherwise, return their number.  */
+
+static Lisp_Object
+search_all (Lisp_Object regexp, Lisp_Object start, Lisp_Object end,
+	    bool collect, Lisp_Object subgroups)
+{
+  check_regexp (regexp);
+  if (NILP (start))
+    XSETFASTINT (start, BEGV);
+  if (NILP (end))
+    XSETFASTINT (end, ZV);
+  validate_region (&start, &end);
+
+  ptrdiff_t pos = XFIXNAT (start), pos_byte = CHAR_TO_BYTE (pos);
+  ptrdiff_t lim = XFIXNAT (end), lim_byte = CHAR_TO_BYTE (lim);
+  Lisp_Object trt = Qnil, inverse_trt = Qnil;
+  if (!NILP (Vcase_fold_search))
+    {
+      trt = BVAR (current_buffer, case_canon_table);
+      inverse_trt = BVAR (current_buffer, case_eqv_table);
+    }
+
+  struct re_registers regs = { 0 };
+  struct regexp_cache *cache_entry
+    = compile_pattern (regexp, &regs, trt, false,
+		       !NILP (BVAR (current_buffer,
+				    enable_multibyte_characters)));
+  struct re_pattern_buffer *bufp = &cache_entry->buf;
+
+  unsigned char *p1 = BEGV_ADDR, *p2 = GAP_END_ADDR;
+  ptrdiff_t s1 = GPT_BYTE - BEGV_BYTE, s2 = ZV_BYTE - GPT_BYTE;
+  if (s1 < 0)
+    {
+      p2 = p1;
+      s2 = ZV_BYTE - BEGV_BYTE;
+      s1 = 0;
+    }
+  if (s2 < 0)
+    {
+      s1 = ZV_BYTE - BEGV_BYTE;
+      s2 = 0;
+    }
+
+  specpdl_ref count = SPECPDL_INDEX ();
+  record_unwind_protect_ptr (free_registers, &regs);
+  freeze_buffer_relocation ();
+  freeze_pattern (cache_entry);
+
+  /* Use the literal that every match contains as search_buffer_re
+     does, except that the last occurrence of a literal that does not
+     start the matches is looked for only once.  */
+  Lisp_Object must = required_literal (bufp);
+  ptrdiff_t must_pos = -1, must_byte = -1;
+  /* No match can start after this.  */
+  ptrdiff_t last_start_byte = lim_byte;
+  if (!NILP (must))
+    {
+      specbind (Qinhibit_changing_match_data, Qt);
+      if (!bufp->must_prefix)
+	{
+	  must_pos = search_literal (must, lim, lim_byte, pos, pos_byte, -1,
+				     trt, inverse_trt, &must_byte);
+	  last_start_byte = (must_pos - bufp->must_offset < pos ? -1
+			     : CHAR_TO_BYTE (must_pos - bufp->must_offset));
+	}
+    }
+
+  EMACS_INT nmatches = 0;
+  Lisp_Object matches = Qnil;
+  unsigned short quit_count = 0;
+
+  /* Like `how-many', look for matches starting at or before END while
+     point is before END, and after an empty match, look for the next
+     one a character further.  */
+  while (pos < lim && pos_byte <= last_start_byte)
+    {
+      ptrdiff_t start_byte = pos_byte, range = last_start_byte - pos_byte;
+      if (!NILP (must) && bufp->must_prefix)
+	{
+	  must_pos = search_literal (must, pos, pos_byte, lim, lim_byte, 1,
+				     trt, inverse_trt, &must_byte);
+	  if (must_pos < 0)
+	    break;
+	  start_byte = must_byte;
+	  range = 0;
+	}
+
+      re_match_object = Qnil;
+      ptrdiff_t val = re_search_2 (bufp, (char *) p1, s1, (char *) p2, s2,
+				   start_byte - BEGV_BYTE, range, &regs,
+				   lim_byte - BEGV_BYTE);
+      rarely_quit (++quit_count);
+      if (val == -1 && !NILP (must) && bufp->must_prefix)
+	{
+	  /* Try the next occurrence of the literal.  */
+	  pos = must_pos;
+	  pos_byte = must_byte;
+	  inc_both (&pos, &pos_byte);
+	  continue;
+	}
+      if (val == -2)
+	matcher_overflow ();
+      if (val < 0)
+	break;
+
+      nmatches++;
+      if (collect)
+	{
+	  Lisp_Object match = Qnil;
+	  ptrdiff_t nregs = NILP (subgroups) ? 1 : bufp->re_nsub + 1;
+	  for (ptrdiff_t i = nregs - 1; i >= 0; i--)
+	    if (i < regs.num_regs && regs.start[i] >= 0)
+	      match = Fcons (make_fixnum (BYTE_TO_CHAR (regs.start[i]
+							+ BEGV_BYTE)),
+			     Fcons (make_fixnum (BYTE_TO_CHAR (regs.end[i]
+							       + BEGV_BYTE)),
+				    match));
+	    else
+	      match = Fcons (Qnil, Fcons (Qnil, match));
+	  if (NILP (subgroups))
+	    match = Fcons (XCAR (match), XCAR (XCDR (match)));
+	  matches = Fcons (match, matches);
+	}
+
+      ptrdiff_t beg_byte = regs.start[0] + BEGV_BYTE;
+      pos_byte = regs.end[0] + BEGV_BYTE;
+      pos = BYTE_TO_CHAR (pos_byte);
+      if (pos_byte == beg_byte && pos < ZV)
+	inc_both (&pos, &pos_byte);
+    }
+
+  unbind_to (count, Qnil);
+  if (!collect)
+    return make_int (nmatches);
+  matches = Fnreverse (matches);
+  return Fvconcat (1, &matches);
+}
+
+DEFUN ("re-search-all", Fre_search_all, Sre_search_all, 1, 4, 0,
+       doc: /* Return a vector of the matches for REGEXP in the current buffer.
+Look for matches between START and END, which default to the
+beginning and end of the accessible portion of the buffer, the way
+`how-many' does: matches do not overlap, and after an empty match the
+next one is looked for a character further.  Each element of the
+vector is a cons (BEG . END) of the bounds of a match, or, if
+SUBGROUPS is non-nil, a list (BEG END SUB1-BEG SUB1-END ...) of the
+bounds of the match and of all the subexpressions of REGEXP, with nil
+for those that did not match.
+
+REGEXP can be a string or a compiled regexp object; see `make-regexp'.
+Matching ignores case if `case-fold-search' is non-nil, as in
+`re-search-forward'.  Point and the match data are not changed.  */)
+  (Lisp_Object regexp, Lisp_Object start, Lisp_Object end,
+   Lisp_Object subgroups)
+{
+  return search_all (regexp, start, end, true, subgroups);
+}
+
+DEFUN ("re-count-matches", Fre_count_matches, Sre_count_matches, 1, 3, 0,
+       doc: /* Return the number of matches for REGEXP in the current buffer.
+The matches counted are those that `re-search-all' returns for REGEXP,
+START and END, which see.  Point and the match data are not changed.  */)
+  (Lisp_Object regexp, Lisp_Object start, Lisp_Object end)
+{
+  return search_all (regexp, start, end, false, Qnil);
+}
+
+DEFUN ("make-string-matcher", Fmake_string_matcher, Smake_string_matcher,
+       1, 2, 0,
+       doc: /* Return an object for finding any of the strings in STRINGS.
+STRINGS is a list or vector of non-empty strings.  The object can be
+passed to `string-matcher-search-forward',
+`string-matcher-search-backward' and `string-matcher-match', which find
+the first or last occurrence of any of the strings, and the longest
+one if several start at the same place.  Those functions take time
+proportional to the length of the text they search, regardless of the
+number of strings.
+
+If CASE-FOLD is non-nil, matching ignores case, according to the case
+table of the current buffer when the object is made.  */)
+  (Lisp_Object strings, Lisp_Object case_fold)
+{
+  Lisp_Object vec = Fvconcat (1, &strings);
+  ptrdiff_t n = ASIZE (vec);
+  Lisp_Object trt = (NILP (case_fold) ? Qnil
+		     : BVAR (current_buffer, case_canon_table));
+
+  /* Convert the strings to the form in which the text is fed to the
+     automata: multibyte and canonicalized.  */
+  USE_SAFE_ALLOCA;
+  Lisp_Object *canon;
+  SAFE_ALLOCA_LISP (canon, n);
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      Lisp_Object str = AREF (vec, i);
+      CHECK_STRING (str);
+      if (SCHARS (str) == 0)
+	error ("Empty string in the strings of a string matcher");
+      str = string_to_multibyte (str);
+      if (!NILP (trt))
+	{
+	  ptrdiff_t nchars = SCHARS (str), nbytes = 0;
+	  unsigned char *buf;
+	  SAFE_NALLOCA (buf, MAX_MULTIBYTE_LENGTH, nchars);
+	  for (ptrdiff_t j = 0, jbyte = 0; j < nchars; )
+	    {
+	      int c = fetch_string_char_advance (str, &j, &jbyte);
+	      nbytes += CHAR_STRING (char_table_translate (trt, c),
+				     buf + nbytes);
+	    }
+	  str = make_multibyte_string ((char *) buf, nchars, nbytes);
+	}
+      canon[i] = str;
+    }
+
+  struct string_matcher *m = xzalloc (sizeof *m);
+  m->nbytes = xnmalloc (n, sizeof *m->nbytes);
+  m->nchars = xnmalloc (n, sizeof *m->nchars);
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      if (INT_MAX < SBYTES (canon[i]))
+	memory_full (SIZE_MAX);
+      m->nbytes[i] = SBYTES (canon[i]);
+      m->nchars[i] = SCHARS (canon[i]);
+      m->max_nchars = max (m->max_nchars, m->nchars[i]);
+    }
+  sm_build (&m->forward, canon, n, false);
+  sm_build (&m->backward, canon, n, true);
+  SAFE_FREE ();
+
+  struct Lisp_String_Matcher *sm
+    = ALLOCATE_PSEUDOVECTOR (struct Lisp_String_Matcher, case_table,
+			     PVEC_STRING_MATCHER);
+  sm->strings = vec;
+  sm->case_table = trt;
+  sm->matcher = m;
+  return make_lisp_ptr (sm, Lisp_Vectorlike);
+}
+
+DEFUN ("string-matcher-p", Fstring_matcher_p, Sstring_matcher_p, 1, 1, 0,
+       doc: /* Return t if OBJECT is a string matcher.
+See `make-string-matcher'.  */)
+  (Lisp_Object object)
+{
+  return STRING_MATCHER_P (object) ? Qt : Qnil;
+}
+
+DEFUN ("string-matcher-search-forward", Fstring_matcher_search_forward,
+       Sstring_matcher_search_forward, 1, 4, 0,
+       doc: /* Search forward from point for any of the strings of MATCHER.
+MATCHER is an object made by `make-string-matcher'.  Of the
+occurrences that start first, the longest is found.  Set point to its
+end, set the match data to its bounds, and return point.
+The optional arguments BOUND, NOERROR and COUNT are as for
+`search-forward', which see.  */)
+  (Lisp_Object matcher, Lisp_Object bound, Lisp_Object noerror,
+   Lisp_Object count)
+{
+  CHECK_STRING_MATCHER (matcher);
+  return search_command (matcher, bound, noerror, count, 1, false, false);
+}
+
+DEFUN ("string-matcher-search-backward", Fstring_matcher_search_backward,
+       Sstring_matcher_search_backward, 1, 4, 0,
+       doc: /* Search backward from point for any of the strings of MATCHER.
+MATCHER is an object made by `make-string-matcher'.  Of the
+occurrences before point that start last, the longest is found.  Set
+point to its beginning, set the match data to its bounds, and return
+point.
+The optional arguments BOUND, NOERROR and COUNT are as for
+`search-backward', which see.  */)
+  (Lisp_Object matcher, Lisp_Object bound, Lisp_Object noerror,
+   Lisp_Object count)
+{
+  CHECK_STRING_MATCHER (matcher);
+  return search_command (matcher, bound, noerror, count, -1, false, false);
+}
+
+DEFUN ("string-matcher-match", Fstring_matcher_match, Sstring_matcher_match,
+       2, 4, 0,
+       doc: /* Return index of the first occurrence in STRING of a string of MATCHER.
+MATCHER is an object made by `make-string-matcher'.  Of the
+occurrences that start first, the longest is found.  Return nil if
+there is none.
+If START is non-nil, start the search at that index in STRING.
+If INHIBIT-MODIFY is nil, set the match data to the bounds of the
+occurrence found, like `string-match' does.  */)
+  (Lisp_Object matcher, Lisp_Object string, Lisp_Object start,
+   Lisp_Object inhibit_modify)
+{
+  CHECK_STRING_MATCHER (matcher);
+  CHECK_STRING (string);
+
+  ptrdiff_t pos_byte = 0;
+  if (!NILP (start))
+    {
+      ptrdiff_t len = SCHARS (string);
+      CHECK_FIXNUM (start);
+      EMACS_INT pos = XFIXNUM (start);
+      if (pos < 0 && -pos <= len)
+	pos = len + pos;
+      else if (0 > pos || pos > len)
+	args_out_of_range (string, start);
+      pos_byte = string_char_to_byte (string, pos);
+    }
+
+  struct sm_text t = { .p1 = SDATA (string), .s1 = SBYTES (string),
+		       .multibyte = STRING_MULTIBYTE (string) };
+  ptrdiff_t beg, end;
+  if (!sm_search_forward (XSTRING_MATCHER (matcher), &t, pos_byte,
+			  SBYTES (string), &beg, &end))
+    return Qnil;
+
+  beg = string_byte_to_char (string, beg);
+  if (NILP (Vinhibit_changing_match_data) && NILP (inhibit_modify))
+    {
+      if (running_asynch_code)
+	save_search_regs ();
+      if (search_regs.num_regs == 0)
+	{
+	  search_regs.start = xmalloc (2 * sizeof *search_regs.start);
+	  search_regs.end = xmalloc (2 * sizeof *search_regs.end);
+	  search_regs.num_regs = 2;
+	}
+      for (ptrdiff_t i = 1; i < search_regs.num_regs; i++)
+	search_regs.start[i] = search_regs.end[i] = -1;
+      search_regs.start[0] = beg;
+      search_regs.end[0] = string_byte_to_char (string, end);
+      last_thing_searched = Qt;
+    }
+  return make_fixnum (beg);
+}
+
 DEFUN ("replace-match", Freplace_match, Sreplace_match, 1, 5, 0,
        doc: /* Replace text matched by last search with NEWTEXT.
 Leave point at the end of the replacement text.
@@ -3440,12 +4877,9 @@ static void syms_of_search_for_pdumper (void);
 void
 syms_of_search (void)
 {
-  for (int i = 0; i < REGEXP_CACHE_SIZE; ++i)
-    {
-      staticpro (&searchbufs[i].regexp);
-      staticpro (&searchbufs[i].f_whitespace_regexp);
-      staticpro (&searchbufs[i].syntax_table);
-    }
+  regexp_cache_pinned = make_hash_table (&hashtest_equal, DEFAULT_HASH_SIZE,
+					 Weak_None, false);
+  staticpro (&regexp_cache_pinned);
 
   /* Error condition used for failing searches.  */
   DEFSYM (Qsearch_failed, "search-failed");
@@ -3485,6 +4919,23 @@ literally.  Note that a value with capturing groups can change the
 numbering of existing capture groups in unexpected ways.  */);
   Vsearch_spaces_regexp = Qnil;
 
+  DEFVAR_INT ("regexp-cache-size", regexp_cache_size,
+    doc: /* Maximum number of compiled regexps to keep in the regexp cache.
+Searching and matching functions compile their regexp argument before
+using it, and keep the compiled form around so that using the same
+regexp again is fast.  If a program uses more distinct regexps than
+this, the least recently used ones are compiled again when they are
+next needed.  See also `regexp-cache-statistics' and `make-regexp'.  */);
+  regexp_cache_size = REGEXP_CACHE_SIZE;
+
+  DEFSYM (Qregexpp, "regexpp");
+  DEFSYM (Qstring_matcher_p, "string-matcher-p");
+  DEFSYM (QCentries, ":entries");
+  DEFSYM (QCpinned, ":pinned");
+  DEFSYM (QChits, ":hits");
+  DEFSYM (QCmisses, ":misses");
+  DEFSYM (QCcompile_time, ":compile-time");
+
   DEFSYM (Qinhibit_changing_match_data, "inhibit-changing-match-data");
   DEFVAR_LISP ("inhibit-changing-match-data", Vinhibit_changing_match_data,
       doc: /* Internal use only.
@@ -3503,6 +4954,13 @@ is to bind it with `let' around a small expression.  */);
   defsubr (&Sre_search_forward);
   defsubr (&Sre_search_backward);
   defsubr (&Sposix_search_forward);
+  defsubr (&Sre_search_all);
+  defsubr (&Sre_count_matches);
+  defsubr (&Smake_string_matcher);
+  defsubr (&Sstring_matcher_p);
+  defsubr (&Sstring_matcher_search_forward);
+  defsubr (&Sstring_matcher_search_backward);
+  defsubr (&Sstring_matcher_match);
   defsubr (&Sposix_search_backward);
   defsubr (&Sreplace_match);
   defsubr (&Smatch_beginning);
@@ -3513,6 +4971,10 @@ is to bind it with `let' around a small expression.  */);
   defsubr (&Sregexp_quote);
   defsubr (&Snewline_cache_check);
   defsubr (&Sre__describe_compiled);
+  defsubr (&Smake_regexp);
+  defsubr (&Sregexpp);
+  defsubr (&Sregexp_source);
+  defsubr (&Sregexp_cache_statistics);
 
   pdumper_do_now_and_after_load (syms_of_search_for_pdumper);
 }
@@ -3520,16 +4982,10 @@ is to bind it with `let' around a small expression.  */);
 static void
 syms_of_search_for_pdumper (void)
 {
-  for (int i = 0; i < REGEXP_CACHE_SIZE; ++i)
-    {
-      searchbufs[i].buf.allocated = 100;
-      searchbufs[i].buf.buffer = xmalloc (100);
-      searchbufs[i].buf.fastmap = searchbufs[i].fastmap;
-      searchbufs[i].regexp = Qnil;
-      searchbufs[i].f_whitespace_regexp = Qnil;
-      searchbufs[i].busy = false;
-      searchbufs[i].syntax_table = Qnil;
-      searchbufs[i].next = (i == REGEXP_CACHE_SIZE-1 ? 0 : &searchbufs[i+1]);
-    }
-  searchbuf_head = &searchbufs[0];
+  /* The cache entries are not dumped; start afresh.  */
+  searchbuf_head = searchbuf_tail = NULL;
+  searchbuf_count = 0;
+  searchbuf_index = NULL;
+  searchbuf_index_size = 0;
+  regexp_cache_reindex ();
 }
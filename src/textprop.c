@@ -60,6 +60,11 @@ enum property_set_type
 Lisp_Object interval_insert_behind_hooks;
 Lisp_Object interval_insert_in_front_hooks;
 
+/* Property lists of intervals, keyed by a hash of their elements.
+   The values are weak, so a plist is forgotten once no interval uses
+   it.  See intern_interval_plist.  */
+static Lisp_Object interval_plists;
+
 /* Signal a `text-read-only' error.  This function makes it easier
    to capture that error in GDB by putting a breakpoint on it.  */
 
@@ -311,6 +316,48 @@ property_value (Lisp_Object plist, Lisp_Object prop)
   return Qunbound;
 }
 
+/* Return a property list with the same elements as PLIST, which is a
+   fresh or interned list about to become the plist of an interval:
+   either PLIST itself or an identical list that other intervals
+   already use.  Interval plists are never modified in place, so
+   intervals with the same properties can share one list, which makes
+   intervals_equal cheap and saves memory.  */
+
+Lisp_Object
+intern_interval_plist (Lisp_Object plist)
+{
+  if (!CONSP (plist))
+    return plist;
+
+  EMACS_UINT hash = 0;
+  for (Lisp_Object tail = plist; CONSP (tail); tail = XCDR (tail))
+    hash = sxhash_combine (hash, XHASH (XCAR (tail)));
+  Lisp_Object key = make_ufixnum (hash & INTMASK);
+
+  if (NILP (interval_plists))
+    interval_plists = make_hash_table (&hashtest_eq, DEFAULT_HASH_SIZE,
+				       Weak_Value, false);
+  struct Lisp_Hash_Table *h = XHASH_TABLE (interval_plists);
+  hash_hash_t khash;
+  ptrdiff_t i = hash_lookup_get_hash (h, key, &khash);
+  if (i < 0)
+    {
+      hash_put (h, key, plist, khash);
+      return plist;
+    }
+
+  Lisp_Object old = HASH_VALUE (h, i), a = old, b = plist;
+  for (; CONSP (a) && CONSP (b); a = XCDR (a), b = XCDR (b))
+    if (!EQ (XCAR (a), XCAR (b)))
+      break;
+  if (NILP (a) && NILP (b))
+    return old;
+
+  /* A different list with the same hash; it takes over the entry.  */
+  set_hash_value_slot (h, i, plist);
+  return plist;
+}
+
 /* Set the properties of INTERVAL to PROPERTIES,
    and record undo info for the previous values.
    OBJECT is the string or buffer that INTERVAL belongs to.  */
@@ -349,7 +396,8 @@ set_properties (Lisp_Object properties, INTERVAL interval, Lisp_Object object)
     }
 
   /* Store new properties.  */
-  set_interval_plist (interval, Fcopy_sequence (properties));
+  set_interval_plist (interval,
+		      intern_interval_plist (Fcopy_sequence (properties)));
 }
 
 /* Add the properties of PLIST to the interval I, or set
@@ -371,6 +419,11 @@ add_properties (Lisp_Object plist, INTERVAL i, Lisp_Object object,
   Lisp_Object tail1, tail2, sym1, val1;
   bool changed = false;
 
+  /* The new plist of I.  Interval plists can be shared, so this is
+     copied before any of its elements is changed.  */
+  Lisp_Object new_plist = i->plist;
+  bool copied = false;
+
   tail1 = plist;
   sym1 = Qnil;
   val1 = Qnil;
@@ -383,58 +436,68 @@ add_properties (Lisp_Object plist, INTERVAL i, Lisp_Object object,
       val1 = Fcar (XCDR (tail1));
 
       /* Go through I's plist, looking for sym1 */
-      for (tail2 = i->plist; CONSP (tail2); tail2 = Fcdr (XCDR (tail2)))
+      for (tail2 = new_plist; CONSP (tail2); tail2 = Fcdr (XCDR (tail2)))
 	if (EQ (sym1, XCAR (tail2)))
 	  {
-	    Lisp_Object this_cdr;
+	    Lisp_Object this_cdr, old_val, new_val;
 
 	    this_cdr = XCDR (tail2);
+	    old_val = Fcar (this_cdr);
 	    /* Found the property.  Now check its value.  */
 	    found = true;
 
 	    /* The properties have the same value on both lists.
 	       Continue to the next property.  */
-	    if (EQ (val1, Fcar (this_cdr)))
+	    if (EQ (val1, old_val))
 	      break;
 
 	    /* Record this change in the buffer, for undo purposes.  */
 	    if (BUFFERP (object))
 	      {
 		record_property_change (i->position, LENGTH (i),
-					sym1, Fcar (this_cdr), object);
+					sym1, old_val, object);
 	      }
 
 	    /* I's property has a different value -- change it */
 	    if (set_type == TEXT_PROPERTY_REPLACE)
-	      Fsetcar (this_cdr, val1);
+	      new_val = val1;
 	    else {
-	      if (CONSP (Fcar (this_cdr)) &&
+	      if (CONSP (old_val) &&
 		  /* Special-case anonymous face properties. */
 		  (! EQ (sym1, Qface) ||
-		   NILP (Fkeywordp (Fcar (Fcar (this_cdr))))))
+		   NILP (Fkeywordp (Fcar (old_val)))))
 		/* The previous value is a list, so prepend (or
 		   append) the new value to this list. */
 		if (set_type == TEXT_PROPERTY_PREPEND)
-		  Fsetcar (this_cdr, Fcons (val1, Fcar (this_cdr)));
+		  new_val = Fcons (val1, old_val);
 		else
 		  {
 		    /* Appending. */
 		    if (destructive)
-		      nconc2 (Fcar (this_cdr), list1 (val1));
+		      new_val = nconc2 (old_val, list1 (val1));
 		    else
-		      Fsetcar (this_cdr, CALLN (Fappend,
-						Fcar (this_cdr),
-						list1 (val1)));
+		      new_val = CALLN (Fappend, old_val, list1 (val1));
 		  }
 	      else {
 		/* The previous value is a single value, so make it
 		   into a list. */
 		if (set_type == TEXT_PROPERTY_PREPEND)
-		  Fsetcar (this_cdr, list2 (val1, Fcar (this_cdr)));
+		  new_val = list2 (val1, old_val);
 		else
-		  Fsetcar (this_cdr, list2 (Fcar (this_cdr), val1));
+		  new_val = list2 (old_val, val1);
 	      }
 	    }
+
+	    if (! copied)
+	      {
+		new_plist = Fcopy_sequence (new_plist);
+		copied = true;
+		for (tail2 = new_plist; ! EQ (sym1, XCAR (tail2));
+		     tail2 = XCDR (XCDR (tail2)))
+		  ;
+		this_cdr = XCDR (tail2);
+	      }
+	    Fsetcar (this_cdr, new_val);
 	    changed = true;
 	    break;
 	  }
@@ -447,14 +510,36 @@ add_properties (Lisp_Object plist, INTERVAL i, Lisp_Object object,
 	      record_property_change (i->position, LENGTH (i),
 				      sym1, Qnil, object);
 	    }
-	  set_interval_plist (i, Fcons (sym1, Fcons (val1, i->plist)));
+	  new_plist = Fcons (sym1, Fcons (val1, new_plist));
 	  changed = true;
 	}
     }
 
+  if (changed)
+    set_interval_plist (i, intern_interval_plist (new_plist));
   return changed;
 }
 
+/* Return a copy of the part of PLIST before its tail TAIL, followed
+   by REST.  */
+
+static Lisp_Object
+plist_splice (Lisp_Object plist, Lisp_Object tail, Lisp_Object rest)
+{
+  Lisp_Object result = rest, last = Qnil;
+
+  for (; ! EQ (plist, tail); plist = XCDR (plist))
+    {
+      Lisp_Object cell = Fcons (XCAR (plist), rest);
+      if (NILP (last))
+	result = cell;
+      else
+	XSETCDR (last, cell);
+      last = cell;
+    }
+  return result;
+}
+
 /* For any members of PLIST, or LIST,
    which are properties of I, remove them from I's plist.
    (If PLIST is non-nil, use that, otherwise use LIST.)
@@ -488,7 +573,9 @@ remove_properties (Lisp_Object plist, Lisp_Object list, INTERVAL i, Lisp_Object
 	  changed = true;
 	}
 
-      /* Go through I's plist, looking for SYM.  */
+      /* Go through I's plist, looking for SYM.  The plist can be
+	 shared with other intervals, so rather than splicing SYM out,
+	 copy the part of the plist before it.  */
       Lisp_Object tail2 = current_plist;
       while (! NILP (tail2))
 	{
@@ -499,7 +586,9 @@ remove_properties (Lisp_Object plist, Lisp_Object list, INTERVAL i, Lisp_Object
 		record_property_change (i->position, LENGTH (i),
 					sym, XCAR (XCDR (this)), object);
 
-	      Fsetcdr (XCDR (tail2), XCDR (XCDR (this)));
+	      current_plist = plist_splice (current_plist, this,
+					    XCDR (XCDR (this)));
+	      this = current_plist;
 	      changed = true;
 	    }
 	  tail2 = this;
@@ -512,7 +601,7 @@ remove_properties (Lisp_Object plist, Lisp_Object list, INTERVAL i, Lisp_Object
     }
 
   if (changed)
-    set_interval_plist (i, current_plist);
+    set_interval_plist (i, intern_interval_plist (current_plist));
   return changed;
 }
 
@@ -568,6 +657,11 @@ buffer narrowing does not affect the value.  That is, if OBJECT is a
 buffer or nil, and the buffer is narrowed and POSITION is at the end
 of the narrowed buffer, the result may be non-nil.
 
+The value is the list that holds the properties of the text, which
+other text with the same properties can share, so do not modify it:
+use `copy-sequence' first, or change the properties of the text with
+functions such as `put-text-property'.
+
 If you want to display the text properties at point in a human-readable
 form, use the `describe-text-properties' command.  */)
   (Lisp_Object position, Lisp_Object object)
@@ -1327,6 +1421,209 @@ markers).  If OBJECT is a string, START and END are 0-based indices into it.  */
   return Qnil;
 }
 
+/* Return the interval of OBJECT that contains POS, looking forward
+   from I, which must not be after it.  */
+
+static INTERVAL
+interval_at_or_after (Lisp_Object object, INTERVAL i, ptrdiff_t pos)
+{
+  /* Runs are usually close together, so try the next few intervals
+     before searching from the root.  */
+  for (int n = 0; n < 8; n++)
+    {
+      if (pos < i->position + LENGTH (i))
+	return i;
+      i = next_interval (i);
+    }
+  return find_interval (BUFFERP (object)
+			? buffer_intervals (XBUFFER (object))
+			: string_intervals (object),
+			pos);
+}
+
+/* Return true if some text of OBJECT in one of the NRUNS runs whose
+   bounds are in BOUNDS lacks one of the properties in PLISTS.  I is
+   the interval that contains the start of the first run.  */
+
+static bool
+runs_change_properties (Lisp_Object object, INTERVAL i, ptrdiff_t nruns,
+			ptrdiff_t const *bounds, Lisp_Object const *plists)
+{
+  for (ptrdiff_t k = 0; k < nruns; k++)
+    {
+      i = interval_at_or_after (object, i, bounds[2 * k]);
+      for (;;)
+	{
+	  if (!interval_has_all_properties (plists[k], i))
+	    return true;
+	  if (bounds[2 * k + 1] <= i->position + LENGTH (i))
+	    break;
+	  i = next_interval (i);
+	}
+    }
+  return false;
+}
+
+/* Add the properties PLIST to the text of OBJECT from START to END,
+   splitting intervals as needed.  I is the interval that contains
+   START.  Set *MODIFIED if a property changed, and return the last
+   interval that the text touches.  */
+
+static INTERVAL
+add_properties_to_run (Lisp_Object object, INTERVAL i, ptrdiff_t start,
+		       ptrdiff_t end, Lisp_Object plist, bool *modified)
+{
+  INTERVAL unchanged;
+
+  /* Skip the text that already has the properties.  */
+  while (interval_has_all_properties (plist, i))
+    {
+      if (end <= i->position + LENGTH (i))
+	return i;
+      i = next_interval (i);
+    }
+
+  if (i->position < start)
+    {
+      unchanged = i;
+      i = split_interval_right (unchanged, start - unchanged->position);
+      copy_properties (unchanged, i);
+    }
+
+  for (;;)
+    {
+      if (end < i->position + LENGTH (i))
+	{
+	  if (interval_has_all_properties (plist, i))
+	    return i;
+	  unchanged = i;
+	  i = split_interval_left (unchanged, end - unchanged->position);
+	  copy_properties (unchanged, i);
+	}
+      if (add_properties (plist, i, object, TEXT_PROPERTY_REPLACE, true))
+	*modified = true;
+      if (end <= i->position + LENGTH (i))
+	return i;
+      i = next_interval (i);
+    }
+}
+
+/* Callers note, this can GC when OBJECT is a buffer (or nil).  */
+
+DEFUN ("put-text-property-runs", Fput_text_property_runs,
+       Sput_text_property_runs, 1, 2, 0,
+       doc: /* Add properties to many stretches of text at once.
+RUNS is a vector whose elements have the form (START END PROPERTIES),
+meaning that the property list PROPERTIES is added to the text from
+START to END, as by `add-text-properties'.  The runs must be sorted by
+START and must not overlap.  If the optional argument OBJECT is a
+buffer (or nil, which means the current buffer), START and END are
+buffer positions (integers or markers).  If OBJECT is a string, START
+and END are 0-based indices into it.
+
+This is like calling `add-text-properties' for each run, but the text
+is traversed once, modification hooks run once for the text from the
+start of the first run to the end of the last, and neighboring
+stretches of that text that end up with the same properties are
+merged, which keeps the number of intervals down when many runs share
+the same properties.
+Return t if any property value actually changed, nil otherwise.  */)
+  (Lisp_Object runs, Lisp_Object object)
+{
+  if (BUFFERP (object) && XBUFFER (object) != current_buffer)
+    {
+      specpdl_ref count = SPECPDL_INDEX ();
+      record_unwind_current_buffer ();
+      set_buffer_internal (XBUFFER (object));
+      return unbind_to (count, Fput_text_property_runs (runs, object));
+    }
+
+  CHECK_VECTOR (runs);
+  if (NILP (object))
+    XSETBUFFER (object, current_buffer);
+
+  USE_SAFE_ALLOCA;
+  ptrdiff_t *bounds;
+  Lisp_Object *plists;
+  ptrdiff_t nruns = 0, prev_end = PTRDIFF_MIN;
+  SAFE_NALLOCA (bounds, 2, ASIZE (runs));
+  SAFE_ALLOCA_LISP (plists, ASIZE (runs));
+
+  for (ptrdiff_t k = 0; k < ASIZE (runs); k++)
+    {
+      Lisp_Object run = AREF (runs, k);
+      Lisp_Object start = Fcar (run), end = Fcar (Fcdr (run));
+      Lisp_Object plist = validate_plist (Fcar (Fcdr (Fcdr (run))));
+      CHECK_FIXNUM_COERCE_MARKER (start);
+      CHECK_FIXNUM_COERCE_MARKER (end);
+      ptrdiff_t s = XFIXNUM (start), e = XFIXNUM (end);
+      if (e < s)
+	{
+	  ptrdiff_t tem = s;
+	  s = e;
+	  e = tem;
+	}
+      if (s < prev_end)
+	error ("Text property runs overlap or are out of order");
+      prev_end = e;
+      if (s < e && !NILP (plist))
+	{
+	  bounds[2 * nruns] = s;
+	  bounds[2 * nruns + 1] = e;
+	  plists[nruns++] = plist;
+	}
+    }
+
+  if (nruns == 0)
+    {
+      SAFE_FREE ();
+      return Qnil;
+    }
+
+  Lisp_Object start = make_fixnum (bounds[0]);
+  Lisp_Object end = make_fixnum (bounds[2 * nruns - 1]);
+  INTERVAL i = validate_interval_range (object, &start, &end, hard);
+  if (!i || !runs_change_properties (object, i, nruns, bounds, plists))
+    {
+      SAFE_FREE ();
+      return Qnil;
+    }
+
+  if (BUFFERP (object))
+    {
+      modify_text_properties (object, start, end);
+      /* The modification hooks could have changed the intervals.  */
+      i = validate_interval_range (object, &start, &end, hard);
+    }
+
+  bool modified = false;
+  for (ptrdiff_t k = 0; k < nruns; k++)
+    {
+      i = interval_at_or_after (object, i, bounds[2 * k]);
+      i = add_properties_to_run (object, i, bounds[2 * k],
+				 bounds[2 * k + 1], plists[k], &modified);
+    }
+
+  /* Merge the intervals that now have the same properties, including
+     those just before and after the text.  */
+  ptrdiff_t lim = XFIXNUM (end);
+  i = find_interval (BUFFERP (object)
+		     ? buffer_intervals (XBUFFER (object))
+		     : string_intervals (object),
+		     max (XFIXNUM (start) - 1,
+			  BUFFERP (object) ? BEG : 0));
+  for (INTERVAL next = next_interval (i);
+       next && next->position <= lim;
+       next = next_interval (i))
+    i = intervals_equal (i, next) ? merge_interval_left (next) : next;
+
+  if (BUFFERP (object))
+    signal_after_change (XFIXNUM (start), XFIXNUM (end) - XFIXNUM (start),
+			 XFIXNUM (end) - XFIXNUM (start));
+  SAFE_FREE ();
+  return modified ? Qt : Qnil;
+}
+
 DEFUN ("set-text-properties", Fset_text_properties,
        Sset_text_properties, 3, 4, 0,
        doc: /* Completely replace properties of text from START to END.
@@ -2413,6 +2710,8 @@ inherits it if NONSTICKINESS is nil.  The `front-sticky' and
   interval_insert_in_front_hooks = Qnil;
   staticpro (&interval_insert_behind_hooks);
   staticpro (&interval_insert_in_front_hooks);
+  staticpro (&interval_plists);
+  interval_plists = Qnil;
 
   /* Common attributes one might give text.  */
 
@@ -2447,6 +2746,7 @@ inherits it if NONSTICKINESS is nil.  The `front-sticky' and
   defsubr (&Sprevious_single_property_change);
   defsubr (&Sadd_text_properties);
   defsubr (&Sput_text_property);
+  defsubr (&Sput_text_property_runs);
   defsubr (&Sset_text_properties);
   defsubr (&Sadd_face_text_property);
   defsubr (&Sremove_text_properties);
@@ -31,6 +31,24 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
    an undo-boundary.  */
 static Lisp_Object pending_boundary;
 
+/* True if some buffer may have recorded more than `undo-limit' bytes
+   of undo information since its undo list was last truncated.  */
+static bool undo_lists_grown;
+
+/* Account for NBYTES of undo information recorded in the current
+   buffer.  If that makes too much since the list was last truncated,
+   ask for maybe_garbage_collect to truncate it.  */
+static void
+note_undo_growth (intmax_t nbytes)
+{
+  current_buffer->text->undo_growth += nbytes;
+  if (current_buffer->text->undo_growth > undo_limit)
+    {
+      undo_lists_grown = true;
+      request_maybe_gc ();
+    }
+}
+
 /* Prepare the undo info for recording a change. */
 static void
 prepare_record (void)
@@ -73,9 +91,12 @@ record_point (ptrdiff_t beg)
   if (at_boundary
       && point_before_last_command_or_undo != beg
       && buffer_before_last_command_or_undo == current_buffer )
-    bset_undo_list (current_buffer,
-		    Fcons (make_fixnum (point_before_last_command_or_undo),
-			   BVAR (current_buffer, undo_list)));
+    {
+      bset_undo_list (current_buffer,
+		      Fcons (make_fixnum (point_before_last_command_or_undo),
+			     BVAR (current_buffer, undo_list)));
+      note_undo_growth (sizeof (struct Lisp_Cons));
+    }
 }
 
 /* Record an insertion that just happened or is about to happen,
@@ -115,6 +136,7 @@ record_insert (ptrdiff_t beg, ptrdiff_t length)
   XSETINT (lend, beg + length);
   bset_undo_list (current_buffer,
 		  Fcons (Fcons (lbeg, lend), BVAR (current_buffer, undo_list)));
+  note_undo_growth (2 * sizeof (struct Lisp_Cons));
 }
 
 /* Record the fact that markers in the region of FROM, TO are about to
@@ -128,9 +150,10 @@ record_marker_adjustments (ptrdiff_t from, ptrdiff_t to)
 {
   prepare_record ();
 
-  for (struct Lisp_Marker *m = BUF_MARKERS (current_buffer); m; m = m->next)
+  for (struct Lisp_Marker *m = marker_tree_first (current_buffer, from);
+       m && marker_charpos (m) <= to; m = marker_tree_next (m))
     {
-      ptrdiff_t charpos = m->charpos;
+      ptrdiff_t charpos = marker_charpos (m);
       eassert (charpos <= Z);
 
       if (from <= charpos && charpos <= to)
@@ -151,6 +174,7 @@ record_marker_adjustments (ptrdiff_t from, ptrdiff_t to)
                 (current_buffer,
                  Fcons (Fcons (marker, make_fixnum (adjustment)),
                         BVAR (current_buffer, undo_list)));
+	      note_undo_growth (2 * sizeof (struct Lisp_Cons));
             }
         }
     }
@@ -189,6 +213,8 @@ record_delete (ptrdiff_t beg, Lisp_Object string, bool record_markers)
   bset_undo_list
     (current_buffer,
      Fcons (Fcons (string, sbeg), BVAR (current_buffer, undo_list)));
+  note_undo_growth (2 * sizeof (struct Lisp_Cons)
+		    + sizeof (struct Lisp_String) + SBYTES (string));
 }
 
 /* Record that a replacement is about to take place,
@@ -220,6 +246,7 @@ record_first_change (void)
   bset_undo_list (current_buffer,
 		  Fcons (Fcons (Qt, buffer_visited_file_modtime (base_buffer)),
 			 BVAR (current_buffer, undo_list)));
+  note_undo_growth (2 * sizeof (struct Lisp_Cons));
 }
 
 /* Record a change in property PROP (whose old value was VAL)
@@ -246,6 +273,7 @@ record_property_change (ptrdiff_t beg, ptrdiff_t length,
   entry = Fcons (Qnil, Fcons (prop, Fcons (value, Fcons (lbeg, lend))));
   bset_undo_list (current_buffer,
 		  Fcons (entry, BVAR (current_buffer, undo_list)));
+  note_undo_growth (5 * sizeof (struct Lisp_Cons));
 }
 
 DEFUN ("undo-boundary", Fundo_boundary, Sundo_boundary, 0, 0, 0,
@@ -281,6 +309,34 @@ but another undo command will undo to the previous boundary.  */)
   return Qnil;
 }
 
+/* Truncate the undo lists of the buffers that recorded more than
+   `undo-limit' bytes of undo information since their lists were last
+   truncated, without waiting for the next garbage collection.  This is
+   called from maybe_garbage_collect, which runs where garbage
+   collection could, so truncating the lists there is just as safe.  */
+
+void
+truncate_grown_undo_lists (void)
+{
+  Lisp_Object tail, buffer;
+
+  if (!undo_lists_grown)
+    return;
+  undo_lists_grown = false;
+
+  FOR_EACH_LIVE_BUFFER (tail, buffer)
+    {
+      struct buffer *b = XBUFFER (buffer);
+
+      /* Skip indirect buffers, and buffers with undo turned off, as
+	 compact_buffer does.  */
+      if (!b->base_buffer
+	  && b->text->undo_growth > undo_limit
+	  && !EQ (BVAR (b, undo_list), Qt))
+	truncate_undo_list (b);
+    }
+}
+
 /* At garbage collection time, make an undo list shorter at the end,
    returning the truncated list.  How this is done depends on the
    variables undo-limit, undo-strong-limit and undo-outer-limit.
@@ -302,6 +358,7 @@ truncate_undo_list (struct buffer *b)
      tell which buffer to operate on.  */
   record_unwind_current_buffer ();
   set_buffer_internal (b);
+  b->text->undo_growth = 0;
 
   list = BVAR (b, undo_list);
 
@@ -1770,7 +1770,7 @@ window_point (struct window *w)
 {
   return (w == XWINDOW (selected_window)
           ? BUF_PT (XBUFFER (w->contents))
-          : XMARKER (w->pointm)->charpos);
+          : marker_charpos (XMARKER (w->pointm)));
 }
 
 DEFUN ("window-point", Fwindow_point, Swindow_point, 0, 1, 0,
@@ -28953,6 +28953,26 @@ display_count_lines (ptrdiff_t start_byte,
     = (!NILP (BVAR (current_buffer, selective_display))
        && !FIXNUMP (BVAR (current_buffer, selective_display)));
 
+  /* Count many lines through the line index, if the buffer has one.  */
+  if (count > 0 && !selective_display
+      && limit_byte - start_byte >= 64 * 1024
+      && buffer_line_index_p (current_buffer))
+    {
+      ptrdiff_t before = buffer_newlines_before (current_buffer, start_byte);
+      if (before >= 0)
+	{
+	  ptrdiff_t nl_byte
+	    = buffer_newline_position (current_buffer, before + count);
+	  if (nl_byte >= 0 && nl_byte <= limit_byte)
+	    {
+	      *byte_pos_ptr = nl_byte;
+	      return count;
+	    }
+	  *byte_pos_ptr = limit_byte;
+	  return buffer_newlines_before (current_buffer, limit_byte) - before;
+	}
+    }
+
   if (count > 0)
     {
       while (start_byte < limit_byte)
@@ -249,4 +249,48 @@ At EOF:
       (ccl-execute compiled registers)
       (should (equal registers [2 16 0 0 0 0 0 1])))))
 
+;; A decoder whose output depends on the current byte alone, although
+;; it leaves values from earlier bytes in r1, and one that keeps a
+;; shift state in r2.
+(define-ccl-program ccl-tests--decoder
+  '(1 ((loop (read r0)
+             (if (r0 < #x80) (write r0)
+               (if (r0 < #xa0) ((r1 = (r0 + #x2000)) (write r1))
+                 ((r1 = (r0 + #x360)) (write r1))))
+             (repeat)))))
+
+(define-ccl-program ccl-tests--shift-decoder
+  '(1 ((loop (read r0)
+             (if (r0 == 27) ((r2 = (r2 ^ 1)))
+               ((if r2 ((r1 = (r0 + #x100)) (write r1)) (write r0))))
+             (repeat)))))
+
+(define-ccl-program ccl-tests--encoder
+  '(1 ((loop (read r0)
+             (if (r0 < #x80) (write r0)
+               (if (r0 >= #x2000) ((r1 = (r0 - #x2000)) (write r1))
+                 ((r1 = (r0 - #x360)) (write r1))))
+             (repeat)))))
+
+(ert-deftest ccl-coding-system ()
+  "Check that CCL coding systems convert text like the CCL interpreter."
+  (let ((bytes (apply #'unibyte-string
+                      (mapcar (lambda (i) (% (* i 13) 256))
+                              (number-sequence 0 20000)))))
+    (dolist (decoder '(ccl-tests--shift-decoder ccl-tests--decoder))
+      (define-coding-system 'ccl-tests--coding "For testing."
+        :coding-type 'ccl :mnemonic ?T :charset-list '(unicode)
+        :ccl-decoder decoder :ccl-encoder 'ccl-tests--encoder)
+      (should (equal (decode-coding-string bytes 'ccl-tests--coding)
+                     (ccl-execute-on-string decoder (make-vector 9 nil)
+                                            bytes))))
+    (let ((text (decode-coding-string bytes 'ccl-tests--coding)))
+      (should (equal (string-to-list
+                      (encode-coding-string text 'ccl-tests--coding))
+                     (string-to-list
+                      (ccl-execute-on-string 'ccl-tests--encoder
+                                             (make-vector 9 nil) text))))
+      (should (equal (encode-coding-string text 'ccl-tests--coding)
+                     bytes)))))
+
 ;;; ccl-tests.el ends here
@@ -0,0 +1,99 @@
+;;; coding-perf.el --- Measure UTF-8 decoding throughput  -*- lexical-binding:t -*-
+
+;; Copyright (C) 2024 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Run this as
+;;
+;;   emacs -Q --batch -l test/manual/coding-perf.el -f coding-perf-run
+;;
+;; It builds UTF-8 corpora of various scripts, decodes them as strings,
+;; in buffers and from files, detects their encoding, and reports the
+;; throughput in GB/s of encoded input.
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar coding-perf-size (* 16 1024 1024)
+  "Approximate size in bytes of each corpus.")
+
+(defvar coding-perf-repetitions 5
+  "Number of times each measurement is repeated.")
+
+(defconst coding-perf-samples
+  '(("ASCII" . "The quick brown fox jumps over the lazy dog.\n")
+    ("Latin" . "Größenwahn führt zu Übermut; ça déçoit l'élève.\n")
+    ("Cyrillic" . "Съешь же ещё этих мягких французских булок.\n")
+    ("CJK" . "色は匂へど散りぬるを我が世誰ぞ常ならむ。\n")
+    ("Emoji" . "😀 🚀 🌍 ✨ 🎉 🐱 👍 🍕\n")
+    ("Mixed" . "int x = 1; // Größe: 長さ, размер 😀\n"))
+  "Alist of corpus names and the lines they are made of.")
+
+(defun coding-perf--corpus (line)
+  "Return a unibyte string of about `coding-perf-size' bytes of LINE."
+  (let* ((bytes (encode-coding-string line 'utf-8))
+         (n (max 1 (/ coding-perf-size (length bytes)))))
+    (apply #'concat (make-list n bytes))))
+
+(defun coding-perf--measure (bytes function)
+  "Return the throughput in GB/s of calling FUNCTION on BYTES input bytes."
+  (garbage-collect)
+  (let ((elapsed (car (benchmark-run coding-perf-repetitions
+                        (funcall function)))))
+    (/ (* bytes coding-perf-repetitions) elapsed 1e9)))
+
+(defun coding-perf-run ()
+  "Decode each corpus in several ways and print the throughput."
+  (let ((file (make-temp-file "coding-perf")))
+    (unwind-protect
+        (progn
+          (princ (format "%-10s %10s %10s %10s %10s %10s\n" "Corpus"
+                         "string" "undecided" "region" "file" "detect"))
+          (dolist (sample coding-perf-samples)
+            (let* ((corpus (coding-perf--corpus (cdr sample)))
+                   (bytes (length corpus)))
+              (let ((coding-system-for-write 'no-conversion))
+                (write-region corpus nil file nil 'silent))
+              (princ
+               (format
+                "%-10s %10.3f %10.3f %10.3f %10.3f %10.3f\n"
+                (car sample)
+                (coding-perf--measure
+                 bytes (lambda () (decode-coding-string corpus 'utf-8-unix)))
+                (coding-perf--measure
+                 bytes (lambda () (decode-coding-string corpus 'undecided)))
+                (coding-perf--measure
+                 bytes (lambda ()
+                         (with-temp-buffer
+                           (set-buffer-multibyte nil)
+                           (insert corpus)
+                           (set-buffer-multibyte t)
+                           (decode-coding-region (point-min) (point-max)
+                                                 'utf-8-unix))))
+                (coding-perf--measure
+                 bytes (lambda ()
+                         (with-temp-buffer
+                           (let ((coding-system-for-read 'utf-8))
+                             (insert-file-contents file)))))
+                (coding-perf--measure
+                 bytes (lambda () (detect-coding-string corpus))))))))
+      (delete-file file))))
+
+;;; coding-perf.el ends here
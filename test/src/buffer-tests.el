@@ -8380,6 +8380,124 @@ dicta sunt, explicabo.  "))
     (remove-overlays)
     (should (= (length (overlays-in (point-min) (point-max))) 0))))
 
+(ert-deftest test-make-overlays ()
+  (with-temp-buffer
+    (insert (make-string 100 ?a))
+    (let* ((old (make-overlay 50 60))
+           (ovs (make-overlays (vector '(10 . 20) (cons 40 (copy-marker 30))
+                                       '(5 . 5) '(90 . 200))
+                               nil nil t '(face bold evaporate t))))
+      (should (= (length ovs) 4))
+      (should (equal (mapcar (lambda (o) (list (overlay-start o) (overlay-end o)))
+                             ovs)
+                     '((10 20) (30 40) (nil nil) (90 101))))
+      (should (eq (overlay-get (aref ovs 0) 'face) 'bold))
+      ;; Each overlay has its own property list.
+      (overlay-put (aref ovs 0) 'face 'italic)
+      (should (eq (overlay-get (aref ovs 1) 'face) 'bold))
+      (should (overlay-get (aref ovs 1) 'evaporate))
+      (goto-char 20)
+      (insert "xx")
+      (should (= (overlay-end (aref ovs 0)) 22))
+      (should (= (overlay-start old) 52))
+      (should (= (length (overlays-in 1 (point-max))) 4))
+      (should-error (make-overlays [(1 . nil)]))
+      (should-error (make-overlays [(1 . 2)] nil nil nil '(face . bold))))))
+
+(ert-deftest test-overlays-count-and-map-in ()
+  (with-temp-buffer
+    (insert (make-string 100 ?a))
+    (make-overlays (vconcat (mapcar (lambda (i) (cons (* 10 i) (+ (* 10 i) 5)))
+                                    (number-sequence 1 9))))
+    (make-overlay 30 30)
+    (dolist (range '((1 101) (25 50) (30 30) (36 40) (100 101)))
+      (should (= (apply #'overlays-count-in range)
+                 (length (apply #'overlays-in range)))))
+    (let ((starts nil))
+      (overlays-map-in (lambda (o) (push (overlay-start o) starts)) 25 50)
+      (should (equal (nreverse starts) '(30 30 40))))
+    ;; Overlays deleted by FUNCTION before their turn are skipped.
+    (let ((seen 0))
+      (overlays-map-in (lambda (o)
+                         (setq seen (1+ seen))
+                         (mapc #'delete-overlay (overlays-in 1 101)))
+                       1 101)
+      (should (= seen 1))
+      (should (= (overlays-count-in 1 101) 0)))))
+
+(ert-deftest test-buffer-snapshot ()
+  (let ((buf (generate-new-buffer " *snapshot*"))
+        (large (make-string (* 1100 1024) ?a)))
+    (unwind-protect
+        (with-current-buffer buf
+          (insert "héllo wörld")
+          (put-text-property 2 5 'face 'bold)
+          (narrow-to-region 3 6)
+          (let ((snap (buffer-snapshot nil t))
+                (plain (buffer-snapshot)))
+            (should (buffer-snapshot-p snap))
+            (should (eq (type-of snap) 'buffer-snapshot))
+            (should (eq (buffer-snapshot-buffer snap) buf))
+            (should (= (buffer-snapshot-size snap) 11))
+            (widen)
+            (erase-buffer)
+            (insert large)
+            (should (equal-including-properties
+                     (buffer-snapshot-substring snap 1 8)
+                     #("héllo w" 1 4 (face bold))))
+            (should (equal-including-properties
+                     (buffer-snapshot-substring plain 8 2)
+                     "éllo w"))
+            (should (equal-including-properties
+                     (buffer-snapshot-substring-no-properties snap 2 4)
+                     "él"))
+            (should-error (buffer-snapshot-substring snap 0 3)
+                          :type 'args-out-of-range)
+            (should-error (buffer-snapshot-substring snap 1 13)
+                          :type 'args-out-of-range)
+            ;; A large buffer shares its text with the snapshot until
+            ;; it changes.
+            (let ((snap (buffer-snapshot)))
+              (goto-char (point-min))
+              (insert "b")
+              (delete-region (- (point-max) 10) (point-max))
+              (should (equal (buffer-snapshot-substring snap 1 3) "aa"))
+              (kill-buffer buf)
+              (garbage-collect)
+              (should (equal (buffer-snapshot-substring
+                              snap 1 (1+ (buffer-snapshot-size snap)))
+                             large)))))
+      (kill-buffer buf))))
+
+(ert-deftest test-buffer-snapshot-edits ()
+  "Check that a snapshot survives edits anywhere in a large buffer."
+  (let ((buf (generate-new-buffer " *snapshot*")))
+    (unwind-protect
+        (with-current-buffer buf
+          (dotimes (i 10000)
+            (insert (format "line %d: héllo €\n" i)))
+          (let* ((text (buffer-string))
+                 (snap (buffer-snapshot))
+                 (size (buffer-snapshot-size snap)))
+            (dolist (pos (list (point-max) 1 (/ (point-max) 2) 5000
+                               (- (point-max) 100) 70000))
+              (goto-char pos)
+              (insert "ü")
+              (delete-region (max 1 (- pos 300)) pos)
+              (insert (make-string 20000 ?x))
+              (upcase-region pos (min (point-max) (+ pos 30000))))
+            (garbage-collect)
+            (should (equal (buffer-snapshot-substring snap 1 (1+ size))
+                           text))
+            (let ((other (buffer-snapshot)))
+              (erase-buffer)
+              (kill-buffer buf)
+              (garbage-collect)
+              (should (equal (buffer-snapshot-substring snap 1 (1+ size))
+                             text))
+              (should (> (buffer-snapshot-size other) size)))))
+      (kill-buffer buf))))
+
 (defun test-kill-buffer-auto-save (auto-save-answer body-func)
   "Test helper for `kill-buffer-delete-auto-save' tests.
 
@@ -8646,4 +8764,52 @@ Finally, kill the buffer and its temporary file."
     (should (= (point-min) 1))
     (should (= (point-max) 5001))))
 
+;; Clones of a large buffer share its text until one of them changes.
+(ert-deftest buffer-tests-copy-large-buffer ()
+  (let* ((line "text é€ of a large buffer\n")
+         (source (generate-new-buffer " *source*"))
+         (text (with-current-buffer source
+                 (dotimes (_ 50000)
+                   (insert line))
+                 (put-text-property 1 10 'face 'bold)
+                 (goto-char 500000)
+                 (buffer-string)))
+         (copy (generate-new-buffer " *copy*"))
+         clone)
+    (unwind-protect
+        (progn
+          ;; Only `clone-buffer' shares the text, which would remove
+          ;; the gap of SOURCE.
+          (with-current-buffer copy
+            (insert-buffer-substring source))
+          (should (> (with-current-buffer source (gap-size)) 0))
+          (setq clone (with-current-buffer source (clone-buffer " *clone*")))
+          (dolist (b (list copy clone))
+            (with-current-buffer b
+              (should (equal-including-properties (buffer-string) text))
+              (should (= (position-bytes (point-max))
+                         (1+ (string-bytes text))))))
+          (with-current-buffer source
+            (goto-char 100)
+            (insert "new")
+            (upcase-region 1 50)
+            (delete-region 1000 2000))
+          (with-current-buffer clone
+            (subst-char-in-region 1 1000 ?t ?T)
+            (set-buffer-multibyte nil))
+          (with-current-buffer copy
+            (should (equal-including-properties (buffer-string) text))
+            (delete-region 1 3)
+            (should (equal (buffer-string) (substring text 2))))
+          (kill-buffer source)
+          (kill-buffer clone)
+          (with-current-buffer copy
+            (goto-char (point-max))
+            (insert "end")
+            (should (equal (buffer-string)
+                           (concat (substring text 2) "end")))))
+      (dolist (b (list source copy clone))
+        (when b
+          (kill-buffer b))))))
+
 ;;; buffer-tests.el ends here
@@ -430,5 +430,256 @@
                  '((iso-latin-1 3) (us-ascii 1 3))))
   (should-error (check-coding-systems-region "å" nil '(bad-coding-system))))
 
+(ert-deftest coding-utf-8-after-ascii-runs ()
+  "Check UTF-8 decoding of sequences placed around long ASCII runs."
+  (dolist (len '(0 1 7 8 9 31 32 33 100))
+    (let ((ascii (make-string len ?a)))
+      (dolist (case `(("é" . "é") ("€" . "€") ("😀" . "😀")
+                      ;; Overlong, surrogate and truncated sequences
+                      ;; decode to raw bytes.
+                      (,(unibyte-string #xc0 #x80)
+                       . ,(string #x3fffc0 #x3fff80))
+                      (,(unibyte-string #xed #xa0 #x80)
+                       . ,(string #x3fffed #x3fffa0 #x3fff80))
+                      (,(unibyte-string #xe2 #x82)
+                       . ,(string #x3fffe2 #x3fff82))))
+        (let* ((encoded (if (multibyte-string-p (car case))
+                            (encode-coding-string (car case) 'utf-8)
+                          (car case)))
+               (source (concat ascii encoded ascii "\n" ascii))
+               (decoded (concat ascii (cdr case) ascii "\n" ascii)))
+          (should (equal (decode-coding-string source 'utf-8-unix) decoded))
+          (should (equal (decode-coding-string (string-to-multibyte source)
+                                               'utf-8-unix)
+                         decoded))
+          (should (equal (decode-coding-string
+                          (concat source "\r\n") 'utf-8-dos)
+                         (concat decoded "\n")))
+          (when (multibyte-string-p (car case))
+            (should (equal (decode-coding-string source 'undecided)
+                           decoded))
+            (should (eq (coding-system-eol-type last-coding-system-used)
+                        0))))))))
+
+(ert-deftest coding-utf-8-passthrough ()
+  "Check that valid UTF-8 decodes the same with and without conversion."
+  (let ((text (encode-coding-string "abc é€😀 中文\n" 'utf-8)))
+    (dolist (coding '(utf-8 utf-8-unix undecided prefer-utf-8))
+      (let ((decoded (decode-coding-string text coding)))
+        (should (equal decoded "abc é€😀 中文\n"))
+        (should (multibyte-string-p decoded))
+        (should (eq last-coding-system-used 'utf-8-unix)))))
+  ;; EOLs that need conversion are still converted.
+  (let ((text (encode-coding-string "é\r\nx\r\n" 'utf-8)))
+    (should (equal (decode-coding-string text 'utf-8) "é\nx\n"))
+    (should (eq last-coding-system-used 'utf-8-dos))
+    (should (equal (decode-coding-string text 'utf-8-unix) "é\r\nx\r\n")))
+  ;; Surrogates and overlong sequences in a file are read as raw
+  ;; bytes, like when decoding a string, and are written back as is.
+  (let ((file (make-temp-file "coding-tests"))
+        (bytes (concat (encode-coding-string "é" 'utf-8)
+                       (unibyte-string #xed #xa0 #x80 #xc0 #x80)
+                       "\n")))
+    (unwind-protect
+        (dolist (coding '(nil utf-8-unix))
+          (let ((coding-system-for-write 'no-conversion))
+            (write-region bytes nil file nil 'silent))
+          (with-temp-buffer
+            (let ((coding-system-for-read coding))
+              (insert-file-contents file))
+            (should (equal (buffer-string)
+                           (decode-coding-string bytes 'utf-8-unix)))
+            (let ((coding-system-for-write 'utf-8-unix))
+              (write-region nil nil file nil 'silent)))
+          (with-temp-buffer
+            (set-buffer-multibyte nil)
+            (insert-file-contents-literally file)
+            (should (equal (buffer-string) bytes))))
+      (delete-file file))))
+
+(ert-deftest coding-utf-8-parallel-scan ()
+  "Check reading and writing UTF-8 that is validated in chunks."
+  ;; Use several threads even on a single processor.
+  (let ((coding-parallel-chunk-size 7)
+        (coding-parallel-threads 4)
+        (file (make-temp-file "coding-tests"))
+        (text (apply #'concat
+                     (make-list 50 "abc é€😀 中文\r\nxyz\n"))))
+    (unwind-protect
+        (progn
+          (dolist (coding '(utf-8-unix utf-8-dos utf-8-mac))
+            (let ((coding-system-for-write coding))
+              (write-region text nil file nil 'silent))
+            (with-temp-buffer
+              (set-buffer-multibyte nil)
+              (insert-file-contents-literally file)
+              (should (equal (buffer-string)
+                             (encode-coding-string text coding))))
+            (with-temp-buffer
+              (let ((coding-system-for-read coding))
+                (insert-file-contents file))
+              (should (equal (buffer-string)
+                             (decode-coding-string
+                              (encode-coding-string text coding)
+                              coding)))))
+          ;; Raw bytes are written back as they were.
+          (let ((bytes (concat (encode-coding-string text 'utf-8)
+                               (unibyte-string #xe4 #xb8 #xff #x80))))
+            (with-temp-buffer
+              (insert (decode-coding-string bytes 'utf-8-unix))
+              (let ((coding-system-for-write 'utf-8-unix))
+                (write-region nil nil file nil 'silent)))
+            (with-temp-buffer
+              (set-buffer-multibyte nil)
+              (insert-file-contents-literally file)
+              (should (equal (buffer-string) bytes)))))
+      (delete-file file))))
+
+(ert-deftest coding-detection-max-bytes ()
+  "Check that detection can be bounded to a sample of the text."
+  (let* ((pad (apply #'concat
+                     (make-list 100 "The quick brown fox jumps over it.\n")))
+         (utf-8 (concat (encode-coding-string "café\n" 'utf-8)
+                        pad "caf\351\n" pad "end\n"))
+         (ascii (concat pad "caf\351\n" pad)))
+    (with-coding-priority '(utf-8 iso-latin-1)
+      (let ((coding-detection-max-bytes nil))
+        (should-not (eq (coding-system-base (detect-coding-string utf-8 t))
+                        'utf-8)))
+      (let ((coding-detection-max-bytes 256))
+        (should (eq (coding-system-base (detect-coding-string utf-8 t))
+                    'utf-8))
+        (should (equal (decode-coding-string utf-8 'undecided)
+                       (decode-coding-string utf-8 'utf-8-unix)))
+        ;; A sample with only ASCII is not enough to decide.
+        (should (equal (detect-coding-string ascii)
+                       (let ((coding-detection-max-bytes nil))
+                         (detect-coding-string ascii))))
+        (should (equal (decode-coding-string ascii 'undecided)
+                       (decode-coding-string ascii 'iso-latin-1-unix)))))))
+
+(ert-deftest coding-detection-cache ()
+  "Check that the coding system detected for a file is reused."
+  (let ((file (make-temp-file "coding-tests"))
+        (latin-1 "caf\351!\n")
+        (utf-8 (encode-coding-string "café\n" 'utf-8))
+        (coding-detection-use-cache t))
+    (unwind-protect
+        (with-coding-priority '(utf-8 iso-latin-1)
+          (let ((coding-system-for-write 'no-conversion))
+            (write-region latin-1 nil file nil 'silent))
+          (let ((mtime (file-attribute-modification-time
+                        (file-attributes file))))
+            (with-temp-buffer
+              (insert-file-contents file)
+              (should (eq last-coding-system-used 'iso-latin-1-unix)))
+            ;; Replace the text by one of the same size, as if the
+            ;; file had not changed.
+            (let ((coding-system-for-write 'no-conversion))
+              (write-region utf-8 nil file nil 'silent))
+            (set-file-times file mtime)
+            (with-temp-buffer
+              (insert-file-contents file)
+              (should (eq last-coding-system-used 'iso-latin-1-unix)))
+            (set-file-times file (time-add mtime 1))
+            (with-temp-buffer
+              (insert-file-contents file)
+              (should (eq last-coding-system-used 'utf-8-unix))
+              (should (equal (buffer-string) "café\n")))
+            ;; Nothing is reused unless asked for.
+            (let ((coding-system-for-write 'no-conversion))
+              (write-region latin-1 nil file nil 'silent))
+            (set-file-times file (time-add mtime 1))
+            (let ((coding-detection-use-cache nil))
+              (with-temp-buffer
+                (insert-file-contents file)
+                (should (eq last-coding-system-used 'iso-latin-1-unix))))))
+      (delete-file file))))
+
+(ert-deftest coding-detection-cache-settings ()
+  "Check that the detection cache heeds the settings of detection."
+  (let ((file (make-temp-file "coding-tests"))
+        (coding-detection-use-cache t))
+    (unwind-protect
+        (progn
+          (let ((coding-system-for-write 'no-conversion))
+            (write-region (encode-coding-string "café\0\n" 'utf-8)
+                          nil file nil 'silent))
+          (with-coding-priority '(utf-8)
+            (let ((inhibit-null-byte-detection t))
+              (with-temp-buffer
+                (insert-file-contents file)
+                (should (eq last-coding-system-used 'utf-8-unix))))
+            (with-temp-buffer
+              (insert-file-contents file)
+              (should (eq last-coding-system-used 'no-conversion)))))
+      (delete-file file))))
+
+(ert-deftest coding-eol-conversion ()
+  "Check the conversion of DOS and Mac EOLs in long texts."
+  (let ((file (make-temp-file "coding-tests"))
+        (text (concat "\r\n" (apply #'concat
+                                    (make-list 500 "a\r\nb é\r\n\r\r\nc\r"))
+                      "\nend\r")))
+    (unwind-protect
+        (dolist (coding '(utf-8 iso-latin-1 raw-text euc-jp))
+          (let ((bytes (encode-coding-string text coding))
+                (dos (string-replace "\r\n" "\n" text))
+                (mac (string-replace "\r" "\n" text)))
+            (when (eq coding 'raw-text)
+              (setq dos (encode-coding-string dos 'utf-8)
+                    mac (encode-coding-string mac 'utf-8)))
+            (let ((coding-system-for-write 'no-conversion))
+              (write-region bytes nil file nil 'silent))
+            (dolist (eol '((dos . 1) (mac . 2)))
+              (let ((coding-system (coding-system-change-eol-conversion
+                                    coding (cdr eol)))
+                    (expected (if (eq (car eol) 'dos) dos mac)))
+                (should (equal (decode-coding-string bytes coding-system)
+                               expected))
+                (with-temp-buffer
+                  (insert "<>")
+                  (goto-char 2)
+                  (let ((coding-system-for-read coding-system))
+                    (insert-file-contents file))
+                  (should (equal (buffer-string)
+                                 (concat "<" (string-to-multibyte expected)
+                                         ">"))))))
+            ;; Detection finds DOS EOLs when every CR precedes an LF.
+            (let ((bytes (encode-coding-string mac coding)))
+              (setq bytes (string-replace "\n" "\r\n" bytes))
+              (should (equal (decode-coding-string
+                              bytes (coding-system-change-eol-conversion
+                                     coding nil))
+                             (decode-coding-string
+                              bytes (coding-system-change-eol-conversion
+                                     coding 1))))
+              (should (eq (coding-system-eol-type last-coding-system-used)
+                          1)))))
+      (delete-file file))))
+
+(ert-deftest coding-eol-conversion-position-index ()
+  "Converting DOS EOLs in a buffer keeps its char/byte positions right."
+  (with-temp-buffer
+    (dotimes (_ 3000)
+      (insert "é€x\n"))
+    ;; Make the buffer index its char/byte positions.
+    (should (= (position-bytes 6001) 10501))
+    (let ((beg (point)))
+      (insert (encode-coding-string
+               (apply #'concat (make-list 4000 "é\r\nab")) 'utf-8))
+      (decode-coding-region beg (point) 'utf-8-dos))
+    (let ((buffer (current-buffer))
+          (size (buffer-size)))
+      (with-temp-buffer
+        (insert-buffer-substring buffer)
+        ;; Visit the positions out of order, so that each conversion
+        ;; consults the index rather than the previous one.
+        (dotimes (i size)
+          (let ((pos (1+ (% (* i 7919) size))))
+            (should (= (position-bytes pos)
+                       (with-current-buffer buffer
+                         (position-bytes pos))))))))))
+
 (provide 'coding-tests)
 ;;; coding-tests.el ends here
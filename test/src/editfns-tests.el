@@ -294,6 +294,43 @@
                  (buffer-string)
                  "foo bar baz qux"))))))
 
+(ert-deftest replace-buffer-contents-large ()
+  "Large buffers are diffed by lines first, and only changes are made."
+  (with-temp-buffer
+    (dotimes (i 5000)
+      (insert (format "line %d é\n" i)))
+    (let ((source (current-buffer))
+          (expected nil))
+      (with-temp-buffer
+        (insert-buffer-substring source)
+        (with-current-buffer source
+          (dolist (line '(4000 2500 1000))
+            (goto-char (point-min))
+            (forward-line line)
+            (insert "  ")
+            (end-of-line)
+            (insert ";"))
+          (setq expected (buffer-string)))
+        (goto-char (point-min))
+        (forward-line 2500)
+        (forward-char 5)
+        (let ((marker (point-marker))
+              (start (copy-marker 100))
+              (changes nil))
+          (add-hook 'after-change-functions
+                    (lambda (beg end len) (push (list beg end len) changes))
+                    nil t)
+          (should (replace-buffer-contents source))
+          (should (equal (buffer-string) expected))
+          (should (= start 100))
+          (should (equal (buffer-substring marker (line-end-position))
+                         "2500 é;"))
+          ;; Only the text between the first and last change is
+          ;; reported as changed.
+          (should (equal (length changes) 1))
+          (should (> (caar changes) 1000))
+          (should (< (cadar changes) (point-max))))))))
+
 (ert-deftest replace-buffer-contents-bug31837 ()
   (switch-to-buffer "a")
   (insert-char (char-from-name "SMILE"))
@@ -305,6 +342,56 @@
   (should (equal (buffer-substring-no-properties (point-min) (point-max))
                  (concat (string (char-from-name "SMILE")) "1234"))))
 
+(ert-deftest buffer-apply-edits-1 ()
+  (with-temp-buffer
+    (buffer-enable-undo)
+    (insert "hello world foo bar")
+    (undo-boundary)
+    (let ((m (copy-marker 13))
+          (m2 (copy-marker 9 t))
+          (changes nil))
+      (add-hook 'before-change-functions
+                (lambda (beg end) (push (list 'before beg end) changes))
+                nil t)
+      (add-hook 'after-change-functions
+                (lambda (beg end len) (push (list 'after beg end len) changes))
+                nil t)
+      (buffer-apply-edits
+       [(13 16 "BAZZ") (1 6 "HI") (7 7 "<") (7 7 ">") (20 20 "!")])
+      (should (equal (buffer-string) "HI <>world BAZZ bar!"))
+      (should (= m 12))
+      (should (= m2 8))
+      (should (equal changes '((after 1 21 19) (before 1 20))))
+      (primitive-undo 1 buffer-undo-list)
+      (should (equal (buffer-string) "hello world foo bar"))
+      ;; Undo puts the markers back where they were.
+      (should (= m 13))
+      (should (= m2 9))
+      (should-error (buffer-apply-edits [(1 5 "a") (3 6 "b")]))
+      (should-error (buffer-apply-edits [(1 50 "a")]))
+      (should (equal (buffer-string) "hello world foo bar")))))
+
+(ert-deftest buffer-apply-edits-read-only ()
+  (with-temp-buffer
+    (insert "hello world foo bar")
+    (put-text-property 7 12 'read-only t)
+    ;; Read-only text between the edits does not matter.
+    (buffer-apply-edits [(1 6 "HI") (13 16 "BAZ")])
+    (should (equal (buffer-string) "HI world BAZ bar"))
+    (should-error (buffer-apply-edits [(1 3 "hi") (5 7 "W")])
+                  :type 'text-read-only)
+    (should (equal (buffer-string) "HI world BAZ bar"))))
+
+(ert-deftest buffer-apply-edits-modifying-hook ()
+  (with-temp-buffer
+    (insert "hello world")
+    (add-hook 'before-change-functions
+              (lambda (_beg _end)
+                (save-excursion (goto-char (point-min)) (insert "x")))
+              nil t)
+    (should-error (buffer-apply-edits [(1 6 "HI") (7 12 "there")]))
+    (should (equal (buffer-string) "xhello world"))))
+
 (ert-deftest delete-region-undo-markers-1 ()
   "Make sure we don't end up with freed markers reachable from Lisp."
   ;; https://debbugs.gnu.org/cgi/bugreport.cgi?bug=30931#40
@@ -713,6 +713,66 @@
                    (buffer-hash))
                  (sha1 "foo"))))
 
+(ert-deftest fns-tests-incremental-hash ()
+  (let ((text (apply #'concat
+                     (mapcar (lambda (i) (format "line %d é\n" i))
+                             (number-sequence 1 5000)))))
+    (with-temp-buffer
+      (insert text)
+      ;; `buffer-hash' stays SHA-1 however large the buffer.
+      (should (equal (buffer-hash)
+                     (sha1 (encode-coding-string text 'utf-8-emacs))))
+      (let ((hash (buffer-incremental-hash)))
+        (should (equal (buffer-incremental-hash) hash))
+        ;; The hash depends only on the text, not on how it was made.
+        (should (equal (with-temp-buffer
+                         (insert (substring text 0 30000))
+                         (goto-char (point-min))
+                         (insert (substring text 30000))
+                         (transpose-regions (point-min) (- (point-max) 30000)
+                                            (- (point-max) 30000)
+                                            (point-max))
+                         (buffer-incremental-hash))
+                       hash))
+        (goto-char 20000)
+        (insert "x")
+        (should-not (equal (buffer-incremental-hash) hash))
+        (delete-char -1)
+        (should (equal (buffer-incremental-hash) hash))))
+    ;; Small buffers are hashed directly, also after they were large.
+    (with-temp-buffer
+      (insert (substring text 0 100))
+      (let ((hash (buffer-incremental-hash)))
+        (insert text)
+        (delete-region 101 (point-max))
+        (should (equal (buffer-incremental-hash) hash))
+        (goto-char 50)
+        (insert text)
+        (delete-region 50 (+ 50 (length text)))
+        (should (equal (buffer-incremental-hash) hash))))))
+
+(ert-deftest fns-tests-buffer-changed-blocks ()
+  (with-temp-buffer
+    (should (equal (buffer-changed-blocks) '((1 . 1))))
+    (should-not (buffer-changed-blocks))
+    (dotimes (i 5000)
+      (insert (format "line %d é\n" i)))
+    (should (equal (buffer-changed-blocks) `((1 . ,(point-max)))))
+    (should-not (buffer-changed-blocks))
+    (goto-char 20000)
+    (insert "new text")
+    (goto-char 40000)
+    (delete-char 10)
+    (let ((regions (buffer-changed-blocks)))
+      (should (= (length regions) 2))
+      (should (<= (car (nth 0 regions)) 20000 20008
+                  (cdr (nth 0 regions))))
+      (should (<= (car (nth 1 regions)) 40000 (cdr (nth 1 regions))))
+      (should (< (- (cdr (nth 0 regions)) (car (nth 0 regions))) 5000)))
+    (should-not (buffer-changed-blocks))
+    (put-text-property 100 200 'face 'bold)
+    (should-not (buffer-changed-blocks))))
+
 (ert-deftest fns-tests-mapconcat ()
   (should (string= (mapconcat #'identity '()) ""))
   (should (string= (mapconcat #'identity '("a" "b")) "ab"))
@@ -1402,6 +1462,37 @@
     (should-error (line-number-at-pos -1))
     (should-error (line-number-at-pos 100))))
 
+(ert-deftest test-line-number-at-position-line-index ()
+  "Line queries agree with and without `buffer-line-index-mode'."
+  (with-temp-buffer
+    (dotimes (i 20000)
+      (insert (if (zerop (% i 7)) "é\n" "line\n")))
+    (buffer-line-index-mode 1)
+    (cl-flet ((check ()
+                (dolist (pos (list 1 5000 33333 (point-max)))
+                  (should (= (line-number-at-pos pos)
+                             (let ((buffer-line-index-mode nil))
+                               (line-number-at-pos pos))))
+                  (should (= (line-number-at-pos pos t)
+                             (let ((buffer-line-index-mode nil))
+                               (line-number-at-pos pos t)))))
+                (dolist (n '(100 -100 5000 -5000 30000))
+                  (goto-char 40000)
+                  (let ((rest (forward-line n))
+                        (pos (point)))
+                    (goto-char 40000)
+                    (let ((buffer-line-index-mode nil))
+                      (should (= rest (forward-line n)))
+                      (should (= pos (point))))))))
+      (check)
+      (goto-char 1000)
+      (insert "a\nb\nc")
+      (delete-region 20000 20100)
+      (subst-char-in-region 30000 31000 ?\n ?x)
+      (check)
+      (narrow-to-region 10000 60000)
+      (check))))
+
 (defun fns-tests-concat (&rest args)
   ;; Dodge the byte-compiler's partial evaluation of `concat' with
   ;; constant arguments.
@@ -57,4 +57,71 @@
     (set-marker marker-2 marker-1)
     (should (goto-char marker-2))))
 
+(ert-deftest marker-tests--position-bytes-large-buffer ()
+  "Char/byte conversion stays right as a large buffer is edited."
+  (with-temp-buffer
+    (let ((chunk "abc é€😀\n"))
+      (dotimes (_ 5000)
+        (insert chunk))
+      (cl-flet ((check (pos)
+                  (let ((bytes (1+ (string-bytes
+                                    (buffer-substring-no-properties
+                                     (point-min) pos)))))
+                    (should (= (position-bytes pos) bytes))
+                    (should (= (byte-to-position bytes) pos)))))
+        (dolist (pos '(1 2 20000 33333 40001))
+          (check pos))
+        (goto-char 20000)
+        (insert "ééé")
+        (delete-region 30000 30100)
+        (transpose-regions 100 200 39000 39010)
+        (goto-char 10)
+        (while (search-forward "é" 2000 t)
+          (replace-match "e"))
+        (upcase-region 1 39000)
+        (dolist (pos '(1 2 9 1000 20001 29999 30000 35000 38999 39000
+                      (point-max)))
+          (check (eval pos t)))
+        (let ((bytes (position-bytes 5500)))
+          (narrow-to-region 5000 6000)
+          (should (= (position-bytes 5500) bytes))
+          (should (= (byte-to-position bytes) 5500)))))))
+
+(ert-deftest marker-tests--many-markers ()
+  "Many markers follow insertion, deletion and transposition."
+  (with-temp-buffer
+    (insert (make-string 1000 ?a))
+    (let ((ms (mapcar (lambda (i) (copy-marker (1+ i) (cl-oddp i)))
+                      (number-sequence 0 999))))
+      (goto-char 101)
+      (insert "xyz")
+      (should (= (nth 99 ms) 100))
+      ;; Markers at the insertion point move only when they advance.
+      (should (= (nth 100 ms) 101))
+      (should (= (nth 101 ms) 105))
+      (should (= (nth 500 ms) 504))
+      (delete-region 201 401)
+      (should (= (nth 200 ms) 201))
+      (should (= (nth 300 ms) 201))
+      (should (= (nth 400 ms) 204))
+      (goto-char 301)
+      (insert-before-markers "é")
+      (should (= (nth 496 ms) 300))
+      (should (= (nth 497 ms) 302))
+      (should (= (nth 498 ms) 303))
+      (should (= (marker-position (nth 498 ms))
+                 (byte-to-position (position-bytes (nth 498 ms)))))
+      (set-marker (nth 10 ms) 700)
+      (should (= (nth 10 ms) 700))
+      (transpose-regions 1 3 5 6)
+      (should (equal (mapcar #'marker-position (take 6 ms))
+                     '(4 5 2 3 1 6)))
+      (set-buffer-multibyte nil)
+      (should (= (nth 498 ms) 304))
+      (set-buffer-multibyte t)
+      (should (= (nth 498 ms) 303))
+      (should (= (nth 999 ms) (1- (point-max))))
+      (mapc (lambda (m) (set-marker m nil)) ms)
+      (should-not (marker-position (car ms))))))
+
 ;;; marker-tests.el ends here
@@ -998,4 +998,49 @@ This evaluates the TESTS test cases from glibc."
   ;; relint suppression: Repetition of expression matching an empty string
   (should (equal (string-match "a*\\(?:c\\|b*\\)*" "a") 0)))
 
+(ert-deftest regex-tests-dfa-no-backtracking ()
+  ;; Patterns without back references or syntax-dependent operators
+  ;; are matched by the DFA, so these neither overflow the failure
+  ;; stack nor take exponential time.
+  (let ((s (make-string 1000000 ?a)))
+    (should (equal (string-match "\\`\\(?:a\\|b\\)*\\'" s) 0))
+    (should (equal (match-end 0) 1000000))
+    (should-not (string-match "\\(?:a\\|b\\)*c" s)))
+  (should-not (string-match "\\`\\(?:a\\|aa\\)*c" (make-string 60 ?a)))
+  (with-temp-buffer
+    (insert (make-string 200000 ?x) "\n")
+    (goto-char (point-min))
+    (should (looking-at "\\(?:x\\|y\\)*$"))
+    (should (equal (match-end 0) 200001))))
+
+(ert-deftest regex-tests-dfa-match-choice ()
+  ;; The DFA must choose the same match as the backtracking matcher.
+  (should (equal (string-match "a\\|ab" "ab") 0))
+  (should (equal (match-end 0) 1))
+  (should (equal (posix-string-match "a\\|ab" "ab") 0))
+  (should (equal (match-end 0) 2))
+  (should (equal (string-match "a+?" "aaa") 0))
+  (should (equal (match-end 0) 1))
+  ;; relint suppression: Repetition of expression matching an empty string
+  (should (equal (string-match "x*\\(?:=*?\\|h\\)*" "xxxx=") 0))
+  (should (equal (match-end 0) 4))
+  (should (equal (string-match "b$\\|bc" "abc\nb") 1))
+  (should (equal (match-end 0) 3))
+  (should (equal (string-match "b$\\|bc" "ab\nbc") 1))
+  (should (equal (match-end 0) 2))
+  (should (equal (string-match "^[0-9]\\{4\\}-[0-9]\\{2,3\\}\\'" "x\n2024-101")
+                 2))
+  (should-not (string-match "^[0-9]\\{4\\}-[0-9]\\{2,3\\}\\'" "x\n2024-1012"))
+  (should (equal (string-match "\\(?:ab\\)\\{2,\\}" "xababab") 1))
+  (should (equal (match-end 0) 7))
+  (let ((case-fold-search t))
+    (should (equal (string-match "Ä[^b]" "xäB äC") 4))
+    (should (equal (string-match "\\([a-z]\351\\)" "xA\351") 1)))
+  (with-temp-buffer
+    (insert "foo bar\nbaz bar")
+    (should (equal (re-search-backward "ba[rz]$" nil t) 13))
+    (should (equal (re-search-backward "ba[rz]$" nil t) 5))
+    (goto-char (point-min))
+    (should (equal (re-search-forward "^ba." nil t) 12))))
+
 ;;; regex-emacs-tests.el ends here
@@ -79,4 +79,187 @@
         ;;(should (equal (match-end 2) beg4))
         ))))
 
+;; Compiled regexp objects and the regexp cache.
+
+(ert-deftest search-tests--make-regexp ()
+  (let ((re (make-regexp "b\\(a+\\)r")))
+    (should (regexpp re))
+    (should-not (regexpp "bar"))
+    (should (eq (type-of re) 'regexp))
+    (should (equal (regexp-source re) "b\\(a+\\)r"))
+    (should (equal (string-match re "foo baaar") 4))
+    (should (equal (match-string 1 "foo baaar") "aaa"))
+    (should-not (string-match re "foo"))
+    (with-temp-buffer
+      (insert "foo bar BAR")
+      (goto-char (point-min))
+      (should (re-search-forward re nil t))
+      (should (equal (match-beginning 0) 5))
+      (should (looking-at " "))
+      (let ((case-fold-search t))
+        (should (re-search-forward re nil t))
+        (should (equal (match-string 0) "BAR")))
+      (let ((case-fold-search nil))
+        (goto-char (point-min))
+        (should (posix-search-forward re nil t))
+        (should-not (re-search-forward re nil t))))))
+
+(ert-deftest search-tests--make-regexp-invalid ()
+  (should-error (make-regexp "\\(") :type 'invalid-regexp)
+  (should-error (string-match 'foo "foo") :type 'wrong-type-argument)
+  (should-error (search-forward (make-regexp "a")) :type 'wrong-type-argument))
+
+(ert-deftest search-tests--regexp-cache ()
+  (let ((stats (regexp-cache-statistics t)))
+    (should (equal (plist-get stats :size) regexp-cache-size)))
+  (let ((re (format "search-tests-%s" (random))))
+    (string-match re "")
+    (string-match re "")
+    (let ((stats (regexp-cache-statistics)))
+      (should (>= (plist-get stats :hits) 1))
+      (should (>= (plist-get stats :misses) 1))
+      (should (floatp (plist-get stats :compile-time))))))
+
+(ert-deftest search-tests--regexp-cache-small ()
+  ;; The cache must keep working when it is smaller than the number of
+  ;; regexps in use, including when searches are nested.
+  (let ((regexp-cache-size 2))
+    (dotimes (i 10)
+      (let ((re (format "x%dy\\|z" i)))
+        (should (equal (string-match re (format "ax%dy" i)) 1))))
+    (with-temp-buffer
+      (insert "abc")
+      (goto-char (point-min))
+      (should (looking-at "a"))
+      (should (string-match "b" "abc"))
+      (should (string-match "c" "abc"))))
+  (garbage-collect)
+  (should (<= (plist-get (regexp-cache-statistics) :entries)
+              (+ regexp-cache-size
+                 (plist-get (regexp-cache-statistics) :pinned)))))
+
+(ert-deftest search-tests--required-literal ()
+  ;; Searches look for the literal parts of a regexp first; the results
+  ;; must be the same as without that shortcut.
+  (with-temp-buffer
+    (insert "Event 1: ERROR: late\nERROR: é timeout\nEvent 2: timeout\n")
+    (let ((case-fold-search nil))
+      (goto-char (point-min))
+      (should (re-search-forward "ERROR: .* timeout" nil t))
+      (should (equal (match-beginning 0) 22))
+      (should (equal (point) 38))
+      (should-not (re-search-forward "ERROR: .* timeout" nil t))
+      (should (equal (match-beginning 0) 22))
+      (goto-char (point-max))
+      (should (re-search-backward "ERROR: .* timeout" nil t))
+      (should (equal (point) 22))
+      (goto-char (point-max))
+      (should (re-search-backward "[0-9]: time" nil t))
+      (should (equal (point) 45))
+      (goto-char (point-min))
+      (should (equal (re-search-forward "[a-z]+ [0-9]: ERR" nil t 1) 13))
+      (should (equal (match-beginning 0) 2))
+      (goto-char (point-min))
+      (should-not (re-search-forward "error" nil t))
+      (should (equal (re-search-forward "Event \\(.\\)" nil t 2) 46))
+      (should (equal (match-string 1) "2"))
+      (goto-char (point-min))
+      (should (equal (re-search-forward "\\`Event 1" nil t) 8))
+      (should-not (re-search-forward "\\`Event 1" nil t))
+      (goto-char (point-max))
+      (should (equal (re-search-backward "\\`Event 1" nil t) 1)))
+    (let ((case-fold-search t))
+      (goto-char (point-min))
+      (should (re-search-forward "error: .* TIMEOUT" nil t))
+      (should (equal (match-beginning 0) 22))
+      (goto-char (point-max))
+      (should (equal (re-search-backward "error: [a-z]" nil t) 10)))))
+
+(ert-deftest search-tests--required-literal-tail ()
+  ;; A loop over the matches of a regexp whose literal does not start
+  ;; them, followed by a long text without the literal, finds each
+  ;; match without scanning that text for every one of them.
+  (with-temp-buffer
+    (dotimes (i 2000)
+      (insert (format "%dx " i)))
+    (insert "x ")
+    (insert (make-string 200000 ?-))
+    (insert " 12y")
+    (let ((case-fold-search nil)
+          (n 0))
+      (goto-char (point-min))
+      (while (re-search-forward "[0-9]+x" nil t)
+        (setq n (1+ n)))
+      (should (= n 2000))
+      (should (equal (match-string 0) "1999x"))
+      (goto-char (point-min))
+      (should (re-search-forward "[0-9]+x" nil t 2000))
+      (should-not (re-search-forward "[0-9]+x" nil t))
+      (goto-char (point-min))
+      (should (equal (re-search-forward "[0-9]+y" nil t) (point-max))))))
+
+(ert-deftest search-tests--string-matcher ()
+  (let ((m (make-string-matcher '("he" "she" "his" "hers" "é"))))
+    (should (string-matcher-p m))
+    (should-not (string-matcher-p "he"))
+    (should (eq (type-of m) 'string-matcher))
+    (with-temp-buffer
+      (insert "ushers and his café")
+      (goto-char (point-min))
+      ;; Leftmost first, then longest.
+      (should (equal (string-matcher-search-forward m) 5))
+      (should (equal (match-beginning 0) 2))
+      (should (equal (string-matcher-search-forward m nil nil 2) 20))
+      (should (equal (match-string 0) "é"))
+      (should-not (string-matcher-search-forward m nil t))
+      (should (equal (string-matcher-search-backward m) 19))
+      (should (equal (string-matcher-search-backward m) 12))
+      (should (equal (match-end 0) 15))
+      (should (equal (string-matcher-search-backward m) 3))
+      (should (equal (match-string 0) "hers"))
+      (should-error (string-matcher-search-backward m 2))
+      (goto-char (point-min))
+      (should-not (string-matcher-search-forward m 4 t))
+      (should (equal (string-matcher-search-forward m 5 t) 5)))
+    (should (equal (string-matcher-match m "she's here") 0))
+    (should (equal (match-end 0) 3))
+    (should (equal (string-matcher-match m "she's here" 1) 1))
+    (should (equal (string-matcher-match m "she's here" -4) 6))
+    (should-not (string-matcher-match m "HERS"))
+    (should-error (string-matcher-match m "hers" 5)))
+  (let ((m (with-temp-buffer (make-string-matcher ["Foo" "BAR"] t))))
+    (should (equal (string-matcher-match m "xfOo") 1))
+    (with-temp-buffer
+      (insert "foo bar")
+      (should (equal (string-matcher-search-backward m) 5))
+      (should (equal (match-end 0) 8))))
+  (should-error (make-string-matcher '("a" "")))
+  (should-error (make-string-matcher '(a))))
+
+(ert-deftest search-tests--re-search-all ()
+  (with-temp-buffer
+    (insert "foo 12 bar 345\nbaz\n\n6")
+    (goto-char 3)
+    (set-match-data '(1 2))
+    (should (equal (re-search-all "[0-9]+") [(5 . 7) (12 . 15) (21 . 22)]))
+    (should (equal (re-count-matches "[0-9]+") 3))
+    (should (equal (re-search-all "[0-9]+" 6 13) [(6 . 7) (12 . 13)]))
+    (should (equal (re-search-all "\\([a-z]\\)\\([0-9]\\)?" 9 11 t)
+                   [(9 10 9 10 nil nil) (10 11 10 11 nil nil)]))
+    (should (equal (re-search-all (make-regexp "ba\\(.\\)") nil nil t)
+                   [(8 11 10 11) (16 19 18 19)]))
+    ;; Empty matches, as in `how-many'.
+    (should (equal (re-search-all "^") [(1 . 1) (16 . 16) (20 . 20) (21 . 21)]))
+    (should (equal (re-count-matches "x*" 1 4) 3))
+    (should (equal (re-count-matches "^$") 1))
+    (let ((case-fold-search t))
+      (should (equal (re-count-matches "BA[RZ]") 2)))
+    (let ((case-fold-search nil))
+      (should (equal (re-count-matches "BA[RZ]") 0)))
+    (narrow-to-region 5 12)
+    (should (equal (re-search-all "[0-9]+") [(5 . 7)]))
+    (should-error (re-count-matches "a" 1 4))
+    (should (equal (point) 5))
+    (should (equal (match-data) '(1 2)))))
+
 ;;; search-tests.el ends here
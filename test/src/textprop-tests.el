@@ -68,5 +68,60 @@
     (should (and (equal-including-properties (pop stack) string)
 		 (null stack)))))
 
+(ert-deftest textprop-tests-put-text-property-runs ()
+  "Test `put-text-property-runs'."
+  (should (equal-including-properties
+           (let ((s (copy-sequence "abcdefghij")))
+             (put-text-property 1 4 'face 'italic s)
+             (should (eq (put-text-property-runs
+                          [(0 2 (face bold)) (2 2 (x 1))
+                           (2 5 (face bold)) (7 9 nil)]
+                          s)
+                         t))
+             (should-not (put-text-property-runs [(0 5 (face bold))] s))
+             s)
+           #("abcdefghij" 0 5 (face bold))))
+  (with-temp-buffer
+    (insert "line one\nline two\n")
+    (let ((changes 0))
+      (add-hook 'after-change-functions
+                (lambda (&rest _) (setq changes (1+ changes)))
+                nil t)
+      (should (put-text-property-runs
+               (vector (list 1 5 '(face bold))
+                       (list (copy-marker 6) 9 '(face italic x 1))
+                       (list 10 14 '(face bold))
+                       (list 15 18 '(face italic x 1)))))
+      (should (= changes 1))
+      (should (equal-including-properties
+               (buffer-string)
+               #("line one\nline two\n"
+                 0 4 (face bold) 5 8 (face italic x 1)
+                 9 13 (face bold) 14 17 (face italic x 1))))
+      (should-error (put-text-property-runs [(5 9 (a 1)) (1 6 (b 2))]))
+      (should-error (put-text-property-runs [(1 2 (a))]))
+      (should (= changes 1)))))
+
+(ert-deftest textprop-tests-shared-plists ()
+  "Text with the same properties shares its property list."
+  (let ((s (make-string 20 ?a)))
+    (put-text-property 0 5 'face 'bold s)
+    (put-text-property 10 15 'face 'bold s)
+    (add-text-properties 0 2 '(x 1 face bold) s)
+    (add-text-properties 10 12 '(x 1) s)
+    (should (eq (text-properties-at 0 s) (text-properties-at 10 s)))
+    (should (eq (text-properties-at 3 s) (text-properties-at 13 s)))
+    ;; Changing one of them leaves the others alone.
+    (put-text-property 0 1 'face 'italic s)
+    (remove-text-properties 11 12 '(x nil) s)
+    (should (equal-including-properties
+             s
+             #("aaaaaaaaaaaaaaaaaaaa"
+               0 1 (x 1 face italic) 1 2 (x 1 face bold) 2 5 (face bold)
+               10 11 (x 1 face bold) 11 15 (face bold))))
+    (should (equal (prin1-to-string (substring s 10 12))
+                   (let ((print-circle t))
+                     (prin1-to-string (substring s 10 12)))))))
+
 (provide 'textprop-tests)
 ;;; textprop-tests.el ends here
@@ -539,5 +539,36 @@ Demonstrates bug 25599."
     (undo-boundary)
     (undo)))
 
+(ert-deftest undo-test-adjacent-deletions ()
+  "Test that adjacent deletions leave recorded undo entries alone."
+  (with-temp-buffer
+    (buffer-enable-undo)
+    (insert "abcdefghij")
+    (undo-boundary)
+    (goto-char 3)
+    (delete-char 1)
+    (let ((entry (car buffer-undo-list)))
+      (should (equal entry '("c" . 3)))
+      (dotimes (_ 2) (delete-char 1))
+      (should (equal entry '("c" . 3)))
+      (should (equal (seq-take buffer-undo-list 3)
+                     '(("e" . 3) ("d" . 3) ("c" . 3)))))
+    (undo-boundary)
+    (undo)
+    (should (equal (buffer-string) "abcdefghij"))))
+
+(ert-deftest undo-test-truncate-grown-list ()
+  "Test that a list grown past `undo-limit' is truncated before GC."
+  (with-temp-buffer
+    (buffer-enable-undo)
+    (let ((undo-limit 2000)
+          (undo-strong-limit 3000)
+          (gc-cons-threshold most-positive-fixnum))
+      (dotimes (i 1000)
+        (insert (format "line %d\n" i))
+        (delete-region (point-min) (+ (point-min) 2))
+        (undo-boundary))
+      (should (< (length buffer-undo-list) 1000)))))
+
 (provide 'undo-tests)
 ;;; undo-tests.el ends here